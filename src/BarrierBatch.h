@@ -0,0 +1,326 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "CommandStream.h"
+
+// collects the image, buffer and memory barriers between two groups of commands and issues them as one
+// dependency. with synchronization2 every barrier keeps its own stages, so it only waits for the work that
+// touched its resource; without it the batch folds into a single vkCmdPipelineBarrier over the union of the
+// stages. only stage and access bits that exist in both APIs can be used, NONE stands for "nothing to wait
+// for" (TOP_OF_PIPE / BOTTOM_OF_PIPE on the old path).
+//
+// with validation on, barriers are checked as they're added: a transition that keeps the layout with only
+// reads on both sides orders nothing, an image that shows up twice in one batch transitions twice, and
+// an access mask naming an access none of its stages perform waits on (or for) the wrong work.
+class BarrierBatch
+{
+public:
+	struct Stats
+	{
+		uint64_t	flushes = 0;
+		uint64_t	imageBarriers = 0;
+		uint64_t	bufferBarriers = 0;
+		uint64_t	memoryBarriers = 0;
+		uint64_t	redundant = 0;		// found by validation
+		uint64_t	mismatched = 0;		// access outside the barrier's stages
+	};
+
+	// pipelineBarrier2 is null without synchronization2
+	BarrierBatch(PFN_vkCmdPipelineBarrier2 pipelineBarrier2, bool validate)
+		: _pipelineBarrier2(pipelineBarrier2), _validate(validate)
+	{
+	}
+
+	BarrierBatch(const BarrierBatch&) = delete;
+	BarrierBatch& operator=(const BarrierBatch&) = delete;
+
+	bool Synchronization2() const { return _pipelineBarrier2 != nullptr; }
+
+	// flushed barriers also go to the recording while one is set, null stops recording
+	void SetRecorder(CommandStream::Recording* recorder) { _recorder = recorder; }
+	bool Empty() const { return _images.empty() && _buffers.empty() && _memory.empty(); }
+
+	// all mips and layers of the aspect
+	void Image(VkImage image, VkImageAspectFlags aspectMask,
+		VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask, VkImageLayout oldLayout,
+		VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask, VkImageLayout newLayout)
+	{
+		VkImageMemoryBarrier2 barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		barrier.srcStageMask = srcStageMask;
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstStageMask = dstStageMask;
+		barrier.dstAccessMask = dstAccessMask;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { aspectMask, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+		if (_validate)
+		{
+			_checkStages(srcStageMask, srcAccessMask);
+			_checkStages(dstStageMask, dstAccessMask);
+			if (oldLayout == newLayout && !_writes(srcAccessMask) && !_writes(dstAccessMask))
+			{
+				_warn(_stats.redundant, "image barrier keeps the layout and only orders reads");
+			}
+			for (const VkImageMemoryBarrier2& other : _images)
+			{
+				if (other.image == image && (other.subresourceRange.aspectMask & aspectMask) != 0)
+				{
+					_warn(_stats.redundant, "image transitioned twice in one batch");
+				}
+			}
+		}
+		_images.push_back(barrier);
+	}
+
+	void Buffer(VkBuffer buffer, VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask,
+		VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE)
+	{
+		VkBufferMemoryBarrier2 barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+		barrier.srcStageMask = srcStageMask;
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstStageMask = dstStageMask;
+		barrier.dstAccessMask = dstAccessMask;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = buffer;
+		barrier.offset = offset;
+		barrier.size = size;
+
+		if (_validate)
+		{
+			_checkStages(srcStageMask, srcAccessMask);
+			_checkStages(dstStageMask, dstAccessMask);
+			if (!_writes(srcAccessMask) && !_writes(dstAccessMask))
+			{
+				_warn(_stats.redundant, "buffer barrier only orders reads");
+			}
+		}
+		_buffers.push_back(barrier);
+	}
+
+	void Memory(VkPipelineStageFlags2 srcStageMask, VkAccessFlags2 srcAccessMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask)
+	{
+		VkMemoryBarrier2 barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+		barrier.srcStageMask = srcStageMask;
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstStageMask = dstStageMask;
+		barrier.dstAccessMask = dstAccessMask;
+
+		if (_validate)
+		{
+			_checkStages(srcStageMask, srcAccessMask);
+			_checkStages(dstStageMask, dstAccessMask);
+		}
+		_memory.push_back(barrier);
+	}
+
+	// issues what was collected since the last flush, nothing if that's nothing
+	void Flush(VkCommandBuffer commandBuffer)
+	{
+		if (Empty())
+			return;
+
+		_stats.flushes++;
+		_stats.imageBarriers += _images.size();
+		_stats.bufferBarriers += _buffers.size();
+		_stats.memoryBarriers += _memory.size();
+		if (_recorder != nullptr)
+		{
+			_record();
+		}
+
+		if (_pipelineBarrier2 != nullptr)
+		{
+			VkDependencyInfo dependencyInfo = { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+			dependencyInfo.memoryBarrierCount = uint32_t(_memory.size());
+			dependencyInfo.pMemoryBarriers = _memory.data();
+			dependencyInfo.bufferMemoryBarrierCount = uint32_t(_buffers.size());
+			dependencyInfo.pBufferMemoryBarriers = _buffers.data();
+			dependencyInfo.imageMemoryBarrierCount = uint32_t(_images.size());
+			dependencyInfo.pImageMemoryBarriers = _images.data();
+			_pipelineBarrier2(commandBuffer, &dependencyInfo);
+		}
+		else
+		{
+			_flushLegacy(commandBuffer);
+		}
+
+		_images.clear();
+		_buffers.clear();
+		_memory.clear();
+	}
+
+	const Stats& GetStats() const { return _stats; }
+
+	void Report(std::ostream& out) const
+	{
+		out << "barriers (" << (Synchronization2() ? "synchronization2" : "vkCmdPipelineBarrier") << "): " << _stats.flushes << " flushes of "
+			<< _stats.imageBarriers << " image, " << _stats.bufferBarriers << " buffer and " << _stats.memoryBarriers << " memory barriers";
+		if (_validate)
+		{
+			out << ", " << _stats.redundant << " redundant, " << _stats.mismatched << " with access outside their stages";
+		}
+		out << std::endl;
+	}
+
+private:
+	static const VkAccessFlags2 WriteAccess = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+	static bool _writes(VkAccessFlags2 access)
+	{
+		return (access & WriteAccess) != 0;
+	}
+
+	// the stages that can perform an access, zero for the ones any stage can
+	static VkPipelineStageFlags2 _stagesFor(VkAccessFlags2 access)
+	{
+		const VkPipelineStageFlags2 shaders = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+
+		switch (access)
+		{
+		case VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT:			return VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+		case VK_ACCESS_2_INDEX_READ_BIT:
+		case VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT:			return VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+		case VK_ACCESS_2_UNIFORM_READ_BIT:
+		case VK_ACCESS_2_SHADER_READ_BIT:
+		case VK_ACCESS_2_SHADER_WRITE_BIT:					return shaders;
+		case VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT:
+		case VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT:		return VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		case VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT:
+		case VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT:	return VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+		case VK_ACCESS_2_TRANSFER_READ_BIT:
+		case VK_ACCESS_2_TRANSFER_WRITE_BIT:				return VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+		case VK_ACCESS_2_HOST_READ_BIT:
+		case VK_ACCESS_2_HOST_WRITE_BIT:					return VK_PIPELINE_STAGE_2_HOST_BIT;
+		default:											return 0;
+		}
+	}
+
+	void _checkStages(VkPipelineStageFlags2 stages, VkAccessFlags2 access)
+	{
+		if ((stages & VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) != 0)
+			return;
+
+		for (VkAccessFlags2 bit = 1; bit != 0 && bit <= access; bit <<= 1)
+		{
+			VkPipelineStageFlags2 performers = _stagesFor(bit);
+			if ((access & bit) != 0 && performers != 0 && (stages & performers) == 0)
+			{
+				_warn(_stats.mismatched, "barrier access isn't performed by any of its stages");
+				return;
+			}
+		}
+	}
+
+	// counted every time, printed once per message
+	void _warn(uint64_t& counter, const char* message)
+	{
+		counter++;
+		if (_warned.insert(message).second)
+		{
+			std::cerr << "barrier validation: " << message << std::endl;
+		}
+	}
+
+	void _record()
+	{
+		auto write = [this](uint32_t kind, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages,
+			VkAccessFlags2 dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout)
+		{
+			_recorder->Write(CommandStream::Op::Barrier, CommandStream::Payload() << kind << uint64_t(srcStages) << uint64_t(srcAccess)
+				<< uint64_t(dstStages) << uint64_t(dstAccess) << uint32_t(oldLayout) << uint32_t(newLayout));
+		};
+		for (const VkImageMemoryBarrier2& barrier : _images)
+		{
+			write(0, barrier.srcStageMask, barrier.srcAccessMask, barrier.dstStageMask, barrier.dstAccessMask, barrier.oldLayout, barrier.newLayout);
+		}
+		for (const VkBufferMemoryBarrier2& barrier : _buffers)
+		{
+			write(1, barrier.srcStageMask, barrier.srcAccessMask, barrier.dstStageMask, barrier.dstAccessMask, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED);
+		}
+		for (const VkMemoryBarrier2& barrier : _memory)
+		{
+			write(2, barrier.srcStageMask, barrier.srcAccessMask, barrier.dstStageMask, barrier.dstAccessMask, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED);
+		}
+	}
+
+	static VkPipelineStageFlags _legacyStages(VkPipelineStageFlags2 stages, VkPipelineStageFlags none)
+	{
+		return stages == VK_PIPELINE_STAGE_2_NONE ? none : VkPipelineStageFlags(stages);
+	}
+
+	void _flushLegacy(VkCommandBuffer commandBuffer)
+	{
+		VkPipelineStageFlags2 srcStages = 0;
+		VkPipelineStageFlags2 dstStages = 0;
+
+		std::vector<VkMemoryBarrier> memory;
+		for (const VkMemoryBarrier2& barrier : _memory)
+		{
+			VkMemoryBarrier legacy = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			legacy.srcAccessMask = VkAccessFlags(barrier.srcAccessMask);
+			legacy.dstAccessMask = VkAccessFlags(barrier.dstAccessMask);
+			memory.push_back(legacy);
+			srcStages |= barrier.srcStageMask;
+			dstStages |= barrier.dstStageMask;
+		}
+
+		std::vector<VkBufferMemoryBarrier> buffers;
+		for (const VkBufferMemoryBarrier2& barrier : _buffers)
+		{
+			VkBufferMemoryBarrier legacy = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+			legacy.srcAccessMask = VkAccessFlags(barrier.srcAccessMask);
+			legacy.dstAccessMask = VkAccessFlags(barrier.dstAccessMask);
+			legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+			legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+			legacy.buffer = barrier.buffer;
+			legacy.offset = barrier.offset;
+			legacy.size = barrier.size;
+			buffers.push_back(legacy);
+			srcStages |= barrier.srcStageMask;
+			dstStages |= barrier.dstStageMask;
+		}
+
+		std::vector<VkImageMemoryBarrier> images;
+		for (const VkImageMemoryBarrier2& barrier : _images)
+		{
+			VkImageMemoryBarrier legacy = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+			legacy.srcAccessMask = VkAccessFlags(barrier.srcAccessMask);
+			legacy.dstAccessMask = VkAccessFlags(barrier.dstAccessMask);
+			legacy.oldLayout = barrier.oldLayout;
+			legacy.newLayout = barrier.newLayout;
+			legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+			legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+			legacy.image = barrier.image;
+			legacy.subresourceRange = barrier.subresourceRange;
+			images.push_back(legacy);
+			srcStages |= barrier.srcStageMask;
+			dstStages |= barrier.dstStageMask;
+		}
+
+		vkCmdPipelineBarrier(commandBuffer, _legacyStages(srcStages, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT), _legacyStages(dstStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT), 0,
+			uint32_t(memory.size()), memory.data(), uint32_t(buffers.size()), buffers.data(), uint32_t(images.size()), images.data());
+	}
+
+	PFN_vkCmdPipelineBarrier2				_pipelineBarrier2;
+	bool									_validate;
+	std::vector<VkImageMemoryBarrier2>		_images;
+	std::vector<VkBufferMemoryBarrier2>		_buffers;
+	std::vector<VkMemoryBarrier2>			_memory;
+	Stats									_stats;
+	std::set<std::string>					_warned;
+	CommandStream::Recording*				_recorder = nullptr;
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "FrameCapture.h"
+
+// shares the frames of a headless job between the renderers of a device group, one renderer per physical
+// device on its own thread. frames are taken in order as each renderer gets to them, so faster devices
+// simply take more of them, and the readbacks come back in whatever order the devices finish. they are put
+// back in frame order before the encoder sees them, so stream formats come out the same as from one device.
+//
+// a renderer holding back an early frame would make the reorder buffer grow without limit, so frames more than
+// 'window' captured frames ahead of the oldest missing one aren't handed out. TryTake says Wait then, and the
+// renderer delivers everything it has in flight before blocking in Take: whoever holds the missing frame is
+// either still rendering it or has delivered it, so the window always opens again.
+class BatchDispatcher
+{
+public:
+	enum class Result
+	{
+		Frame,
+		Wait,	// the reorder window is full, deliver what's in flight and Take
+		Done,
+	};
+
+	struct DeviceStats
+	{
+		std::string	name;
+		uint64_t	frames = 0;
+		double		wallMs = 0.0;
+	};
+
+	// encoder may be null, nothing is captured then
+	BatchDispatcher(uint64_t frameCount, uint64_t captureStart, uint64_t captureFrames, FrameEncoder* encoder, bool dropWhenFull, size_t window)
+		: _frameCount(frameCount), _captureStart(captureStart), _captureFrames(captureFrames), _encoder(encoder),
+		_dropWhenFull(dropWhenFull), _window(std::max<size_t>(window, 1))
+	{
+		_nextDelivery = _nextCaptured(0);
+	}
+
+	BatchDispatcher(const BatchDispatcher&) = delete;
+	BatchDispatcher& operator=(const BatchDispatcher&) = delete;
+
+	bool Captured(uint64_t frame) const
+	{
+		return _encoder != nullptr && frame >= _captureStart && frame < _frameCount &&
+			(_captureFrames == 0 || frame - _captureStart < _captureFrames);
+	}
+
+	Result TryTake(uint64_t& frame)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _take(frame);
+	}
+
+	// false once every frame is handed out or the batch was aborted
+	bool Take(uint64_t& frame)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		Result result = Result::Wait;
+		_changed.wait(lock, [&]() { return (result = _take(frame)) != Result::Wait; });
+		return result == Result::Frame;
+	}
+
+	// a captured frame, from any renderer in any order
+	void Deliver(CapturedFrame&& frame)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pending.emplace(frame.index, std::move(frame));
+		_maxPending = std::max(_maxPending, _pending.size());
+
+		while (!_pending.empty() && _pending.begin()->first == _nextDelivery)
+		{
+			_encoder->Submit(std::move(_pending.begin()->second), _dropWhenFull);
+			_pending.erase(_pending.begin());
+			_nextDelivery = _nextCaptured(_nextDelivery + 1);
+		}
+		_changed.notify_all();
+	}
+
+	std::vector<uint8_t> AcquireStorage(size_t size)
+	{
+		return _encoder->AcquireStorage(size);
+	}
+
+	// a renderer failed, the others stop at their next frame
+	void Abort()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_aborted = true;
+		_changed.notify_all();
+	}
+
+	void AddDevice(const DeviceStats& stats)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_devices.push_back(stats);
+	}
+
+	void Report(std::ostream& out) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _begin).count();
+
+		uint64_t frames = 0;
+		for (const DeviceStats& device : _devices)
+		{
+			frames += device.frames;
+		}
+
+		out << "device group: " << frames << " frames on " << _devices.size() << " devices in " << wallMs << " ms, "
+			<< (wallMs > 0.0 ? 1000.0 * double(frames) / wallMs : 0.0) << " frames/s" << std::endl;
+		for (const DeviceStats& device : _devices)
+		{
+			out << "  " << device.name << ": " << device.frames << " frames (" << (frames > 0 ? 100.0 * double(device.frames) / double(frames) : 0.0)
+				<< "%), " << (device.wallMs > 0.0 ? 1000.0 * double(device.frames) / device.wallMs : 0.0) << " frames/s" << std::endl;
+		}
+		if (_encoder != nullptr)
+		{
+			out << "  reorder buffer: at most " << _maxPending << " frames waiting for an earlier one" << std::endl;
+		}
+	}
+
+private:
+	Result _take(uint64_t& frame)
+	{
+		if (_aborted || _next >= _frameCount)
+			return Result::Done;
+		// captured frames are one contiguous range, so everything between the oldest missing one and _next is captured
+		if (Captured(_next) && _next - _nextDelivery >= _window)
+			return Result::Wait;
+
+		// the group's time starts with its first frame, instance and device creation aren't throughput
+		if (_next == 0)
+		{
+			_begin = std::chrono::steady_clock::now();
+		}
+		frame = _next++;
+		return Result::Frame;
+	}
+
+	// first captured frame at or after 'frame', the frame count if there is none
+	uint64_t _nextCaptured(uint64_t frame) const
+	{
+		if (_encoder == nullptr)
+			return _frameCount;
+		frame = std::max(frame, _captureStart);
+		return Captured(frame) ? frame : _frameCount;
+	}
+
+	uint64_t									_frameCount;
+	uint64_t									_captureStart;
+	uint64_t									_captureFrames;
+	FrameEncoder*								_encoder;
+	bool										_dropWhenFull;
+	size_t										_window;
+
+	mutable std::mutex							_mutex;
+	std::condition_variable						_changed;
+	uint64_t									_next = 0;			// next frame handed out
+	uint64_t									_nextDelivery;		// oldest captured frame not given to the encoder yet
+	std::map<uint64_t, CapturedFrame>			_pending;			// delivered out of order
+	size_t										_maxPending = 0;
+	bool										_aborted = false;
+	std::vector<DeviceStats>					_devices;
+	std::chrono::steady_clock::time_point		_begin;
+};
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// BC1 and BC3 blocks from RGBA8 and back. the encoder fits the color endpoints along each block's principal
+// axis and picks the nearest palette entry per texel, alpha goes to BC3's 8-value ramp between its extremes.
+// fast rather than best: textures are encoded while they load. the decoder is the fallback for BC files on
+// devices without BC sampling
+namespace BlockCompression
+{
+	inline uint16_t _to565(const float color[3])
+	{
+		uint32_t r = uint32_t(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+		uint32_t g = uint32_t(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+		uint32_t b = uint32_t(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+		return uint16_t((r << 11) | (g << 5) | b);
+	}
+
+	inline void _from565(uint16_t color, int rgb[3])
+	{
+		int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// 'fourColors' is BC3's color block, and BC1 when color0 > color1
+	inline void _palette(uint16_t color0, uint16_t color1, bool fourColors, int palette[4][4])
+	{
+		_from565(color0, palette[0]);
+		_from565(color1, palette[1]);
+		palette[0][3] = palette[1][3] = 255;
+		for (int c = 0; c < 3; c++)
+		{
+			if (fourColors)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		palette[2][3] = 255;
+		palette[3][3] = fourColors ? 255 : 0;
+	}
+
+	// 16 RGBA texels in, 8 bytes out, always in four color mode
+	inline void EncodeColorBlock(const uint8_t texels[64], uint8_t out[8])
+	{
+		float mean[3] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 3; c++)
+				mean[c] += texels[i * 4 + c] / 16.0f;
+		}
+
+		float covariance[6] = {};	// rr rg rb gg gb bb
+		for (int i = 0; i < 16; i++)
+		{
+			float r = texels[i * 4] - mean[0], g = texels[i * 4 + 1] - mean[1], b = texels[i * 4 + 2] - mean[2];
+			covariance[0] += r * r;
+			covariance[1] += r * g;
+			covariance[2] += r * b;
+			covariance[3] += g * g;
+			covariance[4] += g * b;
+			covariance[5] += b * b;
+		}
+
+		// a few power iterations find the principal axis well enough for 16 texels
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 4; iteration++)
+		{
+			float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+			float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+			float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+			float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+			if (length < 1e-6f)
+				break;
+			axis[0] = x / length;
+			axis[1] = y / length;
+			axis[2] = z / length;
+		}
+
+		int lowest = 0, highest = 0;
+		float minProjection = 1e30f, maxProjection = -1e30f;
+		for (int i = 0; i < 16; i++)
+		{
+			float projection = (texels[i * 4] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] + (texels[i * 4 + 2] - mean[2]) * axis[2];
+			if (projection < minProjection)
+			{
+				minProjection = projection;
+				lowest = i;
+			}
+			if (projection > maxProjection)
+			{
+				maxProjection = projection;
+				highest = i;
+			}
+		}
+
+		float high[3] = { float(texels[highest * 4]), float(texels[highest * 4 + 1]), float(texels[highest * 4 + 2]) };
+		float low[3] = { float(texels[lowest * 4]), float(texels[lowest * 4 + 1]), float(texels[lowest * 4 + 2]) };
+		uint16_t color0 = _to565(high);
+		uint16_t color1 = _to565(low);
+		if (color0 < color1)
+			std::swap(color0, color1);
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			int palette[4][4];
+			_palette(color0, color1, true, palette);
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0, bestDistance = 1 << 30;
+				for (int entry = 0; entry < 4; entry++)
+				{
+					int distance = 0;
+					for (int c = 0; c < 3; c++)
+					{
+						int d = texels[i * 4 + c] - palette[entry][c];
+						distance += d * d;
+					}
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = entry;
+					}
+				}
+				indices |= uint32_t(best) << (i * 2);
+			}
+		}
+
+		out[0] = uint8_t(color0);
+		out[1] = uint8_t(color0 >> 8);
+		out[2] = uint8_t(color1);
+		out[3] = uint8_t(color1 >> 8);
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = uint8_t(indices >> (i * 8));
+	}
+
+	// BC3's alpha half, 8 bytes out
+	inline void EncodeAlphaBlock(const uint8_t texels[64], uint8_t out[8])
+	{
+		int alpha0 = 0, alpha1 = 255;
+		for (int i = 0; i < 16; i++)
+		{
+			alpha0 = std::max(alpha0, int(texels[i * 4 + 3]));
+			alpha1 = std::min(alpha1, int(texels[i * 4 + 3]));
+		}
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			int ramp[8] = { alpha0, alpha1 };
+			for (int i = 2; i < 8; i++)
+				ramp[i] = ((8 - i) * alpha0 + (i - 1) * alpha1) / 7;
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				for (int entry = 1; entry < 8; entry++)
+				{
+					if (std::abs(texels[i * 4 + 3] - ramp[entry]) < std::abs(texels[i * 4 + 3] - ramp[best]))
+						best = entry;
+				}
+				indices |= uint64_t(best) << (i * 3);
+			}
+		}
+
+		out[0] = uint8_t(alpha0);
+		out[1] = uint8_t(alpha1);
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = uint8_t(indices >> (i * 8));
+	}
+
+	// 'fourColors' forces the four color mode BC3's color blocks are always in. three color mode's black is
+	// transparent only with 'punchThrough', the BC1_RGBA formats; BC1_RGB samples it opaque
+	inline void DecodeColorBlock(const uint8_t block[8], bool fourColors, bool punchThrough, uint8_t texels[64])
+	{
+		uint16_t color0 = uint16_t(block[0] | (block[1] << 8));
+		uint16_t color1 = uint16_t(block[2] | (block[3] << 8));
+		int palette[4][4];
+		_palette(color0, color1, fourColors || color0 > color1, palette);
+		if (!punchThrough)
+		{
+			palette[3][3] = 255;
+		}
+
+		uint32_t indices = uint32_t(block[4]) | uint32_t(block[5]) << 8 | uint32_t(block[6]) << 16 | uint32_t(block[7]) << 24;
+		for (int i = 0; i < 16; i++)
+		{
+			const int* color = palette[(indices >> (i * 2)) & 3];
+			for (int c = 0; c < 4; c++)
+				texels[i * 4 + c] = uint8_t(color[c]);
+		}
+	}
+
+	inline void DecodeAlphaBlock(const uint8_t block[8], uint8_t texels[64])
+	{
+		int alpha0 = block[0], alpha1 = block[1];
+		int ramp[8] = { alpha0, alpha1 };
+		for (int i = 2; i < 8; i++)
+		{
+			if (alpha0 > alpha1)
+				ramp[i] = ((8 - i) * alpha0 + (i - 1) * alpha1) / 7;
+			else
+				ramp[i] = i < 6 ? ((6 - i) * alpha0 + (i - 1) * alpha1) / 5 : (i == 6 ? 0 : 255);
+		}
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++)
+			indices |= uint64_t(block[2 + i]) << (i * 8);
+		for (int i = 0; i < 16; i++)
+			texels[i * 4 + 3] = uint8_t(ramp[(indices >> (i * 3)) & 7]);
+	}
+
+	// a whole level, edge blocks repeat the last row and column. BC3 when 'alpha', BC1 otherwise
+	inline std::vector<uint8_t> Encode(const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height, bool alpha)
+	{
+		uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		size_t blockBytes = alpha ? 16 : 8;
+		std::vector<uint8_t> out(size_t(blocksX) * blocksY * blockBytes);
+
+		uint8_t texels[64];
+		for (uint32_t by = 0; by < blocksY; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				for (uint32_t i = 0; i < 16; i++)
+				{
+					uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+					uint32_t y = std::min(by * 4 + i / 4, height - 1);
+					std::copy_n(&rgba[(size_t(y) * width + x) * 4], 4, &texels[i * 4]);
+				}
+
+				uint8_t* block = &out[(size_t(by) * blocksX + bx) * blockBytes];
+				if (alpha)
+				{
+					EncodeAlphaBlock(texels, block);
+					block += 8;
+				}
+				EncodeColorBlock(texels, block);
+			}
+		}
+		return out;
+	}
+
+	// back to RGBA8. 'alpha' is BC3, otherwise BC1, with its punch-through alpha when 'punchThrough' (BC1_RGBA)
+	inline std::vector<uint8_t> Decode(const std::vector<uint8_t>& blocks, uint32_t width, uint32_t height, bool alpha, bool punchThrough)
+	{
+		uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		size_t blockBytes = alpha ? 16 : 8;
+		std::vector<uint8_t> rgba(size_t(width) * height * 4);
+
+		uint8_t texels[64];
+		for (uint32_t by = 0; by < blocksY; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				const uint8_t* block = &blocks[(size_t(by) * blocksX + bx) * blockBytes];
+				DecodeColorBlock(alpha ? block + 8 : block, alpha, !alpha && punchThrough, texels);
+				if (alpha)
+				{
+					DecodeAlphaBlock(block, texels);
+				}
+
+				for (uint32_t i = 0; i < 16; i++)
+				{
+					uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+					if (x < width && y < height)
+						std::copy_n(&texels[i * 4], 4, &rgba[(size_t(y) * width + x) * 4]);
+				}
+			}
+		}
+		return rgba;
+	}
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// .vkcs: one frame's scene draws, uploads and barriers recorded for offline replay (--record, --replay).
+// little-endian: header, the options the frame was drawn with, the blob table, then the frame's commands. the
+// compute work around the scene passes (cluster culling, light binning) and the shadow passes aren't recorded,
+// the replaying renderer rebuilds them from the recorded options and uploads.
+//
+// the commands are the renderer's rather than Vulkan's: scene pipelines by id, textures by their place in the
+// recorded --texture list, draws with the arguments the scene passed. resource contents live in the blob table,
+// each stored once under its FNV-1a hash: the mesh and texture files, which options name as @<hash>, and every
+// upload's data. every barrier of the frame is kept with its stages, accesses and layouts to compare a replay
+// against; the replaying renderer derives its own.
+//
+// every command is an op byte and a u32 payload size, so a reader can step over ops it doesn't execute
+namespace CommandStream
+{
+	const char		Magic[4] = { 'V', 'K', 'C', 'S' };
+	const uint32_t	Version = 1;
+
+	enum class Op : uint8_t
+	{
+		BeginPass,		// u32 pass: 0 the scene, 1 occlusion culling's late pass
+		EndPass,
+		BindPipeline,	// u32 pipeline, see VKRenderer::ScenePipeline
+		BindTexture,	// u32 texture (into the --texture list, UINT32_MAX for none), f32 scale
+		BindMesh,		// u32 compacted: the culling's index stream rather than the mesh's
+		Push,			// u32 offset, bytes
+		Draw,			// u32 vertexCount, instanceCount
+		DrawIndexed,	// u32 indexCount, instanceCount, firstIndex
+		DrawIndirect,	// u32 command, into the culling's draw commands
+		DrawMeshTasks,	// u32 groupCount
+		Upload,			// u32 target, u32 offset, u64 blob
+		Barrier,		// u32 kind (0 image, 1 buffer, 2 memory), u64 srcStage, srcAccess, dstStage, dstAccess, u32 oldLayout, newLayout
+		Count,
+	};
+
+	inline const char* OpName(Op op)
+	{
+		static const char* names[] = { "begin pass", "end pass", "bind pipeline", "bind texture", "bind mesh", "push", "draw", "draw indexed",
+			"draw indirect", "draw mesh tasks", "upload", "barrier" };
+		static_assert(std::size(names) == size_t(Op::Count), "a name per op");
+		return op < Op::Count ? names[size_t(op)] : "unknown";
+	}
+
+	inline uint64_t Hash(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	inline std::string HashName(uint64_t hash)
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string name(16, '0');
+		for (int i = 15; i >= 0; i--, hash >>= 4)
+		{
+			name[i] = digits[hash & 15];
+		}
+		return name;
+	}
+
+	// a command's arguments, packed without padding
+	class Payload
+	{
+	public:
+		template <typename T>
+		Payload& operator<<(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "payloads hold plain values");
+			return Append(&value, sizeof(value));
+		}
+
+		Payload& Append(const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			_bytes.insert(_bytes.end(), bytes, bytes + size);
+			return *this;
+		}
+
+		const std::vector<uint8_t>& Bytes() const { return _bytes; }
+
+	private:
+		std::vector<uint8_t>	_bytes;
+	};
+
+	// reads a command's arguments back in the order they were written
+	class Arguments
+	{
+	public:
+		Arguments(const uint8_t* data, uint32_t size)
+			: _data(data), _size(size)
+		{
+		}
+
+		template <typename T>
+		T Get()
+		{
+			T value;
+			memcpy(&value, Bytes(sizeof(T)), sizeof(T));
+			return value;
+		}
+
+		const uint8_t* Bytes(uint32_t size)
+		{
+			if (size > _size - _offset)
+				throw std::runtime_error("command stream: command shorter than its arguments");
+			const uint8_t* bytes = _data + _offset;
+			_offset += size;
+			return bytes;
+		}
+
+		uint32_t Remaining() const { return _size - _offset; }
+
+	private:
+		const uint8_t*	_data;
+		uint32_t		_size;
+		uint32_t		_offset = 0;
+	};
+
+	struct Command
+	{
+		Op				op;
+		const uint8_t*	data;
+		uint32_t		size;
+
+		Arguments Args() const { return Arguments(data, size); }
+	};
+
+	// a recording, as written and as read back
+	struct Recording
+	{
+		uint64_t								frame = 0;			// the scene frame, what animation is at
+		float									renderScale = 1.0f;
+		bool									meshShading = false;	// the mesh scene drew with task and mesh shaders
+		std::string								device;
+		std::vector<std::string>				options;			// command line options, files as @<hash>
+		std::map<uint64_t, std::vector<uint8_t>> blobs;
+		std::vector<uint8_t>					commands;
+
+		void Write(Op op, const Payload& payload = Payload())
+		{
+			uint32_t size = uint32_t(payload.Bytes().size());
+			commands.push_back(uint8_t(op));
+			commands.insert(commands.end(), reinterpret_cast<const uint8_t*>(&size), reinterpret_cast<const uint8_t*>(&size) + sizeof(size));
+			commands.insert(commands.end(), payload.Bytes().begin(), payload.Bytes().end());
+		}
+
+		// stored once however often it's referenced
+		uint64_t Blob(const void* data, size_t size)
+		{
+			uint64_t hash = Hash(data, size);
+			if (blobs.find(hash) == blobs.end())
+			{
+				const uint8_t* bytes = static_cast<const uint8_t*>(data);
+				blobs[hash].assign(bytes, bytes + size);
+			}
+			return hash;
+		}
+
+		const std::vector<uint8_t>& GetBlob(uint64_t hash) const
+		{
+			auto blob = blobs.find(hash);
+			if (blob == blobs.end())
+				throw std::runtime_error("command stream: no blob " + HashName(hash));
+			return blob->second;
+		}
+
+		// steps through the commands, false past the last
+		bool Next(size_t& offset, Command& command) const
+		{
+			if (offset >= commands.size())
+				return false;
+			if (commands.size() - offset < 5)
+				throw std::runtime_error("command stream: truncated command");
+
+			uint32_t size;
+			memcpy(&size, &commands[offset + 1], sizeof(size));
+			if (size > commands.size() - offset - 5)
+				throw std::runtime_error("command stream: truncated command");
+			command = { Op(commands[offset]), &commands[offset + 5], size };
+			offset += 5 + size;
+			return true;
+		}
+
+		std::vector<uint64_t> CountOps() const
+		{
+			std::vector<uint64_t> counts(size_t(Op::Count) + 1);
+			size_t offset = 0;
+			Command command;
+			while (Next(offset, command))
+			{
+				counts[std::min(size_t(command.op), size_t(Op::Count))]++;
+			}
+			return counts;
+		}
+
+		uint64_t BlobBytes() const
+		{
+			uint64_t bytes = 0;
+			for (const auto& blob : blobs)
+			{
+				bytes += blob.second.size();
+			}
+			return bytes;
+		}
+	};
+
+	inline void Save(const std::string& path, const Recording& recording)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("Failed to open " + path + " for writing");
+
+		auto write = [&](const void* data, size_t size) { file.write(static_cast<const char*>(data), std::streamsize(size)); };
+		auto writeString = [&](const std::string& value)
+		{
+			uint32_t length = uint32_t(value.size());
+			write(&length, sizeof(length));
+			write(value.data(), value.size());
+		};
+
+		uint32_t meshShading = recording.meshShading ? 1 : 0;
+		write(Magic, sizeof(Magic));
+		write(&Version, sizeof(Version));
+		write(&recording.frame, sizeof(recording.frame));
+		write(&recording.renderScale, sizeof(recording.renderScale));
+		write(&meshShading, sizeof(meshShading));
+		writeString(recording.device);
+
+		uint32_t optionCount = uint32_t(recording.options.size());
+		write(&optionCount, sizeof(optionCount));
+		for (const std::string& option : recording.options)
+		{
+			writeString(option);
+		}
+
+		uint32_t blobCount = uint32_t(recording.blobs.size());
+		write(&blobCount, sizeof(blobCount));
+		for (const auto& blob : recording.blobs)
+		{
+			uint64_t size = blob.second.size();
+			write(&blob.first, sizeof(blob.first));
+			write(&size, sizeof(size));
+			write(blob.second.data(), blob.second.size());
+		}
+
+		uint64_t commandBytes = recording.commands.size();
+		write(&commandBytes, sizeof(commandBytes));
+		write(recording.commands.data(), recording.commands.size());
+		if (!file)
+			throw std::runtime_error("Failed to write " + path);
+	}
+
+	inline Recording Load(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("Failed to open " + path);
+
+		auto read = [&](void* data, size_t size)
+		{
+			if (!file.read(static_cast<char*>(data), std::streamsize(size)))
+				throw std::runtime_error(path + ": truncated command stream");
+		};
+		auto readSize = [&](uint64_t size)
+		{
+			// nothing in a recording is larger than the file holding it
+			std::streampos position = file.tellg();
+			file.seekg(0, std::ios::end);
+			uint64_t left = uint64_t(file.tellg() - position);
+			file.seekg(position);
+			if (size > left)
+				throw std::runtime_error(path + ": truncated command stream");
+			return size_t(size);
+		};
+		auto readString = [&]()
+		{
+			uint32_t length;
+			read(&length, sizeof(length));
+			std::string value(readSize(length), '\0');
+			read(&value[0], value.size());
+			return value;
+		};
+
+		char magic[4];
+		uint32_t version, meshShading;
+		read(magic, sizeof(magic));
+		if (memcmp(magic, Magic, sizeof(Magic)) != 0)
+			throw std::runtime_error(path + " is not a command stream");
+		read(&version, sizeof(version));
+		if (version != Version)
+			throw std::runtime_error(path + ": command stream version " + std::to_string(version) + ", this build reads " + std::to_string(Version));
+
+		Recording recording;
+		read(&recording.frame, sizeof(recording.frame));
+		read(&recording.renderScale, sizeof(recording.renderScale));
+		read(&meshShading, sizeof(meshShading));
+		recording.meshShading = meshShading != 0;
+		recording.device = readString();
+
+		uint32_t optionCount;
+		read(&optionCount, sizeof(optionCount));
+		for (uint32_t i = 0; i < optionCount; i++)
+		{
+			recording.options.push_back(readString());
+		}
+
+		uint32_t blobCount;
+		read(&blobCount, sizeof(blobCount));
+		for (uint32_t i = 0; i < blobCount; i++)
+		{
+			uint64_t hash, size;
+			read(&hash, sizeof(hash));
+			read(&size, sizeof(size));
+			std::vector<uint8_t>& blob = recording.blobs[hash];
+			blob.resize(readSize(size));
+			read(blob.data(), blob.size());
+			if (Hash(blob.data(), blob.size()) != hash)
+				throw std::runtime_error(path + ": blob " + HashName(hash) + " doesn't match its hash");
+		}
+
+		uint64_t commandBytes;
+		read(&commandBytes, sizeof(commandBytes));
+		recording.commands.resize(readSize(commandBytes));
+		read(recording.commands.data(), recording.commands.size());
+		return recording;
+	}
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "RendererConfig.h"
+
+// VK_EXT_debug_utils: the validation layer's messages through a filtered, rate-limited sink, and names and labels
+// for the objects and passes the layer and capture tools show.
+//
+// every message is counted under its message ID. those at least as severe as the print level are printed, each
+// ID at most 'repeatLimit' times and all of them together at most PrintsPerSecond a second, the rest are only
+// counted. the messenger always asks for warnings and errors so the counters cover them whatever is printed,
+// info and verbose only when those are printed: the layer spends more producing them than the sink dropping them.
+// the callback comes from whichever thread called into Vulkan
+class DebugUtils
+{
+public:
+	static const uint32_t PrintsPerSecond = 20;
+
+	struct Stats
+	{
+		uint64_t		errors = 0;
+		uint64_t		warnings = 0;
+		uint64_t		performanceWarnings = 0;	// VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT, of any severity
+		uint64_t		info = 0;
+		uint64_t		verbose = 0;
+		uint64_t		unprinted = 0;				// below the print level, past their repeat limit or over the rate
+	};
+
+	struct MessageStats
+	{
+		std::string		name;						// pMessageIdName, the ID's number where the layer gives none
+		VkDebugUtilsMessageSeverityFlagBitsEXT severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;	// the most severe seen
+		VkDebugUtilsMessageTypeFlagsEXT types = 0;
+		uint64_t		count = 0;
+		uint64_t		printed = 0;
+	};
+
+	DebugUtils(DebugSeverity printSeverity, uint32_t repeatLimit)
+		: _repeatLimit(repeatLimit)
+	{
+		switch (printSeverity)
+		{
+		case DebugSeverity::Error:		_printSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT; break;
+		case DebugSeverity::Warning:	_printSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT; break;
+		case DebugSeverity::Info:		_printSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT; break;
+		case DebugSeverity::Verbose:	_printSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT; break;
+		}
+	}
+
+	DebugUtils(const DebugUtils&) = delete;
+	DebugUtils& operator=(const DebugUtils&) = delete;
+
+	// for the messenger, and chained into VkInstanceCreateInfo so instance creation and destruction are reported too
+	void PopulateMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+	{
+		createInfo = { VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT };
+		createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+		if (_printSeverity <= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+			createInfo.messageSeverity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+		if (_printSeverity <= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT)
+			createInfo.messageSeverity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		createInfo.pfnUserCallback = _callback;
+		createInfo.pUserData = this;
+	}
+
+	// names and labels, once there is a device. they're device commands but come through the instance, where the
+	// layers that take them sit
+	void LoadDeviceFunctions(VkInstance instance, VkDevice device)
+	{
+		_device = device;
+		_setObjectName = (PFN_vkSetDebugUtilsObjectNameEXT)vkGetInstanceProcAddr(instance, "vkSetDebugUtilsObjectNameEXT");
+		_beginLabel = (PFN_vkCmdBeginDebugUtilsLabelEXT)vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT");
+		_endLabel = (PFN_vkCmdEndDebugUtilsLabelEXT)vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT");
+	}
+
+	// null handles are skipped, so optional objects can be named unconditionally
+	template <typename T>
+	void Name(T object, VkObjectType type, const std::string& name)
+	{
+		uint64_t handle = (uint64_t)object;
+		if (_setObjectName == nullptr || handle == 0)
+			return;
+
+		VkDebugUtilsObjectNameInfoEXT nameInfo = { VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT };
+		nameInfo.objectType = type;
+		nameInfo.objectHandle = handle;
+		nameInfo.pObjectName = name.c_str();
+		_setObjectName(_device, &nameInfo);
+		_named++;
+	}
+
+	PFN_vkCmdBeginDebugUtilsLabelEXT BeginLabelFunction() const { return _beginLabel; }
+	PFN_vkCmdEndDebugUtilsLabelEXT EndLabelFunction() const { return _endLabel; }
+
+	Stats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+	void Report(std::ostream& out) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		out << "debug utils: " << _named << " objects named, " << _stats.errors << " errors, " << _stats.warnings << " warnings ("
+			<< _stats.performanceWarnings << " performance), " << _stats.info << " info, " << _stats.verbose << " verbose, "
+			<< _stats.unprinted << " not printed" << std::endl;
+
+		// the most frequent first, those are what floods a run
+		std::vector<const MessageStats*> messages;
+		for (const auto& message : _messages)
+		{
+			messages.push_back(&message.second);
+		}
+		std::sort(messages.begin(), messages.end(), [](const MessageStats* a, const MessageStats* b) { return a->count > b->count; });
+		for (size_t i = 0; i < std::min<size_t>(messages.size(), 10); i++)
+		{
+			out << "  " << messages[i]->name << ": " << messages[i]->count << " (" << _severityName(messages[i]->severity)
+				<< ((messages[i]->types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) != 0 ? ", performance" : "") << ")" << std::endl;
+		}
+		if (messages.size() > 10)
+		{
+			out << "  and " << messages.size() - 10 << " more message IDs" << std::endl;
+		}
+	}
+
+	// the counters, for a perf lab's dashboards
+	void DumpJson(const std::string& path) const
+	{
+		std::ofstream out(path);
+		if (!out)
+		{
+			std::cerr << "debug utils: can't write " << path << std::endl;
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		out << "{\n";
+		out << "  \"errors\": " << _stats.errors << ",\n";
+		out << "  \"warnings\": " << _stats.warnings << ",\n";
+		out << "  \"performanceWarnings\": " << _stats.performanceWarnings << ",\n";
+		out << "  \"info\": " << _stats.info << ",\n";
+		out << "  \"verbose\": " << _stats.verbose << ",\n";
+		out << "  \"unprinted\": " << _stats.unprinted << ",\n";
+		out << "  \"messages\": [\n";
+		size_t i = 0;
+		for (const auto& message : _messages)
+		{
+			const MessageStats& stats = message.second;
+			out << "    { \"id\": \"" << _escape(stats.name) << "\", \"severity\": \"" << _severityName(stats.severity) << "\", \"performance\": "
+				<< ((stats.types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) != 0 ? "true" : "false") << ", \"count\": " << stats.count
+				<< ", \"printed\": " << stats.printed << " }" << (++i < _messages.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n}\n";
+	}
+
+private:
+	static VKAPI_ATTR VkBool32 VKAPI_CALL _callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT types,
+		const VkDebugUtilsMessengerCallbackDataEXT* callbackData, void* userData)
+	{
+		static_cast<DebugUtils*>(userData)->_message(severity, types, callbackData);
+		return VK_FALSE;
+	}
+
+	void _message(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT types, const VkDebugUtilsMessengerCallbackDataEXT* callbackData)
+	{
+		std::string id = callbackData->pMessageIdName != nullptr ? callbackData->pMessageIdName : "id " + std::to_string(callbackData->messageIdNumber);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+			_stats.errors++;
+		else if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+			_stats.warnings++;
+		else if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+			_stats.info++;
+		else
+			_stats.verbose++;
+		if ((types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) != 0)
+			_stats.performanceWarnings++;
+
+		MessageStats& stats = _messages[id];
+		stats.name = id;
+		stats.severity = std::max(stats.severity, severity);
+		stats.types |= types;
+		stats.count++;
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - _windowStart >= std::chrono::seconds(1))
+		{
+			_windowStart = now;
+			_windowPrints = 0;
+		}
+		if (severity < _printSeverity || stats.printed >= _repeatLimit || _windowPrints >= PrintsPerSecond)
+		{
+			_stats.unprinted++;
+			return;
+		}
+
+		stats.printed++;
+		_windowPrints++;
+		std::cerr << "validation " << _severityName(severity) << " [" << id << "]: " << callbackData->pMessage;
+		if (stats.printed == _repeatLimit)
+		{
+			std::cerr << " (printed " << _repeatLimit << " times, only counted from here)";
+		}
+		std::cerr << std::endl;
+	}
+
+	static const char* _severityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity)
+	{
+		if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+			return "error";
+		if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+			return "warning";
+		if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+			return "info";
+		return "verbose";
+	}
+
+	static std::string _escape(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	VkDebugUtilsMessageSeverityFlagBitsEXT	_printSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+	uint32_t								_repeatLimit;
+	VkDevice								_device = VK_NULL_HANDLE;
+	PFN_vkSetDebugUtilsObjectNameEXT		_setObjectName = nullptr;
+	PFN_vkCmdBeginDebugUtilsLabelEXT		_beginLabel = nullptr;
+	PFN_vkCmdEndDebugUtilsLabelEXT			_endLabel = nullptr;
+	uint64_t								_named = 0;
+
+	mutable std::mutex						_mutex;
+	Stats									_stats;
+	std::map<std::string, MessageStats>		_messages;
+	std::chrono::steady_clock::time_point	_windowStart;
+	uint32_t								_windowPrints = 0;
+};
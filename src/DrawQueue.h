@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// one draw of a pass: its sort key and the renderer's index for whatever it needs to record it
+struct DrawPacket
+{
+	uint64_t	key;
+	uint32_t	draw;
+	uint32_t	padding;
+};
+
+// the draws of a pass, recorded in sort key order so draws sharing a pipeline and then a material end up
+// next to each other and their binds go out once. the key, high to low: pass (8 bits), pipeline (16),
+// material (16), depth bucket (24, front to back). packets are sorted with an LSD radix sort over the key's
+// bytes, skipping the bytes no two packets differ in. a pass large enough is split across a pool of workers
+// started with the first such pass and parked between passes: each counts its chunk into its own histogram, the
+// prefix sum over digits then chunks gives every chunk its place in each digit, and each scatters its chunk there.
+// smaller passes sort on the calling thread
+class DrawQueue
+{
+public:
+	static const uint32_t DepthBuckets = 1u << 24;
+
+	struct Stats
+	{
+		uint64_t	frames = 0;			// frames that recorded draws, a pass reused as it was recorded doesn't count
+		uint64_t	sorts = 0;
+		uint64_t	packets = 0;
+		uint64_t	pipelineBinds = 0;
+		uint64_t	materialBinds = 0;
+		uint64_t	bindsSaved = 0;		// against a pipeline and a material bind per draw
+		uint64_t	radixPasses = 0;	// radix passes actually run
+		uint64_t	parallelSorts = 0;
+		double		sortMs = 0.0;
+	};
+
+	// 'record' gets every packet in order, with whether its pipeline or material differs from the last one recorded
+	using Recorder = std::function<void(const DrawPacket& packet, bool bindPipeline, bool bindMaterial)>;
+
+	explicit DrawQueue(bool sort = true)
+		: _sort(sort), _maxThreads(std::max(1u, std::thread::hardware_concurrency()))
+	{
+	}
+
+	~DrawQueue()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_poolMutex);
+			_stopping = true;
+		}
+		_jobReady.notify_all();
+		for (std::thread& worker : _workers)
+		{
+			worker.join();
+		}
+	}
+
+	DrawQueue(const DrawQueue&) = delete;
+	DrawQueue& operator=(const DrawQueue&) = delete;
+
+	// 'depth' is 0 at the front and 1 at the back
+	static uint64_t Key(uint32_t pass, uint32_t pipeline, uint32_t material, float depth)
+	{
+		uint64_t bucket = uint64_t(std::clamp(depth, 0.0f, 1.0f) * float(DepthBuckets - 1));
+		return (uint64_t(pass & 0xff) << 56) | (uint64_t(pipeline & 0xffff) << 40) | (uint64_t(material & 0xffff) << 24) | bucket;
+	}
+
+	static uint32_t Pass(uint64_t key) { return uint32_t(key >> 56); }
+	static uint32_t Pipeline(uint64_t key) { return uint32_t(key >> 40) & 0xffff; }
+	static uint32_t Material(uint64_t key) { return uint32_t(key >> 24) & 0xffff; }
+
+	void Push(uint64_t key, uint32_t draw)
+	{
+		_packets.push_back({ key, draw, 0 });
+	}
+
+	// sorts what was pushed, records it and empties the queue
+	void Flush(const Recorder& record)
+	{
+		Sort();
+		Record(0, _packets.size(), record);
+		Clear();
+	}
+
+	// for a pass recorded in runs: sorts what was pushed once, Packets has them in order for the runs to be split
+	// from, Record records a run and Clear empties the queue when the pass is done
+	void Sort()
+	{
+		if (!_sort)
+			return;
+
+		auto begin = std::chrono::steady_clock::now();
+		_radixSort();
+		_stats.sortMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		_stats.sorts++;
+	}
+
+	const std::vector<DrawPacket>& Packets() const { return _packets; }
+
+	// packets [first, first + count), starting from nothing bound
+	void Record(size_t first, size_t count, const Recorder& record)
+	{
+		const DrawPacket* last = nullptr;
+		for (size_t i = first; i < first + count; i++)
+		{
+			const DrawPacket& packet = _packets[i];
+			// a new pass starts from nothing bound
+			bool newPass = last == nullptr || Pass(packet.key) != Pass(last->key);
+			bool bindPipeline = newPass || Pipeline(packet.key) != Pipeline(last->key);
+			bool bindMaterial = newPass || Material(packet.key) != Material(last->key);
+			record(packet, bindPipeline, bindMaterial);
+
+			_stats.pipelineBinds += bindPipeline ? 1 : 0;
+			_stats.materialBinds += bindMaterial ? 1 : 0;
+			_stats.bindsSaved += (bindPipeline ? 0 : 1) + (bindMaterial ? 0 : 1);
+			last = &packet;
+		}
+		_stats.packets += count;
+		_recorded = _recorded || count > 0;
+	}
+
+	void Clear()
+	{
+		_packets.clear();
+	}
+
+	void EndFrame()
+	{
+		_stats.frames += _recorded ? 1 : 0;
+		_recorded = false;
+	}
+
+	const Stats& GetStats() const { return _stats; }
+
+	void Report(std::ostream& out) const
+	{
+		if (_stats.frames == 0 || _stats.packets == 0)
+			return;
+
+		double frames = double(_stats.frames);
+		uint64_t binds = _stats.pipelineBinds + _stats.materialBinds;
+		out << "draw queue: " << double(_stats.packets) / frames << " draws/recorded frame over " << _stats.frames << " frames, " << double(_stats.pipelineBinds) / frames << " pipeline and "
+			<< double(_stats.materialBinds) / frames << " material binds/frame, " << double(_stats.bindsSaved) / frames << " binds saved/frame ("
+			<< 100.0 * double(_stats.bindsSaved) / double(binds + _stats.bindsSaved) << "%)";
+		if (_sort)
+		{
+			double sorts = double(std::max<uint64_t>(1, _stats.sorts));
+			out << ", " << _stats.sorts << " sorts";
+			if (_stats.parallelSorts > 0)
+			{
+				out << " (" << _stats.parallelSorts << " on up to " << _workers.size() + 1 << " threads)";
+			}
+			out << ", avg " << _stats.sortMs / sorts << " ms, " << double(_stats.radixPasses) / sorts << " radix passes/sort";
+		}
+		else
+		{
+			out << ", unsorted";
+		}
+		out << std::endl;
+	}
+
+private:
+	static const size_t ParallelChunk = 2048;	// packets per thread below which waking another one costs more than it saves
+
+	using Histogram = std::array<size_t, 256>;
+
+	// stable, so packets with equal keys keep their submission order
+	void _radixSort()
+	{
+		size_t count = _packets.size();
+		if (count < 2)
+			return;
+
+		// bytes every key has the same value in can't change the order
+		uint64_t all = ~0ull, any = 0;
+		for (const DrawPacket& packet : _packets)
+		{
+			all &= packet.key;
+			any |= packet.key;
+		}
+		uint64_t varying = all ^ any;
+
+		size_t threads = std::min(_maxThreads, std::max<size_t>(1, count / ParallelChunk));
+		size_t chunk = (count + threads - 1) / threads;
+		_scratch.resize(count);
+		_histograms.resize(threads);
+		_stats.parallelSorts += threads > 1 ? 1 : 0;
+
+		for (uint32_t shift = 0; shift < 64; shift += 8)
+		{
+			if (((varying >> shift) & 0xff) == 0)
+				continue;
+
+			_forEachChunk(threads, chunk, [&](size_t thread, size_t first, size_t last)
+			{
+				Histogram& histogram = _histograms[thread];
+				histogram.fill(0);
+				for (size_t i = first; i < last; i++)
+				{
+					histogram[(_packets[i].key >> shift) & 0xff]++;
+				}
+			});
+
+			// where each chunk's packets of each digit go, chunks in order within a digit
+			size_t offset = 0;
+			for (size_t digit = 0; digit < 256; digit++)
+			{
+				for (size_t thread = 0; thread < threads; thread++)
+				{
+					size_t digitCount = _histograms[thread][digit];
+					_histograms[thread][digit] = offset;
+					offset += digitCount;
+				}
+			}
+
+			_forEachChunk(threads, chunk, [&](size_t thread, size_t first, size_t last)
+			{
+				Histogram& histogram = _histograms[thread];
+				for (size_t i = first; i < last; i++)
+				{
+					_scratch[histogram[(_packets[i].key >> shift) & 0xff]++] = _packets[i];
+				}
+			});
+
+			_packets.swap(_scratch);
+			_stats.radixPasses++;
+		}
+	}
+
+	// 'function(thread, first, last)' over 'threads' chunks of the packets, the calling thread takes the first
+	template <typename Function>
+	void _forEachChunk(size_t threads, size_t chunk, const Function& function)
+	{
+		size_t count = _packets.size();
+		if (threads == 1)
+		{
+			function(0, 0, count);
+			return;
+		}
+
+		while (_workers.size() + 1 < threads)
+		{
+			_workers.emplace_back(&DrawQueue::_work, this, _workers.size() + 1, _generation);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_poolMutex);
+			_job = [&, count](size_t thread) { function(thread, thread * chunk, std::min(count, (thread + 1) * chunk)); };
+			_jobThreads = threads;
+			_jobsLeft = threads - 1;
+			_generation++;
+		}
+		_jobReady.notify_all();
+
+		function(0, 0, std::min(count, chunk));
+
+		std::unique_lock<std::mutex> lock(_poolMutex);
+		_jobDone.wait(lock, [this]() { return _jobsLeft == 0; });
+		_job = nullptr;
+	}
+
+	// worker 'thread' runs its chunk of every job after 'seen' that has one for it, until the queue goes away
+	void _work(size_t thread, uint64_t seen)
+	{
+		std::unique_lock<std::mutex> lock(_poolMutex);
+		for (;;)
+		{
+			_jobReady.wait(lock, [&]() { return _stopping || _generation != seen; });
+			if (_stopping)
+				return;
+			seen = _generation;
+			if (thread >= _jobThreads)
+				continue;
+
+			lock.unlock();
+			_job(thread);
+			lock.lock();
+			if (--_jobsLeft == 0)
+			{
+				_jobDone.notify_one();
+			}
+		}
+	}
+
+	bool						_sort;
+	size_t						_maxThreads;
+	std::vector<DrawPacket>		_packets;
+	std::vector<DrawPacket>		_scratch;
+	std::vector<Histogram>		_histograms;	// per thread
+	bool						_recorded = false;	// this frame
+
+	// the sort's workers, index 0 is the calling thread
+	std::vector<std::thread>			_workers;
+	std::mutex							_poolMutex;
+	std::condition_variable				_jobReady;
+	std::condition_variable				_jobDone;
+	std::function<void(size_t thread)>	_job;
+	size_t								_jobThreads = 0;
+	size_t								_jobsLeft = 0;
+	uint64_t							_generation = 0;
+	bool								_stopping = false;
+	Stats						_stats;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+
+// steers the scene's render scale (per axis) towards a GPU frame time. the scene passes are taken to cost
+// what the pixels they draw cost, the scale squared, and the rest of the frame (culling, shadows, the upscale)
+// to stay what it is at any scale. timings come back frames late, once the frame slot's fence is through, so
+// after a change the frames still drawn at the old scale are skipped and the next decision averages a window
+// of frames drawn at the new one. steps are limited, down faster than up, so a spike is shed quickly and the
+// scale doesn't oscillate
+class DynamicResolution
+{
+public:
+	static const uint32_t Window = 8;		// frames averaged per decision
+	static constexpr float Steps = 32.0f;	// the scale moves in 1/Steps
+	static constexpr double Headroom = 0.9;	// of the target the frame aims for
+
+	// 'latency': frames between recording a frame and reading its timings, the frames in flight
+	DynamicResolution(double targetMs, float minScale, uint32_t latency)
+		: _targetMs(targetMs), _minScale(minScale), _latency(latency)
+	{
+	}
+
+	float Scale() const { return _scale; }
+
+	// the timings of one frame, the whole frame and the passes drawn at the scale. returns the scale to draw at
+	float Update(double frameMs, double sceneMs)
+	{
+		_frames++;
+		_scaleSum += _scale;
+		_overTarget += frameMs > _targetMs ? 1 : 0;
+
+		// still the frames drawn before the last change
+		if (_sinceChange++ < _latency)
+			return _scale;
+
+		_frameSum += frameMs;
+		_sceneSum += sceneMs;
+		if (++_samples < Window)
+			return _scale;
+
+		double frameAverage = _frameSum / _samples;
+		double sceneAverage = _sceneSum / _samples;
+		_frameSum = _sceneSum = 0.0;
+		_samples = 0;
+
+		// what the scaled passes may take next to the rest of the frame
+		double budgetMs = _targetMs * Headroom - std::max(frameAverage - sceneAverage, 0.0);
+		float scale = _minScale;
+		if (sceneAverage <= 0.0)
+			scale = 1.0f;
+		else if (budgetMs > 0.0)
+			scale = _scale * float(std::sqrt(budgetMs / sceneAverage));
+
+		scale = std::clamp(scale, _scale * 0.75f, _scale * 1.1f);
+		scale = std::clamp(std::round(scale * Steps) / Steps, _minScale, 1.0f);
+		if (scale != _scale)
+		{
+			_scale = scale;
+			_sinceChange = 0;
+			_changes++;
+			_lowestScale = std::min(_lowestScale, scale);
+		}
+		return _scale;
+	}
+
+	void Report(std::ostream& out) const
+	{
+		if (_frames == 0)
+			return;
+
+		out << "dynamic resolution: target " << _targetMs << " ms, scale avg " << _scaleSum / double(_frames) << ", lowest " << _lowestScale
+			<< ", last " << _scale << ", " << _changes << " changes, " << _overTarget << " of " << _frames << " frames over the target" << std::endl;
+	}
+
+private:
+	double		_targetMs;
+	float		_minScale;
+	uint32_t	_latency;
+	float		_scale = 1.0f;
+	uint32_t	_sinceChange = 0;
+	uint32_t	_samples = 0;
+	double		_frameSum = 0.0;
+	double		_sceneSum = 0.0;
+
+	uint64_t	_frames = 0;
+	uint64_t	_overTarget = 0;
+	uint64_t	_changes = 0;
+	double		_scaleSum = 0.0;
+	float		_lowestScale = 1.0f;
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "ImageIO.h"
+
+enum class CaptureFormat
+{
+	None,
+	Png,	// one file per frame
+	Raw,	// RGBA8 frames back to back in one stream
+	Y4m,	// YUV4MPEG2 4:4:4 stream
+};
+
+// a frame read back from the device, tightly packed 8-bit RGBA or BGRA
+struct CapturedFrame
+{
+	uint64_t				index = 0;
+	uint32_t				width = 0;
+	uint32_t				height = 0;
+	bool					bgra = false;
+	std::vector<uint8_t>	pixels;
+};
+
+// background encoder with a bounded queue. Submit blocks (or drops, if asked to)
+// when the encoder falls behind, so readback can never grow memory without limit.
+class FrameEncoder
+{
+public:
+	struct Stats
+	{
+		uint64_t	encoded = 0;
+		uint64_t	dropped = 0;
+		size_t		maxQueueDepth = 0;
+		double		blockedMs = 0.0;
+	};
+
+	FrameEncoder(CaptureFormat format, const std::string& pathPrefix, size_t queueCapacity, double frameRate)
+		: _format(format), _pathPrefix(pathPrefix), _queueCapacity(std::max<size_t>(queueCapacity, 1)), _frameRate(frameRate)
+	{
+		std::filesystem::path parent = std::filesystem::path(_pathPrefix).parent_path();
+		if (!parent.empty())
+		{
+			std::filesystem::create_directories(parent);
+		}
+		_thread = std::thread(&FrameEncoder::_run, this);
+	}
+
+	~FrameEncoder()
+	{
+		Close();
+	}
+
+	// writes out everything still queued and stops the encoder thread
+	void Close()
+	{
+		if (!_thread.joinable())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_queueChanged.notify_all();
+		_thread.join();
+	}
+
+	FrameEncoder(const FrameEncoder&) = delete;
+	FrameEncoder& operator=(const FrameEncoder&) = delete;
+
+	// recycled pixel storage, so steady-state capture doesn't allocate
+	std::vector<uint8_t> AcquireStorage(size_t size)
+	{
+		std::vector<uint8_t> storage;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_freeStorage.empty())
+			{
+				storage = std::move(_freeStorage.back());
+				_freeStorage.pop_back();
+			}
+		}
+		storage.resize(size);
+		return storage;
+	}
+
+	// returns false if the frame was dropped
+	bool Submit(CapturedFrame&& frame, bool dropWhenFull)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_queue.size() >= _queueCapacity)
+		{
+			if (dropWhenFull)
+			{
+				_stats.dropped++;
+				_freeStorage.push_back(std::move(frame.pixels));
+				return false;
+			}
+
+			auto begin = std::chrono::steady_clock::now();
+			_queueChanged.wait(lock, [this]() { return _queue.size() < _queueCapacity || _failed; });
+			_stats.blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		}
+		if (_failed)
+		{
+			throw std::runtime_error("Frame encoder failed: " + _error);
+		}
+
+		_queue.push_back(std::move(frame));
+		_stats.maxQueueDepth = std::max(_stats.maxQueueDepth, _queue.size());
+		lock.unlock();
+
+		_queueChanged.notify_all();
+		return true;
+	}
+
+	Stats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+private:
+	void _run()
+	{
+		for (;;)
+		{
+			CapturedFrame frame;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_queueChanged.wait(lock, [this]() { return !_queue.empty() || _stopping; });
+				if (_queue.empty())
+					break;	// stopping, and everything queued has been written
+
+				frame = std::move(_queue.front());
+				_queue.pop_front();
+			}
+			_queueChanged.notify_all();
+
+			try
+			{
+				_encode(frame);
+			}
+			catch (const std::exception& e)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_failed = true;
+				_error = e.what();
+				_queueChanged.notify_all();
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stats.encoded++;
+			_freeStorage.push_back(std::move(frame.pixels));
+		}
+	}
+
+	void _encode(CapturedFrame& frame)
+	{
+		if (frame.bgra)
+		{
+			ImageIO::SwapRedBlue(frame.pixels);
+			frame.bgra = false;
+		}
+
+		switch (_format)
+		{
+		case CaptureFormat::Png:
+		{
+			char suffix[32];
+			snprintf(suffix, sizeof(suffix), "_%06llu.png", (unsigned long long)frame.index);
+			std::vector<uint8_t> png = ImageIO::EncodePng(frame.pixels.data(), frame.width, frame.height);
+			ImageIO::WriteFile(_pathPrefix + suffix, png.data(), png.size());
+			break;
+		}
+		case CaptureFormat::Raw:
+			_openStream(frame, ".rgba", nullptr);
+			_stream.write(reinterpret_cast<const char*>(frame.pixels.data()), frame.pixels.size());
+			break;
+		case CaptureFormat::Y4m:
+			_openStream(frame, ".y4m", [this](std::ofstream& out, uint32_t w, uint32_t h)
+			{
+				out << "YUV4MPEG2 W" << w << " H" << h << " F" << int(_frameRate + 0.5) << ":1 Ip A1:1 C444\n";
+			});
+			_writeY4mFrame(frame);
+			break;
+		case CaptureFormat::None:
+			break;
+		}
+	}
+
+	// stream formats can't change size mid-file, so a resize starts a new segment
+	template<typename HeaderWriter>
+	void _openStream(const CapturedFrame& frame, const char* extension, HeaderWriter writeHeader)
+	{
+		if (_stream.is_open() && frame.width == _streamWidth && frame.height == _streamHeight)
+			return;
+
+		_stream.close();
+		std::string path = _pathPrefix + "_" + std::to_string(_streamSegment++) + "_" +
+			std::to_string(frame.width) + "x" + std::to_string(frame.height) + extension;
+		_stream.open(path, std::ios::binary);
+		if (!_stream.is_open())
+		{
+			throw std::runtime_error("Failed to open capture stream " + path);
+		}
+		_streamWidth = frame.width;
+		_streamHeight = frame.height;
+
+		if constexpr (!std::is_same_v<HeaderWriter, std::nullptr_t>)
+		{
+			writeHeader(_stream, frame.width, frame.height);
+		}
+	}
+
+	// BT.601 limited range, planar 4:4:4
+	void _writeY4mFrame(const CapturedFrame& frame)
+	{
+		size_t pixelCount = size_t(frame.width) * frame.height;
+		_planes.resize(pixelCount * 3);
+		uint8_t* y = _planes.data();
+		uint8_t* u = y + pixelCount;
+		uint8_t* v = u + pixelCount;
+
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			int r = frame.pixels[i * 4 + 0];
+			int g = frame.pixels[i * 4 + 1];
+			int b = frame.pixels[i * 4 + 2];
+			y[i] = uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+			u[i] = uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			v[i] = uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+
+		_stream << "FRAME\n";
+		_stream.write(reinterpret_cast<const char*>(_planes.data()), _planes.size());
+	}
+
+	CaptureFormat						_format;
+	std::string							_pathPrefix;
+	size_t								_queueCapacity;
+	double								_frameRate;
+
+	mutable std::mutex					_mutex;
+	std::condition_variable				_queueChanged;
+	std::deque<CapturedFrame>			_queue;
+	std::vector<std::vector<uint8_t>>	_freeStorage;
+	bool								_stopping = false;
+	bool								_failed = false;
+	std::string							_error;
+	Stats								_stats;
+
+	// encoder thread only
+	std::ofstream						_stream;
+	uint32_t							_streamWidth = 0;
+	uint32_t							_streamHeight = 0;
+	uint32_t							_streamSegment = 0;
+	std::vector<uint8_t>				_planes;
+
+	std::thread							_thread;
+};
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <new>
+#include <cerrno>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// finished frames handed to a local compositor through a POSIX shared-memory ring (--export), no window or
+// swapchain in between. the mapping is a Header followed by 'slotCount' slots of one frame each, rows tightly
+// packed in 'format'. the renderer imports the slots as device memory where it can (VK_EXT_external_memory_host)
+// so the GPU's readback lands in them and neither side copies; otherwise it copies its readback in.
+//
+// slots are filled and read in ring order. 'free' counts the slots the consumer gave back, the renderer takes one
+// per exported frame and drops the frame when there is none. 'ready' is posted once a frame's fence is through,
+// the consumer waits on it, reads the next slot and posts 'free'. both are process-shared semaphores in the mapping,
+// destroyed by whichever side unmaps it last
+namespace FrameExport
+{
+	const char		Magic[8] = { 'V', 'K', 'F', 'R', 'A', 'M', 'E', 'S' };
+	const uint32_t	Version = 2;
+	const uint32_t	MaxSlots = 8;
+
+#ifdef _WIN32
+	// no POSIX shared memory here, the rings can't be created or opened. the Linux build has them, see CMakeLists.txt
+	class Producer
+	{
+	public:
+		struct Stats
+		{
+			uint64_t	published = 0;
+			uint64_t	dropped = 0;
+		};
+
+		Producer(const std::string&, uint32_t, uint32_t, uint32_t, uint32_t, uint64_t) { throw std::runtime_error("--export needs POSIX shared memory"); }
+		uint32_t SlotCount() const { return 0; }
+		uint64_t SlotStride() const { return 0; }
+		uint8_t* Slot(uint32_t) const { return nullptr; }
+		int32_t TryAcquire() { return -1; }
+		void Publish(uint32_t, uint64_t) {}
+		bool ConsumerGone() const { return false; }
+		const Stats& GetStats() const { return _stats; }
+		void Report(std::ostream&) const {}
+
+	private:
+		Stats	_stats;
+	};
+
+	class Consumer
+	{
+	public:
+		struct Frame
+		{
+			uint32_t		slot;
+			uint64_t		index;
+			const uint8_t*	pixels;
+			double			latencyMs;
+		};
+
+		Consumer(const std::string&, uint32_t) { throw std::runtime_error("--export-consume needs POSIX shared memory"); }
+		uint32_t Width() const { return 0; }
+		uint32_t Height() const { return 0; }
+		uint32_t Format() const { return 0; }
+		uint32_t SlotCount() const { return 0; }
+		bool Acquire(Frame&, uint32_t) { return false; }
+		void Release(const Frame&) {}
+	};
+#else
+	struct Slot
+	{
+		std::atomic<uint64_t>	frame;			// the scene frame in it
+		std::atomic<int64_t>	publishedNs;	// CLOCK_MONOTONIC when it was handed over
+	};
+
+	struct Header
+	{
+		char					magic[8];
+		std::atomic<uint32_t>	version;		// written last, a consumer waits for it
+		uint32_t				slotCount;
+		uint32_t				width;
+		uint32_t				height;
+		uint32_t				format;			// VkFormat, 4 bytes per pixel
+		uint32_t				padding;
+		uint64_t				slotOffset;		// of the first slot from the start of the mapping
+		uint64_t				slotStride;
+		uint64_t				frameBytes;
+		std::atomic<uint32_t>	closed;			// the renderer is done, nothing more will be published
+		std::atomic<uint32_t>	consumerAttached;
+		std::atomic<uint32_t>	consumerDetached;
+		std::atomic<uint32_t>	mappings;		// sides still mapping the ring, the last one out destroys the semaphores
+		sem_t					ready;
+		sem_t					free;
+		Slot					slots[MaxSlots];
+	};
+
+	// drops this side's use of the ring's semaphores, destroying them if the other side is gone too
+	inline void Unmap(Header* header, void* mapping, size_t size)
+	{
+		if (header->mappings.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			sem_destroy(&header->ready);
+			sem_destroy(&header->free);
+		}
+		munmap(mapping, size);
+	}
+
+	inline int64_t MonotonicNs()
+	{
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+	}
+
+	// the renderer's end. creates the ring under 'name' (a shm_open name, "/vkrenderer") and unlinks it when closed
+	class Producer
+	{
+	public:
+		struct Stats
+		{
+			uint64_t	published = 0;
+			uint64_t	dropped = 0;		// no slot free, the consumer was behind
+		};
+
+		// 'alignment': what slots start at and are sized to, at least the page size
+		Producer(const std::string& name, uint32_t slotCount, uint32_t width, uint32_t height, uint32_t format, uint64_t alignment)
+			: _name(name)
+		{
+			if (slotCount < 2 || slotCount > MaxSlots)
+				throw std::runtime_error("frame export: 2 to " + std::to_string(MaxSlots) + " slots");
+
+			alignment = std::max<uint64_t>(alignment, uint64_t(sysconf(_SC_PAGESIZE)));
+			uint64_t frameBytes = uint64_t(width) * height * 4;
+			uint64_t slotOffset = (sizeof(Header) + alignment - 1) / alignment * alignment;
+			uint64_t slotStride = (frameBytes + alignment - 1) / alignment * alignment;
+			_size = size_t(slotOffset + slotStride * slotCount);
+
+			// a ring left behind by a renderer that didn't get to close it
+			shm_unlink(_name.c_str());
+			int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (fd < 0)
+				throw std::runtime_error("frame export: shm_open " + _name + " failed: " + strerror(errno));
+			if (ftruncate(fd, off_t(_size)) != 0)
+			{
+				close(fd);
+				shm_unlink(_name.c_str());
+				throw std::runtime_error("frame export: can't size " + _name + " to " + std::to_string(_size) + " bytes");
+			}
+			_mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (_mapping == MAP_FAILED)
+			{
+				shm_unlink(_name.c_str());
+				throw std::runtime_error("frame export: mmap " + _name + " failed");
+			}
+
+			_header = new (_mapping) Header();
+			memcpy(_header->magic, Magic, sizeof(Magic));
+			_header->slotCount = slotCount;
+			_header->width = width;
+			_header->height = height;
+			_header->format = format;
+			_header->slotOffset = slotOffset;
+			_header->slotStride = slotStride;
+			_header->frameBytes = frameBytes;
+			sem_init(&_header->ready, 1, 0);
+			sem_init(&_header->free, 1, slotCount);
+			_header->mappings.store(1, std::memory_order_relaxed);
+			_header->version.store(Version, std::memory_order_release);
+		}
+
+		~Producer()
+		{
+			Close();
+		}
+
+		Producer(const Producer&) = delete;
+		Producer& operator=(const Producer&) = delete;
+
+		uint32_t SlotCount() const { return _header->slotCount; }
+		uint64_t SlotStride() const { return _header->slotStride; }
+		uint8_t* Slot(uint32_t slot) const { return static_cast<uint8_t*>(_mapping) + _header->slotOffset + _header->slotStride * slot; }
+
+		// the slot the next exported frame goes to, -1 drops the frame
+		int32_t TryAcquire()
+		{
+			if (sem_trywait(&_header->free) != 0)
+			{
+				_stats.dropped++;
+				return -1;
+			}
+			uint32_t slot = _next;
+			_next = (_next + 1) % _header->slotCount;
+			return int32_t(slot);
+		}
+
+		// the frame in 'slot' is complete, in the order the slots were acquired
+		void Publish(uint32_t slot, uint64_t frame)
+		{
+			_header->slots[slot].frame.store(frame, std::memory_order_relaxed);
+			_header->slots[slot].publishedNs.store(MonotonicNs(), std::memory_order_relaxed);
+			sem_post(&_header->ready);
+			_stats.published++;
+		}
+
+		// a consumer attached and then went away, nothing is reading the ring anymore
+		bool ConsumerGone() const
+		{
+			return _header->consumerDetached.load(std::memory_order_acquire) != 0;
+		}
+
+		const Stats& GetStats() const { return _stats; }
+
+		void Report(std::ostream& out) const
+		{
+			out << "frame export: " << _name << ", " << _header->slotCount << " slots of " << _header->width << "x" << _header->height << ", "
+				<< _stats.published << " frames published, " << _stats.dropped << " dropped with the consumer behind"
+				<< (_header->consumerAttached.load() != 0 ? "" : ", no consumer attached") << std::endl;
+		}
+
+		// marks the ring closed and removes the name, an attached consumer keeps its mapping and reads what's left
+		void Close()
+		{
+			if (_mapping == nullptr)
+				return;
+			_header->closed.store(1, std::memory_order_release);
+			Unmap(_header, _mapping, _size);
+			shm_unlink(_name.c_str());
+			_mapping = nullptr;
+			_header = nullptr;
+		}
+
+	private:
+		std::string		_name;
+		void*			_mapping = nullptr;
+		size_t			_size = 0;
+		Header*			_header = nullptr;
+		uint32_t		_next = 0;
+		Stats			_stats;
+	};
+
+	// the compositor's end, see --export-consume for the stand-in
+	class Consumer
+	{
+	public:
+		struct Frame
+		{
+			uint32_t		slot;
+			uint64_t		index;
+			const uint8_t*	pixels;
+			double			latencyMs;		// from the renderer handing it over
+		};
+
+		// waits up to 'timeoutMs' for the renderer to create the ring, so either side may start first
+		Consumer(const std::string& name, uint32_t timeoutMs)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+			int fd = -1;
+			while ((fd = shm_open(name.c_str(), O_RDWR, 0)) < 0)
+			{
+				if (std::chrono::steady_clock::now() > deadline)
+					throw std::runtime_error("frame export: no ring " + name + " to read");
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+
+			// the renderer sizes the object right after creating it
+			off_t size = 0;
+			while ((size = lseek(fd, 0, SEEK_END)) < off_t(sizeof(Header)))
+			{
+				if (std::chrono::steady_clock::now() > deadline)
+				{
+					close(fd);
+					throw std::runtime_error("frame export: " + name + " never got its header");
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			_size = size_t(size);
+			_mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (_mapping == MAP_FAILED)
+				throw std::runtime_error("frame export: mmap " + name + " failed");
+
+			_header = static_cast<Header*>(_mapping);
+			while (_header->version.load(std::memory_order_acquire) == 0)
+			{
+				if (std::chrono::steady_clock::now() > deadline)
+					throw std::runtime_error("frame export: " + name + " was never initialized");
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			if (memcmp(_header->magic, Magic, sizeof(Magic)) != 0 || _header->version.load() != Version)
+				throw std::runtime_error("frame export: " + name + " isn't a version " + std::to_string(Version) + " frame ring");
+
+			// a renderer that already closed may have destroyed the semaphores, its ring can't be read anymore
+			uint32_t mappings = _header->mappings.load(std::memory_order_acquire);
+			do
+			{
+				if (mappings == 0)
+				{
+					munmap(_mapping, _size);
+					throw std::runtime_error("frame export: " + name + " was closed before it could be attached");
+				}
+			} while (!_header->mappings.compare_exchange_weak(mappings, mappings + 1, std::memory_order_acq_rel));
+			_header->consumerAttached.store(1, std::memory_order_release);
+		}
+
+		~Consumer()
+		{
+			if (_mapping != nullptr)
+			{
+				_header->consumerDetached.store(1, std::memory_order_release);
+				Unmap(_header, _mapping, _size);
+			}
+		}
+
+		Consumer(const Consumer&) = delete;
+		Consumer& operator=(const Consumer&) = delete;
+
+		uint32_t Width() const { return _header->width; }
+		uint32_t Height() const { return _header->height; }
+		uint32_t Format() const { return _header->format; }
+		uint32_t SlotCount() const { return _header->slotCount; }
+
+		// the next frame in ring order. false when the renderer closed the ring and everything it published was
+		// read, or nothing came for 'timeoutMs'
+		bool Acquire(Frame& frame, uint32_t timeoutMs)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+			while (sem_trywait(&_header->ready) != 0)
+			{
+				// a frame can be posted between the failed wait and the flag being seen, closing publishes nothing
+				// after it so one more try decides
+				if (_header->closed.load(std::memory_order_acquire) != 0)
+				{
+					if (sem_trywait(&_header->ready) == 0)
+						break;
+					return false;
+				}
+				if (std::chrono::steady_clock::now() > deadline)
+					return false;
+
+				// short waits, the renderer closing posts nothing
+				timespec wait;
+				clock_gettime(CLOCK_REALTIME, &wait);
+				wait.tv_nsec += 10 * 1000 * 1000;
+				if (wait.tv_nsec >= 1000000000)
+				{
+					wait.tv_sec++;
+					wait.tv_nsec -= 1000000000;
+				}
+				if (sem_timedwait(&_header->ready, &wait) == 0)
+					break;
+			}
+
+			const Slot& slot = _header->slots[_next];
+			frame.slot = _next;
+			frame.index = slot.frame.load(std::memory_order_relaxed);
+			frame.pixels = static_cast<const uint8_t*>(_mapping) + _header->slotOffset + _header->slotStride * _next;
+			frame.latencyMs = double(MonotonicNs() - slot.publishedNs.load(std::memory_order_relaxed)) / 1e6;
+			_next = (_next + 1) % _header->slotCount;
+			return true;
+		}
+
+		// the frame's slot goes back to the renderer, its pixels may be overwritten from here on
+		void Release(const Frame&)
+		{
+			sem_post(&_header->free);
+		}
+
+	private:
+		void*			_mapping = nullptr;
+		size_t			_size = 0;
+		Header*			_header = nullptr;
+		uint32_t		_next = 0;
+	};
+#endif
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+
+// CPU-side frame limiter. sleeps most of the interval and yields for the last bit,
+// since OS sleep granularity is too coarse to hit the deadline on its own.
+class FrameLimiter
+{
+	using Clock = std::chrono::steady_clock;
+
+public:
+	void SetRate(double framesPerSecond)
+	{
+		_enabled = framesPerSecond > 0.0;
+		if (_enabled)
+		{
+			_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+		}
+		_deadline = Clock::now();
+	}
+
+	void Wait()
+	{
+		if (!_enabled)
+			return;
+
+		_deadline += _interval;
+
+		Clock::time_point now = Clock::now();
+		if (_deadline < now)
+		{
+			// fell behind, don't try to catch up with a burst of frames
+			_deadline = now;
+			return;
+		}
+
+		const auto spinMargin = std::chrono::milliseconds(2);
+		if (_deadline - now > spinMargin)
+		{
+			std::this_thread::sleep_for(_deadline - now - spinMargin);
+		}
+		while (Clock::now() < _deadline)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+private:
+	bool				_enabled = false;
+	Clock::duration		_interval = Clock::duration::zero();
+	Clock::time_point	_deadline;
+};
+
+// input-to-present latency samples, in milliseconds
+class LatencyStats
+{
+public:
+	void Add(double ms)
+	{
+		_count++;
+		_sum += ms;
+		_max = std::max(_max, ms);
+		_last = ms;
+	}
+
+	void Report(std::ostream& out, const char* source) const
+	{
+		if (_count == 0)
+		{
+			out << "input-to-present latency: no samples" << std::endl;
+			return;
+		}
+		out << "input-to-present latency (" << source << "): "
+			<< _count << " frames, avg " << _sum / _count << " ms, max " << _max << " ms, last " << _last << " ms" << std::endl;
+	}
+
+private:
+	uint64_t	_count = 0;
+	double		_sum = 0.0;
+	double		_max = 0.0;
+	double		_last = 0.0;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// perceptual image comparison for golden-image regression runs. the per-pixel metric is the
+// YIQ-weighted distance used by pixelmatch, which tracks visible difference much better than RGB
+// distance. a small fraction of differing pixels is tolerated so rasterizer edge rules of different
+// software devices (lavapipe, SwiftShader) don't fail the run.
+namespace GoldenImage
+{
+	struct CompareResult
+	{
+		uint64_t				mismatchedPixels = 0;
+		uint64_t				totalPixels = 0;
+		double					maxDelta = 0.0;		// 0..1, normalized YIQ distance
+		std::vector<uint8_t>	diff;				// RGBA8, red where pixels differ
+
+		double MismatchFraction() const
+		{
+			return totalPixels ? double(mismatchedPixels) / double(totalPixels) : 0.0;
+		}
+	};
+
+	// squared YIQ distance of two RGBA8 pixels blended over white, normalized to 0..1
+	inline double ColorDelta(const uint8_t* a, const uint8_t* b)
+	{
+		auto blend = [](uint8_t c, uint8_t alpha) { return 255.0 + (c - 255.0) * (alpha / 255.0); };
+
+		double r1 = blend(a[0], a[3]), g1 = blend(a[1], a[3]), b1 = blend(a[2], a[3]);
+		double r2 = blend(b[0], b[3]), g2 = blend(b[1], b[3]), b2 = blend(b[2], b[3]);
+
+		double y = (r1 - r2) * 0.29889531 + (g1 - g2) * 0.58662247 + (b1 - b2) * 0.11448223;
+		double i = (r1 - r2) * 0.59597799 - (g1 - g2) * 0.27417610 - (b1 - b2) * 0.32180189;
+		double q = (r1 - r2) * 0.21147017 - (g1 - g2) * 0.52261711 + (b1 - b2) * 0.31114694;
+
+		const double maxDelta = 35215.0;
+		return (0.5053 * y * y + 0.299 * i * i + 0.1957 * q * q) / maxDelta;
+	}
+
+	// threshold is on the 0..1 scale of pixelmatch (0.1 is its default)
+	inline CompareResult Compare(const std::vector<uint8_t>& expected, const std::vector<uint8_t>& actual, uint32_t width, uint32_t height, double threshold)
+	{
+		CompareResult result;
+		result.totalPixels = uint64_t(width) * height;
+		result.diff.resize(size_t(result.totalPixels) * 4);
+
+		double limit = threshold * threshold;
+		for (size_t p = 0; p < result.totalPixels; p++)
+		{
+			double delta = ColorDelta(&expected[p * 4], &actual[p * 4]);
+			result.maxDelta = std::max(result.maxDelta, std::sqrt(delta));
+
+			uint8_t* out = &result.diff[p * 4];
+			if (delta > limit)
+			{
+				result.mismatchedPixels++;
+				out[0] = 255; out[1] = 0; out[2] = 0; out[3] = 255;
+			}
+			else
+			{
+				// faded grayscale of the expected image for context
+				uint8_t gray = uint8_t(255 - (255 - (expected[p * 4] * 3 + expected[p * 4 + 1] * 6 + expected[p * 4 + 2]) / 10) / 4);
+				out[0] = out[1] = out[2] = gray; out[3] = 255;
+			}
+		}
+		return result;
+	}
+
+	// frame time baselines are a single number in a text file next to the golden image
+	inline bool ReadBaseline(const std::string& path, double& frameMs)
+	{
+		std::ifstream file(path);
+		return bool(file >> frameMs);
+	}
+
+	inline void WriteBaseline(const std::string& path, double frameMs)
+	{
+		std::ofstream file(path);
+		file << frameMs << std::endl;
+	}
+
+	inline double Median(std::vector<double> values)
+	{
+		if (values.empty())
+			return 0.0;
+		std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+		return values[values.size() / 2];
+	}
+}
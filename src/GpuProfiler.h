@@ -0,0 +1,248 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+// GPU time of named scopes in the frame's command buffer, from timestamp queries. every frame slot
+// owns a range of the query pool and reads it back once the slot's fence has been waited on, so the
+// results never stall the frame that wrote them. a device whose queue has no timestamps measures nothing.
+// with VK_EXT_debug_utils every Scope is also a command buffer label, measured or not
+class GpuProfiler
+{
+public:
+	static const uint32_t MaxScopes = 32;	// per frame
+
+	struct ScopeStats
+	{
+		const char*	name = nullptr;
+		uint64_t	frames = 0;
+		double		totalMs = 0.0;
+		double		maxMs = 0.0;
+		double		lastMs = 0.0;
+
+		double AverageMs() const { return frames > 0 ? totalMs / double(frames) : 0.0; }
+	};
+
+	// a scope's span on the device's timestamp clock
+	struct Interval
+	{
+		const char*	name;
+		double		beginMs;
+		double		endMs;
+	};
+
+	// records the commands between construction and destruction as one scope
+	class Scope
+	{
+	public:
+		Scope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char* name)
+			: _profiler(profiler), _commandBuffer(commandBuffer), _query(profiler.Begin(commandBuffer, name))
+		{
+			_profiler.BeginLabel(commandBuffer, name);
+		}
+
+		~Scope()
+		{
+			_profiler.EndLabel(_commandBuffer);
+			_profiler.End(_commandBuffer, _query);
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		GpuProfiler&	_profiler;
+		VkCommandBuffer	_commandBuffer;
+		uint32_t		_query;
+	};
+
+	GpuProfiler(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t frameSlots)
+		: _device(device), _slots(frameSlots)
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+		uint32_t validBits = families[queueFamily].timestampValidBits;
+		if (validBits == 0 || properties.limits.timestampPeriod == 0.0f)
+			return;
+
+		_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		_nanosecondsPerTick = properties.limits.timestampPeriod;
+
+		VkQueryPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = frameSlots * MaxScopes * 2;
+		if (vkCreateQueryPool(_device, &poolInfo, nullptr, &_queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create timestamp query pool");
+		}
+	}
+
+	~GpuProfiler()
+	{
+		vkDestroyQueryPool(_device, _queryPool, nullptr);
+	}
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	bool Enabled() const { return _queryPool != VK_NULL_HANDLE; }
+
+	void SetLabels(PFN_vkCmdBeginDebugUtilsLabelEXT beginLabel, PFN_vkCmdEndDebugUtilsLabelEXT endLabel)
+	{
+		_beginLabel = beginLabel;
+		_endLabel = endLabel;
+	}
+
+	// labels can't span command buffers the way Begin and End may, so they're separate
+	void BeginLabel(VkCommandBuffer commandBuffer, const char* name)
+	{
+		if (_beginLabel == nullptr || _endLabel == nullptr)
+			return;
+
+		VkDebugUtilsLabelEXT label = { VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT };
+		label.pLabelName = name;
+		_beginLabel(commandBuffer, &label);
+	}
+
+	void EndLabel(VkCommandBuffer commandBuffer)
+	{
+		if (_beginLabel != nullptr && _endLabel != nullptr)
+		{
+			_endLabel(commandBuffer);
+		}
+	}
+
+	// first thing in the frame's command buffer, after the slot's fence: collects what the slot
+	// measured last time around and resets its queries for this frame
+	void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+	{
+		_current = frameSlot;
+		_lastFrame.clear();
+		if (!Enabled())
+			return;
+
+		Slot& slot = _slots[frameSlot];
+		if (!slot.scopes.empty())
+		{
+			std::vector<uint64_t> timestamps(slot.scopes.size() * 2);
+			VkResult result = vkGetQueryPoolResults(_device, _queryPool, _firstQuery(frameSlot), uint32_t(timestamps.size()),
+				timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (result == VK_SUCCESS)
+			{
+				for (size_t i = 0; i < slot.scopes.size(); i++)
+				{
+					uint64_t ticks = ((timestamps[i * 2 + 1] & _timestampMask) - (timestamps[i * 2] & _timestampMask)) & _timestampMask;
+					_record(slot.scopes[i], double(ticks) * _nanosecondsPerTick * 1e-6);
+
+					double beginMs = double(timestamps[i * 2] & _timestampMask) * _nanosecondsPerTick * 1e-6;
+					_lastFrame.push_back({ slot.scopes[i], beginMs, beginMs + double(ticks) * _nanosecondsPerTick * 1e-6 });
+				}
+			}
+			slot.scopes.clear();
+		}
+
+		vkCmdResetQueryPool(commandBuffer, _queryPool, _firstQuery(frameSlot), MaxScopes * 2);
+	}
+
+	// returns the query pair to pass to End. scopes past MaxScopes in a frame aren't measured
+	uint32_t Begin(VkCommandBuffer commandBuffer, const char* name)
+	{
+		Slot& slot = _slots[_current];
+		if (!Enabled() || slot.scopes.size() >= MaxScopes)
+			return UINT32_MAX;
+
+		uint32_t query = _firstQuery(_current) + uint32_t(slot.scopes.size()) * 2;
+		slot.scopes.push_back(name);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _queryPool, query);
+		return query;
+	}
+
+	void End(VkCommandBuffer commandBuffer, uint32_t query)
+	{
+		if (query == UINT32_MAX)
+			return;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _queryPool, query + 1);
+	}
+
+	// the scopes of the frame the last BeginFrame collected, for lining up queues against each other
+	const std::vector<Interval>& LastFrame() const
+	{
+		return _lastFrame;
+	}
+
+	// a scope that wasn't recorded yet returns null
+	const ScopeStats* Find(const char* name) const
+	{
+		for (const ScopeStats& stats : _stats)
+		{
+			if (strcmp(stats.name, name) == 0)
+				return &stats;
+		}
+		return nullptr;
+	}
+
+	void Report(std::ostream& out, const char* queue = "graphics") const
+	{
+		if (!Enabled())
+		{
+			out << "gpu profiler: no timestamp support on the " << queue << " queue" << std::endl;
+			return;
+		}
+
+		out << "gpu profiler (" << queue << " queue):" << std::endl;
+		for (const ScopeStats& stats : _stats)
+		{
+			out << "  " << stats.name << ": avg " << stats.AverageMs() << " ms, max " << stats.maxMs << " ms, last "
+				<< stats.lastMs << " ms over " << stats.frames << " frames" << std::endl;
+		}
+	}
+
+private:
+	struct Slot
+	{
+		std::vector<const char*>	scopes;		// in query order, recorded since the last BeginFrame
+	};
+
+	uint32_t _firstQuery(uint32_t frameSlot) const
+	{
+		return frameSlot * MaxScopes * 2;
+	}
+
+	// scopes are told apart by name, the literal's address may differ between translation units
+	void _record(const char* name, double ms)
+	{
+		ScopeStats* stats = const_cast<ScopeStats*>(Find(name));
+		if (stats == nullptr)
+		{
+			_stats.push_back({ name });
+			stats = &_stats.back();
+		}
+		stats->frames++;
+		stats->totalMs += ms;
+		stats->maxMs = std::max(stats->maxMs, ms);
+		stats->lastMs = ms;
+	}
+
+	VkDevice					_device;
+	VkQueryPool					_queryPool = VK_NULL_HANDLE;
+	uint64_t					_timestampMask = 0;
+	double						_nanosecondsPerTick = 0.0;
+	std::vector<Slot>			_slots;
+	uint32_t					_current = 0;
+	std::vector<ScopeStats>		_stats;
+	std::vector<Interval>		_lastFrame;
+	PFN_vkCmdBeginDebugUtilsLabelEXT _beginLabel = nullptr;
+	PFN_vkCmdEndDebugUtilsLabelEXT _endLabel = nullptr;
+};
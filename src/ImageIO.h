@@ -0,0 +1,455 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// minimal PNG read/write and file helpers for captures and golden images. no zlib dependency:
+// the writer emits stored deflate blocks and the reader carries a small inflater.
+namespace ImageIO
+{
+	inline uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+	{
+		static const std::array<uint32_t, 256> table = []()
+		{
+			std::array<uint32_t, 256> t = {};
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	inline uint32_t Adler32(const uint8_t* data, size_t size)
+	{
+		uint32_t a = 1, b = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			a = (a + data[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	inline void PutBigEndian(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back(uint8_t(value >> 24));
+		out.push_back(uint8_t(value >> 16));
+		out.push_back(uint8_t(value >> 8));
+		out.push_back(uint8_t(value));
+	}
+
+	inline uint32_t GetBigEndian(const uint8_t* in)
+	{
+		return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | uint32_t(in[3]);
+	}
+
+	inline void SwapRedBlue(std::vector<uint8_t>& pixels)
+	{
+		for (size_t i = 0; i + 3 < pixels.size(); i += 4)
+			std::swap(pixels[i], pixels[i + 2]);
+	}
+
+	inline std::vector<uint8_t> ReadFile(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open " + path);
+		}
+
+		std::vector<uint8_t> data(size_t(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(data.data()), data.size());
+		return data;
+	}
+
+	inline void WriteFile(const std::string& path, const uint8_t* data, size_t size)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open " + path);
+		}
+		file.write(reinterpret_cast<const char*>(data), size);
+	}
+
+	// RGBA8 PNG with stored (uncompressed) deflate blocks. encoding stays cheap enough to keep up
+	// with the frame rate; recompress offline if size matters.
+	inline std::vector<uint8_t> EncodePng(const uint8_t* rgba, uint32_t width, uint32_t height)
+	{
+		std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+		auto writeChunk = [&png](const char* type, const std::vector<uint8_t>& data)
+		{
+			PutBigEndian(png, uint32_t(data.size()));
+			size_t typeOffset = png.size();
+			png.insert(png.end(), type, type + 4);
+			png.insert(png.end(), data.begin(), data.end());
+			PutBigEndian(png, Crc32(png.data() + typeOffset, data.size() + 4));
+		};
+
+		std::vector<uint8_t> header;
+		PutBigEndian(header, width);
+		PutBigEndian(header, height);
+		header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bit, RGBA, deflate, no filter, no interlace
+		writeChunk("IHDR", header);
+
+		// scanlines with filter type 0
+		size_t rowBytes = size_t(width) * 4;
+		std::vector<uint8_t> raw;
+		raw.reserve((rowBytes + 1) * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			raw.push_back(0);
+			raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+		}
+
+		std::vector<uint8_t> zlib = { 0x78, 0x01 };
+		size_t offset = 0;
+		do
+		{
+			size_t blockSize = std::min<size_t>(raw.size() - offset, 65535);
+			bool last = offset + blockSize == raw.size();
+			zlib.push_back(last ? 1 : 0);
+			zlib.push_back(uint8_t(blockSize));
+			zlib.push_back(uint8_t(blockSize >> 8));
+			zlib.push_back(uint8_t(~blockSize));
+			zlib.push_back(uint8_t(~blockSize >> 8));
+			zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+			offset += blockSize;
+		} while (offset < raw.size());
+
+		PutBigEndian(zlib, Adler32(raw.data(), raw.size()));
+		writeChunk("IDAT", zlib);
+
+		writeChunk("IEND", {});
+		return png;
+	}
+
+	// RFC 1951 decoder, enough for zlib streams written by any PNG tool
+	class Inflater
+	{
+	public:
+		Inflater(const uint8_t* data, size_t size)
+			: _data(data), _size(size)
+		{
+		}
+
+		std::vector<uint8_t> Run()
+		{
+			std::vector<uint8_t> out;
+			bool last = false;
+			while (!last)
+			{
+				last = _bits(1) != 0;
+				uint32_t type = _bits(2);
+				if (type == 0)
+					_stored(out);
+				else if (type == 1)
+					_compressed(out, _fixedLiterals(), _fixedDistances());
+				else if (type == 2)
+					_dynamic(out);
+				else
+					throw std::runtime_error("inflate: invalid block type");
+			}
+			return out;
+		}
+
+	private:
+		struct Huffman
+		{
+			uint16_t				counts[16] = {};
+			std::vector<uint16_t>	symbols;
+		};
+
+		static Huffman _build(const uint8_t* lengths, size_t count)
+		{
+			Huffman h;
+			h.symbols.resize(count);
+			for (size_t i = 0; i < count; i++)
+				h.counts[lengths[i]]++;
+			h.counts[0] = 0;
+
+			uint16_t offsets[16] = {};
+			for (int i = 1; i < 16; i++)
+				offsets[i] = offsets[i - 1] + h.counts[i - 1];
+			for (size_t i = 0; i < count; i++)
+			{
+				if (lengths[i] != 0)
+					h.symbols[offsets[lengths[i]]++] = uint16_t(i);
+			}
+			return h;
+		}
+
+		static const Huffman& _fixedLiterals()
+		{
+			static const Huffman h = []()
+			{
+				uint8_t lengths[288];
+				std::fill(lengths, lengths + 144, 8);
+				std::fill(lengths + 144, lengths + 256, 9);
+				std::fill(lengths + 256, lengths + 280, 7);
+				std::fill(lengths + 280, lengths + 288, 8);
+				return _build(lengths, 288);
+			}();
+			return h;
+		}
+
+		static const Huffman& _fixedDistances()
+		{
+			static const Huffman h = []()
+			{
+				uint8_t lengths[30];
+				std::fill(lengths, lengths + 30, 5);
+				return _build(lengths, 30);
+			}();
+			return h;
+		}
+
+		uint32_t _bits(int count)
+		{
+			while (_bitCount < count)
+			{
+				if (_pos >= _size)
+					throw std::runtime_error("inflate: unexpected end of data");
+				_bitBuffer |= uint32_t(_data[_pos++]) << _bitCount;
+				_bitCount += 8;
+			}
+			uint32_t value = _bitBuffer & ((1u << count) - 1);
+			_bitBuffer >>= count;
+			_bitCount -= count;
+			return value;
+		}
+
+		// canonical codes are read MSB first, one bit at a time
+		int _decode(const Huffman& h)
+		{
+			int code = 0, first = 0, index = 0;
+			for (int length = 1; length < 16; length++)
+			{
+				code |= int(_bits(1));
+				int count = h.counts[length];
+				if (code - first < count)
+					return h.symbols[index + code - first];
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+			throw std::runtime_error("inflate: invalid huffman code");
+		}
+
+		void _stored(std::vector<uint8_t>& out)
+		{
+			_bitBuffer = 0;
+			_bitCount = 0;
+			if (_pos + 4 > _size)
+				throw std::runtime_error("inflate: truncated stored block");
+			uint32_t length = _data[_pos] | (_data[_pos + 1] << 8);
+			uint32_t inverse = _data[_pos + 2] | (_data[_pos + 3] << 8);
+			_pos += 4;
+			if (length != (~inverse & 0xFFFF) || _pos + length > _size)
+				throw std::runtime_error("inflate: corrupt stored block");
+			out.insert(out.end(), _data + _pos, _data + _pos + length);
+			_pos += length;
+		}
+
+		void _dynamic(std::vector<uint8_t>& out)
+		{
+			static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+			uint32_t literalCount = _bits(5) + 257;
+			uint32_t distanceCount = _bits(5) + 1;
+			uint32_t codeCount = _bits(4) + 4;
+
+			uint8_t codeLengths[19] = {};
+			for (uint32_t i = 0; i < codeCount; i++)
+				codeLengths[order[i]] = uint8_t(_bits(3));
+			Huffman codes = _build(codeLengths, 19);
+
+			uint8_t lengths[320] = {};
+			uint32_t n = 0;
+			while (n < literalCount + distanceCount)
+			{
+				int symbol = _decode(codes);
+				if (symbol < 16)
+				{
+					lengths[n++] = uint8_t(symbol);
+					continue;
+				}
+
+				uint8_t value = 0;
+				uint32_t repeat = 0;
+				if (symbol == 16)
+				{
+					if (n == 0)
+						throw std::runtime_error("inflate: repeat with no previous length");
+					value = lengths[n - 1];
+					repeat = 3 + _bits(2);
+				}
+				else if (symbol == 17)
+					repeat = 3 + _bits(3);
+				else
+					repeat = 11 + _bits(7);
+
+				if (n + repeat > literalCount + distanceCount)
+					throw std::runtime_error("inflate: too many code lengths");
+				while (repeat--)
+					lengths[n++] = value;
+			}
+
+			Huffman literals = _build(lengths, literalCount);
+			Huffman distances = _build(lengths + literalCount, distanceCount);
+			_compressed(out, literals, distances);
+		}
+
+		void _compressed(std::vector<uint8_t>& out, const Huffman& literals, const Huffman& distances)
+		{
+			static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			static const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+			for (;;)
+			{
+				int symbol = _decode(literals);
+				if (symbol < 256)
+				{
+					out.push_back(uint8_t(symbol));
+					continue;
+				}
+				if (symbol == 256)
+					return;
+
+				symbol -= 257;
+				if (symbol >= 29)
+					throw std::runtime_error("inflate: invalid length symbol");
+				size_t length = lengthBase[symbol] + _bits(lengthExtra[symbol]);
+
+				int distanceSymbol = _decode(distances);
+				if (distanceSymbol >= 30)
+					throw std::runtime_error("inflate: invalid distance symbol");
+				size_t distance = distanceBase[distanceSymbol] + _bits(distanceExtra[distanceSymbol]);
+				if (distance > out.size())
+					throw std::runtime_error("inflate: distance too far back");
+
+				size_t from = out.size() - distance;
+				for (size_t i = 0; i < length; i++)
+					out.push_back(out[from + i]);
+			}
+		}
+
+		const uint8_t*	_data;
+		size_t			_size;
+		size_t			_pos = 0;
+		uint32_t		_bitBuffer = 0;
+		int				_bitCount = 0;
+	};
+
+	// 8-bit RGB or RGBA, non-interlaced PNG to RGBA8
+	inline std::vector<uint8_t> DecodePng(const std::vector<uint8_t>& png, uint32_t& width, uint32_t& height)
+	{
+		static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		if (png.size() < 8 || !std::equal(signature, signature + 8, png.begin()))
+			throw std::runtime_error("not a PNG file");
+
+		uint8_t colorType = 0;
+		std::vector<uint8_t> zlib;
+		size_t pos = 8;
+		while (pos + 12 <= png.size())
+		{
+			uint32_t length = GetBigEndian(&png[pos]);
+			if (pos + 12 + length > png.size())
+				throw std::runtime_error("PNG: truncated chunk");
+			std::string type(reinterpret_cast<const char*>(&png[pos + 4]), 4);
+			const uint8_t* data = &png[pos + 8];
+
+			if (type == "IHDR")
+			{
+				width = GetBigEndian(data);
+				height = GetBigEndian(data + 4);
+				colorType = data[9];
+				if (data[8] != 8 || (colorType != 2 && colorType != 6) || data[12] != 0)
+					throw std::runtime_error("PNG: only 8-bit non-interlaced RGB/RGBA is supported");
+			}
+			else if (type == "IDAT")
+			{
+				zlib.insert(zlib.end(), data, data + length);
+			}
+			else if (type == "IEND")
+			{
+				break;
+			}
+			pos += 12 + length;
+		}
+
+		if (zlib.size() < 6)
+			throw std::runtime_error("PNG: missing image data");
+		std::vector<uint8_t> raw = Inflater(zlib.data() + 2, zlib.size() - 6).Run();
+
+		size_t channels = colorType == 6 ? 4 : 3;
+		size_t stride = size_t(width) * channels;
+		if (raw.size() < (stride + 1) * height)
+			throw std::runtime_error("PNG: not enough image data");
+
+		// undo the per-scanline filters in place
+		std::vector<uint8_t> previous(stride, 0);
+		std::vector<uint8_t> rgba(size_t(width) * height * 4);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			uint8_t filter = raw[y * (stride + 1)];
+			uint8_t* row = &raw[y * (stride + 1) + 1];
+			for (size_t x = 0; x < stride; x++)
+			{
+				int a = x >= channels ? row[x - channels] : 0;
+				int b = previous[x];
+				int c = x >= channels ? previous[x - channels] : 0;
+				int predictor = 0;
+				switch (filter)
+				{
+				case 0: predictor = 0; break;
+				case 1: predictor = a; break;
+				case 2: predictor = b; break;
+				case 3: predictor = (a + b) / 2; break;
+				case 4:
+				{
+					int p = a + b - c;
+					int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+					predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+					break;
+				}
+				default:
+					throw std::runtime_error("PNG: invalid filter type");
+				}
+				row[x] = uint8_t(row[x] + predictor);
+			}
+			std::copy(row, row + stride, previous.begin());
+
+			for (uint32_t x = 0; x < width; x++)
+			{
+				uint8_t* dst = &rgba[(size_t(y) * width + x) * 4];
+				const uint8_t* src = row + x * channels;
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+				dst[3] = channels == 4 ? src[3] : 255;
+			}
+		}
+		return rgba;
+	}
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ImageIO.h"
+#include "Zstd.h"
+
+// KTX2 container reading: single 2D images in the block formats the streamer can upload as they are, or RGBA8.
+// levels may be Zstd or zlib supercompressed. Basis Universal payloads (vkFormat UNDEFINED, ETC1S or UASTC)
+// need the Basis transcoder, which isn't built in; encode those files to a BCn, ETC2 or ASTC vkFormat instead
+namespace Ktx2
+{
+	struct FormatInfo
+	{
+		uint32_t	blockWidth;
+		uint32_t	blockHeight;
+		uint32_t	blockBytes;
+	};
+
+	// the formats a KTX2 may hold for the streamer, false for anything else
+	inline bool GetFormatInfo(VkFormat format, FormatInfo& info)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			info = { 1, 1, 4 };
+			return true;
+
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+		case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+		case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+			info = { 4, 4, 8 };
+			return true;
+
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC5_SNORM_BLOCK:
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+		case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+		case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+			info = { 4, 4, 16 };
+			return true;
+
+		default:
+			break;
+		}
+
+		// ASTC LDR, every footprint is 16 bytes. the enum runs through the footprints in UNORM, SRGB pairs
+		static const uint8_t astcFootprints[14][2] = { { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 }, { 8, 8 },
+			{ 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 } };
+		if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+		{
+			const uint8_t* footprint = astcFootprints[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+			info = { footprint[0], footprint[1], 16 };
+			return true;
+		}
+		return false;
+	}
+
+	inline size_t LevelBytes(const FormatInfo& info, uint32_t width, uint32_t height)
+	{
+		return size_t((width + info.blockWidth - 1) / info.blockWidth) * ((height + info.blockHeight - 1) / info.blockHeight) * info.blockBytes;
+	}
+
+	// level 0 first, each tightly packed in the format's blocks
+	struct Image
+	{
+		VkFormat							format = VK_FORMAT_UNDEFINED;
+		uint32_t							width = 0;
+		uint32_t							height = 0;
+		std::vector<std::vector<uint8_t>>	levels;
+	};
+
+	inline bool IsKtx2(const std::vector<uint8_t>& file)
+	{
+		static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+		return file.size() >= 12 && std::equal(identifier, identifier + 12, file.begin());
+	}
+
+	inline Image Decode(const std::vector<uint8_t>& file)
+	{
+		if (!IsKtx2(file))
+			throw std::runtime_error("not a KTX2 file");
+		if (file.size() < 80)
+			throw std::runtime_error("KTX2: truncated header");
+
+		auto read32 = [&](size_t pos) { return uint32_t(file[pos]) | uint32_t(file[pos + 1]) << 8 | uint32_t(file[pos + 2]) << 16 | uint32_t(file[pos + 3]) << 24; };
+		auto read64 = [&](size_t pos) { return uint64_t(read32(pos)) | uint64_t(read32(pos + 4)) << 32; };
+
+		Image image;
+		image.format = VkFormat(read32(12));
+		image.width = read32(20);
+		image.height = read32(24);
+		uint32_t depth = read32(28);
+		uint32_t layers = read32(32);
+		uint32_t faces = read32(36);
+		uint32_t levelCount = std::max(read32(40), 1u);	// 0 asks the loader to generate the mips
+		uint32_t supercompression = read32(44);
+
+		if (image.format == VK_FORMAT_UNDEFINED || supercompression == 1)
+			throw std::runtime_error("KTX2: Basis Universal payloads aren't supported, encode to a BCn, ETC2 or ASTC format");
+		FormatInfo info;
+		if (!GetFormatInfo(image.format, info))
+			throw std::runtime_error("KTX2: unsupported vkFormat " + std::to_string(int(image.format)));
+		if (image.width == 0 || image.height == 0 || depth > 1 || layers > 1 || faces != 1)
+			throw std::runtime_error("KTX2: only single 2D images are supported");
+		if (supercompression > 3)
+			throw std::runtime_error("KTX2: unknown supercompression scheme " + std::to_string(supercompression));
+		if (levelCount > 32 || 80 + size_t(levelCount) * 24 > file.size())
+			throw std::runtime_error("KTX2: truncated level index");
+
+		for (uint32_t level = 0; level < levelCount; level++)
+		{
+			uint64_t offset = read64(80 + level * 24);
+			uint64_t length = read64(80 + level * 24 + 8);
+			uint64_t uncompressedLength = read64(80 + level * 24 + 16);
+			if (offset > file.size() || length > file.size() - offset)
+				throw std::runtime_error("KTX2: level " + std::to_string(level) + " is out of the file");
+
+			const uint8_t* data = file.data() + offset;
+			std::vector<uint8_t> levelData;
+			if (supercompression == 2)
+			{
+				levelData = Zstd::Decompress(data, size_t(length), size_t(uncompressedLength));
+			}
+			else if (supercompression == 3)
+			{
+				if (length < 6)
+					throw std::runtime_error("KTX2: truncated zlib level");
+				levelData = ImageIO::Inflater(data + 2, size_t(length) - 6).Run();
+			}
+			else
+			{
+				levelData.assign(data, data + length);
+			}
+
+			uint32_t width = std::max(image.width >> level, 1u);
+			uint32_t height = std::max(image.height >> level, 1u);
+			if (levelData.size() != LevelBytes(info, width, height))
+				throw std::runtime_error("KTX2: level " + std::to_string(level) + " has " + std::to_string(levelData.size()) + " bytes, expected " +
+					std::to_string(LevelBytes(info, width, height)));
+			image.levels.push_back(std::move(levelData));
+
+			if (width == 1 && height == 1)
+				break;
+		}
+		return image;
+	}
+}
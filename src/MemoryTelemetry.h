@@ -0,0 +1,288 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class MemoryCategory
+{
+	Mesh,		// vertex, index, meshlet and culling buffers
+	Texture,	// streamed texture residency
+	Staging,	// upload rings and readback slots
+	Transient,	// render targets and per-frame data that follow the swapchain
+	Other,
+	Count,
+};
+
+inline const char* MemoryCategoryName(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MemoryCategory::Mesh:		return "mesh";
+	case MemoryCategory::Texture:	return "texture";
+	case MemoryCategory::Staging:	return "staging";
+	case MemoryCategory::Transient:	return "transient";
+	case MemoryCategory::Other:		return "other";
+	default:						return "unknown";
+	}
+}
+
+// every device allocation of the renderer, per heap and per category, against the heaps' budgets.
+//
+// Update runs once per frame: it reads VK_EXT_memory_budget where the device has it (the process' usage and
+// budget per heap, which includes what the driver and other allocators took) and otherwise measures our own
+// allocations against the heap size. a heap past 'warnFraction' of its budget prints a warning when it gets
+// there and calls the eviction callbacks every frame it stays there, with how many bytes would bring it back.
+// a failed allocation writes the JSON snapshot before the caller throws, so an out-of-memory leaves data behind.
+class MemoryTelemetry
+{
+public:
+	// 'heap' is over its warning level by 'bytes'
+	using EvictionCallback = std::function<void(uint32_t heap, VkDeviceSize bytes)>;
+
+	MemoryTelemetry(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudgetSupported, double warnFraction, const std::string& dumpPath)
+		: _physicalDevice(physicalDevice), _device(device), _memoryBudgetSupported(memoryBudgetSupported), _warnFraction(warnFraction), _dumpPath(dumpPath)
+	{
+		vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &_memoryProperties);
+		_heaps.resize(_memoryProperties.memoryHeapCount);
+		Update(0);
+	}
+
+	MemoryTelemetry(const MemoryTelemetry&) = delete;
+	MemoryTelemetry& operator=(const MemoryTelemetry&) = delete;
+
+	// vkAllocateMemory, recorded under 'category'
+	VkResult Allocate(const VkMemoryAllocateInfo& allocInfo, MemoryCategory category, VkDeviceMemory* memory)
+	{
+		VkResult result = vkAllocateMemory(_device, &allocInfo, nullptr, memory);
+		uint32_t heap = _memoryProperties.memoryTypes[allocInfo.memoryTypeIndex].heapIndex;
+		if (result != VK_SUCCESS)
+		{
+			_failures++;
+			_lastFailure = { heap, category, allocInfo.allocationSize, allocInfo.memoryTypeIndex, result };
+			std::cerr << "memory: allocating " << allocInfo.allocationSize << " bytes of " << MemoryCategoryName(category) << " memory from heap "
+				<< heap << " failed (" << result << ")" << std::endl;
+			if (!_dumpPath.empty())
+			{
+				DumpJson(_dumpPath);
+			}
+			return result;
+		}
+
+		_allocations[*memory] = { heap, category, allocInfo.allocationSize };
+		Heap& stats = _heaps[heap];
+		stats.tracked += allocInfo.allocationSize;
+		stats.peakTracked = std::max(stats.peakTracked, stats.tracked);
+		stats.categories[size_t(category)] += allocInfo.allocationSize;
+
+		Category& categoryStats = _categories[size_t(category)];
+		categoryStats.bytes += allocInfo.allocationSize;
+		categoryStats.peakBytes = std::max(categoryStats.peakBytes, categoryStats.bytes);
+		categoryStats.allocations++;
+		return result;
+	}
+
+	// vkFreeMemory, null is fine
+	void Free(VkDeviceMemory memory)
+	{
+		auto allocation = _allocations.find(memory);
+		if (allocation != _allocations.end())
+		{
+			const Allocation& info = allocation->second;
+			_heaps[info.heap].tracked -= info.size;
+			_heaps[info.heap].categories[size_t(info.category)] -= info.size;
+			_categories[size_t(info.category)].bytes -= info.size;
+			_categories[size_t(info.category)].allocations--;
+			_allocations.erase(allocation);
+		}
+		vkFreeMemory(_device, memory, nullptr);
+	}
+
+	void AddEvictionCallback(const EvictionCallback& callback)
+	{
+		_evictionCallbacks.push_back(callback);
+	}
+
+	// once per frame, before anything of the frame allocates
+	void Update(uint64_t frame)
+	{
+		_frame = frame;
+
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+		if (_memoryBudgetSupported)
+		{
+			VkPhysicalDeviceMemoryProperties2 properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+			properties.pNext = &budget;
+			vkGetPhysicalDeviceMemoryProperties2(_physicalDevice, &properties);
+		}
+
+		for (uint32_t i = 0; i < _heaps.size(); i++)
+		{
+			Heap& heap = _heaps[i];
+			heap.usage = _memoryBudgetSupported ? budget.heapUsage[i] : heap.tracked;
+			heap.budget = _memoryBudgetSupported ? budget.heapBudget[i] : _memoryProperties.memoryHeaps[i].size;
+			heap.peakUsage = std::max(heap.peakUsage, heap.usage);
+
+			VkDeviceSize warnLevel = VkDeviceSize(double(heap.budget) * _warnFraction);
+			if (heap.budget == 0 || heap.usage <= warnLevel)
+			{
+				heap.nearBudget = false;
+				continue;
+			}
+
+			if (!heap.nearBudget)
+			{
+				_warnings++;
+				std::cerr << "memory: heap " << i << " at " << 100.0 * double(heap.usage) / double(heap.budget) << "% of its budget ("
+					<< heap.usage / (1024 * 1024) << " of " << heap.budget / (1024 * 1024) << " MB) in frame " << frame << ", evicting" << std::endl;
+			}
+			heap.nearBudget = true;
+			heap.pressuredFrames++;
+
+			for (const EvictionCallback& callback : _evictionCallbacks)
+			{
+				callback(i, heap.usage - warnLevel);
+			}
+		}
+	}
+
+	bool IsDeviceLocal(uint32_t heap) const
+	{
+		return (_memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	}
+
+	void WriteJson(std::ostream& out) const
+	{
+		out << "{\n";
+		out << "  \"frame\": " << _frame << ",\n";
+		out << "  \"budgetSource\": \"" << (_memoryBudgetSupported ? "VK_EXT_memory_budget" : "heap size") << "\",\n";
+		out << "  \"warnFraction\": " << _warnFraction << ",\n";
+		out << "  \"allocations\": " << _allocations.size() << ",\n";
+		out << "  \"warnings\": " << _warnings << ",\n";
+		out << "  \"failedAllocations\": " << _failures << ",\n";
+
+		out << "  \"heaps\": [\n";
+		for (uint32_t i = 0; i < _heaps.size(); i++)
+		{
+			const Heap& heap = _heaps[i];
+			out << "    { \"index\": " << i << ", \"size\": " << _memoryProperties.memoryHeaps[i].size << ", \"deviceLocal\": " << (IsDeviceLocal(i) ? "true" : "false")
+				<< ", \"budget\": " << heap.budget << ", \"usage\": " << heap.usage << ", \"peakUsage\": " << heap.peakUsage << ", \"tracked\": " << heap.tracked
+				<< ", \"peakTracked\": " << heap.peakTracked << ", \"pressuredFrames\": " << heap.pressuredFrames << ", \"categories\": {";
+			for (size_t category = 0; category < size_t(MemoryCategory::Count); category++)
+			{
+				out << (category > 0 ? ", " : " ") << "\"" << MemoryCategoryName(MemoryCategory(category)) << "\": " << heap.categories[category];
+			}
+			out << " } }" << (i + 1 < _heaps.size() ? "," : "") << "\n";
+		}
+		out << "  ],\n";
+
+		out << "  \"categories\": [\n";
+		for (size_t i = 0; i < size_t(MemoryCategory::Count); i++)
+		{
+			const Category& category = _categories[i];
+			out << "    { \"name\": \"" << MemoryCategoryName(MemoryCategory(i)) << "\", \"bytes\": " << category.bytes << ", \"peakBytes\": " << category.peakBytes
+				<< ", \"allocations\": " << category.allocations << " }" << (i + 1 < size_t(MemoryCategory::Count) ? "," : "") << "\n";
+		}
+		out << "  ]";
+
+		if (_failures > 0)
+		{
+			out << ",\n  \"lastFailure\": { \"heap\": " << _lastFailure.heap << ", \"memoryType\": " << _lastFailure.memoryType << ", \"category\": \""
+				<< MemoryCategoryName(_lastFailure.category) << "\", \"bytes\": " << _lastFailure.size << ", \"result\": " << _lastFailure.result << " }";
+		}
+		out << "\n}\n";
+	}
+
+	void DumpJson(const std::string& path) const
+	{
+		std::ofstream file(path);
+		if (!file)
+		{
+			std::cerr << "memory: can't write " << path << std::endl;
+			return;
+		}
+		WriteJson(file);
+	}
+
+	void Report(std::ostream& out) const
+	{
+		const double mb = 1.0 / (1024.0 * 1024.0);
+		out << "memory (" << (_memoryBudgetSupported ? "VK_EXT_memory_budget" : "no budget extension, heap sizes") << "): " << _warnings << " warnings, "
+			<< _failures << " failed allocations, " << _allocations.size() << " allocations live" << std::endl;
+		for (uint32_t i = 0; i < _heaps.size(); i++)
+		{
+			const Heap& heap = _heaps[i];
+			if (heap.peakTracked == 0)
+				continue;
+			out << "  heap " << i << (IsDeviceLocal(i) ? " (device local)" : "") << ": peak " << heap.peakUsage * mb << " MB of " << heap.budget * mb
+				<< " MB budget, ours at most " << heap.peakTracked * mb << " MB, " << heap.pressuredFrames << " frames near budget" << std::endl;
+		}
+		for (size_t i = 0; i < size_t(MemoryCategory::Count); i++)
+		{
+			const Category& category = _categories[i];
+			if (category.peakBytes == 0)
+				continue;
+			out << "  " << MemoryCategoryName(MemoryCategory(i)) << ": peak " << category.peakBytes * mb << " MB" << std::endl;
+		}
+	}
+
+private:
+	struct Allocation
+	{
+		uint32_t		heap;
+		MemoryCategory	category;
+		VkDeviceSize	size;
+	};
+
+	struct Heap
+	{
+		VkDeviceSize	tracked = 0;		// our allocations
+		VkDeviceSize	peakTracked = 0;
+		VkDeviceSize	usage = 0;			// the process', from the budget extension, or ours without it
+		VkDeviceSize	peakUsage = 0;
+		VkDeviceSize	budget = 0;
+		VkDeviceSize	categories[size_t(MemoryCategory::Count)] = {};
+		bool			nearBudget = false;
+		uint64_t		pressuredFrames = 0;
+	};
+
+	struct Category
+	{
+		VkDeviceSize	bytes = 0;
+		VkDeviceSize	peakBytes = 0;
+		uint64_t		allocations = 0;
+	};
+
+	struct Failure
+	{
+		uint32_t		heap = 0;
+		MemoryCategory	category = MemoryCategory::Other;
+		VkDeviceSize	size = 0;
+		uint32_t		memoryType = 0;
+		VkResult		result = VK_SUCCESS;
+	};
+
+	VkPhysicalDevice							_physicalDevice;
+	VkDevice									_device;
+	bool										_memoryBudgetSupported;
+	double										_warnFraction;
+	std::string									_dumpPath;		// written on a failed allocation, empty = never
+	VkPhysicalDeviceMemoryProperties			_memoryProperties;
+
+	std::unordered_map<VkDeviceMemory, Allocation>	_allocations;
+	std::vector<Heap>							_heaps;
+	Category									_categories[size_t(MemoryCategory::Count)];
+	std::vector<EvictionCallback>				_evictionCallbacks;
+	uint64_t									_frame = 0;
+	uint64_t									_warnings = 0;
+	uint64_t									_failures = 0;
+	Failure										_lastFailure;
+};
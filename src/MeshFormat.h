@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// .vkmesh: the optimized, quantized mesh the offline tool writes (see MeshOptimizer.h) and the renderer
+// uploads as is. little-endian, header followed by the vertex array and the index array.
+//
+// positions are snorm16 relative to the bounding box center, divided by the largest half extent, so
+// the pipeline's R16G16B16A16_SNORM fetch yields [-1, 1] and the mesh keeps its proportions.
+// normals are octahedral-encoded snorm16 pairs, texture coordinates are half floats.
+//
+// version 2 adds meshlets after the index array: the meshlet table, each meshlet's vertex indices
+// (into the vertex array) and its triangles, three local 8-bit indices packed per uint32.
+//
+// version 3 adds the LOD table at the end. every level is a range of the index array and of the
+// meshlet table, all levels share the vertex array. level 0 is the full mesh.
+namespace MeshFormat
+{
+	const char		Magic[4] = { 'V', 'K', 'M', 'S' };
+	const uint32_t	Version = 3;
+	const uint32_t	MaxLods = 8;
+
+	// sized so a meshlet fits one mesh shader workgroup's output on every vendor
+	const uint32_t	MaxMeshletVertices = 64;
+	const uint32_t	MaxMeshletTriangles = 124;
+
+	struct Header
+	{
+		char		magic[4];
+		uint32_t	version;
+		uint32_t	vertexCount;
+		uint32_t	indexCount;
+		uint32_t	indexSize;		// 2 or 4 bytes
+		uint32_t	meshletCount;
+		uint32_t	meshletVertexCount;
+		uint32_t	meshletTriangleCount;
+		uint32_t	lodCount;
+		float		center[3];		// object space bounding box center
+		float		extent;			// largest half extent, position = center + snorm * extent
+	};
+
+	struct Vertex
+	{
+		int16_t		position[4];	// w is padding, keeps the attribute 8 byte aligned
+		int16_t		normal[2];
+		uint16_t	uv[2];
+	};
+	static_assert(sizeof(Vertex) == 16, "vertex layout is shared with the pipeline's vertex input");
+
+	// bounds are in the normalized space the dequantized positions live in
+	struct Meshlet
+	{
+		uint32_t	vertexOffset;		// into meshletVertices
+		uint32_t	triangleOffset;		// into meshletTriangles
+		uint32_t	vertexCount;
+		uint32_t	triangleCount;
+		float		center[3];			// bounding sphere
+		float		radius;
+		float		coneAxis[3];		// average facing of the triangles
+		float		coneCutoff;			// sin of the normal cone's half angle, > 1 never culls
+	};
+	static_assert(sizeof(Meshlet) == 48, "meshlet layout is shared with the culling shaders (std430)");
+
+	struct Lod
+	{
+		uint32_t	indexOffset;
+		uint32_t	indexCount;
+		uint32_t	meshletOffset;
+		uint32_t	meshletCount;
+		float		error;			// geometric deviation from level 0, normalized units like the positions
+		uint32_t	padding[3];
+	};
+	static_assert(sizeof(Lod) == 32, "LOD layout is shared with the culling shaders (std430)");
+
+	struct Mesh
+	{
+		Header					header = {};
+		std::vector<Vertex>		vertices;
+		std::vector<uint8_t>	indices;	// indexSize bytes each
+		std::vector<Meshlet>	meshlets;
+		std::vector<uint32_t>	meshletVertices;
+		std::vector<uint32_t>	meshletTriangles;	// a | b << 8 | c << 16
+		std::vector<Lod>		lods;
+	};
+
+	inline int16_t QuantizeSnorm16(float v)
+	{
+		v = std::clamp(v, -1.0f, 1.0f);
+		return int16_t(std::lround(v * 32767.0f));
+	}
+
+	inline float DequantizeSnorm16(int16_t v)
+	{
+		return std::max(float(v) / 32767.0f, -1.0f);
+	}
+
+	// IEEE half, round to nearest even, flushes values below the half range to zero
+	inline uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+		uint32_t mantissa = bits & 0x7fffff;
+
+		if (((bits >> 23) & 0xff) == 0xff)
+			return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0));	// inf / nan
+		if (exponent >= 31)
+			return uint16_t(sign | 0x7c00);
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
+				return uint16_t(sign);
+			// denormal
+			mantissa |= 0x800000;
+			uint32_t shift = uint32_t(14 - exponent);
+			uint32_t half = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1)))
+				half++;
+			return uint16_t(sign | half);
+		}
+
+		uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+		uint32_t rest = mantissa & 0x1fff;
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+			half++;	// may carry into the exponent, which is the correct rounding
+		return uint16_t(half);
+	}
+
+	inline float HalfToFloat(uint16_t half)
+	{
+		uint32_t sign = uint32_t(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1f;
+		uint32_t mantissa = half & 0x3ff;
+
+		uint32_t bits;
+		if (exponent == 0)
+		{
+			if (mantissa == 0)
+			{
+				bits = sign;
+			}
+			else
+			{
+				// normalize the denormal
+				exponent = 127 - 15 + 1;
+				while ((mantissa & 0x400) == 0)
+				{
+					mantissa <<= 1;
+					exponent--;
+				}
+				bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+			}
+		}
+		else if (exponent == 31)
+		{
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else
+		{
+			bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		}
+
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// unit vector to the octahedron, folded into [-1, 1]^2
+	inline void EncodeOctahedral(const float n[3], int16_t out[2])
+	{
+		float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+		float x = l1 > 0.0f ? n[0] / l1 : 0.0f;
+		float y = l1 > 0.0f ? n[1] / l1 : 0.0f;
+		if (n[2] < 0.0f)
+		{
+			float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		out[0] = QuantizeSnorm16(x);
+		out[1] = QuantizeSnorm16(y);
+	}
+
+	// same decode as mesh.vert.glsl
+	inline void DecodeOctahedral(const int16_t in[2], float n[3])
+	{
+		float x = DequantizeSnorm16(in[0]);
+		float y = DequantizeSnorm16(in[1]);
+		float z = 1.0f - std::fabs(x) - std::fabs(y);
+		float t = std::max(-z, 0.0f);
+		x += x >= 0.0f ? -t : t;
+		y += y >= 0.0f ? -t : t;
+		float length = std::sqrt(x * x + y * y + z * z);
+		n[0] = x / length;
+		n[1] = y / length;
+		n[2] = z / length;
+	}
+
+	inline uint32_t Index(const Mesh& mesh, size_t i)
+	{
+		if (mesh.header.indexSize == 2)
+		{
+			uint16_t index;
+			memcpy(&index, &mesh.indices[i * 2], 2);
+			return index;
+		}
+		uint32_t index;
+		memcpy(&index, &mesh.indices[i * 4], 4);
+		return index;
+	}
+
+	inline void Write(const std::string& path, const Mesh& mesh)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open " + path + " for writing");
+		}
+		file.write(reinterpret_cast<const char*>(&mesh.header), sizeof(Header));
+		file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+		file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size());
+		file.write(reinterpret_cast<const char*>(mesh.meshlets.data()), mesh.meshlets.size() * sizeof(Meshlet));
+		file.write(reinterpret_cast<const char*>(mesh.meshletVertices.data()), mesh.meshletVertices.size() * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(mesh.meshletTriangles.data()), mesh.meshletTriangles.size() * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(mesh.lods.data()), mesh.lods.size() * sizeof(Lod));
+		if (!file)
+		{
+			throw std::runtime_error("Failed to write " + path);
+		}
+	}
+
+	inline Mesh Read(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open mesh " + path);
+		}
+
+		Mesh mesh;
+		file.read(reinterpret_cast<char*>(&mesh.header), sizeof(Header));
+		if (!file || memcmp(mesh.header.magic, Magic, sizeof(Magic)) != 0)
+		{
+			throw std::runtime_error(path + " is not a .vkmesh file");
+		}
+		if (mesh.header.version != Version || (mesh.header.indexSize != 2 && mesh.header.indexSize != 4) ||
+			mesh.header.lodCount == 0 || mesh.header.lodCount > MaxLods)
+		{
+			throw std::runtime_error(path + ": unsupported .vkmesh version " + std::to_string(mesh.header.version) + ", re-run --optimize-mesh");
+		}
+
+		mesh.vertices.resize(mesh.header.vertexCount);
+		mesh.indices.resize(size_t(mesh.header.indexCount) * mesh.header.indexSize);
+		file.read(reinterpret_cast<char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+		file.read(reinterpret_cast<char*>(mesh.indices.data()), mesh.indices.size());
+		mesh.meshlets.resize(mesh.header.meshletCount);
+		mesh.meshletVertices.resize(mesh.header.meshletVertexCount);
+		mesh.meshletTriangles.resize(mesh.header.meshletTriangleCount);
+		mesh.lods.resize(mesh.header.lodCount);
+		file.read(reinterpret_cast<char*>(mesh.meshlets.data()), mesh.meshlets.size() * sizeof(Meshlet));
+		file.read(reinterpret_cast<char*>(mesh.meshletVertices.data()), mesh.meshletVertices.size() * sizeof(uint32_t));
+		file.read(reinterpret_cast<char*>(mesh.meshletTriangles.data()), mesh.meshletTriangles.size() * sizeof(uint32_t));
+		file.read(reinterpret_cast<char*>(mesh.lods.data()), mesh.lods.size() * sizeof(Lod));
+		if (!file)
+		{
+			throw std::runtime_error(path + " is truncated");
+		}
+		return mesh;
+	}
+}
@@ -0,0 +1,1107 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "MeshFormat.h"
+
+// offline mesh processing: OBJ in, optimized and quantized .vkmesh out.
+//
+// the passes run in the usual order: vertex cache (Forsyth's linear-speed optimizer), overdraw
+// (Sander et al.'s cluster sort, cache-aware so it keeps most of the first pass's locality),
+// vertex fetch (vertices renumbered in first-use order), quantization, the LOD chain and finally meshlet
+// building, which keeps the optimized triangle order so meshlets come out spatially coherent.
+namespace MeshOptimizer
+{
+	// float attributes, deduplicated, three indices per triangle
+	struct SourceMesh
+	{
+		std::vector<float>		positions;	// xyz
+		std::vector<float>		normals;	// xyz
+		std::vector<float>		uvs;		// uv
+		std::vector<uint32_t>	indices;
+
+		size_t VertexCount() const { return positions.size() / 3; }
+	};
+
+	struct CacheStats
+	{
+		double	acmr = 0.0;		// vertex shader invocations per triangle, 0.5 is ideal for large grids, 3 is worst
+		double	atvr = 0.0;		// invocations per vertex, 1 is ideal
+	};
+
+	struct Report
+	{
+		size_t		vertexCount = 0;
+		size_t		triangleCount = 0;
+		CacheStats	before;
+		CacheStats	afterCache;
+		CacheStats	afterOverdraw;
+		size_t		bytesBefore = 0;		// float32 position/normal/uv, 32-bit indices
+		size_t		bytesAfter = 0;
+		float		positionPrecision = 0.0f;	// object space step of the quantized positions
+		size_t		meshletCount = 0;
+		double		trianglesPerMeshlet = 0.0;
+		double		verticesPerMeshlet = 0.0;
+		size_t		degenerateCones = 0;		// meshlets too curved to ever be cone culled
+		std::vector<size_t>	lodTriangles;
+		std::vector<float>	lodErrors;			// normalized units
+	};
+
+	const size_t MinLodTriangles = 64;		// not worth another level below this
+	const float MaxLodError = 0.1f;			// normalized units, coarser levels would only ever be a few pixels big
+
+	const uint32_t AnalyzeCacheSize = 16;	// FIFO, a common post-transform cache model
+
+	// FIFO post-transform cache simulation
+	inline CacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = AnalyzeCacheSize)
+	{
+		std::vector<uint32_t> timestamps(vertexCount, 0);
+		uint32_t timestamp = cacheSize + 1;
+		size_t misses = 0;
+
+		for (uint32_t index : indices)
+		{
+			if (timestamp - timestamps[index] > cacheSize)
+			{
+				timestamps[index] = timestamp++;
+				misses++;
+			}
+		}
+
+		CacheStats stats;
+		size_t triangles = indices.size() / 3;
+		stats.acmr = triangles ? double(misses) / triangles : 0.0;
+		stats.atvr = vertexCount ? double(misses) / vertexCount : 0.0;
+		return stats;
+	}
+
+	// a triangle that uses a vertex twice covers no pixels
+	inline bool IsDegenerate(uint32_t a, uint32_t b, uint32_t c)
+	{
+		return a == b || b == c || a == c;
+	}
+
+	// Forsyth, "Linear-Speed Vertex Cache Optimisation". degenerate triangles are dropped, they would count
+	// their vertex twice in the adjacency
+	inline std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& sourceIndices, size_t vertexCount)
+	{
+		const int CacheSize = 32;
+		std::vector<uint32_t> indices;
+		indices.reserve(sourceIndices.size());
+		for (size_t t = 0; t + 2 < sourceIndices.size(); t += 3)
+		{
+			if (!IsDegenerate(sourceIndices[t], sourceIndices[t + 1], sourceIndices[t + 2]))
+				indices.insert(indices.end(), &sourceIndices[t], &sourceIndices[t] + 3);
+		}
+		const size_t triangleCount = indices.size() / 3;
+
+		auto vertexScore = [](int cachePosition, uint32_t remainingTriangles)
+		{
+			if (remainingTriangles == 0)
+				return -1.0f;
+
+			float score = 0.0f;
+			if (cachePosition >= 0)
+			{
+				// the last triangle's vertices get a fixed score so the next triangle doesn't just reuse its edge
+				if (cachePosition < 3)
+					score = 0.75f;
+				else
+					score = std::pow(1.0f - float(cachePosition - 3) / float(CacheSize - 3), 1.5f);
+			}
+			// favor vertices with few triangles left, so they are finished off and leave the cache for good
+			score += 2.0f * std::pow(float(remainingTriangles), -0.5f);
+			return score;
+		};
+
+		// vertex -> triangle adjacency
+		std::vector<uint32_t> remaining(vertexCount, 0);
+		for (uint32_t index : indices)
+		{
+			remaining[index]++;
+		}
+		std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+		}
+		std::vector<uint32_t> adjacency(indices.size());
+		std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				adjacency[fill[indices[t * 3 + k]]++] = uint32_t(t);
+			}
+		}
+
+		std::vector<float> vertexScores(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			vertexScores[v] = vertexScore(-1, remaining[v]);
+		}
+		std::vector<float> triangleScores(triangleCount);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+		}
+
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> cache;
+		std::vector<uint32_t> newCache;
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+
+		size_t scanCursor = 0;
+		int64_t best = -1;
+
+		for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+		{
+			if (best < 0)
+			{
+				// nothing adjacent to the cache, continue with the next unused triangle
+				while (emitted[scanCursor])
+					scanCursor++;
+				best = int64_t(scanCursor);
+			}
+
+			uint32_t triangle = uint32_t(best);
+			emitted[triangle] = true;
+			const uint32_t* tri = &indices[size_t(triangle) * 3];
+			result.insert(result.end(), tri, tri + 3);
+
+			// the triangle's vertices go to the front of the LRU cache
+			newCache.assign(tri, tri + 3);
+			for (uint32_t v : cache)
+			{
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+					newCache.push_back(v);
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				remaining[tri[k]]--;
+			}
+
+			// rescore everything that was or is in the cache, the triangles around them follow
+			best = -1;
+			float bestScore = -1.0f;
+			for (size_t position = 0; position < newCache.size(); position++)
+			{
+				uint32_t v = newCache[position];
+				int cachePosition = position < size_t(CacheSize) ? int(position) : -1;
+				float score = vertexScore(cachePosition, remaining[v]);
+				float delta = score - vertexScores[v];
+				vertexScores[v] = score;
+
+				for (uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; a++)
+				{
+					uint32_t t = adjacency[a];
+					if (emitted[t])
+						continue;
+					triangleScores[t] += delta;
+					if (cachePosition >= 0 && triangleScores[t] > bestScore)
+					{
+						bestScore = triangleScores[t];
+						best = int64_t(t);
+					}
+				}
+			}
+
+			if (newCache.size() > size_t(CacheSize))
+				newCache.resize(CacheSize);
+			cache.swap(newCache);
+		}
+
+		return result;
+	}
+
+	// Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+	// splits the cache-optimized order into clusters where the cache restarts anyway (or where the
+	// running ACMR is within 'threshold' of the cluster's), then draws clusters that face outward first.
+	inline std::vector<uint32_t> OptimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<float>& positions, float threshold = 1.05f)
+	{
+		const uint32_t cacheSize = AnalyzeCacheSize;
+		const size_t triangleCount = indices.size() / 3;
+		const size_t vertexCount = positions.size() / 3;
+		if (triangleCount == 0)
+			return indices;
+
+		std::vector<uint32_t> timestamps(vertexCount, 0);
+		uint32_t timestamp = cacheSize + 1;
+		auto updateCache = [&](size_t triangle)
+		{
+			uint32_t misses = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = indices[triangle * 3 + k];
+				if (timestamp - timestamps[v] > cacheSize)
+				{
+					timestamps[v] = timestamp++;
+					misses++;
+				}
+			}
+			return misses;
+		};
+		auto resetCache = [&]() { timestamp += cacheSize + 1; };
+
+		// hard boundaries: all three vertices missed, which is where the optimizer started a new patch. the
+		// first triangle always starts one, whatever it missed
+		std::vector<size_t> hard = { 0 };
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			if (updateCache(t) == 3 && t > 0)
+				hard.push_back(t);
+		}
+		hard.push_back(triangleCount);
+
+		// soft boundaries inside each hard cluster
+		std::vector<size_t> clusters;
+		for (size_t h = 0; h + 1 < hard.size(); h++)
+		{
+			size_t start = hard[h], end = hard[h + 1];
+
+			resetCache();
+			uint32_t clusterMisses = 0;
+			for (size_t t = start; t < end; t++)
+			{
+				clusterMisses += updateCache(t);
+			}
+			float clusterThreshold = threshold * float(clusterMisses) / float(end - start);
+
+			clusters.push_back(start);
+			resetCache();
+			uint32_t runningMisses = 0, runningTriangles = 0;
+			for (size_t t = start; t < end; t++)
+			{
+				runningMisses += updateCache(t);
+				runningTriangles++;
+				if (float(runningMisses) / float(runningTriangles) <= clusterThreshold && t + 1 < end)
+				{
+					clusters.push_back(t + 1);
+					resetCache();
+					runningMisses = 0;
+					runningTriangles = 0;
+				}
+			}
+		}
+		clusters.push_back(triangleCount);
+
+		// area-weighted centroid and normal per cluster
+		auto position = [&](uint32_t v, int c) { return positions[size_t(v) * 3 + c]; };
+		double meshCentroid[3] = {}, meshArea = 0.0;
+		struct Cluster { size_t start, end; double centroid[3], normal[3]; double key; };
+		std::vector<Cluster> sorted;
+		for (size_t c = 0; c + 1 < clusters.size(); c++)
+		{
+			Cluster cluster = { clusters[c], clusters[c + 1], {}, {}, 0.0 };
+			double area = 0.0;
+			for (size_t t = cluster.start; t < cluster.end; t++)
+			{
+				uint32_t a = indices[t * 3], b = indices[t * 3 + 1], d = indices[t * 3 + 2];
+				double e1[3], e2[3], n[3];
+				for (int k = 0; k < 3; k++)
+				{
+					e1[k] = position(b, k) - position(a, k);
+					e2[k] = position(d, k) - position(a, k);
+				}
+				n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+				n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+				n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+				double triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+				for (int k = 0; k < 3; k++)
+				{
+					double center = (position(a, k) + position(b, k) + position(d, k)) / 3.0;
+					cluster.centroid[k] += center * triangleArea;
+					cluster.normal[k] += n[k];
+					meshCentroid[k] += center * triangleArea;
+				}
+				area += triangleArea;
+			}
+			meshArea += area;
+
+			double normalLength = std::sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+			for (int k = 0; k < 3; k++)
+			{
+				cluster.centroid[k] = area > 0.0 ? cluster.centroid[k] / area : 0.0;
+				cluster.normal[k] = normalLength > 0.0 ? cluster.normal[k] / normalLength : 0.0;
+			}
+			sorted.push_back(cluster);
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			meshCentroid[k] = meshArea > 0.0 ? meshCentroid[k] / meshArea : 0.0;
+		}
+
+		// clusters far out along their own normal are likely to occlude the rest, draw them first
+		for (Cluster& cluster : sorted)
+		{
+			cluster.key = 0.0;
+			for (int k = 0; k < 3; k++)
+			{
+				cluster.key += (cluster.centroid[k] - meshCentroid[k]) * cluster.normal[k];
+			}
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+		for (const Cluster& cluster : sorted)
+		{
+			result.insert(result.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+		}
+		return result;
+	}
+
+	// renumbers vertices in the order the index buffer first uses them, drops unreferenced ones
+	inline void OptimizeVertexFetch(SourceMesh& mesh)
+	{
+		const uint32_t unused = ~0u;
+		std::vector<uint32_t> remap(mesh.VertexCount(), unused);
+		uint32_t next = 0;
+		for (uint32_t& index : mesh.indices)
+		{
+			if (remap[index] == unused)
+				remap[index] = next++;
+			index = remap[index];
+		}
+
+		SourceMesh reordered;
+		reordered.positions.resize(size_t(next) * 3);
+		reordered.normals.resize(size_t(next) * 3);
+		reordered.uvs.resize(size_t(next) * 2);
+		for (size_t v = 0; v < remap.size(); v++)
+		{
+			if (remap[v] == unused)
+				continue;
+			std::copy_n(&mesh.positions[v * 3], 3, &reordered.positions[size_t(remap[v]) * 3]);
+			std::copy_n(&mesh.normals[v * 3], 3, &reordered.normals[size_t(remap[v]) * 3]);
+			std::copy_n(&mesh.uvs[v * 2], 2, &reordered.uvs[size_t(remap[v]) * 2]);
+		}
+		mesh.positions.swap(reordered.positions);
+		mesh.normals.swap(reordered.normals);
+		mesh.uvs.swap(reordered.uvs);
+	}
+
+	inline MeshFormat::Mesh Quantize(const SourceMesh& source)
+	{
+		MeshFormat::Mesh mesh;
+		memcpy(mesh.header.magic, MeshFormat::Magic, sizeof(MeshFormat::Magic));
+		mesh.header.version = MeshFormat::Version;
+		mesh.header.vertexCount = uint32_t(source.VertexCount());
+		mesh.header.indexCount = uint32_t(source.indices.size());
+		mesh.header.indexSize = source.VertexCount() <= 0xffff ? 2 : 4;
+
+		float minimum[3] = { INFINITY, INFINITY, INFINITY };
+		float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+		for (size_t v = 0; v < source.VertexCount(); v++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				minimum[k] = std::min(minimum[k], source.positions[v * 3 + k]);
+				maximum[k] = std::max(maximum[k], source.positions[v * 3 + k]);
+			}
+		}
+		float extent = 0.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			mesh.header.center[k] = source.VertexCount() ? (minimum[k] + maximum[k]) * 0.5f : 0.0f;
+			extent = std::max(extent, (maximum[k] - minimum[k]) * 0.5f);
+		}
+		mesh.header.extent = extent > 0.0f ? extent : 1.0f;
+
+		mesh.vertices.resize(source.VertexCount());
+		for (size_t v = 0; v < source.VertexCount(); v++)
+		{
+			MeshFormat::Vertex& vertex = mesh.vertices[v];
+			for (int k = 0; k < 3; k++)
+			{
+				vertex.position[k] = MeshFormat::QuantizeSnorm16((source.positions[v * 3 + k] - mesh.header.center[k]) / mesh.header.extent);
+			}
+			vertex.position[3] = 0;
+			MeshFormat::EncodeOctahedral(&source.normals[v * 3], vertex.normal);
+			vertex.uv[0] = MeshFormat::FloatToHalf(source.uvs[v * 2]);
+			vertex.uv[1] = MeshFormat::FloatToHalf(source.uvs[v * 2 + 1]);
+		}
+
+		mesh.indices.resize(source.indices.size() * mesh.header.indexSize);
+		for (size_t i = 0; i < source.indices.size(); i++)
+		{
+			if (mesh.header.indexSize == 2)
+			{
+				uint16_t index = uint16_t(source.indices[i]);
+				memcpy(&mesh.indices[i * 2], &index, 2);
+			}
+			else
+			{
+				memcpy(&mesh.indices[i * 4], &source.indices[i], 4);
+			}
+		}
+
+		MeshFormat::Lod lod = {};
+		lod.indexCount = mesh.header.indexCount;
+		mesh.lods.push_back(lod);
+		mesh.header.lodCount = 1;
+		return mesh;
+	}
+
+	// symmetric 4x4 plane quadric, Garland and Heckbert
+	struct Quadric
+	{
+		double	a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double	b0 = 0, b1 = 0, b2 = 0;
+		double	c = 0;
+		double	weight = 0;
+
+		void AddPlane(const double n[3], double d)
+		{
+			a00 += n[0] * n[0]; a01 += n[0] * n[1]; a02 += n[0] * n[2];
+			a11 += n[1] * n[1]; a12 += n[1] * n[2]; a22 += n[2] * n[2];
+			b0 += n[0] * d; b1 += n[1] * d; b2 += n[2] * d;
+			c += d * d;
+			weight += 1.0;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// mean squared distance to the accumulated planes
+		double Error(const float* p) const
+		{
+			if (weight == 0.0)
+				return 0.0;
+			double x = p[0], y = p[1], z = p[2];
+			double error = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+				2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			return std::max(error, 0.0) / weight;
+		}
+	};
+
+	// edge collapse simplification towards targetTriangles, never past maxError. vertices collapse onto a neighbour instead of
+	// a new optimal position, so every level indexes the same vertex buffer. vertices on an open border or
+	// an attribute seam (several vertices at one position) never move, keeping silhouettes and UV seams
+	// intact at the cost of some reduction on heavily seamed meshes. 'error' is the largest collapse
+	// error, as an RMS distance in the positions' units
+	inline std::vector<uint32_t> Simplify(const std::vector<uint32_t>& indices, const std::vector<float>& positions, size_t targetTriangles, float maxError, float& error)
+	{
+		const size_t vertexCount = positions.size() / 3;
+		auto position = [&](uint32_t v) { return &positions[size_t(v) * 3]; };
+
+		// vertices sharing a position form a seam
+		std::map<std::array<float, 3>, uint32_t> positionIds;
+		std::vector<uint32_t> positionId(vertexCount);
+		std::vector<uint32_t> verticesAtPosition;
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			std::array<float, 3> key = { positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2] };
+			auto inserted = positionIds.emplace(key, uint32_t(positionIds.size()));
+			positionId[v] = inserted.first->second;
+			if (inserted.second)
+				verticesAtPosition.push_back(0);
+			verticesAtPosition[positionId[v]]++;
+		}
+
+		// an edge without its opposite half is on a border
+		std::set<std::pair<uint32_t, uint32_t>> halfEdges;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				halfEdges.emplace(positionId[indices[i + k]], positionId[indices[i + (k + 1) % 3]]);
+			}
+		}
+		std::vector<bool> locked(vertexCount, false);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+				if (halfEdges.count({ positionId[b], positionId[a] }) == 0)
+				{
+					locked[a] = true;
+					locked[b] = true;
+				}
+			}
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			if (verticesAtPosition[positionId[v]] > 1)
+				locked[v] = true;
+		}
+
+		auto triangleNormal = [](const float* a, const float* b, const float* c, double n[3])
+		{
+			double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+			n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+			n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		};
+
+		std::vector<Quadric> quadrics(vertexCount);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			double n[3];
+			triangleNormal(position(indices[i]), position(indices[i + 1]), position(indices[i + 2]), n);
+			double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length == 0.0)
+				continue;
+			for (int k = 0; k < 3; k++)
+				n[k] /= length;
+			const float* p = position(indices[i]);
+			double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+			for (int k = 0; k < 3; k++)
+				quadrics[indices[i + k]].AddPlane(n, d);
+		}
+
+		std::vector<uint32_t> result = indices;
+		struct Collapse { uint32_t from, to; double cost; };
+		std::vector<Collapse> collapses;
+		std::vector<uint32_t> remap(vertexCount);
+		std::vector<bool> touched(vertexCount);
+		std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+		std::vector<uint32_t> adjacency;
+		double maxCost = 0.0;
+
+		// passes of independent collapses, cheapest first, until the target or nothing is left to collapse
+		while (result.size() / 3 > targetTriangles)
+		{
+			collapses.clear();
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t a = result[i + k], b = result[i + (k + 1) % 3];
+					Quadric q = quadrics[a];
+					q.Add(quadrics[b]);
+					if (!locked[a])
+						collapses.push_back({ a, b, q.Error(position(b)) });
+					if (!locked[b])
+						collapses.push_back({ b, a, q.Error(position(a)) });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+			// vertex -> triangle
+			std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+			for (uint32_t v : result)
+				adjacencyOffset[v + 1]++;
+			for (size_t v = 0; v < vertexCount; v++)
+				adjacencyOffset[v + 1] += adjacencyOffset[v];
+			adjacency.resize(result.size());
+			std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				adjacency[fill[result[i]]++] = uint32_t(i / 3);
+
+			for (size_t v = 0; v < vertexCount; v++)
+				remap[v] = uint32_t(v);
+			std::fill(touched.begin(), touched.end(), false);
+
+			size_t triangles = result.size() / 3;
+			size_t applied = 0;
+			for (const Collapse& collapse : collapses)
+			{
+				if (triangles <= targetTriangles || collapse.cost > double(maxError) * maxError)
+					break;
+				if (touched[collapse.from] || touched[collapse.to])
+					continue;
+
+				// reject collapses that would flip a triangle around 'from'
+				bool flips = false;
+				size_t removed = 0;
+				for (uint32_t a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1] && !flips; a++)
+				{
+					const uint32_t* tri = &result[size_t(adjacency[a]) * 3];
+					if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+					{
+						removed++;
+						continue;
+					}
+
+					const float* before[3];
+					const float* after[3];
+					for (int k = 0; k < 3; k++)
+					{
+						before[k] = position(tri[k]);
+						after[k] = tri[k] == collapse.from ? position(collapse.to) : before[k];
+					}
+					double n0[3], n1[3];
+					triangleNormal(before[0], before[1], before[2], n0);
+					triangleNormal(after[0], after[1], after[2], n1);
+					flips = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0;
+				}
+				if (flips)
+					continue;
+
+				// the neighbourhood changed, its other collapses wait for the next pass
+				for (uint32_t a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1]; a++)
+				{
+					const uint32_t* tri = &result[size_t(adjacency[a]) * 3];
+					touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+				}
+				remap[collapse.from] = collapse.to;
+				quadrics[collapse.to].Add(quadrics[collapse.from]);
+				maxCost = std::max(maxCost, collapse.cost);
+				triangles -= removed;
+				applied++;
+			}
+			if (applied == 0)
+				break;
+
+			size_t write = 0;
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+				if (a == b || b == c || a == c)
+					continue;
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+			result.resize(write);
+		}
+
+		error = float(std::sqrt(maxCost));
+		return result;
+	}
+
+	// halves the triangle count per level while the simplifier keeps up. level indices are appended to the
+	// index array, each level in vertex cache order
+	inline void BuildLods(MeshFormat::Mesh& mesh, Report& report)
+	{
+		std::vector<float> positions(mesh.vertices.size() * 3);
+		for (size_t v = 0; v < mesh.vertices.size(); v++)
+		{
+			for (int k = 0; k < 3; k++)
+				positions[v * 3 + k] = MeshFormat::DequantizeSnorm16(mesh.vertices[v].position[k]);
+		}
+
+		std::vector<std::vector<uint32_t>> levels(1);
+		std::vector<float> errors = { 0.0f };
+		for (size_t i = 0; i < mesh.header.indexCount; i++)
+		{
+			levels[0].push_back(MeshFormat::Index(mesh, i));
+		}
+
+		while (levels.size() < MeshFormat::MaxLods)
+		{
+			size_t triangles = levels.back().size() / 3;
+			if (triangles <= MinLodTriangles)
+				break;
+
+			float error = 0.0f;
+			std::vector<uint32_t> simplified = Simplify(levels.back(), positions, triangles / 2, MaxLodError - errors.back(), error);
+			if (simplified.size() / 3 > triangles * 9 / 10)
+				break;	// mostly locked, another level would cost memory for nothing
+
+			// errors add up since each level is simplified from the previous one
+			errors.push_back(errors.back() + error);
+			levels.push_back(OptimizeVertexCache(simplified, mesh.vertices.size()));
+		}
+
+		mesh.lods.clear();
+		mesh.indices.clear();
+		uint32_t indexOffset = 0;
+		for (size_t l = 0; l < levels.size(); l++)
+		{
+			MeshFormat::Lod lod = {};
+			lod.indexOffset = indexOffset;
+			lod.indexCount = uint32_t(levels[l].size());
+			lod.error = errors[l];
+			mesh.lods.push_back(lod);
+			indexOffset += lod.indexCount;
+
+			for (uint32_t index : levels[l])
+			{
+				if (mesh.header.indexSize == 2)
+				{
+					uint16_t narrow = uint16_t(index);
+					mesh.indices.insert(mesh.indices.end(), reinterpret_cast<uint8_t*>(&narrow), reinterpret_cast<uint8_t*>(&narrow) + 2);
+				}
+				else
+				{
+					mesh.indices.insert(mesh.indices.end(), reinterpret_cast<uint8_t*>(&index), reinterpret_cast<uint8_t*>(&index) + 4);
+				}
+			}
+
+			report.lodTriangles.push_back(levels[l].size() / 3);
+			report.lodErrors.push_back(errors[l]);
+		}
+		mesh.header.indexCount = indexOffset;
+		mesh.header.lodCount = uint32_t(mesh.lods.size());
+	}
+
+	// smallest-ish sphere around the points, Ritter's two pass approximation
+	inline void BoundingSphere(const std::vector<std::array<float, 3>>& points, float center[3], float& radius)
+	{
+		auto distanceSquared = [](const std::array<float, 3>& a, const std::array<float, 3>& b)
+		{
+			float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+			return dx * dx + dy * dy + dz * dz;
+		};
+
+		// the point farthest from an arbitrary one, then the point farthest from that spans the first guess
+		size_t a = 0;
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			if (distanceSquared(points[i], points[0]) > distanceSquared(points[a], points[0]))
+				a = i;
+		}
+		size_t b = a;
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			if (distanceSquared(points[i], points[a]) > distanceSquared(points[b], points[a]))
+				b = i;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			center[k] = (points[a][k] + points[b][k]) * 0.5f;
+		}
+		radius = std::sqrt(distanceSquared(points[a], points[b])) * 0.5f;
+
+		// grow to cover the stragglers
+		for (const std::array<float, 3>& p : points)
+		{
+			std::array<float, 3> c = { center[0], center[1], center[2] };
+			float distance = std::sqrt(distanceSquared(p, c));
+			if (distance > radius)
+			{
+				float grown = (radius + distance) * 0.5f;
+				for (int k = 0; k < 3; k++)
+				{
+					center[k] += (p[k] - center[k]) * (grown - radius) / distance;
+				}
+				radius = grown;
+			}
+		}
+	}
+
+	// greedy split of the (already optimized) index order into meshlets, plus the bounds the cluster culling needs
+	inline void BuildMeshlets(MeshFormat::Mesh& mesh, Report& report)
+	{
+		const uint32_t unused = ~0u;
+		std::vector<uint32_t> localIndex(mesh.vertices.size(), unused);
+
+		mesh.meshlets.clear();
+		mesh.meshletVertices.clear();
+		mesh.meshletTriangles.clear();
+
+		MeshFormat::Meshlet current = {};
+		auto finish = [&]()
+		{
+			if (current.triangleCount == 0)
+				return;
+			for (uint32_t i = 0; i < current.vertexCount; i++)
+			{
+				localIndex[mesh.meshletVertices[current.vertexOffset + i]] = unused;
+			}
+			mesh.meshlets.push_back(current);
+			current = {};
+			current.vertexOffset = uint32_t(mesh.meshletVertices.size());
+			current.triangleOffset = uint32_t(mesh.meshletTriangles.size());
+		};
+
+		auto addTriangle = [&](size_t t)
+		{
+			uint32_t corners[3] = { MeshFormat::Index(mesh, t * 3), MeshFormat::Index(mesh, t * 3 + 1), MeshFormat::Index(mesh, t * 3 + 2) };
+
+			uint32_t newVertices = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				bool repeated = (k > 0 && corners[k] == corners[0]) || (k > 1 && corners[k] == corners[1]);
+				newVertices += localIndex[corners[k]] == unused && !repeated;
+			}
+			if (current.vertexCount + newVertices > MeshFormat::MaxMeshletVertices || current.triangleCount + 1 > MeshFormat::MaxMeshletTriangles)
+			{
+				finish();
+			}
+
+			uint32_t packed = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				if (localIndex[corners[k]] == unused)
+				{
+					localIndex[corners[k]] = current.vertexCount++;
+					mesh.meshletVertices.push_back(corners[k]);
+				}
+				packed |= localIndex[corners[k]] << (8 * k);
+			}
+			mesh.meshletTriangles.push_back(packed);
+			current.triangleCount++;
+		};
+
+		// levels never share a meshlet
+		for (MeshFormat::Lod& lod : mesh.lods)
+		{
+			lod.meshletOffset = uint32_t(mesh.meshlets.size());
+			for (size_t t = lod.indexOffset / 3; t < (lod.indexOffset + lod.indexCount) / 3; t++)
+			{
+				addTriangle(t);
+			}
+			finish();
+			lod.meshletCount = uint32_t(mesh.meshlets.size()) - lod.meshletOffset;
+		}
+
+		auto position = [&](uint32_t v)
+		{
+			const int16_t* p = mesh.vertices[v].position;
+			return std::array<float, 3>{ MeshFormat::DequantizeSnorm16(p[0]), MeshFormat::DequantizeSnorm16(p[1]), MeshFormat::DequantizeSnorm16(p[2]) };
+		};
+
+		std::vector<std::array<float, 3>> points;
+		std::vector<std::array<float, 3>> normals;
+		for (MeshFormat::Meshlet& meshlet : mesh.meshlets)
+		{
+			points.clear();
+			for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+			{
+				points.push_back(position(mesh.meshletVertices[meshlet.vertexOffset + i]));
+			}
+			BoundingSphere(points, meshlet.center, meshlet.radius);
+
+			// normal cone: every triangle's facing is within acos(minimumDot) of the average
+			normals.clear();
+			float axis[3] = {};
+			for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+			{
+				uint32_t packed = mesh.meshletTriangles[meshlet.triangleOffset + t];
+				const std::array<float, 3>& a = points[packed & 0xff];
+				const std::array<float, 3>& b = points[(packed >> 8) & 0xff];
+				const std::array<float, 3>& c = points[(packed >> 16) & 0xff];
+				float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+				std::array<float, 3> n = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length == 0.0f)
+					continue;	// degenerate, can't face away
+				for (int k = 0; k < 3; k++)
+				{
+					n[k] /= length;
+					axis[k] += n[k];
+				}
+				normals.push_back(n);
+			}
+
+			float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			float minimumDot = 1.0f;
+			for (int k = 0; k < 3; k++)
+			{
+				meshlet.coneAxis[k] = axisLength > 0.0f ? axis[k] / axisLength : 0.0f;
+			}
+			for (const std::array<float, 3>& n : normals)
+			{
+				minimumDot = std::min(minimumDot, n[0] * meshlet.coneAxis[0] + n[1] * meshlet.coneAxis[1] + n[2] * meshlet.coneAxis[2]);
+			}
+
+			// the whole cluster faces away once the view direction is within 90 degrees minus the cone's
+			// half angle of the axis, i.e. dot(view, axis) >= sin(half angle). wide cones never get there
+			if (normals.empty() || axisLength == 0.0f || minimumDot <= 0.1f)
+			{
+				meshlet.coneCutoff = 2.0f;
+				report.degenerateCones++;
+			}
+			else
+			{
+				meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+			}
+		}
+
+		mesh.header.meshletCount = uint32_t(mesh.meshlets.size());
+		mesh.header.meshletVertexCount = uint32_t(mesh.meshletVertices.size());
+		mesh.header.meshletTriangleCount = uint32_t(mesh.meshletTriangles.size());
+
+		report.meshletCount = mesh.meshlets.size();
+		if (!mesh.meshlets.empty())
+		{
+			report.trianglesPerMeshlet = double(mesh.meshletTriangles.size()) / mesh.meshlets.size();
+			report.verticesPerMeshlet = double(mesh.meshletVertices.size()) / mesh.meshlets.size();
+		}
+	}
+
+	// Wavefront OBJ: v/vt/vn and polygonal f (fan triangulated), negative indices allowed.
+	// normals are generated (area weighted) if the file has none
+	inline SourceMesh LoadObj(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open " + path);
+		}
+
+		std::vector<float> positions, normals, uvs;
+		SourceMesh mesh;
+		std::map<std::tuple<int, int, int>, uint32_t> vertexMap;
+		bool haveNormals = false;
+
+		auto resolve = [](int index, size_t count) -> int
+		{
+			if (index < 0)
+				return int(count) + index;
+			return index - 1;
+		};
+
+		std::string line;
+		size_t lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			lineNumber++;
+			std::istringstream in(line);
+			std::string tag;
+			in >> tag;
+
+			if (tag == "v")
+			{
+				float x = 0, y = 0, z = 0;
+				in >> x >> y >> z;
+				positions.insert(positions.end(), { x, y, z });
+			}
+			else if (tag == "vt")
+			{
+				float u = 0, v = 0;
+				in >> u >> v;
+				uvs.insert(uvs.end(), { u, v });
+			}
+			else if (tag == "vn")
+			{
+				float x = 0, y = 0, z = 0;
+				in >> x >> y >> z;
+				normals.insert(normals.end(), { x, y, z });
+			}
+			else if (tag == "f")
+			{
+				std::vector<uint32_t> polygon;
+				std::string corner;
+				while (in >> corner)
+				{
+					int p = 0, t = 0, n = 0;
+					size_t slash1 = corner.find('/');
+					p = std::atoi(corner.c_str());
+					if (slash1 != std::string::npos)
+					{
+						size_t slash2 = corner.find('/', slash1 + 1);
+						if (slash2 != slash1 + 1)
+							t = std::atoi(corner.c_str() + slash1 + 1);
+						if (slash2 != std::string::npos)
+							n = std::atoi(corner.c_str() + slash2 + 1);
+					}
+
+					int pi = resolve(p, positions.size() / 3);
+					int ti = t ? resolve(t, uvs.size() / 2) : -1;
+					int ni = n ? resolve(n, normals.size() / 3) : -1;
+					if (pi < 0 || size_t(pi) >= positions.size() / 3 || (t && (ti < 0 || size_t(ti) >= uvs.size() / 2)) ||
+						(n && (ni < 0 || size_t(ni) >= normals.size() / 3)))
+					{
+						throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": face index out of range");
+					}
+					haveNormals |= ni >= 0;
+
+					auto key = std::make_tuple(pi, ti, ni);
+					auto found = vertexMap.find(key);
+					if (found == vertexMap.end())
+					{
+						uint32_t index = uint32_t(mesh.VertexCount());
+						found = vertexMap.emplace(key, index).first;
+						mesh.positions.insert(mesh.positions.end(), &positions[size_t(pi) * 3], &positions[size_t(pi) * 3] + 3);
+						if (ni >= 0)
+							mesh.normals.insert(mesh.normals.end(), &normals[size_t(ni) * 3], &normals[size_t(ni) * 3] + 3);
+						else
+							mesh.normals.insert(mesh.normals.end(), { 0.0f, 0.0f, 0.0f });
+						if (ti >= 0)
+							mesh.uvs.insert(mesh.uvs.end(), &uvs[size_t(ti) * 2], &uvs[size_t(ti) * 2] + 2);
+						else
+							mesh.uvs.insert(mesh.uvs.end(), { 0.0f, 0.0f });
+					}
+					polygon.push_back(found->second);
+				}
+
+				// faces that repeat a corner (f 1 1 2) fan out into degenerate triangles, those are skipped
+				for (size_t k = 1; k + 1 < polygon.size(); k++)
+				{
+					if (!IsDegenerate(polygon[0], polygon[k], polygon[k + 1]))
+						mesh.indices.insert(mesh.indices.end(), { polygon[0], polygon[k], polygon[k + 1] });
+				}
+			}
+		}
+
+		if (!haveNormals)
+		{
+			for (size_t t = 0; t < mesh.indices.size(); t += 3)
+			{
+				const float* a = &mesh.positions[size_t(mesh.indices[t]) * 3];
+				const float* b = &mesh.positions[size_t(mesh.indices[t + 1]) * 3];
+				const float* c = &mesh.positions[size_t(mesh.indices[t + 2]) * 3];
+				float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+				float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				for (int k = 0; k < 3; k++)
+				{
+					for (int j = 0; j < 3; j++)
+						mesh.normals[size_t(mesh.indices[t + k]) * 3 + j] += n[j];
+				}
+			}
+		}
+		for (size_t v = 0; v < mesh.VertexCount(); v++)
+		{
+			float* n = &mesh.normals[v * 3];
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length > 0.0f)
+			{
+				n[0] /= length; n[1] /= length; n[2] /= length;
+			}
+			else
+			{
+				n[0] = 0.0f; n[1] = 0.0f; n[2] = 1.0f;
+			}
+		}
+
+		if (mesh.indices.empty())
+		{
+			throw std::runtime_error(path + " has no faces");
+		}
+		return mesh;
+	}
+
+	// every pass in order, source is consumed
+	inline MeshFormat::Mesh Optimize(SourceMesh& source, Report& report)
+	{
+		report.vertexCount = source.VertexCount();
+		report.triangleCount = source.indices.size() / 3;
+		report.bytesBefore = source.VertexCount() * 8 * sizeof(float) + source.indices.size() * sizeof(uint32_t);
+		report.before = AnalyzeVertexCache(source.indices, source.VertexCount());
+
+		source.indices = OptimizeVertexCache(source.indices, source.VertexCount());
+		report.afterCache = AnalyzeVertexCache(source.indices, source.VertexCount());
+
+		source.indices = OptimizeOverdraw(source.indices, source.positions);
+		report.afterOverdraw = AnalyzeVertexCache(source.indices, source.VertexCount());
+
+		OptimizeVertexFetch(source);
+		MeshFormat::Mesh mesh = Quantize(source);
+		BuildLods(mesh, report);
+		BuildMeshlets(mesh, report);
+
+		report.vertexCount = mesh.vertices.size();
+		report.bytesAfter = mesh.vertices.size() * sizeof(MeshFormat::Vertex) + mesh.indices.size();
+		report.positionPrecision = mesh.header.extent / 32767.0f;
+		return mesh;
+	}
+}
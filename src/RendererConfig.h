@@ -0,0 +1,697 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "FrameCapture.h"
+
+// how the swapchain trades latency against throughput and power
+enum class PresentPolicy
+{
+	LowLatency,		// IMMEDIATE/FIFO_RELAXED, one frame in flight, present-wait bounded queue
+	Throughput,		// MAILBOX, deeper swapchain, MAX_FRAMES in flight
+	PowerSaving,	// FIFO with a CPU frame limiter
+};
+
+inline const char* PresentPolicyName(PresentPolicy policy)
+{
+	switch (policy)
+	{
+	case PresentPolicy::LowLatency:		return "low-latency";
+	case PresentPolicy::Throughput:		return "throughput";
+	case PresentPolicy::PowerSaving:	return "power-saving";
+	}
+	return "unknown";
+}
+
+// canonical scenes, shared by interactive runs and the golden-image suite
+enum class Scene
+{
+	Triangle,		// the original single draw
+	Instancing,		// one draw, 64 instances on a grid
+	ManyPipelines,	// 16 specialized pipelines, one draw each
+	Mesh,			// an optimized .vkmesh, not part of the golden suite since it needs an asset
+};
+
+inline const char* SceneName(Scene scene)
+{
+	switch (scene)
+	{
+	case Scene::Triangle:		return "triangle";
+	case Scene::Instancing:		return "instancing";
+	case Scene::ManyPipelines:	return "many-pipelines";
+	case Scene::Mesh:			return "mesh";
+	}
+	return "unknown";
+}
+
+// how the mesh scene culls its meshlets
+enum class ClusterCulling
+{
+	Auto,		// task/mesh shaders with VK_EXT_mesh_shader, the compute pre-pass otherwise
+	Compute,	// compute pre-pass writing a compacted index stream for the vertex pipeline
+	Off,		// the whole index buffer
+};
+
+// how passes bind their attachments
+enum class RenderingPath
+{
+	Auto,		// dynamic rendering where the device has it, render passes otherwise
+	Dynamic,	// VK_KHR_dynamic_rendering (core in 1.3): no render pass or framebuffer objects
+	RenderPass,	// VkRenderPass and a VkFramebuffer per swapchain image
+};
+
+// how split-screen views of the mesh scene share their pass
+enum class ViewMode
+{
+	Auto,		// multiview where the device has it, viewports otherwise
+	Multiview,	// VK_KHR_multiview (core in 1.1): a layer per view, copied to the view's tile
+	Viewports,	// a viewport per view, picked per instance with VK_EXT_shader_viewport_index_layer
+};
+
+// the least severe validation message printed, see DebugUtils.h
+enum class DebugSeverity
+{
+	Error,
+	Warning,
+	Info,
+	Verbose,
+};
+
+// runtime options, filled from the command line so deployments don't need a recompile
+struct RendererConfig
+{
+	PresentPolicy	presentPolicy		= PresentPolicy::Throughput;
+
+	// CPU-side frame limiter, 0 = unlimited. power-saving defaults to 30 if left unset
+	double			frameRateLimit		= -1.0;
+
+	// low-latency only: presents allowed to queue up before the CPU waits on present completion
+	uint32_t		maxQueuedPresents	= 1;
+
+	// frame readback
+	CaptureFormat	captureFormat		= CaptureFormat::None;
+	std::string		capturePath			= "capture/frame";
+	uint64_t		captureFrames		= 0;		// 0 = until exit
+	uint32_t		captureQueueDepth	= 8;		// frames waiting for the encoder before backpressure
+	bool			captureDropWhenFull	= false;	// drop instead of stalling the render loop
+	uint64_t		captureStartFrame	= 0;		// first frame index read back
+	bool			captureToMemory		= false;	// keep the last readback for the caller, not settable from the command line
+
+	// offscreen rendering without a window or surface, e.g. on a software device of a GPU-less box
+	bool			headless			= false;
+	uint32_t		width				= 800;
+	uint32_t		height				= 600;
+	uint64_t		frameCount			= 0;		// 0 = until the window is closed, headless needs a count
+	Scene			scene				= Scene::Triangle;
+	bool			preferSoftwareDevice = false;	// rank CPU devices (lavapipe, SwiftShader) first
+	int32_t			deviceIndex			= -1;		// vkEnumeratePhysicalDevices index, -1 = the best rated device
+	RenderingPath	renderingPath		= RenderingPath::Auto;
+	bool			drawSort			= true;		// off records the draw queue in submission order, binds are still deduplicated
+	bool			sceneBatches		= true;		// the static scenes' draws recorded once into secondaries, see SceneBatches.h
+
+	// dynamic resolution: the scene passes draw at a scale steered towards this GPU frame time, then are scaled up to the swapchain
+	double			targetFrameMs		= 0.0;		// 0 = always at the swapchain's size
+	double			minRenderScale		= 0.5;		// per axis
+
+	// streamed textures, drawn round-robin by the scene's draws
+	std::vector<std::string> texturePaths;
+	uint32_t		textureBudgetMB		= 0;		// 0 = from VK_EXT_memory_budget
+	uint32_t		textureStagingMB	= 64;		// staging ring shared by the frames in flight
+	bool			textureCompression	= true;		// encode RGBA8 textures to BC1/BC3 where the device samples those
+
+	// device memory telemetry, see MemoryTelemetry.h
+	double			memoryWarnPercent	= 90.0;		// of a heap's budget, past this the texture streamer gives mips back
+	std::string		memoryDumpPath;					// JSON snapshot at exit and on a failed allocation, empty = none
+
+	// VK_EXT_debug_utils, see DebugUtils.h
+#ifdef _DEBUG
+	bool			validation			= true;		// VK_LAYER_KHRONOS_validation, its messages through the sink
+#else
+	bool			validation			= false;
+#endif
+	bool			debugUtils			= false;	// object names and pass labels without the layer, for capture tools
+	DebugSeverity	debugPrintSeverity	= DebugSeverity::Warning;	// less severe messages are only counted
+	uint32_t		debugRepeatLimit	= 5;		// times a message ID is printed before it's only counted
+	std::string		debugDumpPath;					// JSON of the message counters at exit, empty = none
+
+	// meshes
+	std::string		meshPath;						// .vkmesh drawn by the mesh scene
+	std::string		optimizeMeshPath;				// non-empty converts this OBJ instead of running the renderer
+	std::string		meshOutPath;					// default: the OBJ path with a .vkmesh extension
+	ClusterCulling	clusterCulling		= ClusterCulling::Auto;
+	bool			occlusionCulling	= true;		// two-phase, against a depth pyramid. needs cluster culling
+	uint32_t		meshInstances		= 1;		// n x n grid, rows shrinking towards the top
+	double			lodErrorPixels		= 1.0;		// screen-space error a LOD may show
+	double			lodHysteresis		= 0.25;		// fraction around the threshold where the current LOD is kept
+	uint32_t		viewCount			= 1;		// split-screen views, each panned and zoomed onto the grid. culled per view, see cluster_cull.comp.glsl
+	ViewMode		viewMode			= ViewMode::Auto;
+
+	// clustered forward lighting, 0 = none. point lights circling over the view volume, binned per froxel
+	uint32_t		lightCount			= 0;
+	bool			asyncCompute		= true;		// bin on a compute-only queue family next to the graphics work, where there is one
+
+	// shadows of the mesh scene: cascades for the directional light, atlas tiles for the first point lights
+	uint32_t		shadowedLights		= 4;		// these lights stay put so their cached maps stay valid
+	uint32_t		dynamicInstances	= 0;		// the grid's last n instances wander, the rest are static casters
+	bool			shadowCache			= true;		// off re-renders every shadow map every frame
+
+	// finished frames to a local compositor through shared memory instead of a window, see FrameExport.h
+	std::string		exportName;						// shm_open name, non-empty renders headless into the ring
+	uint32_t		exportSlots			= 3;		// frames the consumer may hold before frames are dropped
+	std::string		exportConsumeName;				// non-empty runs the stand-in consumer of that ring instead of the renderer
+
+	// one headless job on several devices at once, see BatchDispatcher.h
+	bool			deviceGroup			= false;
+	std::vector<uint32_t> deviceGroupDevices;		// vkEnumeratePhysicalDevices indices, empty = every device
+
+	// one frame's scene commands to a file and back, see CommandStream.h
+	std::string		recordPath;						// non-empty records the scene draws, uploads and barriers of frame 'recordFrame' into this .vkcs
+	uint64_t		recordFrame			= 100;		// late enough for streaming and the shadow cache to settle
+	std::string		replayPath;						// non-empty replays this .vkcs headless instead of running the renderer
+	uint32_t		replayLoops			= 100;		// times the recorded frame is replayed
+
+	// golden-image regression suite, see GoldenImage.h
+	std::string		goldenDirectory;				// non-empty runs the suite instead of the renderer
+	bool			goldenUpdate		= false;	// write new goldens and frame time baselines
+	uint32_t		goldenWarmupFrames	= 10;
+	uint32_t		goldenMeasuredFrames = 60;
+	double			goldenPixelThreshold = 0.1;		// per-pixel YIQ distance, 0..1
+	double			goldenMaxMismatch	= 0.001;	// fraction of pixels allowed over the threshold
+	double			goldenTimeTolerance	= 0.25;		// allowed median frame time growth over the baseline
+
+	double EffectiveFrameRateLimit() const
+	{
+		if (frameRateLimit >= 0.0)
+			return frameRateLimit;
+		return presentPolicy == PresentPolicy::PowerSaving ? 30.0 : 0.0;
+	}
+
+	static const char* Usage()
+	{
+		return
+			"usage: VKRenderer [options]\n"
+			"  --present-policy=<low-latency|throughput|power-saving>\n"
+			"  --fps-limit=<frames per second, 0 = unlimited>\n"
+			"  --max-queued-presents=<n>\n"
+			"  --capture=<png|raw|y4m>\n"
+			"  --capture-path=<path prefix>\n"
+			"  --capture-frames=<n, 0 = until exit>\n"
+			"  --capture-queue=<n>\n"
+			"  --capture-drop\n"
+			"  --capture-start=<first frame index>\n"
+			"  --headless\n"
+			"  --size=<width>x<height>\n"
+			"  --frames=<n, 0 = until the window is closed>\n"
+			"  --scene=<triangle|instancing|many-pipelines|mesh>\n"
+			"  --prefer-software-device\n"
+			"  --device=<index>\n"
+			"  --device-group=<all|index,index,...>, headless on several devices\n"
+			"  --export=<shared memory name>, headless into a compositor's frame ring, --frames=0 until it detaches\n"
+			"  --export-slots=<2-8>\n"
+			"  --export-consume=<shared memory name>, reads --frames frames of a ring, 0 = until it closes\n"
+			"  --rendering=<auto|dynamic|render-pass>\n"
+			"  --draw-sort=<on|off>\n"
+			"  --scene-batches=<on|off>\n"
+			"  --target-frame-ms=<GPU ms the render scale steers to, 0 = native resolution>\n"
+			"  --min-render-scale=<0.25-1>\n"
+			"  --texture=<png|ktx2>, repeatable\n"
+			"  --texture-budget-mb=<n, 0 = from VK_EXT_memory_budget>\n"
+			"  --texture-staging-mb=<n>\n"
+			"  --texture-compression=<on|off>\n"
+			"  --memory-warn=<percent of a heap's budget>\n"
+			"  --memory-dump=<json>\n"
+			"  --validation=<on|off>\n"
+			"  --debug-utils, object names and pass labels without --validation\n"
+			"  --debug-print=<error|warning|info|verbose>\n"
+			"  --debug-repeat=<times a message ID is printed>\n"
+			"  --debug-dump=<json>\n"
+			"  --mesh=<.vkmesh>, drawn by --scene=mesh\n"
+			"  --optimize-mesh=<obj>\n"
+			"  --mesh-out=<.vkmesh>\n"
+			"  --cluster-culling=<auto|compute|off>\n"
+			"  --occlusion-culling=<on|off>\n"
+			"  --mesh-instances=<n, drawn as an n x n grid>\n"
+			"  --lod-error=<pixels>\n"
+			"  --lod-hysteresis=<fraction of the error, 0..1>\n"
+			"  --views=<1-4>, split-screen views of --scene=mesh. more than one turns occlusion culling and mesh shading off\n"
+			"  --view-mode=<auto|multiview|viewports>\n"
+			"  --lights=<n, 0 = none>\n"
+			"  --async-compute=<on|off>\n"
+			"  --shadowed-lights=<n, at most 16>\n"
+			"  --dynamic-instances=<n>\n"
+			"  --shadow-cache=<on|off>\n"
+			"  --record=<.vkcs>\n"
+			"  --record-frame=<frame index>\n"
+			"  --replay=<.vkcs>\n"
+			"  --replay-loops=<n>\n"
+			"  --golden-test=<golden directory>\n"
+			"  --golden-update\n"
+			"  --golden-frames=<measured frames per scene>\n"
+			"  --golden-threshold=<per-pixel distance, 0..1>\n"
+			"  --golden-max-mismatch=<fraction of pixels>\n"
+			"  --golden-time-tolerance=<fraction over baseline>\n";
+	}
+
+	static RendererConfig FromCommandLine(int argc, char** argv)
+	{
+		RendererConfig config;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			std::string key = arg;
+			std::string value;
+
+			size_t eq = arg.find('=');
+			if (eq != std::string::npos)
+			{
+				key = arg.substr(0, eq);
+				value = arg.substr(eq + 1);
+			}
+
+			if (key == "--present-policy")
+			{
+				if (value == "low-latency")
+					config.presentPolicy = PresentPolicy::LowLatency;
+				else if (value == "throughput")
+					config.presentPolicy = PresentPolicy::Throughput;
+				else if (value == "power-saving")
+					config.presentPolicy = PresentPolicy::PowerSaving;
+				else
+					throw std::runtime_error("Unknown present policy: " + value);
+			}
+			else if (key == "--fps-limit")
+			{
+				config.frameRateLimit = _parseNumber(key, value);
+			}
+			else if (key == "--max-queued-presents")
+			{
+				config.maxQueuedPresents = static_cast<uint32_t>(_parseNumber(key, value));
+				if (config.maxQueuedPresents == 0)
+					throw std::runtime_error("--max-queued-presents must be at least 1");
+			}
+			else if (key == "--capture")
+			{
+				if (value == "png")
+					config.captureFormat = CaptureFormat::Png;
+				else if (value == "raw")
+					config.captureFormat = CaptureFormat::Raw;
+				else if (value == "y4m")
+					config.captureFormat = CaptureFormat::Y4m;
+				else
+					throw std::runtime_error("Unknown capture format: " + value);
+			}
+			else if (key == "--capture-path")
+			{
+				config.capturePath = value;
+			}
+			else if (key == "--capture-frames")
+			{
+				config.captureFrames = static_cast<uint64_t>(_parseNumber(key, value));
+			}
+			else if (key == "--capture-queue")
+			{
+				config.captureQueueDepth = static_cast<uint32_t>(_parseNumber(key, value));
+			}
+			else if (key == "--capture-drop")
+			{
+				config.captureDropWhenFull = true;
+			}
+			else if (key == "--capture-start")
+			{
+				config.captureStartFrame = static_cast<uint64_t>(_parseNumber(key, value));
+			}
+			else if (key == "--headless")
+			{
+				config.headless = true;
+			}
+			else if (key == "--size")
+			{
+				size_t x = value.find('x');
+				if (x == std::string::npos)
+					throw std::runtime_error("Invalid value for --size: " + value);
+				config.width = static_cast<uint32_t>(_parseNumber(key, value.substr(0, x)));
+				config.height = static_cast<uint32_t>(_parseNumber(key, value.substr(x + 1)));
+				if (config.width == 0 || config.height == 0)
+					throw std::runtime_error("Invalid value for --size: " + value);
+			}
+			else if (key == "--frames")
+			{
+				config.frameCount = static_cast<uint64_t>(_parseNumber(key, value));
+			}
+			else if (key == "--scene")
+			{
+				if (value == "triangle")
+					config.scene = Scene::Triangle;
+				else if (value == "instancing")
+					config.scene = Scene::Instancing;
+				else if (value == "many-pipelines")
+					config.scene = Scene::ManyPipelines;
+				else if (value == "mesh")
+					config.scene = Scene::Mesh;
+				else
+					throw std::runtime_error("Unknown scene: " + value);
+			}
+			else if (key == "--prefer-software-device")
+			{
+				config.preferSoftwareDevice = true;
+			}
+			else if (key == "--device")
+			{
+				config.deviceIndex = static_cast<int32_t>(_parseNumber(key, value));
+			}
+			else if (key == "--device-group")
+			{
+				config.deviceGroup = true;
+				config.headless = true;
+				config.deviceGroupDevices.clear();
+				if (value != "all")
+				{
+					size_t begin = 0;
+					while (begin <= value.size())
+					{
+						size_t comma = std::min(value.find(',', begin), value.size());
+						config.deviceGroupDevices.push_back(static_cast<uint32_t>(_parseNumber(key, value.substr(begin, comma - begin))));
+						begin = comma + 1;
+					}
+				}
+			}
+			else if (key == "--export")
+			{
+				if (value.empty() || value[0] != '/')
+					throw std::runtime_error("--export needs a shared memory name starting with '/'");
+				config.exportName = value;
+				config.headless = true;
+			}
+			else if (key == "--export-slots")
+			{
+				config.exportSlots = static_cast<uint32_t>(_parseNumber(key, value));
+				if (config.exportSlots < 2 || config.exportSlots > 8)
+					throw std::runtime_error("--export-slots must be 2 to 8");
+			}
+			else if (key == "--export-consume")
+			{
+				if (value.empty() || value[0] != '/')
+					throw std::runtime_error("--export-consume needs a shared memory name starting with '/'");
+				config.exportConsumeName = value;
+			}
+			else if (key == "--rendering")
+			{
+				if (value == "auto")
+					config.renderingPath = RenderingPath::Auto;
+				else if (value == "dynamic")
+					config.renderingPath = RenderingPath::Dynamic;
+				else if (value == "render-pass")
+					config.renderingPath = RenderingPath::RenderPass;
+				else
+					throw std::runtime_error("Unknown rendering path: " + value);
+			}
+			else if (key == "--draw-sort")
+			{
+				if (value == "on")
+					config.drawSort = true;
+				else if (value == "off")
+					config.drawSort = false;
+				else
+					throw std::runtime_error("Invalid value for --draw-sort: " + value);
+			}
+			else if (key == "--scene-batches")
+			{
+				if (value == "on")
+					config.sceneBatches = true;
+				else if (value == "off")
+					config.sceneBatches = false;
+				else
+					throw std::runtime_error("Invalid value for --scene-batches: " + value);
+			}
+			else if (key == "--target-frame-ms")
+			{
+				config.targetFrameMs = _parseNumber(key, value);
+			}
+			else if (key == "--min-render-scale")
+			{
+				config.minRenderScale = _parseNumber(key, value);
+				if (config.minRenderScale < 0.25 || config.minRenderScale > 1.0)
+					throw std::runtime_error("--min-render-scale must be 0.25 to 1");
+			}
+			else if (key == "--texture")
+			{
+				if (value.empty())
+					throw std::runtime_error("--texture needs a path");
+				config.texturePaths.push_back(value);
+			}
+			else if (key == "--texture-budget-mb")
+			{
+				config.textureBudgetMB = static_cast<uint32_t>(_parseNumber(key, value));
+			}
+			else if (key == "--texture-staging-mb")
+			{
+				config.textureStagingMB = static_cast<uint32_t>(_parseNumber(key, value));
+				if (config.textureStagingMB == 0)
+					throw std::runtime_error("--texture-staging-mb must be at least 1");
+			}
+			else if (key == "--texture-compression")
+			{
+				if (value == "on")
+					config.textureCompression = true;
+				else if (value == "off")
+					config.textureCompression = false;
+				else
+					throw std::runtime_error("Invalid value for --texture-compression: " + value);
+			}
+			else if (key == "--memory-warn")
+			{
+				config.memoryWarnPercent = _parseNumber(key, value);
+				if (config.memoryWarnPercent <= 0.0 || config.memoryWarnPercent > 100.0)
+					throw std::runtime_error("--memory-warn must be in (0, 100]");
+			}
+			else if (key == "--memory-dump")
+			{
+				config.memoryDumpPath = value;
+			}
+			else if (key == "--validation")
+			{
+				if (value == "on")
+					config.validation = true;
+				else if (value == "off")
+					config.validation = false;
+				else
+					throw std::runtime_error("Invalid value for --validation: " + value);
+			}
+			else if (key == "--debug-utils")
+			{
+				config.debugUtils = true;
+			}
+			else if (key == "--debug-print")
+			{
+				if (value == "error")
+					config.debugPrintSeverity = DebugSeverity::Error;
+				else if (value == "warning")
+					config.debugPrintSeverity = DebugSeverity::Warning;
+				else if (value == "info")
+					config.debugPrintSeverity = DebugSeverity::Info;
+				else if (value == "verbose")
+					config.debugPrintSeverity = DebugSeverity::Verbose;
+				else
+					throw std::runtime_error("Unknown debug print level: " + value);
+			}
+			else if (key == "--debug-repeat")
+			{
+				config.debugRepeatLimit = static_cast<uint32_t>(_parseNumber(key, value));
+			}
+			else if (key == "--debug-dump")
+			{
+				config.debugDumpPath = value;
+			}
+			else if (key == "--mesh")
+			{
+				config.meshPath = value;
+			}
+			else if (key == "--optimize-mesh")
+			{
+				if (value.empty())
+					throw std::runtime_error("--optimize-mesh needs an OBJ path");
+				config.optimizeMeshPath = value;
+			}
+			else if (key == "--mesh-out")
+			{
+				config.meshOutPath = value;
+			}
+			else if (key == "--cluster-culling")
+			{
+				if (value == "auto")
+					config.clusterCulling = ClusterCulling::Auto;
+				else if (value == "compute")
+					config.clusterCulling = ClusterCulling::Compute;
+				else if (value == "off")
+					config.clusterCulling = ClusterCulling::Off;
+				else
+					throw std::runtime_error("Unknown cluster culling mode: " + value);
+			}
+			else if (key == "--occlusion-culling")
+			{
+				if (value == "on")
+					config.occlusionCulling = true;
+				else if (value == "off")
+					config.occlusionCulling = false;
+				else
+					throw std::runtime_error("Invalid value for --occlusion-culling: " + value);
+			}
+			else if (key == "--mesh-instances")
+			{
+				config.meshInstances = static_cast<uint32_t>(_parseNumber(key, value));
+				if (config.meshInstances == 0)
+					throw std::runtime_error("--mesh-instances must be at least 1");
+			}
+			else if (key == "--lod-error")
+			{
+				config.lodErrorPixels = _parseNumber(key, value);
+			}
+			else if (key == "--lod-hysteresis")
+			{
+				config.lodHysteresis = _parseNumber(key, value);
+				if (config.lodHysteresis >= 1.0)
+					throw std::runtime_error("--lod-hysteresis must be below 1");
+			}
+			else if (key == "--views")
+			{
+				config.viewCount = static_cast<uint32_t>(_parseNumber(key, value));
+				if (config.viewCount == 0 || config.viewCount > 4)
+					throw std::runtime_error("--views must be 1 to 4");
+			}
+			else if (key == "--view-mode")
+			{
+				if (value == "auto")
+					config.viewMode = ViewMode::Auto;
+				else if (value == "multiview")
+					config.viewMode = ViewMode::Multiview;
+				else if (value == "viewports")
+					config.viewMode = ViewMode::Viewports;
+				else
+					throw std::runtime_error("Unknown view mode: " + value);
+			}
+			else if (key == "--lights")
+			{
+				config.lightCount = static_cast<uint32_t>(_parseNumber(key, value));
+			}
+			else if (key == "--async-compute")
+			{
+				if (value == "on")
+					config.asyncCompute = true;
+				else if (value == "off")
+					config.asyncCompute = false;
+				else
+					throw std::runtime_error("Invalid value for --async-compute: " + value);
+			}
+			else if (key == "--shadowed-lights")
+			{
+				config.shadowedLights = static_cast<uint32_t>(_parseNumber(key, value));
+				if (config.shadowedLights > 16)
+					throw std::runtime_error("--shadowed-lights must be at most 16");
+			}
+			else if (key == "--dynamic-instances")
+			{
+				config.dynamicInstances = static_cast<uint32_t>(_parseNumber(key, value));
+			}
+			else if (key == "--shadow-cache")
+			{
+				if (value == "on")
+					config.shadowCache = true;
+				else if (value == "off")
+					config.shadowCache = false;
+				else
+					throw std::runtime_error("Invalid value for --shadow-cache: " + value);
+			}
+			else if (key == "--record")
+			{
+				if (value.empty())
+					throw std::runtime_error("--record needs a path");
+				config.recordPath = value;
+			}
+			else if (key == "--record-frame")
+			{
+				config.recordFrame = static_cast<uint64_t>(_parseNumber(key, value));
+			}
+			else if (key == "--replay")
+			{
+				if (value.empty())
+					throw std::runtime_error("--replay needs a .vkcs path");
+				config.replayPath = value;
+			}
+			else if (key == "--replay-loops")
+			{
+				config.replayLoops = static_cast<uint32_t>(_parseNumber(key, value));
+				if (config.replayLoops == 0)
+					throw std::runtime_error("--replay-loops must be at least 1");
+			}
+			else if (key == "--golden-test")
+			{
+				if (value.empty())
+					throw std::runtime_error("--golden-test needs a directory");
+				config.goldenDirectory = value;
+			}
+			else if (key == "--golden-update")
+			{
+				config.goldenUpdate = true;
+			}
+			else if (key == "--golden-frames")
+			{
+				config.goldenMeasuredFrames = static_cast<uint32_t>(_parseNumber(key, value));
+				if (config.goldenMeasuredFrames == 0)
+					throw std::runtime_error("--golden-frames must be at least 1");
+			}
+			else if (key == "--golden-threshold")
+			{
+				config.goldenPixelThreshold = _parseNumber(key, value);
+			}
+			else if (key == "--golden-max-mismatch")
+			{
+				config.goldenMaxMismatch = _parseNumber(key, value);
+			}
+			else if (key == "--golden-time-tolerance")
+			{
+				config.goldenTimeTolerance = _parseNumber(key, value);
+			}
+			else
+			{
+				throw std::runtime_error("Unknown option: " + arg + "\n" + Usage());
+			}
+		}
+
+		if (config.headless && config.frameCount == 0 && config.goldenDirectory.empty() && config.replayPath.empty() && config.exportName.empty())
+		{
+			throw std::runtime_error("--headless needs --frames=<n>");
+		}
+		if (config.scene == Scene::Mesh && config.meshPath.empty())
+		{
+			throw std::runtime_error("--scene=mesh needs --mesh=<.vkmesh>");
+		}
+		if (config.viewCount > 1 && config.scene != Scene::Mesh)
+		{
+			throw std::runtime_error("--views needs --scene=mesh");
+		}
+		if (!config.exportName.empty() && (config.captureFormat != CaptureFormat::None || config.deviceGroup))
+		{
+			throw std::runtime_error("--export reads the frames back itself, it doesn't go with --capture or --device-group");
+		}
+
+		return config;
+	}
+
+private:
+	static double _parseNumber(const std::string& key, const std::string& value)
+	{
+		char* end = nullptr;
+		double number = std::strtod(value.c_str(), &end);
+		if (value.empty() || *end != '\0' || number < 0.0)
+		{
+			throw std::runtime_error("Invalid value for " + key + ": " + value);
+		}
+		return number;
+	}
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+// the static scenes' draws, recorded once into secondary command buffers the frame's primary only executes.
+// a batch is a run of draws, kept per frame slot because what it binds (the slot's light slice) is. each
+// recording is filed under a key of everything the commands were recorded from that can change between frames,
+// the render area and the texture sets the streamer hands out; a batch whose key changed is re-recorded, the
+// others are reused as they are. Invalidate drops every recording, for what the keys don't see: pipelines and
+// render passes recreated with the swapchain.
+//
+// a secondary is only re-recorded once its frame slot's fence is through, so no submitted frame still uses it
+class SceneBatches
+{
+public:
+	struct Stats
+	{
+		uint64_t		frames = 0;
+		uint64_t		reused = 0;
+		uint64_t		recorded = 0;
+		uint64_t		invalidations = 0;
+	};
+
+	// builds a batch's key out of the values its commands were recorded from
+	class Key
+	{
+	public:
+		template <typename T>
+		Key& operator<<(const T& value)
+		{
+			uint8_t bytes[sizeof(T)];
+			memcpy(bytes, &value, sizeof(T));
+			for (uint8_t byte : bytes)
+			{
+				_hash = (_hash ^ byte) * 0x100000001b3ull;
+			}
+			return *this;
+		}
+
+		uint64_t Value() const { return _hash; }
+
+	private:
+		uint64_t	_hash = 0xcbf29ce484222325ull;
+	};
+
+	SceneBatches(VkDevice device, uint32_t queueFamily, uint32_t frameSlots, uint32_t batchCount)
+		: _device(device), _batchCount(batchCount), _batches(size_t(frameSlots) * batchCount)
+	{
+		// re-recorded one at a time
+		VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = queueFamily;
+		if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create the scene batches' command pool");
+		}
+
+		std::vector<VkCommandBuffer> commandBuffers(_batches.size());
+		VkCommandBufferAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+		allocInfo.commandPool = _pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = uint32_t(commandBuffers.size());
+		if (vkAllocateCommandBuffers(_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+		{
+			vkDestroyCommandPool(_device, _pool, nullptr);
+			throw std::runtime_error("Failed to allocate the scene batches' command buffers");
+		}
+		for (size_t i = 0; i < _batches.size(); i++)
+		{
+			_batches[i].commandBuffer = commandBuffers[i];
+		}
+	}
+
+	~SceneBatches()
+	{
+		vkDestroyCommandPool(_device, _pool, nullptr);
+	}
+
+	SceneBatches(const SceneBatches&) = delete;
+	SceneBatches& operator=(const SceneBatches&) = delete;
+
+	uint32_t BatchCount() const { return _batchCount; }
+
+	// the batch's secondary for this frame slot. 'record' is set when its recording doesn't match 'key', the
+	// caller records it again before executing it
+	VkCommandBuffer Acquire(uint32_t frameSlot, uint32_t batch, uint64_t key, bool& record)
+	{
+		Batch& entry = _batches[size_t(frameSlot) * _batchCount + batch];
+		record = !entry.recorded || entry.key != key;
+		if (record)
+		{
+			entry.key = key;
+			entry.recorded = true;
+			_stats.recorded++;
+		}
+		else
+		{
+			_stats.reused++;
+		}
+		return entry.commandBuffer;
+	}
+
+	void EndFrame()
+	{
+		_stats.frames++;
+	}
+
+	void Invalidate()
+	{
+		for (Batch& batch : _batches)
+		{
+			batch.recorded = false;
+		}
+		_stats.invalidations++;
+	}
+
+	Stats GetStats() const { return _stats; }
+
+	void Report(std::ostream& out) const
+	{
+		if (_stats.frames == 0)
+			return;
+
+		uint64_t total = _stats.reused + _stats.recorded;
+		out << "scene batches: " << _batchCount << " per frame slot, " << _stats.reused << " reused, " << _stats.recorded << " re-recorded ("
+			<< (total > 0 ? 100.0 * double(_stats.reused) / double(total) : 0.0) << "% reused) over " << _stats.frames << " frames, "
+			<< _stats.invalidations << " invalidations" << std::endl;
+	}
+
+private:
+	struct Batch
+	{
+		VkCommandBuffer	commandBuffer = VK_NULL_HANDLE;
+		uint64_t		key = 0;
+		bool			recorded = false;
+	};
+
+	VkDevice			_device;
+	VkCommandPool		_pool = VK_NULL_HANDLE;
+	uint32_t			_batchCount;
+	std::vector<Batch>	_batches;			// frame slot major
+	Stats				_stats;
+};
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <ostream>
+#include <vector>
+
+// shadow map caching for a fixed set of views packed into one depth atlas, e.g. a directional light's
+// cascades and a tile per shadowed point light. static casters live in a cache image that is only
+// re-rendered where a static caster moved or a view changed; every frame the texels dynamic casters
+// covered last frame are restored from the cache, then the dynamic casters are drawn on top. this is
+// the CPU side only: it turns caster bounds into texel rects and tells the renderer what to record
+class ShadowCache
+{
+public:
+	static const uint32_t MaxRectsPerView = 8;	// past this a view's rects collapse into their bounds
+	static const int32_t TexelMargin = 2;		// rasterization slop and the receivers' 2x2 filter
+
+	// atlas texels
+	struct Rect
+	{
+		int32_t		x = 0;
+		int32_t		y = 0;
+		uint32_t	width = 0;
+		uint32_t	height = 0;
+
+		bool Empty() const { return width == 0 || height == 0; }
+		uint64_t Area() const { return uint64_t(width) * height; }
+		int32_t Right() const { return x + int32_t(width); }
+		int32_t Bottom() const { return y + int32_t(height); }
+
+		bool Intersects(const Rect& other) const
+		{
+			return !Empty() && !other.Empty() && x < other.Right() && other.x < Right() && y < other.Bottom() && other.y < Bottom();
+		}
+
+		Rect Union(const Rect& other) const
+		{
+			if (Empty())
+				return other;
+			if (other.Empty())
+				return *this;
+			return FromEdges(std::min(x, other.x), std::min(y, other.y), std::max(Right(), other.Right()), std::max(Bottom(), other.Bottom()));
+		}
+
+		Rect Intersection(const Rect& other) const
+		{
+			return FromEdges(std::max(x, other.x), std::max(y, other.y), std::min(Right(), other.Right()), std::min(Bottom(), other.Bottom()));
+		}
+
+		static Rect FromEdges(int32_t left, int32_t top, int32_t right, int32_t bottom)
+		{
+			Rect rect;
+			if (right <= left || bottom <= top)
+				return rect;
+			rect.x = left;
+			rect.y = top;
+			rect.width = uint32_t(right - left);
+			rect.height = uint32_t(bottom - top);
+			return rect;
+		}
+	};
+
+	// axis aligned, in the space the view matrices transform from
+	struct Bounds
+	{
+		float	min[3];
+		float	max[3];
+	};
+
+	// column-major like GLSL's mat4, clip z in [0, 1]. the views are rendered with an unflipped viewport,
+	// so clip y = -1 is the tile's first row
+	struct Matrix
+	{
+		float	m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+		bool operator==(const Matrix& other) const { return std::equal(std::begin(m), std::end(m), std::begin(other.m)); }
+		bool operator!=(const Matrix& other) const { return !(*this == other); }
+
+		Matrix operator*(const Matrix& other) const
+		{
+			Matrix result;
+			for (int column = 0; column < 4; column++)
+			{
+				for (int row = 0; row < 4; row++)
+				{
+					float sum = 0.0f;
+					for (int k = 0; k < 4; k++)
+						sum += m[k * 4 + row] * other.m[column * 4 + k];
+					result.m[column * 4 + row] = sum;
+				}
+			}
+			return result;
+		}
+
+		void Transform(const float point[3], float clip[4]) const
+		{
+			for (int row = 0; row < 4; row++)
+				clip[row] = m[row] * point[0] + m[4 + row] * point[1] + m[8 + row] * point[2] + m[12 + row];
+		}
+
+		static Matrix LookAt(const float eye[3], const float target[3], const float up[3])
+		{
+			float f[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+			_normalize(f);
+			float s[3];
+			_cross(f, up, s);
+			_normalize(s);
+			float u[3];
+			_cross(s, f, u);
+
+			Matrix result;
+			for (int i = 0; i < 3; i++)
+			{
+				result.m[i * 4 + 0] = s[i];
+				result.m[i * 4 + 1] = u[i];
+				result.m[i * 4 + 2] = -f[i];
+			}
+			result.m[12] = -_dot(s, eye);
+			result.m[13] = -_dot(u, eye);
+			result.m[14] = _dot(f, eye);
+			return result;
+		}
+
+		// looking down -z, near maps to depth 0
+		static Matrix Orthographic(float left, float right, float bottom, float top, float nearPlane, float farPlane)
+		{
+			Matrix result;
+			result.m[0] = 2.0f / (right - left);
+			result.m[5] = 2.0f / (top - bottom);
+			result.m[10] = -1.0f / (farPlane - nearPlane);
+			result.m[12] = -(right + left) / (right - left);
+			result.m[13] = -(top + bottom) / (top - bottom);
+			result.m[14] = -nearPlane / (farPlane - nearPlane);
+			return result;
+		}
+
+		static Matrix Perspective(float fovY, float aspect, float nearPlane, float farPlane)
+		{
+			float g = 1.0f / std::tan(fovY * 0.5f);
+			Matrix result;
+			result.m[0] = g / aspect;
+			result.m[5] = g;
+			result.m[10] = farPlane / (nearPlane - farPlane);
+			result.m[11] = -1.0f;
+			result.m[14] = nearPlane * farPlane / (nearPlane - farPlane);
+			result.m[15] = 0.0f;
+			return result;
+		}
+	};
+
+	// what the frame records for one view: re-render the cache inside 'redraw' (cleared first),
+	// copy the cache into the atlas inside 'restore', then draw the dynamic casters over the whole tile
+	struct ViewPlan
+	{
+		std::vector<Rect>	redraw;
+		std::vector<Rect>	restore;
+	};
+
+	struct Stats
+	{
+		uint64_t	frames = 0;
+		uint64_t	redrawTexels = 0;
+		uint64_t	restoreTexels = 0;
+		uint64_t	redrawFrames = 0;		// frames that touched the cache at all
+		uint64_t	tileTexels = 0;			// every view's tile, what re-rendering everything costs per frame
+	};
+
+	// an orthographic view of a directional light (pointing towards the light) that covers 'slice' and
+	// anything up to 'casterReach' in front of it. the window is square and moves in whole texels, so
+	// a slice that shifts a little doesn't make its texels swim
+	static Matrix DirectionalView(const float direction[3], const Bounds& slice, uint32_t resolution, float casterReach)
+	{
+		float toLight[3] = { direction[0], direction[1], direction[2] };
+		_normalize(toLight);
+		float center[3], eye[3];
+		for (int i = 0; i < 3; i++)
+		{
+			center[i] = 0.5f * (slice.min[i] + slice.max[i]);
+			eye[i] = center[i] + toLight[i];
+		}
+		float up[3] = { 0.0f, 1.0f, 0.0f };
+		if (std::abs(toLight[1]) > 0.99f)
+		{
+			up[0] = 1.0f;
+			up[1] = 0.0f;
+		}
+		Matrix view = Matrix::LookAt(eye, center, up);
+
+		float lo[3] = { INFINITY, INFINITY, INFINITY };
+		float hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+		for (int corner = 0; corner < 8; corner++)
+		{
+			float point[3] = { (corner & 1) ? slice.max[0] : slice.min[0], (corner & 2) ? slice.max[1] : slice.min[1], (corner & 4) ? slice.max[2] : slice.min[2] };
+			float light[4];
+			view.Transform(point, light);
+			for (int i = 0; i < 3; i++)
+			{
+				lo[i] = std::min(lo[i], light[i]);
+				hi[i] = std::max(hi[i], light[i]);
+			}
+		}
+
+		float extent = std::max(hi[0] - lo[0], hi[1] - lo[1]);
+		float texel = extent / float(resolution);
+		extent += 2.0f * texel;
+		float left = std::floor(lo[0] / texel) * texel - texel;
+		float bottom = std::floor(lo[1] / texel) * texel - texel;
+
+		// the light looks down its -z, so the slice's near side is its largest z
+		return Matrix::Orthographic(left, left + extent, bottom, bottom + extent, -hi[2] - casterReach, -lo[2]) * view;
+	}
+
+	// a square frustum from 'position' looking down -z, as far as the light reaches
+	static Matrix SpotView(const float position[3], float fovY, float reach)
+	{
+		float target[3] = { position[0], position[1], position[2] - 1.0f };
+		float up[3] = { 0.0f, 1.0f, 0.0f };
+		return Matrix::Perspective(fovY, 1.0f, reach * 0.05f, reach) * Matrix::LookAt(position, target, up);
+	}
+
+	uint32_t AddView(const Rect& tile)
+	{
+		_views.push_back({ tile });
+		_plans.emplace_back();
+		_stats.tileTexels += tile.Area();
+		return uint32_t(_views.size() - 1);
+	}
+
+	size_t ViewCount() const { return _views.size(); }
+	const Rect& Tile(uint32_t view) const { return _views[view].tile; }
+	const Matrix& ViewMatrix(uint32_t view) const { return _views[view].matrix; }
+
+	// a changed matrix invalidates everything the view had cached
+	void SetViewMatrix(uint32_t view, const Matrix& matrix)
+	{
+		View& state = _views[view];
+		if (state.valid && state.matrix == matrix)
+			return;
+		state.matrix = matrix;
+		state.valid = true;
+		state.staticDirty.assign(1, state.tile);
+	}
+
+	// the cache image's contents are gone, e.g. it was recreated
+	void InvalidateAll()
+	{
+		for (View& view : _views)
+			view.staticDirty.assign(1, view.tile);
+	}
+
+	// a static caster moved: both where it was and where it is now need re-rendering
+	void MoveStaticCaster(const Bounds& before, const Bounds& after)
+	{
+		for (View& view : _views)
+		{
+			_add(view.staticDirty, _project(view, before));
+			_add(view.staticDirty, _project(view, after));
+		}
+	}
+
+	// this frame's dynamic casters, before Plan
+	void AddDynamicCaster(const Bounds& bounds)
+	{
+		for (View& view : _views)
+			_add(view.dynamic, _project(view, bounds));
+	}
+
+	// the texels of the view's tile a caster can touch, empty when it's outside the view
+	Rect Project(uint32_t view, const Bounds& bounds) const
+	{
+		return _project(_views[view], bounds);
+	}
+
+	// per view, what to record this frame. with caching off every tile is re-rendered and restored
+	// whole, which is the cost the cache saves. call once per frame, after the casters were added
+	const std::vector<ViewPlan>& Plan(bool cached)
+	{
+		_stats.frames++;
+		bool redrew = false;
+		for (size_t i = 0; i < _views.size(); i++)
+		{
+			View& view = _views[i];
+			ViewPlan& plan = _plans[i];
+			if (cached)
+			{
+				plan.redraw = view.staticDirty;
+				plan.restore = view.staticDirty;
+				for (const Rect& rect : view.previousDynamic)
+					_add(plan.restore, rect);
+			}
+			else
+			{
+				plan.redraw.assign(1, view.tile);
+				plan.restore.assign(1, view.tile);
+			}
+
+			for (const Rect& rect : plan.redraw)
+				_stats.redrawTexels += rect.Area();
+			for (const Rect& rect : plan.restore)
+				_stats.restoreTexels += rect.Area();
+			redrew |= !plan.redraw.empty();
+
+			view.staticDirty.clear();
+			view.previousDynamic.swap(view.dynamic);
+			view.dynamic.clear();
+		}
+		if (redrew)
+			_stats.redrawFrames++;
+		return _plans;
+	}
+
+	const Stats& GetStats() const { return _stats; }
+
+	void Report(std::ostream& out) const
+	{
+		if (_stats.frames == 0)
+			return;
+
+		double frames = double(_stats.frames);
+		double tile = double(_stats.tileTexels);
+		out << "shadow cache: " << _views.size() << " views, " << _stats.tileTexels << " texels; per frame "
+			<< double(_stats.redrawTexels) / frames << " re-rendered (" << 100.0 * double(_stats.redrawTexels) / (frames * tile) << "%), "
+			<< double(_stats.restoreTexels) / frames << " restored (" << 100.0 * double(_stats.restoreTexels) / (frames * tile) << "%); "
+			<< "static casters re-rendered in " << _stats.redrawFrames << " of " << _stats.frames << " frames" << std::endl;
+	}
+
+private:
+	struct View
+	{
+		Rect				tile;
+		Matrix				matrix;
+		bool				valid = false;
+		std::vector<Rect>	staticDirty;
+		std::vector<Rect>	dynamic;			// this frame's casters
+		std::vector<Rect>	previousDynamic;	// last frame's, still in the atlas
+	};
+
+	static Rect _project(const View& view, const Bounds& bounds)
+	{
+		float lo[2] = { INFINITY, INFINITY };
+		float hi[2] = { -INFINITY, -INFINITY };
+		for (int corner = 0; corner < 8; corner++)
+		{
+			float point[3] = { (corner & 1) ? bounds.max[0] : bounds.min[0], (corner & 2) ? bounds.max[1] : bounds.min[1], (corner & 4) ? bounds.max[2] : bounds.min[2] };
+			float clip[4];
+			view.matrix.Transform(point, clip);
+
+			// behind a perspective view's eye the projection folds over, assume the whole tile
+			if (clip[3] <= 1e-5f)
+				return view.tile;
+			for (int i = 0; i < 2; i++)
+			{
+				lo[i] = std::min(lo[i], clip[i] / clip[3]);
+				hi[i] = std::max(hi[i], clip[i] / clip[3]);
+			}
+		}
+		if (hi[0] < -1.0f || lo[0] > 1.0f || hi[1] < -1.0f || lo[1] > 1.0f)
+			return Rect();
+
+		const Rect& tile = view.tile;
+		auto texel = [](float ndc, uint32_t size) { return (std::clamp(ndc, -1.0f, 1.0f) * 0.5f + 0.5f) * float(size); };
+		Rect rect = Rect::FromEdges(
+			tile.x + int32_t(std::floor(texel(lo[0], tile.width))) - TexelMargin,
+			tile.y + int32_t(std::floor(texel(lo[1], tile.height))) - TexelMargin,
+			tile.x + int32_t(std::ceil(texel(hi[0], tile.width))) + TexelMargin,
+			tile.y + int32_t(std::ceil(texel(hi[1], tile.height))) + TexelMargin);
+		return rect.Intersection(tile);
+	}
+
+	// adds a rect, merging it with any it overlaps. merged rects may overlap others, so merging repeats
+	static void _add(std::vector<Rect>& rects, Rect rect)
+	{
+		if (rect.Empty())
+			return;
+
+		for (size_t i = 0; i < rects.size();)
+		{
+			if (rects[i].Intersects(rect))
+			{
+				rect = rect.Union(rects[i]);
+				rects[i] = rects.back();
+				rects.pop_back();
+				i = 0;
+				continue;
+			}
+			i++;
+		}
+		rects.push_back(rect);
+
+		if (rects.size() > MaxRectsPerView)
+		{
+			Rect bounds;
+			for (const Rect& r : rects)
+				bounds = bounds.Union(r);
+			rects.assign(1, bounds);
+		}
+	}
+
+	static float _dot(const float a[3], const float b[3])
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	static void _cross(const float a[3], const float b[3], float result[3])
+	{
+		result[0] = a[1] * b[2] - a[2] * b[1];
+		result[1] = a[2] * b[0] - a[0] * b[2];
+		result[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	static void _normalize(float v[3])
+	{
+		float length = std::sqrt(_dot(v, v));
+		if (length > 0.0f)
+		{
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+
+	std::vector<View>		_views;
+	std::vector<ViewPlan>	_plans;
+	Stats					_stats;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// wall-clock trace of the startup phases, relative to the moment the trace was created.
+// phases may be recorded from any thread, so overlapping work shows up as overlapping intervals.
+class StartupTrace
+{
+	using Clock = std::chrono::steady_clock;
+
+public:
+	struct Phase
+	{
+		std::string		name;
+		double			beginMs;
+		double			endMs;
+		std::thread::id	thread;
+	};
+
+	// records the lifetime of the scope as one phase
+	class Scope
+	{
+	public:
+		Scope(StartupTrace& trace, const char* name)
+			: _trace(trace), _name(name), _begin(Clock::now())
+		{
+		}
+
+		~Scope()
+		{
+			_trace.Record(_name, _begin, Clock::now());
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		StartupTrace&		_trace;
+		const char*			_name;
+		Clock::time_point	_begin;
+	};
+
+	StartupTrace()
+		: _origin(Clock::now())
+	{
+	}
+
+	void Record(const char* name, Clock::time_point begin, Clock::time_point end)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_phases.push_back({ name, _toMs(begin), _toMs(end), std::this_thread::get_id() });
+	}
+
+	void MarkFirstFrame()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_firstFrameMs = _toMs(Clock::now());
+	}
+
+	double TimeToFirstFrameMs() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _firstFrameMs;
+	}
+
+	void Report(std::ostream& out) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		std::vector<std::thread::id> threads;
+		for (const Phase& phase : _phases)
+		{
+			if (std::find(threads.begin(), threads.end(), phase.thread) == threads.end())
+				threads.push_back(phase.thread);
+		}
+
+		out << "startup trace:" << std::endl;
+		out << std::fixed << std::setprecision(2);
+		for (const Phase& phase : _phases)
+		{
+			size_t lane = std::find(threads.begin(), threads.end(), phase.thread) - threads.begin();
+			out << "  [" << lane << "] "
+				<< std::left << std::setw(24) << phase.name << std::right
+				<< std::setw(10) << phase.beginMs << " -> "
+				<< std::setw(10) << phase.endMs << " ms"
+				<< std::setw(10) << (phase.endMs - phase.beginMs) << " ms" << std::endl;
+		}
+
+		// single line so CI can grep and regress against it
+		out << "time_to_first_frame_ms=" << _firstFrameMs << std::endl;
+		out << std::defaultfloat;
+	}
+
+private:
+	double _toMs(Clock::time_point t) const
+	{
+		return std::chrono::duration<double, std::milli>(t - _origin).count();
+	}
+
+	Clock::time_point	_origin;
+	mutable std::mutex	_mutex;
+	std::vector<Phase>	_phases;
+	double				_firstFrameMs = 0.0;
+};
@@ -0,0 +1,707 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MemoryTelemetry.h"
+#include "TextureTranscoder.h"
+
+// streams texture mips into device memory on demand.
+//
+// every texture always keeps its small mip tail resident; finer levels are requested from the on-screen
+// footprint of each draw and uploaded through a per-frame staging ring. a texture's resident levels live
+// in one image, so a residency change builds a new image (uploaded coarsest level first, possibly over
+// several frames) and swaps it in when complete. the old image is destroyed once no frame in flight can
+// still sample it. when the committed levels would exceed the budget (VK_EXT_memory_budget if present),
+// the finest levels of the least recently used textures are evicted first. levels are stored and uploaded in
+// whatever format the transcoder picked for the device, block compressed where it can.
+class TextureStreamer
+{
+public:
+	static const uint32_t DefaultTexture = 0;	// 1x1 white, what everything samples until its mips arrive
+
+	struct Stats
+	{
+		uint32_t		textures = 0;
+		VkDeviceSize	residentBytes = 0;
+		VkDeviceSize	budgetBytes = 0;
+		uint64_t		uploadedBytes = 0;
+		uint64_t		rebuilds = 0;
+		uint64_t		evictedLevels = 0;
+		uint64_t		deniedRequests = 0;		// frames a texture wanted finer mips than the budget allowed
+		uint64_t		trims = 0;				// frames trimmed for memory pressure
+	};
+
+	TextureStreamer(VkPhysicalDevice physicalDevice, VkDevice device, MemoryTelemetry& telemetry, uint32_t frameSlots, VkDeviceSize stagingSize,
+		VkDeviceSize budgetOverride, bool memoryBudgetSupported, bool compressTextures)
+		: _physicalDevice(physicalDevice), _device(device), _telemetry(telemetry), _frameSlots(frameSlots), _budgetOverride(budgetOverride),
+		_memoryBudgetSupported(memoryBudgetSupported), _transcoder(physicalDevice, compressTextures)
+	{
+		vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &_memoryProperties);
+		for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++)
+		{
+			if (_memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+			{
+				_heapIndex = _memoryProperties.memoryTypes[i].heapIndex;
+				break;
+			}
+		}
+
+		_createDescriptors();
+		_createStaging(stagingSize);
+
+		// the default texture goes through the same path, it's uploaded by the first RecordUploads
+		Texture white;
+		white.path = "default";
+		white.mips.width = 1;
+		white.mips.height = 1;
+		white.mips.levels.push_back({ 255, 255, 255, 255 });
+		_textures.push_back(std::move(white));
+		_onLoaded(DefaultTexture);
+	}
+
+	~TextureStreamer()
+	{
+		// the caller has waited for the device to go idle
+		for (Texture& texture : _textures)
+		{
+			_destroyResidency(texture.resident);
+		}
+		for (Rebuild& rebuild : _rebuilds)
+		{
+			_destroyResidency(rebuild.target);
+		}
+		for (Retired& retired : _retired)
+		{
+			_destroyResidency(retired.residency);
+		}
+
+		vkUnmapMemory(_device, _stagingMemory);
+		vkDestroyBuffer(_device, _stagingBuffer, nullptr);
+		_telemetry.Free(_stagingMemory);
+
+		vkDestroySampler(_device, _sampler, nullptr);
+		vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+	}
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// set 0, binding 0: combined image sampler, fragment stage
+	VkDescriptorSetLayout DescriptorSetLayout() const
+	{
+		return _setLayout;
+	}
+
+	// decoding, transcoding and mip generation run on a worker thread per texture, so a batch of loads decodes in
+	// parallel. the texture samples the default until its tail is resident
+	uint32_t Load(const std::string& path)
+	{
+		if (_textures.size() >= MaxTextures)
+		{
+			throw std::runtime_error("Too many streamed textures, at most " + std::to_string(MaxTextures));
+		}
+
+		Texture texture;
+		texture.path = path;
+		texture.loading = std::async(std::launch::async, [this, path]()
+		{
+			return _transcoder.Load(path);
+		});
+		_textures.push_back(std::move(texture));
+
+		return uint32_t(_textures.size() - 1);
+	}
+
+	// call once the fence of the frame that last used this slot has signaled
+	void BeginFrame(uint64_t frameIndex, uint32_t frameSlot)
+	{
+		_frameIndex = frameIndex;
+		_stagingOffset = VkDeviceSize(frameSlot) * _stagingSegment;
+		_stagingEnd = _stagingOffset + _stagingSegment;
+
+		// anything retired a full ring of frames ago can no longer be sampled
+		while (!_retired.empty() && _retired.front().frame + _frameSlots <= _frameIndex)
+		{
+			_destroyResidency(_retired.front().residency);
+			_retired.pop_front();
+		}
+
+		for (uint32_t i = 0; i < _textures.size(); i++)
+		{
+			Texture& texture = _textures[i];
+			if (texture.loading.valid() && texture.loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			{
+				texture.mips = texture.loading.get();	// rethrows decode errors
+				_onLoaded(i);
+			}
+		}
+
+		_updateBudget();
+		if (_trimBytes > 0)
+		{
+			_budgetBytes = std::min(_budgetBytes, _committedBytes > _trimBytes ? _committedBytes - _trimBytes : 0);
+			_stats.trims++;
+			_trimBytes = 0;
+		}
+		_planResidency();
+	}
+
+	// memory pressure from outside: the next BeginFrame gives back up to 'bytes' of the least recently
+	// used mips and streams nothing in for that frame
+	void Trim(VkDeviceSize bytes)
+	{
+		_trimBytes = std::max(_trimBytes, bytes);
+	}
+
+	uint32_t HeapIndex() const
+	{
+		return _heapIndex;
+	}
+
+	// records demand from a draw's on-screen footprint in pixels and returns the set to bind for it
+	VkDescriptorSet Request(uint32_t textureIndex, float screenWidth, float screenHeight)
+	{
+		Texture& texture = _textures[textureIndex];
+		if (!texture.ready)
+			return _textures[DefaultTexture].resident.set;
+
+		// level whose texel density matches the screen, clamped to what can ever be resident
+		double ratio = std::max(texture.mips.width / std::max(screenWidth, 1.0f), texture.mips.height / std::max(screenHeight, 1.0f));
+		uint32_t level = ratio > 1.0 ? uint32_t(std::floor(std::log2(ratio))) : 0;
+		level = std::clamp(level, texture.finestLevel, texture.tailLevel);
+
+		// several draws can share a texture, the finest request of the frame wins
+		if (texture.lastUsedFrame != _frameIndex || level < texture.wantedLevel)
+		{
+			texture.wantedLevel = level;
+		}
+		texture.lastUsedFrame = _frameIndex;
+
+		if (texture.resident.image == VK_NULL_HANDLE)
+			return _textures[DefaultTexture].resident.set;
+		return texture.resident.set;
+	}
+
+	// residency changes and uploads, recorded into the frame's command buffer before the render pass
+	void RecordUploads(VkCommandBuffer commandBuffer)
+	{
+		while (!_rebuilds.empty())
+		{
+			Rebuild& rebuild = _rebuilds.front();
+			Texture& texture = _textures[rebuild.texture];
+
+			if (rebuild.target.image == VK_NULL_HANDLE)
+			{
+				_createResidency(texture, rebuild.target);
+
+				VkImageMemoryBarrier toTransfer = _barrier(rebuild.target.image, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &toTransfer);
+			}
+
+			// coarsest first, the image isn't used until every level is in
+			while (rebuild.remainingLevels > 0)
+			{
+				uint32_t imageLevel = rebuild.remainingLevels - 1;
+				uint32_t level = rebuild.target.baseLevel + imageLevel;
+				const std::vector<uint8_t>& data = texture.mips.levels[level];
+
+				// copies start on a texel block, 16 bytes covers every format's block
+				VkDeviceSize offset = (_stagingOffset + 15) & ~VkDeviceSize(15);
+				if (offset + data.size() > _stagingEnd)
+					return;	// ring segment full, continue next frame
+				_stagingOffset = offset;
+
+				memcpy(static_cast<uint8_t*>(_stagingMapped) + _stagingOffset, data.data(), data.size());
+
+				VkBufferImageCopy region = {};
+				region.bufferOffset = _stagingOffset;
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = imageLevel;
+				region.imageSubresource.baseArrayLayer = 0;
+				region.imageSubresource.layerCount = 1;
+				region.imageExtent = { texture.mips.LevelWidth(level), texture.mips.LevelHeight(level), 1 };
+				vkCmdCopyBufferToImage(commandBuffer, _stagingBuffer, rebuild.target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+				_stagingOffset += data.size();
+				_stats.uploadedBytes += data.size();
+				rebuild.remainingLevels--;
+			}
+
+			VkImageMemoryBarrier toShader = _barrier(rebuild.target.image, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, 0, 0, 0, 1, &toShader);
+
+			// swap in, the old image may still be sampled by frames in flight
+			if (texture.resident.image != VK_NULL_HANDLE)
+			{
+				_retired.push_back({ texture.resident, _frameIndex });
+			}
+			texture.resident = rebuild.target;
+			texture.rebuilding = false;
+			_stats.rebuilds++;
+			_rebuilds.pop_front();
+		}
+	}
+
+	Stats GetStats() const
+	{
+		Stats stats = _stats;
+		stats.textures = uint32_t(_textures.size() - 1);
+		stats.residentBytes = _committedBytes;
+		stats.budgetBytes = _budgetBytes;
+		return stats;
+	}
+
+	void Report(std::ostream& out) const
+	{
+		Stats stats = GetStats();
+		const double mb = 1.0 / (1024.0 * 1024.0);
+		out << "texture streaming: " << stats.textures << " textures, " << stats.residentBytes * mb << " MB resident of "
+			<< stats.budgetBytes * mb << " MB budget (" << _budgetSource() << "), " << stats.uploadedBytes * mb << " MB uploaded, "
+			<< stats.rebuilds << " residency changes, " << stats.evictedLevels << " levels evicted, "
+			<< stats.deniedRequests << " requests over budget, " << stats.trims << " frames trimmed" << std::endl;
+		_transcoder.Report(out);
+	}
+
+private:
+	static const uint32_t MaxTextures = 256;
+	static const uint32_t TailSize = 64;	// levels this size and smaller are never evicted
+
+	// one image holding levels [baseLevel, mip count) of a texture
+	struct Residency
+	{
+		VkImage			image = VK_NULL_HANDLE;
+		VkDeviceMemory	memory = VK_NULL_HANDLE;
+		VkImageView		view = VK_NULL_HANDLE;
+		VkDescriptorSet	set = VK_NULL_HANDLE;
+		uint32_t		baseLevel = 0;
+	};
+
+	struct Texture
+	{
+		std::string				path;
+		std::future<MipChain>	loading;
+		MipChain				mips;
+		bool					ready = false;
+		bool					rebuilding = false;
+		Residency				resident;
+		uint32_t				committedLevel = 0;		// base level of the resident image, or of the one being built
+		uint32_t				wantedLevel = 0;
+		uint32_t				tailLevel = 0;
+		uint32_t				finestLevel = 0;		// finest level that fits a staging segment
+		uint64_t				lastUsedFrame = 0;
+	};
+
+	struct Rebuild
+	{
+		uint32_t	texture;
+		Residency	target;
+		uint32_t	remainingLevels;
+	};
+
+	struct Retired
+	{
+		Residency	residency;
+		uint64_t	frame;
+	};
+
+	void _onLoaded(uint32_t textureIndex)
+	{
+		Texture& texture = _textures[textureIndex];
+		uint32_t levelCount = uint32_t(texture.mips.levels.size());
+
+		texture.tailLevel = levelCount - 1;
+		while (texture.tailLevel > 0 && texture.mips.LevelWidth(texture.tailLevel - 1) <= TailSize && texture.mips.LevelHeight(texture.tailLevel - 1) <= TailSize)
+		{
+			texture.tailLevel--;
+		}
+		texture.finestLevel = 0;
+		while (texture.finestLevel < texture.tailLevel && texture.mips.levels[texture.finestLevel].size() > _stagingSegment)
+		{
+			texture.finestLevel++;
+		}
+
+		// the tail is loaded right away and doesn't count against the budget's eviction decisions
+		texture.ready = true;
+		texture.committedLevel = levelCount;
+		texture.wantedLevel = texture.tailLevel;
+		_commit(textureIndex, texture.tailLevel);
+	}
+
+	VkDeviceSize _chainBytes(const Texture& texture, uint32_t baseLevel) const
+	{
+		VkDeviceSize bytes = 0;
+		for (size_t level = baseLevel; level < texture.mips.levels.size(); level++)
+		{
+			bytes += texture.mips.levels[level].size();
+		}
+		return bytes;
+	}
+
+	// queues a rebuild of the texture with levels [baseLevel, mip count) resident
+	void _commit(uint32_t textureIndex, uint32_t baseLevel)
+	{
+		Texture& texture = _textures[textureIndex];
+		_committedBytes -= _chainBytes(texture, texture.committedLevel);
+		_committedBytes += _chainBytes(texture, baseLevel);
+		texture.committedLevel = baseLevel;
+		texture.rebuilding = true;
+
+		Rebuild rebuild;
+		rebuild.texture = textureIndex;
+		rebuild.target.baseLevel = baseLevel;
+		rebuild.remainingLevels = uint32_t(texture.mips.levels.size()) - baseLevel;
+		_rebuilds.push_back(rebuild);
+	}
+
+	void _updateBudget()
+	{
+		if (_budgetOverride > 0)
+		{
+			_budgetBytes = _budgetOverride;
+			return;
+		}
+
+		if (_memoryBudgetSupported)
+		{
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+			VkPhysicalDeviceMemoryProperties2 properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+			properties.pNext = &budget;
+			vkGetPhysicalDeviceMemoryProperties2(_physicalDevice, &properties);
+
+			// what the heap can take on top of everything that isn't ours, with headroom for
+			// attachments and other processes
+			VkDeviceSize usage = budget.heapUsage[_heapIndex];
+			VkDeviceSize others = usage > _committedBytes ? usage - _committedBytes : 0;
+			VkDeviceSize available = budget.heapBudget[_heapIndex] > others ? budget.heapBudget[_heapIndex] - others : 0;
+			_budgetBytes = available / 10 * 8;
+			return;
+		}
+
+		_budgetBytes = _memoryProperties.memoryHeaps[_heapIndex].size / 2;
+	}
+
+	const char* _budgetSource() const
+	{
+		if (_budgetOverride > 0)
+			return "override";
+		return _memoryBudgetSupported ? "VK_EXT_memory_budget" : "half of the device heap";
+	}
+
+	// drops the finest levels of the least recently used textures until 'needed' more bytes fit.
+	// plans against a copy of the committed levels, so nothing is evicted unless everything fits
+	bool _makeRoom(VkDeviceSize needed)
+	{
+		std::vector<uint32_t> levels(_textures.size());
+		for (uint32_t i = 0; i < _textures.size(); i++)
+		{
+			levels[i] = _textures[i].committedLevel;
+		}
+
+		VkDeviceSize committed = _committedBytes;
+		while (committed + needed > _budgetBytes)
+		{
+			// textures drawn this or last frame would only be streamed right back in
+			int victim = -1;
+			for (uint32_t i = 0; i < _textures.size(); i++)
+			{
+				const Texture& texture = _textures[i];
+				if (!texture.ready || texture.rebuilding || levels[i] >= texture.tailLevel || texture.lastUsedFrame + 1 >= _frameIndex)
+					continue;
+				if (victim < 0 || texture.lastUsedFrame < _textures[victim].lastUsedFrame)
+				{
+					victim = int(i);
+				}
+			}
+			if (victim < 0)
+				return false;
+
+			committed -= _textures[victim].mips.levels[levels[victim]].size();
+			levels[victim]++;
+		}
+
+		for (uint32_t i = 0; i < _textures.size(); i++)
+		{
+			if (levels[i] != _textures[i].committedLevel)
+			{
+				_stats.evictedLevels += levels[i] - _textures[i].committedLevel;
+				_commit(i, levels[i]);
+			}
+		}
+		return true;
+	}
+
+	void _planResidency()
+	{
+		// the budget can shrink under us, give back the LRU levels first
+		if (_committedBytes > _budgetBytes)
+		{
+			_makeRoom(0);
+		}
+
+		for (uint32_t i = 0; i < _textures.size(); i++)
+		{
+			// demand is only current for textures drawn last frame
+			Texture& texture = _textures[i];
+			if (!texture.ready || texture.rebuilding || texture.wantedLevel >= texture.committedLevel || texture.lastUsedFrame + 1 < _frameIndex)
+				continue;
+
+			// finest wanted level that fits, evicting other textures' mips as needed
+			uint32_t level = texture.wantedLevel;
+			for (; level < texture.committedLevel; level++)
+			{
+				VkDeviceSize needed = _chainBytes(texture, level) - _chainBytes(texture, texture.committedLevel);
+				if (_makeRoom(needed))
+					break;
+			}
+
+			if (level != texture.wantedLevel)
+			{
+				_stats.deniedRequests++;
+			}
+			if (level < texture.committedLevel)
+			{
+				_commit(i, level);
+			}
+		}
+	}
+
+	void _createResidency(const Texture& texture, Residency& residency)
+	{
+		uint32_t levelCount = uint32_t(texture.mips.levels.size()) - residency.baseLevel;
+
+		VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = texture.mips.format;
+		imageInfo.extent = { texture.mips.LevelWidth(residency.baseLevel), texture.mips.LevelHeight(residency.baseLevel), 1 };
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(_device, &imageInfo, nullptr, &residency.image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture image for " + texture.path);
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(_device, residency.image, &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = _findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (_telemetry.Allocate(allocInfo, MemoryCategory::Texture, &residency.memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate texture memory for " + texture.path);
+		}
+		vkBindImageMemory(_device, residency.image, residency.memory, 0);
+
+		VkImageViewCreateInfo viewInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = residency.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = imageInfo.format;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = levelCount;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(_device, &viewInfo, nullptr, &residency.view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture image view for " + texture.path);
+		}
+
+		VkDescriptorSetAllocateInfo setInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		setInfo.descriptorPool = _descriptorPool;
+		setInfo.descriptorSetCount = 1;
+		setInfo.pSetLayouts = &_setLayout;
+
+		if (vkAllocateDescriptorSets(_device, &setInfo, &residency.set) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate texture descriptor set!");
+		}
+
+		VkDescriptorImageInfo imageDescriptor = {};
+		imageDescriptor.sampler = _sampler;
+		imageDescriptor.imageView = residency.view;
+		imageDescriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.dstSet = residency.set;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &imageDescriptor;
+		vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+	}
+
+	void _destroyResidency(Residency& residency)
+	{
+		if (residency.set != VK_NULL_HANDLE)
+		{
+			vkFreeDescriptorSets(_device, _descriptorPool, 1, &residency.set);
+		}
+		vkDestroyImageView(_device, residency.view, nullptr);
+		vkDestroyImage(_device, residency.image, nullptr);
+		_telemetry.Free(residency.memory);
+		residency = Residency();
+	}
+
+	void _createDescriptors()
+	{
+		VkDescriptorSetLayoutBinding binding = {};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+
+		if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_setLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture descriptor set layout!");
+		}
+
+		// resident + one being built + retired ones waiting out the frames in flight
+		uint32_t maxSets = MaxTextures * (2 + _frameSlots);
+
+		VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxSets };
+		VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		poolInfo.maxSets = maxSets;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture descriptor pool!");
+		}
+
+		// views only cover the resident levels, so the sampler never has to clamp the LOD
+		VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(_device, &samplerInfo, nullptr, &_sampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture sampler!");
+		}
+	}
+
+	// one host-visible ring split into a segment per frame slot, a segment is reused once its frame's fence signaled
+	void _createStaging(VkDeviceSize stagingSize)
+	{
+		_stagingSegment = (stagingSize / _frameSlots) & ~VkDeviceSize(15);
+		if (_stagingSegment == 0)
+		{
+			throw std::runtime_error("Texture staging ring is too small");
+		}
+
+		VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = _stagingSegment * _frameSlots;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(_device, &bufferInfo, nullptr, &_stagingBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture staging buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(_device, _stagingBuffer, &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = _findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		if (_telemetry.Allocate(allocInfo, MemoryCategory::Staging, &_stagingMemory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate texture staging memory!");
+		}
+
+		vkBindBufferMemory(_device, _stagingBuffer, _stagingMemory, 0);
+		vkMapMemory(_device, _stagingMemory, 0, VK_WHOLE_SIZE, 0, &_stagingMapped);
+	}
+
+	uint32_t _findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++)
+		{
+			if (typeFilter & (1 << i) && (_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
+		throw std::runtime_error("Failed to find suitable memory type for textures!");
+	}
+
+	VkImageMemoryBarrier _barrier(VkImage image, VkAccessFlags srcAccessMask, VkImageLayout oldLayout, VkAccessFlags dstAccessMask, VkImageLayout newLayout) const
+	{
+		VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstAccessMask = dstAccessMask;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		return barrier;
+	}
+
+	VkPhysicalDevice					_physicalDevice;
+	VkDevice							_device;
+	MemoryTelemetry&					_telemetry;
+	uint32_t							_frameSlots;
+	VkDeviceSize						_budgetOverride;
+	bool								_memoryBudgetSupported;
+	TextureTranscoder					_transcoder;
+	VkPhysicalDeviceMemoryProperties	_memoryProperties;
+	uint32_t							_heapIndex = 0;
+
+	VkDescriptorSetLayout				_setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool					_descriptorPool = VK_NULL_HANDLE;
+	VkSampler							_sampler = VK_NULL_HANDLE;
+
+	VkBuffer							_stagingBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory						_stagingMemory = VK_NULL_HANDLE;
+	void*								_stagingMapped = nullptr;
+	VkDeviceSize						_stagingSegment = 0;
+	VkDeviceSize						_stagingOffset = 0;
+	VkDeviceSize						_stagingEnd = 0;
+
+	std::vector<Texture>				_textures;
+	std::deque<Rebuild>					_rebuilds;
+	std::deque<Retired>					_retired;
+	uint64_t							_frameIndex = 0;
+	VkDeviceSize						_committedBytes = 0;
+	VkDeviceSize						_budgetBytes = 0;
+	VkDeviceSize						_trimBytes = 0;		// asked for by Trim, applied by the next BeginFrame
+	Stats								_stats;
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "ImageIO.h"
+#include "Ktx2.h"
+
+// full mip chain, level 0 first, each level tightly packed in 'format'. kept in system memory as the source
+// for streaming, so any level can be (re)uploaded without touching the file again
+struct MipChain
+{
+	VkFormat							format = VK_FORMAT_R8G8B8A8_UNORM;
+	uint32_t							width = 0;
+	uint32_t							height = 0;
+	std::vector<std::vector<uint8_t>>	levels;
+
+	uint32_t LevelWidth(uint32_t level) const { return std::max(width >> level, 1u); }
+	uint32_t LevelHeight(uint32_t level) const { return std::max(height >> level, 1u); }
+
+	// RGBA8, 2x2 box filter down to 1x1, the odd last row/column is clamped
+	static MipChain Build(std::vector<uint8_t> rgba, uint32_t width, uint32_t height)
+	{
+		MipChain chain;
+		chain.width = width;
+		chain.height = height;
+		chain.levels.push_back(std::move(rgba));
+
+		for (uint32_t level = 1; chain.LevelWidth(level - 1) > 1 || chain.LevelHeight(level - 1) > 1; level++)
+		{
+			const std::vector<uint8_t>& src = chain.levels[level - 1];
+			uint32_t srcWidth = chain.LevelWidth(level - 1);
+			uint32_t srcHeight = chain.LevelHeight(level - 1);
+			uint32_t dstWidth = chain.LevelWidth(level);
+			uint32_t dstHeight = chain.LevelHeight(level);
+
+			std::vector<uint8_t> dst(size_t(dstWidth) * dstHeight * 4);
+			for (uint32_t y = 0; y < dstHeight; y++)
+			{
+				uint32_t y0 = std::min(y * 2, srcHeight - 1);
+				uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+				for (uint32_t x = 0; x < dstWidth; x++)
+				{
+					uint32_t x0 = std::min(x * 2, srcWidth - 1);
+					uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+					for (uint32_t c = 0; c < 4; c++)
+					{
+						uint32_t sum = src[(size_t(y0) * srcWidth + x0) * 4 + c] + src[(size_t(y0) * srcWidth + x1) * 4 + c] +
+							src[(size_t(y1) * srcWidth + x0) * 4 + c] + src[(size_t(y1) * srcWidth + x1) * 4 + c];
+						dst[(size_t(y) * dstWidth + x) * 4 + c] = uint8_t((sum + 2) / 4);
+					}
+				}
+			}
+			chain.levels.push_back(std::move(dst));
+		}
+		return chain;
+	}
+};
+
+// turns a texture file into the mip chain the device samples best, on whatever thread the streamer loads on.
+//
+// KTX2 files in a block format the device samples (vkGetPhysicalDeviceFormatProperties) are taken as they are,
+// with their precomputed mips; a lone RGBA8 level gets its mips built. BC1/BC3 files on a device without BC are
+// decoded to RGBA8. RGBA8 (PNG and uncompressed KTX2) is encoded to BC1, or BC3 when any texel isn't opaque,
+// where the device samples those. nothing is encoded to ETC2 or ASTC, those only come precompressed
+class TextureTranscoder
+{
+public:
+	struct Stats
+	{
+		uint32_t		textures = 0;
+		uint32_t		precompressed = 0;	// uploaded in the file's block format
+		uint32_t		encoded = 0;		// RGBA8 encoded to BC1/BC3 here
+		uint32_t		decoded = 0;		// block format the device can't sample, decoded to RGBA8
+		uint64_t		bytes = 0;			// all levels as uploaded
+		uint64_t		rgbaBytes = 0;		// the same levels as RGBA8
+		double			loadMs = 0.0;		// summed over the worker threads
+	};
+
+	TextureTranscoder(VkPhysicalDevice physicalDevice, bool compress)
+		: _physicalDevice(physicalDevice), _compress(compress)
+	{
+		_bcSupported = Supports(VK_FORMAT_BC1_RGB_UNORM_BLOCK) && Supports(VK_FORMAT_BC3_UNORM_BLOCK) &&
+			Supports(VK_FORMAT_BC1_RGB_SRGB_BLOCK) && Supports(VK_FORMAT_BC3_SRGB_BLOCK);
+	}
+
+	TextureTranscoder(const TextureTranscoder&) = delete;
+	TextureTranscoder& operator=(const TextureTranscoder&) = delete;
+
+	// sampled with linear filtering from optimal tiling
+	bool Supports(VkFormat format) const
+	{
+		VkFormatProperties properties = {};
+		vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &properties);
+		VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		return (properties.optimalTilingFeatures & needed) == needed;
+	}
+
+	// safe to call from several threads at once
+	MipChain Load(const std::string& path)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		std::vector<uint8_t> file = ImageIO::ReadFile(path);
+
+		MipChain chain;
+		bool precompressed = false, encoded = false, decoded = false;
+		if (Ktx2::IsKtx2(file))
+		{
+			Ktx2::Image image = Ktx2::Decode(file);
+			chain.format = image.format;
+			chain.width = image.width;
+			chain.height = image.height;
+			chain.levels = std::move(image.levels);
+
+			if (!_isRgba8(chain.format))
+			{
+				precompressed = Supports(chain.format);
+				if (!precompressed)
+				{
+					_decode(chain, path);
+					decoded = true;
+				}
+			}
+			if (_isRgba8(chain.format) && chain.levels.size() == 1)
+			{
+				VkFormat format = chain.format;
+				chain = MipChain::Build(std::move(chain.levels[0]), chain.width, chain.height);
+				chain.format = format;
+			}
+		}
+		else
+		{
+			uint32_t width = 0, height = 0;
+			std::vector<uint8_t> rgba = ImageIO::DecodePng(file, width, height);
+			chain = MipChain::Build(std::move(rgba), width, height);
+		}
+
+		uint64_t rgbaBytes = 0;
+		for (uint32_t level = 0; level < chain.levels.size(); level++)
+		{
+			rgbaBytes += uint64_t(chain.LevelWidth(level)) * chain.LevelHeight(level) * 4;
+		}
+
+		if (_compress && _bcSupported && _isRgba8(chain.format) && !decoded)
+		{
+			_encode(chain);
+			encoded = true;
+		}
+
+		uint64_t bytes = 0;
+		for (const std::vector<uint8_t>& level : chain.levels)
+		{
+			bytes += level.size();
+		}
+
+		std::lock_guard<std::mutex> lock(_statsMutex);
+		_stats.textures++;
+		_stats.precompressed += precompressed ? 1 : 0;
+		_stats.encoded += encoded ? 1 : 0;
+		_stats.decoded += decoded ? 1 : 0;
+		_stats.bytes += bytes;
+		_stats.rgbaBytes += rgbaBytes;
+		_stats.loadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		return chain;
+	}
+
+	Stats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(_statsMutex);
+		return _stats;
+	}
+
+	void Report(std::ostream& out) const
+	{
+		Stats stats = GetStats();
+		if (stats.textures == 0)
+			return;
+
+		const double mb = 1.0 / (1024.0 * 1024.0);
+		out << "texture transcoding (" << (_bcSupported ? "BC" : "no BC") << (_compress ? "" : ", compression off") << "): " << stats.precompressed
+			<< " precompressed, " << stats.encoded << " encoded to BC1/BC3, " << stats.decoded << " decoded to RGBA8, " << stats.bytes * mb << " MB instead of "
+			<< stats.rgbaBytes * mb << " MB as RGBA8, load avg " << stats.loadMs / stats.textures << " ms" << std::endl;
+	}
+
+private:
+	static bool _isRgba8(VkFormat format)
+	{
+		return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+	}
+
+	static bool _isSrgb(VkFormat format)
+	{
+		return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+			format == VK_FORMAT_BC3_SRGB_BLOCK;
+	}
+
+	// every level, BC3 if any texel of the top level isn't opaque
+	void _encode(MipChain& chain) const
+	{
+		const std::vector<uint8_t>& top = chain.levels[0];
+		bool alpha = false;
+		for (size_t i = 3; i < top.size() && !alpha; i += 4)
+		{
+			alpha = top[i] != 255;
+		}
+
+		bool srgb = _isSrgb(chain.format);
+		for (uint32_t level = 0; level < chain.levels.size(); level++)
+		{
+			chain.levels[level] = BlockCompression::Encode(chain.levels[level], chain.LevelWidth(level), chain.LevelHeight(level), alpha);
+		}
+		if (alpha)
+			chain.format = srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+		else
+			chain.format = srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	}
+
+	void _decode(MipChain& chain, const std::string& path) const
+	{
+		bool bc1 = chain.format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || chain.format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ||
+			chain.format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || chain.format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		bool bc1Alpha = chain.format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || chain.format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		bool bc3 = chain.format == VK_FORMAT_BC3_UNORM_BLOCK || chain.format == VK_FORMAT_BC3_SRGB_BLOCK;
+		if (!bc1 && !bc3)
+		{
+			throw std::runtime_error(path + ": the device can't sample vkFormat " + std::to_string(int(chain.format)) + " and there's no decoder for it");
+		}
+
+		for (uint32_t level = 0; level < chain.levels.size(); level++)
+		{
+			chain.levels[level] = BlockCompression::Decode(chain.levels[level], chain.LevelWidth(level), chain.LevelHeight(level), bc3, bc1Alpha);
+		}
+		chain.format = _isSrgb(chain.format) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	VkPhysicalDevice	_physicalDevice;
+	bool				_compress;
+	bool				_bcSupported = false;
+	mutable std::mutex	_statsMutex;
+	Stats				_stats;
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "MemoryTelemetry.h"
+
+// the frame's intermediate images, which hold nothing from one frame to the next. each is added with the range of
+// passes that use it, in recording order; images whose ranges don't overlap share one allocation, bound at the same
+// offset. whoever uses an image first in a frame has to treat its contents as undefined (an UNDEFINED layout
+// transition, or a load op that doesn't load) and order itself after the last use of whatever shares its memory.
+//
+// 'tileOnly' images are never sampled, loaded or stored: they get TRANSIENT_ATTACHMENT usage and lazily allocated
+// memory where the device has it, which a tiler never backs with real memory. they only share with each other.
+class TransientAttachments
+{
+public:
+	struct Stats
+	{
+		uint32_t		images = 0;
+		uint32_t		allocations = 0;
+		VkDeviceSize	dedicatedBytes = 0;		// what an allocation per image would take
+		VkDeviceSize	allocatedBytes = 0;		// not counting lazily allocated memory
+		VkDeviceSize	lazyBytes = 0;			// reserved lazily allocated memory
+		VkDeviceSize	lazyCommittedBytes = 0;	// of that, what the driver backed
+	};
+
+	TransientAttachments(VkPhysicalDevice physicalDevice, VkDevice device, MemoryTelemetry& telemetry)
+		: _device(device), _telemetry(telemetry)
+	{
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+	}
+
+	~TransientAttachments()
+	{
+		Destroy();
+	}
+
+	TransientAttachments(const TransientAttachments&) = delete;
+	TransientAttachments& operator=(const TransientAttachments&) = delete;
+
+	// creates the image right away, memory is bound by Allocate
+	VkImage Add(VkImageCreateInfo imageInfo, uint32_t firstPass, uint32_t lastPass, bool tileOnly)
+	{
+		if (tileOnly)
+		{
+			imageInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
+
+		Image image;
+		image.firstPass = firstPass;
+		image.lastPass = lastPass;
+		image.tileOnly = tileOnly;
+		if (vkCreateImage(_device, &imageInfo, nullptr, &image.image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create transient attachment");
+		}
+		vkGetImageMemoryRequirements(_device, image.image, &image.requirements);
+		_images.push_back(image);
+		return image.image;
+	}
+
+	// largest first, each into the first allocation it fits in time and memory type with
+	void Allocate()
+	{
+		std::vector<size_t> order(_images.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return _images[a].requirements.size > _images[b].requirements.size; });
+
+		for (size_t index : order)
+		{
+			Image& image = _images[index];
+			VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			if (image.tileOnly && _findMemoryType(image.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != UINT32_MAX)
+			{
+				properties = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			}
+
+			Block* target = nullptr;
+			for (Block& block : _blocks)
+			{
+				if (block.properties == properties && block.tileOnly == image.tileOnly &&
+					_findMemoryType(block.memoryTypeBits & image.requirements.memoryTypeBits, properties) != UINT32_MAX && !_overlaps(block, image))
+				{
+					target = &block;
+					break;
+				}
+			}
+			if (target == nullptr)
+			{
+				_blocks.push_back({});
+				target = &_blocks.back();
+				target->properties = properties;
+				target->tileOnly = image.tileOnly;
+				target->memoryTypeBits = ~0u;
+			}
+
+			target->memoryTypeBits &= image.requirements.memoryTypeBits;
+			target->size = std::max(target->size, image.requirements.size);
+			target->images.push_back(index);
+		}
+
+		// every member binds at offset 0, which any alignment allows
+		for (Block& block : _blocks)
+		{
+			VkMemoryAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+			allocInfo.allocationSize = block.size;
+			allocInfo.memoryTypeIndex = _findMemoryType(block.memoryTypeBits, block.properties);
+			if (_telemetry.Allocate(allocInfo, MemoryCategory::Transient, &block.memory) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to allocate transient attachment memory");
+			}
+			for (size_t index : block.images)
+			{
+				vkBindImageMemory(_device, _images[index].image, block.memory, 0);
+			}
+		}
+		_lastStats = GetStats();
+	}
+
+	// images and memory, the caller has destroyed the views
+	void Destroy()
+	{
+		if (!_images.empty())
+		{
+			_lastStats = GetStats();
+		}
+		for (Image& image : _images)
+		{
+			vkDestroyImage(_device, image.image, nullptr);
+		}
+		for (Block& block : _blocks)
+		{
+			_telemetry.Free(block.memory);
+		}
+		_images.clear();
+		_blocks.clear();
+	}
+
+	Stats GetStats() const
+	{
+		Stats stats;
+		stats.images = uint32_t(_images.size());
+		stats.allocations = uint32_t(_blocks.size());
+		for (const Image& image : _images)
+		{
+			stats.dedicatedBytes += image.requirements.size;
+		}
+		for (const Block& block : _blocks)
+		{
+			if (block.properties == VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+			{
+				VkDeviceSize committed = 0;
+				vkGetDeviceMemoryCommitment(_device, block.memory, &committed);
+				stats.lazyBytes += block.size;
+				stats.lazyCommittedBytes += committed;
+			}
+			else
+			{
+				stats.allocatedBytes += block.size;
+			}
+		}
+		return stats;
+	}
+
+	// the last set of images, the renderer reports after it destroyed them
+	void Report(std::ostream& out) const
+	{
+		const Stats& stats = _images.empty() ? _lastStats : GetStats();
+		if (stats.images == 0)
+			return;
+
+		const double mb = 1.0 / (1024.0 * 1024.0);
+		VkDeviceSize used = stats.allocatedBytes + stats.lazyCommittedBytes;
+		out << "transient attachments: " << stats.images << " images in " << stats.allocations << " allocations, " << stats.allocatedBytes * mb
+			<< " MB allocated and " << stats.lazyBytes * mb << " MB lazily allocated (" << stats.lazyCommittedBytes * mb << " MB committed) instead of "
+			<< stats.dedicatedBytes * mb << " MB, " << (stats.dedicatedBytes > used ? stats.dedicatedBytes - used : 0) * mb << " MB saved" << std::endl;
+	}
+
+private:
+	struct Image
+	{
+		VkImage					image = VK_NULL_HANDLE;
+		VkMemoryRequirements	requirements = {};
+		uint32_t				firstPass = 0;
+		uint32_t				lastPass = 0;
+		bool					tileOnly = false;
+	};
+
+	struct Block
+	{
+		VkDeviceMemory			memory = VK_NULL_HANDLE;
+		VkMemoryPropertyFlags	properties = 0;
+		bool					tileOnly = false;
+		uint32_t				memoryTypeBits = 0;
+		VkDeviceSize			size = 0;
+		std::vector<size_t>		images;
+	};
+
+	bool _overlaps(const Block& block, const Image& image) const
+	{
+		for (size_t index : block.images)
+		{
+			const Image& other = _images[index];
+			if (image.firstPass <= other.lastPass && other.firstPass <= image.lastPass)
+				return true;
+		}
+		return false;
+	}
+
+	uint32_t _findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++)
+		{
+			if (typeFilter & (1 << i) && (_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
+		return UINT32_MAX;
+	}
+
+	VkDevice							_device;
+	MemoryTelemetry&					_telemetry;
+	VkPhysicalDeviceMemoryProperties	_memoryProperties;
+	std::vector<Image>					_images;
+	std::vector<Block>					_blocks;
+	Stats								_lastStats;
+};
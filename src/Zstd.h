@@ -0,0 +1,686 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// Zstandard decompression (RFC 8878) for KTX2 supercompression, no libzstd dependency like ImageIO's inflater.
+// whole frames into memory, no dictionaries; the content checksum is skipped, not verified
+namespace Zstd
+{
+	class Decoder
+	{
+	public:
+		Decoder(const uint8_t* data, size_t size)
+			: _data(data), _size(size)
+		{
+		}
+
+		// every frame in the input, skippable frames are skipped
+		std::vector<uint8_t> Run(size_t sizeHint = 0)
+		{
+			std::vector<uint8_t> out;
+			out.reserve(sizeHint);
+			while (_pos < _size)
+			{
+				uint32_t magic = _read32(_pos);
+				if ((magic & 0xFFFFFFF0u) == 0x184D2A50u)
+				{
+					_pos += 8 + size_t(_read32(_pos + 4));
+					continue;
+				}
+				if (magic != 0xFD2FB528u)
+					throw std::runtime_error("zstd: bad frame magic");
+				_pos += 4;
+				_frame(out);
+			}
+			return out;
+		}
+
+	private:
+		static const int MaxHuffmanBits = 11;
+
+		struct Fse
+		{
+			uint32_t				accuracyLog = 0;
+			std::vector<uint8_t>	symbols;
+			std::vector<uint8_t>	bits;
+			std::vector<uint16_t>	base;
+		};
+
+		struct Huffman
+		{
+			uint32_t				maxBits = 0;
+			std::vector<uint8_t>	symbols;
+			std::vector<uint8_t>	bits;
+		};
+
+		// read back to front from the last byte, whose highest set bit marks where the data starts
+		struct BackwardStream
+		{
+			const uint8_t*	data;
+			size_t			size;
+			int64_t			offset;
+
+			BackwardStream(const uint8_t* data_, size_t size_)
+				: data(data_), size(size_)
+			{
+				if (size == 0 || data[size - 1] == 0)
+					throw std::runtime_error("zstd: bad bitstream end");
+				int high = 7;
+				while (!(data[size - 1] & (1 << high)))
+					high--;
+				offset = int64_t(size - 1) * 8 + high;
+			}
+
+			// past the start reads zeros, which the last states of a stream rely on
+			uint32_t Read(uint32_t count)
+			{
+				if (count == 0)
+					return 0;
+				offset -= count;
+				int64_t start = offset;
+				uint32_t available = count;
+				if (start < 0)
+				{
+					available = start + count > 0 ? uint32_t(start + count) : 0;
+					start = 0;
+				}
+				uint64_t value = 0;
+				if (available > 0)
+				{
+					size_t byte = size_t(start / 8);
+					for (size_t i = 0; i < 8 && byte + i < size; i++)
+						value |= uint64_t(data[byte + i]) << (8 * i);
+					value = (value >> (start % 8)) & ((uint64_t(1) << available) - 1);
+				}
+				return uint32_t(value << (count - available));
+			}
+		};
+
+		uint32_t _read32(size_t pos) const
+		{
+			if (pos + 4 > _size)
+				throw std::runtime_error("zstd: truncated frame");
+			return uint32_t(_data[pos]) | uint32_t(_data[pos + 1]) << 8 | uint32_t(_data[pos + 2]) << 16 | uint32_t(_data[pos + 3]) << 24;
+		}
+
+		void _need(size_t pos, size_t count) const
+		{
+			if (pos + count > _size)
+				throw std::runtime_error("zstd: truncated data");
+		}
+
+		static int _highBit(uint32_t value)
+		{
+			int bit = -1;
+			while (value)
+			{
+				value >>= 1;
+				bit++;
+			}
+			return bit;
+		}
+
+		void _frame(std::vector<uint8_t>& out)
+		{
+			_need(_pos, 1);
+			uint8_t descriptor = _data[_pos++];
+			uint32_t contentSizeFlag = descriptor >> 6;
+			bool singleSegment = (descriptor >> 5) & 1;
+			bool checksum = (descriptor >> 2) & 1;
+			uint32_t dictionaryFlag = descriptor & 3;
+
+			if (!singleSegment)
+				_pos++;	// window descriptor, the whole frame is kept anyway
+			static const size_t dictionaryBytes[4] = { 0, 1, 2, 4 };
+			_need(_pos, dictionaryBytes[dictionaryFlag]);
+			for (size_t i = 0; i < dictionaryBytes[dictionaryFlag]; i++)
+			{
+				if (_data[_pos + i] != 0)
+					throw std::runtime_error("zstd: dictionaries are not supported");
+			}
+			_pos += dictionaryBytes[dictionaryFlag];
+			static const size_t contentSizeBytes[4] = { 0, 2, 4, 8 };
+			_pos += contentSizeFlag == 0 && singleSegment ? 1 : contentSizeBytes[contentSizeFlag];
+
+			// repeat offsets and tables carry over from block to block within a frame
+			size_t frameStart = out.size();
+			_repeatOffsets[0] = 1;
+			_repeatOffsets[1] = 4;
+			_repeatOffsets[2] = 8;
+			_huffman = Huffman();
+			_tables[0] = _tables[1] = _tables[2] = Fse();
+
+			bool last = false;
+			while (!last)
+			{
+				_need(_pos, 3);
+				uint32_t header = uint32_t(_data[_pos]) | uint32_t(_data[_pos + 1]) << 8 | uint32_t(_data[_pos + 2]) << 16;
+				_pos += 3;
+				last = header & 1;
+				uint32_t type = (header >> 1) & 3;
+				size_t size = header >> 3;
+
+				if (type == 0)
+				{
+					_need(_pos, size);
+					out.insert(out.end(), _data + _pos, _data + _pos + size);
+					_pos += size;
+				}
+				else if (type == 1)
+				{
+					_need(_pos, 1);
+					out.insert(out.end(), size, _data[_pos]);
+					_pos += 1;
+				}
+				else if (type == 2)
+				{
+					_need(_pos, size);
+					_compressedBlock(_data + _pos, size, out, frameStart);
+					_pos += size;
+				}
+				else
+				{
+					throw std::runtime_error("zstd: reserved block type");
+				}
+			}
+			if (checksum)
+				_pos += 4;
+		}
+
+		void _compressedBlock(const uint8_t* block, size_t size, std::vector<uint8_t>& out, size_t frameStart)
+		{
+			size_t pos = 0;
+			std::vector<uint8_t> literals = _literals(block, size, pos);
+
+			if (pos >= size)
+				throw std::runtime_error("zstd: missing sequences section");
+			uint32_t count = block[pos++];
+			if (count >= 128)
+			{
+				if (pos >= size)
+					throw std::runtime_error("zstd: truncated sequence count");
+				if (count < 255)
+				{
+					count = ((count - 128) << 8) + block[pos++];
+				}
+				else
+				{
+					if (pos + 2 > size)
+						throw std::runtime_error("zstd: truncated sequence count");
+					count = block[pos] + (uint32_t(block[pos + 1]) << 8) + 0x7F00;
+					pos += 2;
+				}
+			}
+			if (count == 0)
+			{
+				out.insert(out.end(), literals.begin(), literals.end());
+				return;
+			}
+
+			if (pos >= size)
+				throw std::runtime_error("zstd: missing compression modes");
+			uint8_t modes = block[pos++];
+			static const int16_t literalLengthDefaults[36] = { 4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1, -1, -1, -1, -1 };
+			static const int16_t offsetDefaults[29] = { 1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1 };
+			static const int16_t matchLengthDefaults[53] = { 1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+				1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1 };
+			_sequenceTable(_tables[0], modes >> 6, block, size, pos, literalLengthDefaults, 36, 6, 9);
+			_sequenceTable(_tables[1], (modes >> 4) & 3, block, size, pos, offsetDefaults, 29, 5, 8);
+			_sequenceTable(_tables[2], (modes >> 2) & 3, block, size, pos, matchLengthDefaults, 53, 6, 9);
+
+			_sequences(block + pos, size - pos, count, literals, out, frameStart);
+		}
+
+		std::vector<uint8_t> _literals(const uint8_t* block, size_t size, size_t& pos)
+		{
+			if (size == 0)
+				throw std::runtime_error("zstd: empty block");
+			uint32_t type = block[0] & 3;
+			uint32_t sizeFormat = (block[0] >> 2) & 3;
+
+			if (type < 2)
+			{
+				size_t regenerated = 0;
+				if (sizeFormat == 0 || sizeFormat == 2)
+				{
+					regenerated = block[0] >> 3;
+					pos = 1;
+				}
+				else if (sizeFormat == 1)
+				{
+					if (size < 2)
+						throw std::runtime_error("zstd: truncated literals header");
+					regenerated = (block[0] >> 4) + (size_t(block[1]) << 4);
+					pos = 2;
+				}
+				else
+				{
+					if (size < 3)
+						throw std::runtime_error("zstd: truncated literals header");
+					regenerated = (block[0] >> 4) + (size_t(block[1]) << 4) + (size_t(block[2]) << 12);
+					pos = 3;
+				}
+
+				if (type == 0)
+				{
+					if (pos + regenerated > size)
+						throw std::runtime_error("zstd: truncated raw literals");
+					std::vector<uint8_t> literals(block + pos, block + pos + regenerated);
+					pos += regenerated;
+					return literals;
+				}
+				if (pos >= size)
+					throw std::runtime_error("zstd: truncated RLE literals");
+				std::vector<uint8_t> literals(regenerated, block[pos]);
+				pos += 1;
+				return literals;
+			}
+
+			size_t headerBytes = sizeFormat < 2 ? 3 : sizeFormat == 2 ? 4 : 5;
+			if (size < headerBytes)
+				throw std::runtime_error("zstd: truncated literals header");
+			uint64_t header = 0;
+			for (size_t i = 0; i < headerBytes; i++)
+				header |= uint64_t(block[i]) << (8 * i);
+			uint32_t sizeBits = sizeFormat < 2 ? 10 : sizeFormat == 2 ? 14 : 18;
+			size_t regenerated = size_t(header >> 4) & ((size_t(1) << sizeBits) - 1);
+			size_t compressed = size_t(header >> (4 + sizeBits)) & ((size_t(1) << sizeBits) - 1);
+			bool fourStreams = sizeFormat != 0;
+			pos = headerBytes;
+			if (pos + compressed > size)
+				throw std::runtime_error("zstd: truncated compressed literals");
+
+			const uint8_t* streams = block + pos;
+			size_t streamsSize = compressed;
+			if (type == 2)
+			{
+				size_t treeSize = _huffmanTable(streams, streamsSize);
+				streams += treeSize;
+				streamsSize -= treeSize;
+			}
+			else if (_huffman.maxBits == 0)
+			{
+				throw std::runtime_error("zstd: treeless literals without a previous table");
+			}
+			pos += compressed;
+
+			std::vector<uint8_t> literals(regenerated);
+			if (!fourStreams)
+			{
+				_huffmanStream(streams, streamsSize, literals.data(), regenerated);
+				return literals;
+			}
+
+			if (streamsSize < 6)
+				throw std::runtime_error("zstd: truncated jump table");
+			size_t sizes[4];
+			sizes[0] = streams[0] | (size_t(streams[1]) << 8);
+			sizes[1] = streams[2] | (size_t(streams[3]) << 8);
+			sizes[2] = streams[4] | (size_t(streams[5]) << 8);
+			if (sizes[0] + sizes[1] + sizes[2] + 6 > streamsSize)
+				throw std::runtime_error("zstd: bad jump table");
+			sizes[3] = streamsSize - 6 - sizes[0] - sizes[1] - sizes[2];
+
+			size_t quarter = (regenerated + 3) / 4;
+			const uint8_t* stream = streams + 6;
+			size_t written = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				size_t count = i < 3 ? std::min(quarter, regenerated - written) : regenerated - written;
+				_huffmanStream(stream, sizes[i], literals.data() + written, count);
+				stream += sizes[i];
+				written += count;
+			}
+			return literals;
+		}
+
+		// returns the bytes the tree description took
+		size_t _huffmanTable(const uint8_t* data, size_t size)
+		{
+			if (size == 0)
+				throw std::runtime_error("zstd: missing huffman tree");
+			uint8_t header = data[0];
+			std::vector<uint8_t> weights;
+			size_t used = 0;
+			if (header >= 128)
+			{
+				size_t count = header - 127;
+				used = 1 + (count + 1) / 2;
+				if (used > size)
+					throw std::runtime_error("zstd: truncated huffman weights");
+				for (size_t i = 0; i < count; i++)
+				{
+					uint8_t byte = data[1 + i / 2];
+					weights.push_back(i % 2 == 0 ? byte >> 4 : byte & 15);
+				}
+			}
+			else
+			{
+				used = 1 + size_t(header);
+				if (used > size)
+					throw std::runtime_error("zstd: truncated huffman weights");
+				weights = _fseWeights(data + 1, header);
+			}
+
+			// the last weight is implied by the others filling a power of two
+			uint32_t total = 0;
+			for (uint8_t weight : weights)
+			{
+				if (weight > MaxHuffmanBits)
+					throw std::runtime_error("zstd: bad huffman weight");
+				total += weight > 0 ? 1u << (weight - 1) : 0;
+			}
+			if (total == 0)
+				throw std::runtime_error("zstd: empty huffman tree");
+			uint32_t maxBits = uint32_t(_highBit(total)) + 1;
+			uint32_t rest = (1u << maxBits) - total;
+			if (rest & (rest - 1))
+				throw std::runtime_error("zstd: huffman weights don't fill the tree");
+			weights.push_back(uint8_t(_highBit(rest) + 1));
+			if (maxBits > MaxHuffmanBits || weights.size() > 256)
+				throw std::runtime_error("zstd: huffman tree too large");
+
+			Huffman huffman;
+			huffman.maxBits = maxBits;
+			huffman.symbols.resize(size_t(1) << maxBits);
+			huffman.bits.resize(size_t(1) << maxBits);
+
+			// longest codes first, each symbol taking 2^(maxBits - bits) entries
+			uint32_t rankCount[MaxHuffmanBits + 2] = {};
+			for (uint8_t weight : weights)
+			{
+				if (weight > 0)
+					rankCount[maxBits + 1 - weight]++;
+			}
+			uint32_t rankStart[MaxHuffmanBits + 2] = {};
+			uint32_t next = 0;
+			for (uint32_t bits = maxBits; bits >= 1; bits--)
+			{
+				rankStart[bits] = next;
+				next += rankCount[bits] << (maxBits - bits);
+			}
+			for (size_t symbol = 0; symbol < weights.size(); symbol++)
+			{
+				if (weights[symbol] == 0)
+					continue;
+				uint32_t bits = maxBits + 1 - weights[symbol];
+				uint32_t length = 1u << (maxBits - bits);
+				std::fill_n(huffman.symbols.begin() + rankStart[bits], length, uint8_t(symbol));
+				std::fill_n(huffman.bits.begin() + rankStart[bits], length, uint8_t(bits));
+				rankStart[bits] += length;
+			}
+			_huffman = std::move(huffman);
+			return used;
+		}
+
+		// huffman weights, two interleaved FSE states over one stream
+		std::vector<uint8_t> _fseWeights(const uint8_t* data, size_t size)
+		{
+			size_t pos = 0;
+			Fse table = _fseTable(data, size, pos, 255, 6);
+			BackwardStream stream(data + pos, size - pos);
+
+			std::vector<uint8_t> weights;
+			uint32_t states[2] = { stream.Read(table.accuracyLog), stream.Read(table.accuracyLog) };
+			for (int current = 0;; current ^= 1)
+			{
+				if (weights.size() >= 255)
+					throw std::runtime_error("zstd: too many huffman weights");
+				uint32_t& state = states[current];
+				weights.push_back(table.symbols[state]);
+				state = table.base[state] + stream.Read(table.bits[state]);
+				if (stream.offset < 0)
+				{
+					weights.push_back(table.symbols[states[current ^ 1]]);
+					break;
+				}
+			}
+			return weights;
+		}
+
+		void _huffmanStream(const uint8_t* data, size_t size, uint8_t* out, size_t count)
+		{
+			if (count == 0)
+				return;
+			BackwardStream stream(data, size);
+			uint32_t mask = (1u << _huffman.maxBits) - 1;
+			uint32_t state = stream.Read(_huffman.maxBits);
+			for (size_t i = 0; i < count; i++)
+			{
+				out[i] = _huffman.symbols[state];
+				uint32_t bits = _huffman.bits[state];
+				state = ((state << bits) + stream.Read(bits)) & mask;
+			}
+			if (stream.offset != -int64_t(_huffman.maxBits))
+				throw std::runtime_error("zstd: huffman stream size mismatch");
+		}
+
+		// normalized counts as the table description encodes them, read from 'pos' forward
+		Fse _fseTable(const uint8_t* data, size_t size, size_t& pos, uint32_t maxSymbols, uint32_t maxAccuracyLog)
+		{
+			uint64_t bitPos = uint64_t(pos) * 8;
+			auto read = [&](uint32_t count)
+			{
+				uint32_t value = 0;
+				for (uint32_t i = 0; i < count; i++, bitPos++)
+				{
+					if (bitPos / 8 >= size)
+						throw std::runtime_error("zstd: truncated FSE table");
+					value |= uint32_t((data[bitPos / 8] >> (bitPos % 8)) & 1) << i;
+				}
+				return value;
+			};
+
+			uint32_t accuracyLog = read(4) + 5;
+			if (accuracyLog > maxAccuracyLog)
+				throw std::runtime_error("zstd: FSE accuracy too high");
+
+			std::vector<int16_t> counts;
+			int32_t remaining = 1 << accuracyLog;
+			while (remaining > 0 && counts.size() <= maxSymbols)
+			{
+				uint32_t bits = uint32_t(_highBit(uint32_t(remaining + 1))) + 1;
+				uint32_t value = read(bits);
+				uint32_t lowerMask = (1u << (bits - 1)) - 1;
+				uint32_t threshold = (1u << bits) - 1 - uint32_t(remaining + 1);
+				if ((value & lowerMask) < threshold)
+				{
+					bitPos--;
+					value &= lowerMask;
+				}
+				else if (value > lowerMask)
+				{
+					value -= threshold;
+				}
+
+				int16_t count = int16_t(value) - 1;
+				remaining -= count < 0 ? -count : count;
+				counts.push_back(count);
+				if (count == 0)
+				{
+					for (uint32_t repeat = read(2);; repeat = read(2))
+					{
+						counts.insert(counts.end(), repeat, 0);
+						if (repeat != 3)
+							break;
+					}
+				}
+			}
+			if (remaining != 0 || counts.size() > maxSymbols + 1)
+				throw std::runtime_error("zstd: bad FSE table");
+			pos = size_t((bitPos + 7) / 8);
+			return _buildFse(counts.data(), counts.size(), accuracyLog);
+		}
+
+		static Fse _buildFse(const int16_t* counts, size_t symbolCount, uint32_t accuracyLog)
+		{
+			uint32_t tableSize = 1u << accuracyLog;
+			Fse table;
+			table.accuracyLog = accuracyLog;
+			table.symbols.resize(tableSize);
+			table.bits.resize(tableSize);
+			table.base.resize(tableSize);
+
+			// "less than 1" probabilities go to the end, the rest spread with the standard step
+			std::vector<uint32_t> next(symbolCount);
+			uint32_t high = tableSize;
+			for (size_t symbol = 0; symbol < symbolCount; symbol++)
+			{
+				if (counts[symbol] == -1)
+				{
+					table.symbols[--high] = uint8_t(symbol);
+					next[symbol] = 1;
+				}
+			}
+			uint32_t step = (tableSize >> 1) + (tableSize >> 3) + 3;
+			uint32_t mask = tableSize - 1;
+			uint32_t position = 0;
+			for (size_t symbol = 0; symbol < symbolCount; symbol++)
+			{
+				if (counts[symbol] <= 0)
+					continue;
+				next[symbol] = uint32_t(counts[symbol]);
+				for (int16_t i = 0; i < counts[symbol]; i++)
+				{
+					table.symbols[position] = uint8_t(symbol);
+					do
+					{
+						position = (position + step) & mask;
+					} while (position >= high);
+				}
+			}
+			if (position != 0)
+				throw std::runtime_error("zstd: FSE table doesn't add up");
+
+			for (uint32_t i = 0; i < tableSize; i++)
+			{
+				uint32_t state = next[table.symbols[i]]++;
+				table.bits[i] = uint8_t(accuracyLog - uint32_t(_highBit(state)));
+				table.base[i] = uint16_t((state << table.bits[i]) - tableSize);
+			}
+			return table;
+		}
+
+		void _sequenceTable(Fse& table, uint32_t mode, const uint8_t* block, size_t size, size_t& pos, const int16_t* defaults, size_t defaultCount,
+			uint32_t defaultLog, uint32_t maxLog)
+		{
+			if (mode == 0)
+			{
+				table = _buildFse(defaults, defaultCount, defaultLog);
+			}
+			else if (mode == 1)
+			{
+				if (pos >= size)
+					throw std::runtime_error("zstd: truncated RLE table");
+				table = Fse();
+				table.symbols.assign(1, block[pos++]);
+				table.bits.assign(1, 0);
+				table.base.assign(1, 0);
+			}
+			else if (mode == 2)
+			{
+				table = _fseTable(block, size, pos, uint32_t(defaultCount - 1), maxLog);
+			}
+			else if (table.symbols.empty())
+			{
+				throw std::runtime_error("zstd: repeated table without a previous one");
+			}
+		}
+
+		void _sequences(const uint8_t* data, size_t size, uint32_t count, const std::vector<uint8_t>& literals, std::vector<uint8_t>& out, size_t frameStart)
+		{
+			static const uint32_t literalLengthBase[36] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128,
+				256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536 };
+			static const uint8_t literalLengthBits[36] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11,
+				12, 13, 14, 15, 16 };
+			static const uint32_t matchLengthBase[53] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28,
+				29, 30, 31, 32, 33, 34, 35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051, 4099, 8195, 16387, 32771, 65539 };
+			static const uint8_t matchLengthBits[53] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+				0, 1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+
+			Fse& literalLengths = _tables[0];
+			Fse& offsets = _tables[1];
+			Fse& matchLengths = _tables[2];
+
+			BackwardStream stream(data, size);
+			uint32_t literalLengthState = stream.Read(literalLengths.accuracyLog);
+			uint32_t offsetState = stream.Read(offsets.accuracyLog);
+			uint32_t matchLengthState = stream.Read(matchLengths.accuracyLog);
+
+			size_t literal = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint32_t offsetCode = offsets.symbols[offsetState];
+				uint32_t matchLengthCode = matchLengths.symbols[matchLengthState];
+				uint32_t literalLengthCode = literalLengths.symbols[literalLengthState];
+				if (offsetCode > 31 || matchLengthCode > 52 || literalLengthCode > 35)
+					throw std::runtime_error("zstd: bad sequence code");
+
+				uint32_t offsetValue = (1u << offsetCode) + stream.Read(offsetCode);
+				uint32_t matchLength = matchLengthBase[matchLengthCode] + stream.Read(matchLengthBits[matchLengthCode]);
+				uint32_t literalLength = literalLengthBase[literalLengthCode] + stream.Read(literalLengthBits[literalLengthCode]);
+
+				if (i + 1 < count)
+				{
+					literalLengthState = literalLengths.base[literalLengthState] + stream.Read(literalLengths.bits[literalLengthState]);
+					matchLengthState = matchLengths.base[matchLengthState] + stream.Read(matchLengths.bits[matchLengthState]);
+					offsetState = offsets.base[offsetState] + stream.Read(offsets.bits[offsetState]);
+				}
+
+				// values 1-3 pick a repeat offset, shifted by one when there are no literals
+				size_t offset = 0;
+				if (offsetValue > 3)
+				{
+					offset = offsetValue - 3;
+					_repeatOffsets[2] = _repeatOffsets[1];
+					_repeatOffsets[1] = _repeatOffsets[0];
+					_repeatOffsets[0] = offset;
+				}
+				else
+				{
+					uint32_t repeat = offsetValue + (literalLength == 0 ? 1 : 0);
+					if (repeat == 1)
+					{
+						offset = _repeatOffsets[0];
+					}
+					else
+					{
+						offset = repeat == 4 ? _repeatOffsets[0] - 1 : _repeatOffsets[repeat - 1];
+						if (repeat != 2)
+							_repeatOffsets[2] = _repeatOffsets[1];
+						_repeatOffsets[1] = _repeatOffsets[0];
+						_repeatOffsets[0] = offset;
+					}
+				}
+
+				if (literal + literalLength > literals.size())
+					throw std::runtime_error("zstd: sequence past the literals");
+				out.insert(out.end(), literals.begin() + literal, literals.begin() + literal + literalLength);
+				literal += literalLength;
+
+				if (offset == 0 || offset > out.size() - frameStart)
+					throw std::runtime_error("zstd: offset out of the frame");
+				size_t from = out.size() - offset;
+				for (uint32_t j = 0; j < matchLength; j++)
+					out.push_back(out[from + j]);
+			}
+			out.insert(out.end(), literals.begin() + literal, literals.end());
+		}
+
+		const uint8_t*	_data;
+		size_t			_size;
+		size_t			_pos = 0;
+		size_t			_repeatOffsets[3] = {};
+		Huffman			_huffman;
+		Fse				_tables[3];		// literal lengths, offsets, match lengths
+	};
+
+	inline std::vector<uint8_t> Decompress(const uint8_t* data, size_t size, size_t sizeHint = 0)
+	{
+		return Decoder(data, size).Run(sizeHint);
+	}
+}
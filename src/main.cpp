@@ -14,11 +14,58 @@
 #include <assert.h>
 #include <optional>
 #include <vector>
+#include <future>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <cmath>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include "StartupTrace.h"
+#include "GpuProfiler.h"
+#include "RendererConfig.h"
+#include "FramePacing.h"
+#include "FrameCapture.h"
+#include "GoldenImage.h"
+#include "TextureStreamer.h"
+#include "MeshFormat.h"
+#include "MeshOptimizer.h"
+#include "ShadowCache.h"
+#include "BarrierBatch.h"
+#include "BatchDispatcher.h"
+#include "DrawQueue.h"
+#include "MemoryTelemetry.h"
+#include "TransientAttachments.h"
+#include "DynamicResolution.h"
+#include "CommandStream.h"
+#include "DebugUtils.h"
+#include "FrameExport.h"
+#include "SceneBatches.h"
 
 // global const
 const int		WIDTH			= 800;
 const int		HEIGHT			= 600;
-const int		MAX_FRAMES		= 2;
+const int		MAX_FRAMES		= 2;	// frames in flight, the low-latency policy uses 1
+const uint32_t	MAX_VIEWS		= 4;	// split-screen views, must match the mesh and culling shaders' view arrays
+const VkClearColorValue CLEAR_COLOR	= { { 48.0f / 255.0f, 10.0f / 255.0f, 36.0f / 255.0f, 1.0f } };
+const uint32_t	MANY_PIPELINES_COLUMNS = 4;	// the many-pipelines scene's grid, a pipeline per cell
+
+// clustered forward lighting, see light_bin.comp.glsl
+const uint32_t	LIGHT_TILE_SIZE	= 64;	// froxel width and height in pixels
+const uint32_t	LIGHT_SLICES	= 16;	// logarithmic depth slices
+const uint32_t	MAX_CLUSTER_LIGHTS = 128;	// per froxel, must match light_bin.comp.glsl
+const float		LIGHT_NEAR		= 1.0f;	// view distance of depth 0, the viewer sits in front of the volume
+const float		LIGHT_FAR		= 3.0f;	// and of depth 1: the orthographic volume is 2 units deep
+
+// mesh scene shadows, one depth atlas: three cascade quadrants, the fourth split into point light tiles
+const uint32_t	SHADOW_ATLAS_SIZE	= 2048;
+const uint32_t	SHADOW_CASCADES		= 3;	// must match mesh.frag.glsl
+const uint32_t	SHADOW_CASCADE_SIZE	= 1024;
+const uint32_t	SHADOW_TILE_SIZE	= 256;
+const float		SUN_DIRECTION[3]	= { 0.4f, 0.6f, 0.7f };	// towards the light, mesh.frag.glsl's lightDirection
 
 // for validation layer
 const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
@@ -26,12 +73,6 @@ const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation
 // for device layer
 const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
-#ifdef _DEBUG
-const bool enableValidationLayer = true;
-#else
-const bool enableValidationLayer = false;
-#endif // #ifdef NDEBUG
-
 
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
 	const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
@@ -84,8 +125,9 @@ class VKRenderer
 	{
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
+		std::optional<uint32_t> computeFamily;	// compute without graphics, runs next to the graphics queue
 
-		bool isComplete()
+		bool isComplete() const
 		{
 			return graphicsFamily.has_value() && presentFamily.has_value();
 		}
@@ -97,28 +139,274 @@ class VKRenderer
 		std::vector<VkSurfaceFormatKHR> formats;
 		std::vector<VkPresentModeKHR> presentModes;
 	};
+
+	// everything device selection needs, queried once per physical device
+	struct PhysicalDeviceInfo
+	{
+		VkPhysicalDevice			device = VK_NULL_HANDLE;
+		VkPhysicalDeviceProperties	properties;
+		VkPhysicalDeviceFeatures	features;
+		QueueFamilyIndices			queueFamilies;
+		bool						extensionsSupported = false;
+		std::set<std::string>		availableExtensions;
+		bool						presentWaitSupported = false;
+		bool						memoryBudgetSupported = false;
+		bool						meshShaderSupported = false;
+		bool						dynamicRenderingSupported = false;	// core or VK_KHR_dynamic_rendering
+		bool						synchronization2Supported = false;	// core or VK_KHR_synchronization2
+		bool						multiviewSupported = false;			// core from 1.1
+		bool						viewportIndexSupported = false;		// multiViewport and VK_EXT_shader_viewport_index_layer
+		SwapchainSupportDetails		swapchainSupport;
+	};
+
+	struct PendingPresent
+	{
+		uint64_t								id;
+		std::chrono::steady_clock::time_point	inputTime;
+	};
+
+	// host-visible readback target, one per frame in flight. filled by the frame's command buffer
+	// and read once that frame's fence is waited on anyway, so capture never stalls the queue
+	struct CaptureSlot
+	{
+		VkBuffer		buffer = VK_NULL_HANDLE;
+		VkDeviceMemory	memory = VK_NULL_HANDLE;
+		void*			mapped = nullptr;
+		VkDeviceSize	size = 0;
+		bool			coherent = false;
+		bool			pending = false;
+		uint64_t		frameIndex = 0;
+		VkExtent2D		extent = {};
+		bool			imported = false;	// the export ring's memory, mapped by the ring
+	};
+
+	// vertex push constants, see triangle.vert.glsl
+	struct DrawParams
+	{
+		float		offset[2];
+		float		scale[2];
+		uint32_t	columns;
+		uint32_t	view;		// the split-screen view a mesh draw is for
+	};
+
+	// a split-screen view of the mesh scene: clip space is (position - center) * zoom. all views are pushed
+	// once per pass behind DrawParams, see mesh_multiview.vert.glsl
+	struct ViewParams
+	{
+		float		center[2];
+		float		zoom;
+		float		padding;
+	};
+	static const uint32_t ViewParamsOffset = 32;
+
+	// the frame's passes in recording order, the lifetimes of transient attachments
+	enum FramePass : uint32_t
+	{
+		FramePassClusterCulling,
+		FramePassEarlyScene,
+		FramePassDepthReduce,
+		FramePassLateCulling,
+		FramePassLateScene,
+		FramePassUpscale,		// multiview and dynamic resolution only
+	};
+
+	// ClusterCullParams::phase. with occlusion culling the early phase draws what was visible last frame and
+	// the late phase whatever the early phase's depth doesn't hide. without it one phase draws everything
+	enum CullPhase : uint32_t
+	{
+		CullPhaseEarly,
+		CullPhaseLate,
+		CullPhaseAll,
+	};
+
+	// the scene's pipelines as the command stream names them
+	enum ScenePipeline : uint32_t
+	{
+		ScenePipelineGraphics,
+		ScenePipelineMesh,
+		ScenePipelineMany,		// plus the many-pipelines scene's index
+	};
+
+	// what a recorded upload writes, offsets are from the start of the target
+	enum UploadTarget : uint32_t
+	{
+		UploadTargetLights,				// this frame slot's PointLight slice
+		UploadTargetDynamicInstances,	// _meshInstances from the first dynamic one
+	};
+
+	// cluster culling push constants, see lod_select.comp.glsl and cluster_cull.comp.glsl. the mesh shaders share them
+	struct ClusterCullParams
+	{
+		float		viewDirection[3];
+		float		aspect;				// height / width, instance x scales are multiplied by it
+		uint32_t	instanceCount;
+		uint32_t	lodCount;
+		uint32_t	maxMeshlets;		// LOD 0's, the most any level has
+		uint32_t	instance;			// mesh shading draws one instance at a time
+		float		viewportHeight;
+		float		errorThreshold;		// pixels
+		float		hysteresis;
+		uint32_t	indexStride;		// compacted indices reserved per instance
+		uint32_t	phase;				// CullPhase
+		uint32_t	viewCount;			// each view is culled into its own commands and index stream slices
+		uint32_t	padding[2];
+		ViewParams	views[MAX_VIEWS];
+	};
+	static_assert(sizeof(ClusterCullParams) == 128, "push constant layout is shared with the culling shaders, 128 bytes is all a device must have");
+
+	// per instance and phase: what the culling pre-pass hands the indirect draw, counters for the report
+	// and the LOD picked last frame, which the hysteresis needs. the late phase's commands follow the early ones
+	struct ClusterDrawCommand
+	{
+		VkDrawIndexedIndirectCommand	draw;
+		uint32_t						visibleMeshlets;
+		uint32_t						lod;
+		uint32_t						occludedMeshlets;	// late phase only
+	};
+
+	// lighting uniforms, std140. see light_bin.comp.glsl
+	struct LightingParams
+	{
+		uint32_t	clusterCount[3];	// tiles x, tiles y, depth slices
+		uint32_t	lightCount;
+		float		viewportSize[2];
+		float		nearDistance;
+		float		farDistance;
+		uint32_t	tileSize;
+		uint32_t	padding[3];
+	};
+
+	// view space, what the binning and the fragment shaders read
+	struct PointLight
+	{
+		float		position[3];
+		float		radius;
+		float		color[3];
+		int32_t		shadowView;			// -1 when the light casts no shadow
+	};
+
+	// a light circling its center, placed in view space every frame
+	struct AnimatedLight
+	{
+		float		center[3];			// x in [-1, 1], stretched to the viewport's aspect when placed
+		float		orbit;
+		float		speed;				// radians per second
+		float		phase;
+		PointLight	light;
+	};
+
+	// mesh scene instance placement, clip space
+	struct MeshInstance
+	{
+		float		offset[2];
+		float		scale;
+		float		padding;
+	};
+
+	// std430, see mesh.frag.glsl
+	struct ShadowView
+	{
+		float		shadowMatrix[16];	// view space to the shadow view's clip space
+		float		tile[4];			// atlas uv offset and size
+		float		splitDistance;		// cascades only
+		float		padding[3];
+	};
+
+	// shadow caster push constants, see shadow.vert.glsl
+	struct ShadowDrawParams
+	{
+		float		shadowMatrix[16];
+		float		offset[2];
+		float		scale;
+		float		depthOffset;
+	};
+
+	struct DeviceBuffer
+	{
+		VkBuffer		buffer = VK_NULL_HANDLE;
+		VkDeviceMemory	memory = VK_NULL_HANDLE;
+	};
 public:
+	explicit VKRenderer(const RendererConfig& config)
+		: _config(config), _drawQueue(config.drawSort)
+	{
+	}
+
 	void Run()
 	{
-		_initWindow();
+		if (_config.headless)
+		{
+			windowWidth = static_cast<int>(_config.width);
+			windowHeight = static_cast<int>(_config.height);
+		}
+		else
+		{
+			_initWindow();
+		}
 		_initVulkan();
 		_mainLoop();
 		_cleanup();
 	}
 
+	// RGBA8, only filled with captureToMemory
+	const CapturedFrame& LastCapturedFrame() const
+	{
+		return _lastCapturedFrame;
+	}
+
+	// CPU wall time of every main loop iteration
+	const std::vector<double>& FrameTimesMs() const
+	{
+		return _frameTimesMs;
+	}
+
+	// the "frame" scope's GPU time by frame index, -1 where it wasn't measured. the last frames in flight are
+	// never collected, and a queue without timestamps measures nothing
+	const std::vector<double>& GpuFrameTimesMs() const
+	{
+		return _gpuFrameTimesMs;
+	}
+
+	std::string DeviceName() const
+	{
+		return _physicalDeviceInfo.properties.deviceName;
+	}
+
+	// device group member: frames come from the dispatcher and readbacks go back to it
+	void SetDispatcher(BatchDispatcher* dispatcher)
+	{
+		_dispatcher = dispatcher;
+	}
+
+	uint64_t FramesRendered() const
+	{
+		return _frameIndex;
+	}
+
+	// every frame draws the recorded frame: its scene commands and uploads at its scene frame and render scale
+	void SetReplay(const CommandStream::Recording* replay)
+	{
+		_replay = replay;
+	}
+
 private:
+	RendererConfig	_config;
+
 	GLFWwindow* _window;
 	int			windowWidth;
 	int			windowHeight;
 
 	// vulkan
 	VkInstance							_instance;
+	uint32_t							_instanceApiVersion = VK_API_VERSION_1_0;
 
 	// debug messenger
-	VkDebugUtilsMessengerEXT			debugMessenger;
+	VkDebugUtilsMessengerEXT			debugMessenger = VK_NULL_HANDLE;
+	std::unique_ptr<DebugUtils>			_debugUtils;		// --validation or --debug-utils, outlives the instance for its last messages
 
 	// physical device-->gpu graphics card
 	VkPhysicalDevice					_physicalDevice = VK_NULL_HANDLE;
+	PhysicalDeviceInfo					_physicalDeviceInfo;
 
 	// logic device
 	VkDevice							_device;
@@ -127,8 +415,24 @@ private:
 	VkQueue								_graphicsQueue;
 	VkQueue								_presentQueue;
 
-	// surface
-	VkSurfaceKHR						_surface;
+	// async compute: light binning on a compute-only queue. the frame's graphics work is split in two submits,
+	// the part before the scene runs alongside the binning and the scene waits for it. the next binning waits
+	// for the scene to be done with the lists, which every frame shares
+	bool								_asyncCompute = false;
+	VkQueue								_computeQueue = VK_NULL_HANDLE;
+	VkCommandPool						_computeCommandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer>		_computeCommandBuffers;		// per frame slot
+	std::vector<VkCommandBuffer>		_earlyCommandBuffers;		// per swapchain image, the graphics work before the scene
+	VkSemaphore							_lightsBinnedSemaphore = VK_NULL_HANDLE;
+	VkSemaphore							_lightsReleasedSemaphore = VK_NULL_HANDLE;
+	bool								_lightsReleasedPending = false;	// signaled by a frame the next binning hasn't waited for
+	std::unique_ptr<GpuProfiler>		_computeProfiler;
+	uint64_t							_overlapFrames = 0;
+	double								_computeMs = 0.0;
+	double								_overlapMs = 0.0;			// of _computeMs, while graphics scopes ran
+
+	// surface, null when headless
+	VkSurfaceKHR						_surface = VK_NULL_HANDLE;
 
 	// swapchain
 	VkSwapchainKHR						_swapChain;
@@ -136,17 +440,53 @@ private:
 	VkFormat							_swapChainImageFormat;
 	VkExtent2D							_swapChainExtent;
 
+	// headless stand-in for the swapchain images
+	std::vector<VkDeviceMemory>			_offscreenMemory;
+
 	// image view
 	std::vector<VkImageView>			_swapChainImageViews;
 
 	// pipeline layout
 	VkPipelineLayout					_pipelineLayout;
 
-	// render pass
-	VkRenderPass						_renderPass;
+	// render pass, none with dynamic rendering
+	VkRenderPass						_renderPass = VK_NULL_HANDLE;
+	VkRenderPass						_lateRenderPass = VK_NULL_HANDLE;	// occlusion culling's second phase, loads what the first drew
+	VkFormat							_colorFormat = VK_FORMAT_UNDEFINED;	// what the pipelines render to
+
+	// dynamic rendering: passes begin on image views, pipelines only know the attachment formats, and nothing
+	// but the images themselves has to be rebuilt with the swapchain
+	bool								_dynamicRendering = false;
+	PFN_vkCmdBeginRendering				_vkCmdBeginRendering = nullptr;
+	PFN_vkCmdEndRendering				_vkCmdEndRendering = nullptr;
+
+	// depth, one image shared by all frames since the render passes order its uses
+	VkFormat							_depthFormat = VK_FORMAT_UNDEFINED;
+	VkImage								_depthImage = VK_NULL_HANDLE;
+	VkImageView							_depthImageView = VK_NULL_HANDLE;
+
+	// split-screen views of the mesh scene, tiled two across. multiview renders them into the layers of
+	// _sceneColorImage at tile size and copies each to its tile, the viewports path draws straight to the tiles
+	uint32_t							_viewCount = 1;
+	bool								_multiview = false;
+	ViewParams							_views[MAX_VIEWS] = { { { 0.0f, 0.0f }, 1.0f }, { { -0.5f, -0.5f }, 2.0f },
+											{ { 0.5f, -0.5f }, 2.0f }, { { 0.0f, -0.25f }, 1.5f } };
+
+	// where the scene passes draw when it isn't the swapchain image, see _offscreenScene. sized for the
+	// swapchain (a tile with multiview), dynamic resolution draws only the scaled render area of it
+	VkImage								_sceneColorImage = VK_NULL_HANDLE;
+	VkImageView							_sceneColorView = VK_NULL_HANDLE;		// every layer
+	std::unique_ptr<DynamicResolution>	_dynamicResolution;						// null at native resolution
+	float								_renderScale = 1.0f;					// this frame's, per axis
+
+	// depth and the pyramid: nothing in them outlives the frame, so their memory can be shared or never backed
+	std::unique_ptr<TransientAttachments>	_transientAttachments;
 
 	// graphics pipeline
 	VkPipeline							_graphicsPipeline;
+	std::vector<VkPipeline>				_scenePipelines;	// many-pipelines scene only
+	DrawQueue							_drawQueue;			// the scene's draws, sorted by pipeline and material
+	std::unique_ptr<SceneBatches>		_sceneBatches;		// the static scenes' draws as reusable secondaries, null records them inline
 
 	// frame buffers
 	std::vector<VkFramebuffer>			_swapChainFrameBuffers;
@@ -165,29 +505,155 @@ private:
 
 	// current frame
 	size_t								_currentFrame = 0;
+	size_t								_framesInFlight = MAX_FRAMES;
+
+	// frame pacing / latency
+	FrameLimiter						_frameLimiter;
+	bool								_presentWaitEnabled = false;
+	PFN_vkWaitForPresentKHR				_vkWaitForPresentKHR = nullptr;
+	uint64_t							_presentId = 0;
+	std::deque<PendingPresent>			_pendingPresents;
+	std::chrono::steady_clock::time_point _inputTimestamp;
+	LatencyStats						_latencyStats;
+
+	// frame capture
+	bool								_captureEnabled = false;
+	std::vector<CaptureSlot>			_captureSlots;
+	std::unique_ptr<FrameEncoder>		_frameEncoder;
+	uint64_t							_frameIndex = 0;
+	uint64_t							_capturedFrames = 0;
+	CapturedFrame						_lastCapturedFrame;
+	std::vector<double>					_frameTimesMs;
+	std::vector<double>					_gpuFrameTimesMs;	// by frame index, -1 for frames the profiler didn't collect
+	std::array<uint64_t, MAX_FRAMES>	_profiledFrames = {};	// the frame each slot's queries were recorded for
+
+	// device group: which of the job's frames this one is. animation and capture numbering follow it,
+	// so every device draws a frame the same. _frameIndex keeps counting this device's frames
+	BatchDispatcher*					_dispatcher = nullptr;
+	uint64_t							_sceneFrame = 0;
+
+	// frame export to a compositor's shared-memory ring, see FrameExport.h. a readback slot per ring slot, on
+	// the ring's own memory where the device imports host pointers
+	std::unique_ptr<FrameExport::Producer> _exportRing;
+	std::vector<CaptureSlot>			_exportSlots;
+	std::vector<int32_t>				_exportPending;			// per frame slot, the ring slot its frame went to or -1
+	bool								_exportHostImport = false;	// VK_EXT_external_memory_host
+	VkDeviceSize						_exportImportAlignment = 0;
+	PFN_vkGetMemoryHostPointerPropertiesEXT _vkGetMemoryHostPointerPropertiesEXT = nullptr;
+
+	// command stream, see CommandStream.h. the recording only exists while the frame it records is drawn
+	std::unique_ptr<CommandStream::Recording> _recording;
+	const CommandStream::Recording*		_replay = nullptr;
 
 	// resized
 	bool								_framebufferResized = false;
 
+	// texture streaming
+	std::unique_ptr<TextureStreamer>	_textureStreamer;
+	std::vector<uint32_t>				_sceneTextures;
+
+	// GPU timestamps per frame slot
+	std::unique_ptr<GpuProfiler>		_gpuProfiler;
+
+	// the frame's layout transitions and hand-offs, one dependency per batch
+	std::unique_ptr<BarrierBatch>		_barriers;
+	std::unique_ptr<MemoryTelemetry>	_memoryTelemetry;	// every device allocation goes through it
+
+	// clustered lights. the light set is bound by every scene, lights or not, so the shaders' bindings are always valid
+	std::vector<AnimatedLight>			_lights;
+	VkDescriptorSetLayout				_lightSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool					_lightDescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet						_lightSet = VK_NULL_HANDLE;
+	DeviceBuffer						_lightParams;			// LightingParams, host visible, rewritten with the swapchain
+	DeviceBuffer						_lightData;				// PointLight slice per frame slot, host visible
+	PointLight*							_lightDataMapped = nullptr;
+	VkDeviceSize						_lightSliceSize = 0;	// dynamic offset step
+	DeviceBuffer						_lightClusters;			// first index and count per froxel
+	DeviceBuffer						_lightIndices;			// counter, then the froxels' index runs
+	uint32_t							_lightClusterCount[3] = {};
+	VkPipelineLayout					_lightBinLayout = VK_NULL_HANDLE;
+	VkPipeline							_lightBinPipeline = VK_NULL_HANDLE;
+
+	// mesh scene, an optimized .vkmesh
+	MeshFormat::Header					_meshHeader = {};
+	DeviceBuffer						_meshVertices;
+	DeviceBuffer						_meshIndices;
+	std::vector<MeshFormat::Lod>		_meshLods;
+	std::vector<MeshInstance>			_meshInstances;
+	std::vector<MeshInstance>			_meshInstanceHomes;		// where the dynamic ones wander around
+	uint32_t							_dynamicInstances = 0;	// the last ones of _meshInstances
+	VkPipeline							_meshPipeline = VK_NULL_HANDLE;
+
+	// cached shadow maps of the mesh scene. static casters are rendered into the cache image, the atlas is
+	// the cache plus the dynamic casters. ShadowCache decides which texels of either need recording
+	bool								_shadowsEnabled = false;
+	ShadowCache							_shadowCache;
+	uint32_t							_shadowedLights = 0;	// the first ones of _lights
+	VkFormat							_shadowFormat = VK_FORMAT_UNDEFINED;
+	VkImage								_shadowImages[2] = {};	// cache, atlas
+	VkDeviceMemory						_shadowMemory[2] = {};
+	VkImageView							_shadowImageViews[2] = {};
+	VkFramebuffer						_shadowFramebuffers[2] = {};
+	VkRenderPass						_shadowCacheRenderPass = VK_NULL_HANDLE;
+	VkRenderPass						_shadowAtlasRenderPass = VK_NULL_HANDLE;
+	bool								_shadowImagesInitialized = false;
+	VkSampler							_shadowSampler = VK_NULL_HANDLE;
+	VkPipelineLayout					_shadowPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline							_shadowPipeline = VK_NULL_HANDLE;
+	VkShaderModule						_shadowShaderModuleVS = VK_NULL_HANDLE;
+	DeviceBuffer						_shadowViewData;		// ShadowView per view, host visible, rewritten with the swapchain
+
+	// cluster culling of the mesh scene's meshlets, by a compute pre-pass or by task shaders
+	ClusterCulling						_clusterCulling = ClusterCulling::Off;
+	bool								_meshShading = false;	// VK_EXT_mesh_shader path
+	PFN_vkCmdDrawMeshTasksEXT			_vkCmdDrawMeshTasksEXT = nullptr;
+	DeviceBuffer						_meshlets;
+	DeviceBuffer						_meshletVertices;
+	DeviceBuffer						_meshletTriangles;
+	DeviceBuffer						_clusterIndices;		// compacted stream, compute path only
+	DeviceBuffer						_clusterDraw;			// ClusterDrawCommand per instance, host visible
+	DeviceBuffer						_meshLodTable;
+	DeviceBuffer						_meshInstanceData;
+	VkDescriptorSetLayout				_clusterSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool					_clusterDescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet						_clusterSet = VK_NULL_HANDLE;
+	VkPipelineLayout					_clusterCullLayout = VK_NULL_HANDLE;
+	VkPipeline							_clusterCullPipeline = VK_NULL_HANDLE;
+	VkPipeline							_lodSelectPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout					_meshletPipelineLayout = VK_NULL_HANDLE;	// texture, light and cluster sets, mesh shading only
+
+	// two-phase occlusion culling: last frame's visible meshlets are drawn first, their depth is reduced
+	// into a max-depth pyramid and everything else is tested against it
+	bool								_occlusionCulling = false;
+	DeviceBuffer						_clusterVisibility;		// per instance and meshlet slot, written by the late phase
+	VkImage								_depthPyramid = VK_NULL_HANDLE;
+	VkImageView							_depthPyramidView = VK_NULL_HANDLE;		// every level, sampled by the culling
+	std::vector<VkImageView>			_depthPyramidLevels;
+	VkSampler							_depthPyramidSampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout				_depthReduceSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool					_depthReducePool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet>		_depthReduceSets;		// one per pyramid level
+	VkPipelineLayout					_depthReduceLayout = VK_NULL_HANDLE;
+	VkPipeline							_depthReducePipeline = VK_NULL_HANDLE;
+
 	// shaders
 	VkShaderModule						_shaderModuleVS;
 	VkShaderModule						_shaderModulePS;
+	VkShaderModule						_meshShaderModuleVS = VK_NULL_HANDLE;
+	VkShaderModule						_meshShaderModulePS = VK_NULL_HANDLE;
+	VkShaderModule						_meshletShaderModuleTS = VK_NULL_HANDLE;
+	VkShaderModule						_meshletShaderModuleMS = VK_NULL_HANDLE;
 
+	// startup timing
+	StartupTrace						_startupTrace;
+	bool								_firstFrameReported = false;
 
 private:
 
-	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
-		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-		VkDebugUtilsMessageTypeFlagsEXT messageType,
-		const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
-		void* pUserdata)
-	{
-		std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-
-		return VK_FALSE;
-	}
 	void _initWindow()
 	{
+		StartupTrace::Scope trace(_startupTrace, "window");
+
 		glfwInit();
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);	// no openGL api
@@ -237,13 +703,16 @@ private:
 
 	std::vector<const char*> getRequiredExtensions()
 	{
-		uint32_t gfwExtensionCount = 0;
-		const char** glfwExtensions;
-
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&gfwExtensionCount);
+		std::vector<const char*> extensions;
+		if (!_config.headless) // no surface, so no window system extensions
+		{
+			uint32_t gfwExtensionCount = 0;
+			const char** glfwExtensions;
 
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + gfwExtensionCount);
-		if (enableValidationLayer)
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&gfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + gfwExtensionCount);
+		}
+		if (_debugUtils)
 		{
 			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		}
@@ -251,28 +720,56 @@ private:
 		return extensions;
 	}
 
-	void _populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+	bool _checkInstanceExtensionSupport(const char* name)
 	{
-		createInfo = {};
-		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-		createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-		createInfo.pfnUserCallback = debugCallback;
+		uint32_t extensionCount = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+		for (const VkExtensionProperties& extension : extensions)
+		{
+			if (strcmp(extension.extensionName, name) == 0)
+				return true;
+		}
+		return false;
 	}
 
 	void _createInstance()
 	{
-		if (enableValidationLayer && !_checkValidationLayerSupport())
+		if (_config.validation && !_checkValidationLayerSupport())
 		{
 			throw std::runtime_error("validation layers requested, but not available");
 		}
+
+		// the validation layer brings VK_EXT_debug_utils along, names and labels alone need the loader to have it
+		bool debugUtils = _config.validation || _config.debugUtils;
+		if (debugUtils && !_config.validation && !_checkInstanceExtensionSupport(VK_EXT_DEBUG_UTILS_EXTENSION_NAME))
+		{
+			std::cout << "debug utils: no VK_EXT_debug_utils, objects stay unnamed" << std::endl;
+			debugUtils = false;
+		}
+		if (debugUtils)
+		{
+			_debugUtils = std::make_unique<DebugUtils>(_config.debugPrintSeverity, _config.debugRepeatLimit);
+		}
+
+		// 1.1 for vkGetPhysicalDeviceFeatures2 and 1.3 for core dynamic rendering, if the loader has them
+		// (1.0 loaders lack vkEnumerateInstanceVersion)
+		auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+		if (enumerateInstanceVersion != nullptr)
+		{
+			uint32_t loaderVersion = VK_API_VERSION_1_0;
+			enumerateInstanceVersion(&loaderVersion);
+			_instanceApiVersion = std::min(loaderVersion, VK_API_VERSION_1_3);
+		}
 		VkApplicationInfo appInfo = {};
 		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
 		appInfo.pApplicationName = "Hello Triangle";
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = _instanceApiVersion;
 
 		VkInstanceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -284,18 +781,20 @@ private:
 		createInfo.ppEnabledExtensionNames = extensions.data();
 
 		VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo;
-		if (enableValidationLayer)
+		if (_config.validation)
 		{
 			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
 			createInfo.ppEnabledLayerNames = validationLayers.data();
-
-			_populateDebugMessengerCreateInfo(debugCreateInfo);
-			createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
 		}
 		else
 		{
 			createInfo.enabledLayerCount = 0;
 		}
+		if (_debugUtils)
+		{
+			_debugUtils->PopulateMessengerCreateInfo(debugCreateInfo);
+			createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+		}
 
 
 		if (vkCreateInstance(&createInfo, nullptr, &_instance) != VK_SUCCESS)
@@ -306,6 +805,9 @@ private:
 
 	void _createSurface()
 	{
+		if (_config.headless)
+			return;
+
 		if (glfwCreateWindowSurface(_instance, _window, nullptr, &_surface) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create window surface.");
@@ -314,10 +816,10 @@ private:
 
 	void _setupMessenger()
 	{
-		if (!enableValidationLayer) return;
+		if (!_debugUtils) return;
 
 		VkDebugUtilsMessengerCreateInfoEXT createInfo = {};
-		_populateDebugMessengerCreateInfo(createInfo);
+		_debugUtils->PopulateMessengerCreateInfo(createInfo);
 
 		if (CreateDebugUtilsMessengerEXT(_instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS)
 		{
@@ -325,7 +827,7 @@ private:
 		}
 	}
 
-	bool _checkDeviceExtensionSupport(VkPhysicalDevice device)
+	std::set<std::string> _queryDeviceExtensions(VkPhysicalDevice device)
 	{
 		uint32_t extensionCount;
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -333,39 +835,167 @@ private:
 		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-		std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
-
+		std::set<std::string> extensions;
 		for (const auto& extension : availableExtensions)
 		{
-			requiredExtensions.erase(extension.extensionName); // do we have swapchain support?
+			extensions.insert(extension.extensionName);
+		}
+		return extensions;
+	}
+
+	bool _checkDeviceExtensionSupport(const std::set<std::string>& availableExtensions)
+	{
+		for (const char* extension : deviceExtensions)
+		{
+			if (availableExtensions.count(extension) == 0) // do we have swapchain support?
+				return false;
 		}
 
-		return requiredExtensions.empty();
+		return true;
 	}
 
-	bool _isDeviceSuitable(VkPhysicalDevice device)
+	// VK_KHR_present_id + VK_KHR_present_wait, both extensions and both features
+	bool _checkPresentWaitSupport(VkPhysicalDevice device, const std::set<std::string>& availableExtensions, uint32_t apiVersion)
 	{
-		QueueFamilyIndices indices = _findQueueFamily(device);
+		if (_instanceApiVersion < VK_API_VERSION_1_1 || apiVersion < VK_API_VERSION_1_1)
+			return false;
 
-		// check device for swapchain support
-		bool extensionsSupported = _checkDeviceExtensionSupport(device);
+		if (availableExtensions.count(VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0 ||
+			availableExtensions.count(VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0)
+			return false;
+
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR };
+		presentIdFeatures.pNext = &presentWaitFeatures;
+
+		VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+	}
+
+	// VK_EXT_mesh_shader with task and mesh shaders. on a 1.1 instance it also needs SPIR-V 1.4
+	bool _checkMeshShaderSupport(VkPhysicalDevice device, const std::set<std::string>& availableExtensions, uint32_t apiVersion)
+	{
+		if (_instanceApiVersion < VK_API_VERSION_1_1 || apiVersion < VK_API_VERSION_1_1)
+			return false;
+
+		if (availableExtensions.count(VK_EXT_MESH_SHADER_EXTENSION_NAME) == 0 ||
+			availableExtensions.count(VK_KHR_SPIRV_1_4_EXTENSION_NAME) == 0 ||
+			availableExtensions.count(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME) == 0)
+			return false;
+
+		VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+
+		VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features.pNext = &meshShaderFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		return meshShaderFeatures.taskShader && meshShaderFeatures.meshShader;
+	}
+
+	// core from 1.3. before that the extension, which needs depth_stencil_resolve and create_renderpass2 (core in 1.2)
+	bool _checkDynamicRenderingSupport(VkPhysicalDevice device, const std::set<std::string>& availableExtensions, uint32_t apiVersion)
+	{
+		if (_instanceApiVersion < VK_API_VERSION_1_1 || apiVersion < VK_API_VERSION_1_1)
+			return false;
+
+		if (std::min(_instanceApiVersion, apiVersion) < VK_API_VERSION_1_3)
+		{
+			if (availableExtensions.count(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) == 0)
+				return false;
+			if (apiVersion < VK_API_VERSION_1_2 && (availableExtensions.count(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) == 0 ||
+				availableExtensions.count(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME) == 0))
+				return false;
+		}
+
+		VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES };
+
+		VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features.pNext = &dynamicRenderingFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		return dynamicRenderingFeatures.dynamicRendering;
+	}
+
+	// core from 1.3, the extension before that
+	bool _checkSynchronization2Support(VkPhysicalDevice device, const std::set<std::string>& availableExtensions, uint32_t apiVersion)
+	{
+		if (_instanceApiVersion < VK_API_VERSION_1_1 || apiVersion < VK_API_VERSION_1_1)
+			return false;
+
+		if (std::min(_instanceApiVersion, apiVersion) < VK_API_VERSION_1_3 && availableExtensions.count(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME) == 0)
+			return false;
+
+		VkPhysicalDeviceSynchronization2Features synchronization2Features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES };
+
+		VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features.pNext = &synchronization2Features;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		return synchronization2Features.synchronization2;
+	}
+
+	// core from 1.1, it's only the feature bit that's optional
+	bool _checkMultiviewSupport(VkPhysicalDevice device, uint32_t apiVersion)
+	{
+		if (_instanceApiVersion < VK_API_VERSION_1_1 || apiVersion < VK_API_VERSION_1_1)
+			return false;
+
+		VkPhysicalDeviceMultiviewFeatures multiviewFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES };
+
+		VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features.pNext = &multiviewFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features);
 
-		bool swapChainAdequate = false;
-		if (extensionsSupported)
+		return multiviewFeatures.multiview;
+	}
+
+	PhysicalDeviceInfo _queryPhysicalDeviceInfo(VkPhysicalDevice device)
+	{
+		PhysicalDeviceInfo info;
+		info.device = device;
+		vkGetPhysicalDeviceProperties(device, &info.properties);
+		vkGetPhysicalDeviceFeatures(device, &info.features);
+		info.queueFamilies = _findQueueFamily(device);
+
+		// check device for swapchain support
+		info.availableExtensions = _queryDeviceExtensions(device);
+		info.memoryBudgetSupported = _instanceApiVersion >= VK_API_VERSION_1_1 && info.properties.apiVersion >= VK_API_VERSION_1_1 &&
+			info.availableExtensions.count(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) != 0;
+		info.meshShaderSupported = _checkMeshShaderSupport(device, info.availableExtensions, info.properties.apiVersion);
+		info.dynamicRenderingSupported = _checkDynamicRenderingSupport(device, info.availableExtensions, info.properties.apiVersion);
+		info.synchronization2Supported = _checkSynchronization2Support(device, info.availableExtensions, info.properties.apiVersion);
+		info.multiviewSupported = _checkMultiviewSupport(device, info.properties.apiVersion);
+		info.viewportIndexSupported = info.features.multiViewport && info.availableExtensions.count(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME) != 0;
+		if (_config.headless)
+			return info;
+
+		info.extensionsSupported = _checkDeviceExtensionSupport(info.availableExtensions);
+		if (info.extensionsSupported)
 		{
-			SwapchainSupportDetails swapChainSupport = _querySwapchainSupport(device);
-			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+			info.swapchainSupport = _querySwapchainSupport(device);
 		}
+		info.presentWaitSupported = _checkPresentWaitSupport(device, info.availableExtensions, info.properties.apiVersion);
+
+		return info;
+	}
+
+	bool _isDeviceSuitable(const PhysicalDeviceInfo& info)
+	{
+		// offscreen rendering only needs a graphics queue
+		if (_config.headless)
+			return info.queueFamilies.isComplete();
+
+		bool swapChainAdequate = !info.swapchainSupport.formats.empty() && !info.swapchainSupport.presentModes.empty();
 
-		return indices.isComplete() && extensionsSupported && swapChainAdequate;
+		return info.queueFamilies.isComplete() && info.extensionsSupported && swapChainAdequate;
 	}
 
-	int _rateDeviceSuitability(VkPhysicalDevice device)
+	int _rateDeviceSuitability(const PhysicalDeviceInfo& info)
 	{
-		VkPhysicalDeviceProperties deviceProperties;
-		VkPhysicalDeviceFeatures deviceFeatures;
-		vkGetPhysicalDeviceProperties(device, &deviceProperties);
-		vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+		const VkPhysicalDeviceProperties& deviceProperties = info.properties;
 		int score = 0;
 
 		// discrete GPUs have a significant performance advantage
@@ -377,10 +1007,10 @@ private:
 		// maximum possible size of textures affects graphics quality
 		score += deviceProperties.limits.maxImageDimension2D;
 
-		// application can't funcion without geometry shaders
-		if (!deviceFeatures.geometryShader)
+		// golden images are rendered on a software rasterizer, so results don't depend on the GPU
+		if (_config.preferSoftwareDevice && deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
 		{
-			return 0;
+			score += 1 << 20;
 		}
 
 		return score;
@@ -401,39 +1031,44 @@ private:
 		std::vector<VkPhysicalDevice> devices(deviceCount);
 		vkEnumeratePhysicalDevices(_instance, &deviceCount, devices.data());
 
-		for (const auto& device : devices)
+		// an explicit pick, e.g. one member of a device group
+		if (_config.deviceIndex >= 0)
 		{
-			if (_isDeviceSuitable(device))
+			if (uint32_t(_config.deviceIndex) >= deviceCount)
 			{
-				_physicalDevice = device;
-				break;
+				throw std::runtime_error("--device=" + std::to_string(_config.deviceIndex) + " but there are " + std::to_string(deviceCount) + " devices");
 			}
+			_physicalDeviceInfo = _queryPhysicalDeviceInfo(devices[_config.deviceIndex]);
+			if (!_isDeviceSuitable(_physicalDeviceInfo))
+			{
+				throw std::runtime_error(std::string("Device ") + _physicalDeviceInfo.properties.deviceName + " isn't suitable");
+			}
+			_physicalDevice = _physicalDeviceInfo.device;
+			return;
 		}
 
-		// if no suitable GPU
-		if (_physicalDevice == VK_NULL_HANDLE)
-		{
-			throw std::runtime_error("Failed to find a suitable GPU!");
-		}
-
-		// use an ordered map to automatically sort candidates by increasing score
-		std::multimap<int, VkPhysicalDevice> candidates;
+		// query every device once; only suitable ones become candidates,
+		// sorted by increasing score in the ordered map
+		std::multimap<int, PhysicalDeviceInfo> candidates;
 
 		for (const auto& device : devices)
 		{
-			int score = _rateDeviceSuitability(device);
-			candidates.insert(std::make_pair(score, device));
+			PhysicalDeviceInfo info = _queryPhysicalDeviceInfo(device);
+			if (!_isDeviceSuitable(info))
+				continue;
+
+			int score = _rateDeviceSuitability(info);
+			candidates.insert(std::make_pair(score, info));
 		}
 
 		// check if the best candidate is suitable alt all
-		if (candidates.rbegin()->first > 0)
+		if (candidates.empty() || candidates.rbegin()->first <= 0)
 		{
-			_physicalDevice = candidates.rbegin()->second;
-		}
-		else
-		{
-			throw std::runtime_error("Failed to find a suitable GPU");
+			throw std::runtime_error("Failed to find a suitable GPU!");
 		}
+
+		_physicalDeviceInfo = candidates.rbegin()->second;
+		_physicalDevice = _physicalDeviceInfo.device;
 	}
 
 	QueueFamilyIndices _findQueueFamily(VkPhysicalDevice device)
@@ -450,17 +1085,31 @@ private:
 		VkBool32 presentSupport = false;
 		for (const auto& queueFamily : queueFamilies)
 		{
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
-			if (presentSupport)
+			if (!indices.isComplete())
 			{
-				indices.presentFamily = i;
+				if (_surface != VK_NULL_HANDLE)
+				{
+					vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+				}
+				if (presentSupport)
+				{
+					indices.presentFamily = i;
+				}
+				if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				{
+					indices.graphicsFamily = i;
+
+					// headless "presents" are readbacks on the graphics queue
+					if (_surface == VK_NULL_HANDLE)
+					{
+						indices.presentFamily = i;
+					}
+				}
 			}
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if (!indices.computeFamily.has_value() && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
 			{
-				indices.graphicsFamily = i;
+				indices.computeFamily = i;
 			}
-			if (indices.isComplete())
-				break;
 			i++;
 		}
 		return indices;
@@ -468,10 +1117,17 @@ private:
 
 	void _createLogicDevice()
 	{
-		QueueFamilyIndices indices = _findQueueFamily(_physicalDevice);
+		const QueueFamilyIndices& indices = _physicalDeviceInfo.queueFamilies;
+
+		// light binning moves to a compute-only family when there is one
+		_asyncCompute = _config.asyncCompute && _config.lightCount > 0 && indices.computeFamily.has_value();
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamiles = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+		if (_asyncCompute)
+		{
+			uniqueQueueFamiles.insert(indices.computeFamily.value());
+		}
 		float queuePriority = 1.0f;
 		for (uint32_t queueFamily : uniqueQueueFamiles)
 		{
@@ -493,76 +1149,318 @@ private:
 
 		deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
-		// enable swapchain
-		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
-
-		if (enableValidationLayer)
+		// enable swapchain, plus the optional extensions the device has
+		std::vector<const char*> extensions;
+		if (!_config.headless)
 		{
-			deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-			deviceCreateInfo.ppEnabledLayerNames = validationLayers.data();
+			extensions.assign(deviceExtensions.begin(), deviceExtensions.end());
 		}
-		else
+
+		// texture streaming sizes its budget from the driver's numbers
+		if (_physicalDeviceInfo.memoryBudgetSupported)
 		{
-			deviceCreateInfo.enabledLayerCount = 0;
+			extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 		}
 
-		if (vkCreateDevice(_physicalDevice, &deviceCreateInfo, nullptr, &_device) != VK_SUCCESS)
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR };
+		if (_physicalDeviceInfo.presentWaitSupported)
 		{
-			throw std::runtime_error("Failed to create logical device");
-		}
+			extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
 
-		// retrieving queue handle
-		vkGetDeviceQueue(_device, indices.graphicsFamily.value(), 0, &_graphicsQueue);
-		vkGetDeviceQueue(_device, indices.presentFamily.value(), 0, &_presentQueue);
-	}
+			presentIdFeatures.presentId = VK_TRUE;
+			presentWaitFeatures.presentWait = VK_TRUE;
+			presentIdFeatures.pNext = &presentWaitFeatures;
+			deviceCreateInfo.pNext = &presentIdFeatures;
+		}
 
-	SwapchainSupportDetails _querySwapchainSupport(VkPhysicalDevice device)
-	{
-		SwapchainSupportDetails details;
+		// meshlets go straight to mesh shaders when the device has them, a compute pre-pass culls otherwise
+		if (_config.scene == Scene::Mesh)
+		{
+			_clusterCulling = _config.clusterCulling;
+			if (_clusterCulling == ClusterCulling::Auto)
+			{
+				_meshShading = _physicalDeviceInfo.meshShaderSupported;
+				_clusterCulling = ClusterCulling::Compute;
+			}
+			_occlusionCulling = _config.occlusionCulling && _clusterCulling != ClusterCulling::Off;
 
-		// surface
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, _surface, &details.capabilities);
+			// split-screen views share the pass: as layers of a multiview pass, or as viewports the vertex shader
+			// picks per draw. each view is culled against its own frustum, but there's one depth pyramid and
+			// no per-view visibility to test against, and the task shaders don't fan out to views
+			_viewCount = _config.viewCount;
+			if (_viewCount > 1)
+			{
+				_multiview = _config.viewMode != ViewMode::Viewports && _physicalDeviceInfo.multiviewSupported;
+				if (_config.viewMode == ViewMode::Multiview && !_multiview)
+				{
+					throw std::runtime_error("--view-mode=multiview needs Vulkan 1.1 and the multiview feature");
+				}
+				if (!_multiview && !_physicalDeviceInfo.viewportIndexSupported)
+				{
+					throw std::runtime_error("--views needs multiview, or multiViewport and VK_EXT_shader_viewport_index_layer");
+				}
+				if (_meshShading || _occlusionCulling)
+				{
+					std::cout << "split-screen views: " << (_meshShading ? "mesh shading" : "") << (_meshShading && _occlusionCulling ? " and " : "")
+						<< (_occlusionCulling ? "occlusion culling" : "") << " off, they have no per-view depth pyramid or task shaders" << std::endl;
+				}
+				_meshShading = false;
+				_occlusionCulling = false;
+			}
+			if (_replay != nullptr && _replay->meshShading != _meshShading)
+			{
+				throw std::runtime_error(std::string("the recording's mesh scene was drawn ") + (_replay->meshShading ? "with" : "without") +
+					" mesh shaders, this device draws it " + (_meshShading ? "with" : "without"));
+			}
+		}
+		_depthFormat = _chooseDepthFormat();
 
-		// support format
-		uint32_t formatCount;
-		vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, nullptr);
-		if (formatCount != 0)
+		VkPhysicalDeviceMultiviewFeatures multiviewFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES };
+		if (_multiview)
 		{
-			details.formats.resize(formatCount);
-			vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, details.formats.data());
+			multiviewFeatures.multiview = VK_TRUE;
+			multiviewFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+			deviceCreateInfo.pNext = &multiviewFeatures;
 		}
-
-		// query present
-		uint32_t presentModeCount;
-		vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, nullptr);
-		if (presentModeCount != 0)
+		else if (_viewCount > 1)
 		{
-			details.presentModes.resize(presentModeCount);
-			vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, details.presentModes.data());
+			extensions.push_back(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME);
+			deviceFeatures.multiViewport = VK_TRUE;
 		}
 
-		return details;
-	}
-
-	VkSurfaceFormatKHR _chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
-	{
-		for (const VkSurfaceFormatKHR& availableFormat : availableFormats)
+		VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+		if (_meshShading)
 		{
-			if (availableFormat.format == VK_FORMAT_B8G8R8A8_UNORM && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
-				return availableFormat;
+			extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+			extensions.push_back(VK_KHR_SPIRV_1_4_EXTENSION_NAME);
+			extensions.push_back(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME);
+
+			meshShaderFeatures.taskShader = VK_TRUE;
+			meshShaderFeatures.meshShader = VK_TRUE;
+			meshShaderFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+			deviceCreateInfo.pNext = &meshShaderFeatures;
 		}
 
-		return availableFormats[0];
-	}
+		// passes begin on image views directly where the device can, render pass objects otherwise
+		_dynamicRendering = _config.renderingPath != RenderingPath::RenderPass && _physicalDeviceInfo.dynamicRenderingSupported;
+		if (_config.renderingPath == RenderingPath::Dynamic && !_dynamicRendering)
+		{
+			throw std::runtime_error("--rendering=dynamic needs Vulkan 1.3 or VK_KHR_dynamic_rendering");
+		}
 
-	VkPresentModeKHR _chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
-	{
-		for (const auto& presentMode : availablePresentModes)
+		uint32_t deviceApiVersion = std::min(_instanceApiVersion, _physicalDeviceInfo.properties.apiVersion);
+		VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES };
+		if (_dynamicRendering)
 		{
-			if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+			if (deviceApiVersion < VK_API_VERSION_1_3)
 			{
-				return presentMode;
+				extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+				if (deviceApiVersion < VK_API_VERSION_1_2)
+				{
+					extensions.push_back(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+					extensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+				}
+			}
+
+			dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+			dynamicRenderingFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+			deviceCreateInfo.pNext = &dynamicRenderingFeatures;
+		}
+
+		// per-barrier stages where the device has them, barriers fold into vkCmdPipelineBarrier otherwise
+		VkPhysicalDeviceSynchronization2Features synchronization2Features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES };
+		if (_physicalDeviceInfo.synchronization2Supported)
+		{
+			if (deviceApiVersion < VK_API_VERSION_1_3)
+			{
+				extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+			}
+
+			synchronization2Features.synchronization2 = VK_TRUE;
+			synchronization2Features.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+			deviceCreateInfo.pNext = &synchronization2Features;
+		}
+
+		// frame export reads back straight into the ring's shared memory where the device imports host pointers
+		_exportHostImport = !_config.exportName.empty() && deviceApiVersion >= VK_API_VERSION_1_1 &&
+			_physicalDeviceInfo.availableExtensions.count(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) != 0;
+		if (_exportHostImport)
+		{
+			extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+
+			VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT };
+			VkPhysicalDeviceProperties2 properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+			properties.pNext = &hostProperties;
+			vkGetPhysicalDeviceProperties2(_physicalDevice, &properties);
+			_exportImportAlignment = hostProperties.minImportedHostPointerAlignment;
+		}
+
+		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
+
+		if (_config.validation)
+		{
+			deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+			deviceCreateInfo.ppEnabledLayerNames = validationLayers.data();
+		}
+		else
+		{
+			deviceCreateInfo.enabledLayerCount = 0;
+		}
+
+		if (vkCreateDevice(_physicalDevice, &deviceCreateInfo, nullptr, &_device) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create logical device");
+		}
+
+		// retrieving queue handle
+		vkGetDeviceQueue(_device, indices.graphicsFamily.value(), 0, &_graphicsQueue);
+		vkGetDeviceQueue(_device, indices.presentFamily.value(), 0, &_presentQueue);
+
+		_gpuProfiler = std::make_unique<GpuProfiler>(_physicalDevice, _device, indices.graphicsFamily.value(), uint32_t(MAX_FRAMES));
+		if (_asyncCompute)
+		{
+			vkGetDeviceQueue(_device, indices.computeFamily.value(), 0, &_computeQueue);
+			_computeProfiler = std::make_unique<GpuProfiler>(_physicalDevice, _device, indices.computeFamily.value(), uint32_t(MAX_FRAMES));
+		}
+		if (_debugUtils)
+		{
+			_debugUtils->LoadDeviceFunctions(_instance, _device);
+			_gpuProfiler->SetLabels(_debugUtils->BeginLabelFunction(), _debugUtils->EndLabelFunction());
+			if (_computeProfiler)
+			{
+				_computeProfiler->SetLabels(_debugUtils->BeginLabelFunction(), _debugUtils->EndLabelFunction());
+			}
+		}
+
+		if (_physicalDeviceInfo.presentWaitSupported)
+		{
+			_vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(_device, "vkWaitForPresentKHR");
+			_presentWaitEnabled = _vkWaitForPresentKHR != nullptr;
+		}
+
+		if (_meshShading)
+		{
+			_vkCmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(_device, "vkCmdDrawMeshTasksEXT");
+			if (_vkCmdDrawMeshTasksEXT == nullptr)
+			{
+				throw std::runtime_error("VK_EXT_mesh_shader is enabled but vkCmdDrawMeshTasksEXT is missing");
+			}
+		}
+
+		if (_dynamicRendering)
+		{
+			bool core = deviceApiVersion >= VK_API_VERSION_1_3;
+			_vkCmdBeginRendering = (PFN_vkCmdBeginRendering)vkGetDeviceProcAddr(_device, core ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+			_vkCmdEndRendering = (PFN_vkCmdEndRendering)vkGetDeviceProcAddr(_device, core ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+			if (_vkCmdBeginRendering == nullptr || _vkCmdEndRendering == nullptr)
+			{
+				throw std::runtime_error("Dynamic rendering is enabled but vkCmdBeginRendering is missing");
+			}
+		}
+
+		if (_exportHostImport)
+		{
+			_vkGetMemoryHostPointerPropertiesEXT = (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(_device, "vkGetMemoryHostPointerPropertiesEXT");
+			_exportHostImport = _vkGetMemoryHostPointerPropertiesEXT != nullptr;
+		}
+
+		PFN_vkCmdPipelineBarrier2 pipelineBarrier2 = nullptr;
+		if (_physicalDeviceInfo.synchronization2Supported)
+		{
+			bool core = deviceApiVersion >= VK_API_VERSION_1_3;
+			pipelineBarrier2 = (PFN_vkCmdPipelineBarrier2)vkGetDeviceProcAddr(_device, core ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier2KHR");
+		}
+		_barriers = std::make_unique<BarrierBatch>(pipelineBarrier2, _config.validation);
+		_memoryTelemetry = std::make_unique<MemoryTelemetry>(_physicalDevice, _device, _physicalDeviceInfo.memoryBudgetSupported,
+			_config.memoryWarnPercent / 100.0, _config.memoryDumpPath);
+		_transientAttachments = std::make_unique<TransientAttachments>(_physicalDevice, _device, *_memoryTelemetry);
+	}
+
+	SwapchainSupportDetails _querySwapchainSupport(VkPhysicalDevice device)
+	{
+		SwapchainSupportDetails details;
+
+		// surface
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, _surface, &details.capabilities);
+
+		// support format
+		uint32_t formatCount;
+		vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, nullptr);
+		if (formatCount != 0)
+		{
+			details.formats.resize(formatCount);
+			vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, details.formats.data());
+		}
+
+		// query present
+		uint32_t presentModeCount;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, nullptr);
+		if (presentModeCount != 0)
+		{
+			details.presentModes.resize(presentModeCount);
+			vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, details.presentModes.data());
+		}
+
+		return details;
+	}
+
+	VkSurfaceFormatKHR _chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
+	{
+		for (const VkSurfaceFormatKHR& availableFormat : availableFormats)
+		{
+			if (availableFormat.format == VK_FORMAT_B8G8R8A8_UNORM && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+				return availableFormat;
+		}
+
+		return availableFormats[0];
+	}
+
+	// depth-only formats, so one view serves as attachment and as the depth pyramid's source.
+	// one of D32 and X8_D24 is always supported as an attachment, D16 as a last resort
+	VkFormat _chooseDepthFormat()
+	{
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		if (_occlusionCulling)
+		{
+			required |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		}
+
+		for (VkFormat format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM })
+		{
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &properties);
+			if ((properties.optimalTilingFeatures & required) == required)
+				return format;
+		}
+
+		throw std::runtime_error("No supported depth format");
+	}
+
+	VkPresentModeKHR _chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+	{
+		// preferred modes per policy, FIFO is always available as the last resort. throughput never tears, without
+		// MAILBOX it is FIFO as before the policies
+		std::vector<VkPresentModeKHR> preferred;
+		switch (_config.presentPolicy)
+		{
+		case PresentPolicy::LowLatency:
+			preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+			break;
+		case PresentPolicy::Throughput:
+			preferred = { VK_PRESENT_MODE_MAILBOX_KHR };
+			break;
+		case PresentPolicy::PowerSaving:
+			break;
+		}
+
+		for (VkPresentModeKHR mode : preferred)
+		{
+			if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end())
+			{
+				return mode;
 			}
 		}
 		return VK_PRESENT_MODE_FIFO_KHR;
@@ -590,13 +1488,25 @@ private:
 
 	void _createSwapchain()
 	{
+		if (_config.headless)
+		{
+			_createOffscreenTargets();
+			return;
+		}
+
 		SwapchainSupportDetails swapChainSupport = _querySwapchainSupport(_physicalDevice);
 
 		VkSurfaceFormatKHR surfaceFormat = _chooseSwapSurfaceFormat(swapChainSupport.formats);
 		VkPresentModeKHR presentMode = _chooseSwapPresentMode(swapChainSupport.presentModes);
 		VkExtent2D extent = _chooseSwapExtent(swapChainSupport.capabilities);
 
-		uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+		// throughput keeps a spare image so the CPU never waits on acquire,
+		// the other policies use the minimum to keep the queue (and memory) short
+		uint32_t imageCount = swapChainSupport.capabilities.minImageCount;
+		if (_config.presentPolicy == PresentPolicy::Throughput)
+		{
+			imageCount += 1;
+		}
 		if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
 		{
 			imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -612,7 +1522,35 @@ private:
 		createInfo.imageArrayLayers = 1;
 		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-		QueueFamilyIndices indices = _findQueueFamily(_physicalDevice);
+		// multiview's layers are copied into their tiles, dynamic resolution's render area is scaled up
+		if (_offscreenScene())
+		{
+			if ((swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0)
+			{
+				throw std::runtime_error("Swapchain images can't be copied to, multiview (try --view-mode=viewports) and dynamic resolution need that");
+			}
+			createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
+
+		// readback copies straight out of the swapchain image
+		_captureEnabled = false;
+		if (_config.captureFormat != CaptureFormat::None)
+		{
+			bool transferSrc = (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+			bool byteFormat = surfaceFormat.format == VK_FORMAT_B8G8R8A8_UNORM || surfaceFormat.format == VK_FORMAT_B8G8R8A8_SRGB ||
+				surfaceFormat.format == VK_FORMAT_R8G8B8A8_UNORM || surfaceFormat.format == VK_FORMAT_R8G8B8A8_SRGB;
+			if (transferSrc && byteFormat)
+			{
+				createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+				_captureEnabled = true;
+			}
+			else
+			{
+				std::cerr << "frame capture disabled: swapchain images can't be copied as 8-bit RGBA" << std::endl;
+			}
+		}
+
+		const QueueFamilyIndices& indices = _physicalDeviceInfo.queueFamilies;
 		uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
 
 		if (indices.graphicsFamily != indices.presentFamily)
@@ -648,6 +1586,57 @@ private:
 		_swapChainExtent = extent;
 	}
 
+	// headless replacement for the swapchain: the same number of images, rendered to and read back
+	// like swapchain images but never presented
+	void _createOffscreenTargets()
+	{
+		_swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+		_swapChainExtent = { _config.width, _config.height };
+		_captureEnabled = _config.captureFormat != CaptureFormat::None || _config.captureToMemory;
+
+		_swapChainImages.resize(MAX_FRAMES);
+		_offscreenMemory.resize(MAX_FRAMES);
+		for (size_t i = 0; i < _swapChainImages.size(); i++)
+		{
+			VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = _swapChainImageFormat;
+			imageInfo.extent = { _swapChainExtent.width, _swapChainExtent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | (_offscreenScene() ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0);
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			if (vkCreateImage(_device, &imageInfo, nullptr, &_swapChainImages[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create offscreen image!");
+			}
+
+			VkMemoryRequirements memRequirements;
+			vkGetImageMemoryRequirements(_device, _swapChainImages[i], &memRequirements);
+
+			VkMemoryAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+			allocInfo.allocationSize = memRequirements.size;
+			allocInfo.memoryTypeIndex = _findeMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			if (_memoryTelemetry->Allocate(allocInfo, MemoryCategory::Transient, &_offscreenMemory[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to allocate offscreen image memory!");
+			}
+
+			vkBindImageMemory(_device, _swapChainImages[i], _offscreenMemory[i], 0);
+		}
+	}
+
+	// layout a finished frame is left in: presentable, or ready for readback when there is nothing to present to
+	VkImageLayout _presentLayout() const
+	{
+		return _config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	}
+
 	void _createImageViews()
 	{
 		_swapChainImageViews.resize(_swapChainImages.size());
@@ -678,29 +1667,14 @@ private:
 		}
 	}
 
-	VkShaderModule  _createShaderModule(const char* path)
+	// the SPIR-V is read up front (see _initVulkan) so file I/O does not wait for the device
+	VkShaderModule  _createShaderModule(const std::vector<char>& code)
 	{
-		// load file
-		FILE* file = fopen(path, "rb");
-		assert(file);
-
-		fseek(file, 0, SEEK_END);
-		long length = ftell(file);
-		assert(length >= 0);
-		fseek(file, 0, SEEK_SET);
-
-		char* buffer = new char[length];
-		assert(buffer);
-
-		size_t rc = fread(buffer, 1, length, file);
-		assert(rc == size_t(length));
-		fclose(file);
-
 		VkShaderModuleCreateInfo createInfo = {};
 
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = length;
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(buffer);
+		createInfo.codeSize = code.size();
+		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
 		VkShaderModule shaderModule = 0;
 		if (vkCreateShaderModule(_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
@@ -711,98 +1685,265 @@ private:
 		return shaderModule;
 	}
 	
-	void _createRenderPass()
+	void _createRenderPass(VkFormat colorFormat)
+	{
+		_colorFormat = colorFormat;
+		if (_dynamicRendering)
+			return;
+
+		_renderPass = _createRenderPass(colorFormat, false);
+		if (_occlusionCulling)
+		{
+			_lateRenderPass = _createRenderPass(colorFormat, true);
+		}
+	}
+
+	// 'resume' is occlusion culling's late pass: it loads the early pass' color and depth instead of clearing.
+	// both are compatible, so pipelines and framebuffers work with either
+	VkRenderPass _createRenderPass(VkFormat colorFormat, bool resume)
 	{
 		VkAttachmentDescription colorAttachment = {};
-		colorAttachment.format = _swapChainImageFormat;
+		colorAttachment.format = colorFormat;
 		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
 		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		colorAttachment.initialLayout = resume ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
 		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+		// the early pass keeps its depth for the pyramid, nothing reads the final depth
+		bool keepDepth = _occlusionCulling && !resume;
+		VkAttachmentDescription depthAttachment = {};
+		depthAttachment.format = _depthFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = keepDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = resume ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = keepDepth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment };
+
 		// SUBPASS
 		// attachment references
 		VkAttachmentReference colorAttachmentRef = {};
 		colorAttachmentRef.attachment = 0;
 		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+		VkAttachmentReference depthAttachmentRef = {};
+		depthAttachmentRef.attachment = 1;
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 		VkSubpassDescription subpass = {};
 		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 		subpass.colorAttachmentCount = 1;
 		subpass.pColorAttachments = &colorAttachmentRef;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
 		VkRenderPassCreateInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.attachmentCount = 1;
-		renderPassInfo.pAttachments = &colorAttachment;
+		renderPassInfo.attachmentCount = uint32_t(std::size(attachments));
+		renderPassInfo.pAttachments = attachments;
 		renderPassInfo.subpassCount = 1;
 		renderPassInfo.pSubpasses = &subpass;
 
 		// subpass dependencies
-		VkSubpassDependency dependency = {};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
+		VkSubpassDependency dependencies[3] = {};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = resume ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0;
+
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		// the previous frame's depth tests and pyramid reduction are done with the shared depth image
+		dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].dstSubpass = 0;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		// the pyramid reduction reads the early pass' depth
+		dependencies[2].srcSubpass = 0;
+		dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[2].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[2].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		renderPassInfo.dependencyCount = keepDepth ? 3 : 2;
+		renderPassInfo.pDependencies = dependencies;
+
+		// every view in a layer of its own
+		uint32_t viewMask = _viewMask();
+		VkRenderPassMultiviewCreateInfo multiviewInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO };
+		if (_multiview)
+		{
+			multiviewInfo.subpassCount = 1;
+			multiviewInfo.pViewMasks = &viewMask;
+			renderPassInfo.pNext = &multiviewInfo;
+		}
+		// the previous frame's copy or blit to the swapchain image is done reading the scene's color
+		if (_offscreenScene())
+		{
+			dependencies[0].srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
 
-		if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS)
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create render pass!");
 		}
+		return renderPass;
+	}
+
+	// the layers a multiview pass draws, 0 without multiview
+	uint32_t _viewMask() const
+	{
+		return _multiview ? (1u << _viewCount) - 1 : 0;
+	}
+
+	// the scene passes draw into _sceneColorImage, and _recordUpscale brings that to the swapchain image
+	bool _offscreenScene() const
+	{
+		return _multiview || _dynamicResolution != nullptr;
 	}
 
 	void _createPipelineLayout()
 	{
+		VkPushConstantRange pushConstants = {};
+		pushConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstants.offset = 0;
+		pushConstants.size = _viewCount > 1 ? ViewParamsOffset + sizeof(ViewParams) * MAX_VIEWS : sizeof(DrawParams);
+
+		VkDescriptorSetLayout setLayouts[] = { _textureStreamer->DescriptorSetLayout(), _lightSetLayout };
+
 		VkPipelineLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		createInfo.setLayoutCount = uint32_t(std::size(setLayouts));
+		createInfo.pSetLayouts = setLayouts;
+		createInfo.pushConstantRangeCount = 1;
+		createInfo.pPushConstantRanges = &pushConstants;
 
 		vkCreatePipelineLayout(_device, &createInfo, nullptr, &_pipelineLayout);
+
+		if (_meshShading)
+		{
+			VkPushConstantRange meshletPushConstants = { VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0, sizeof(ClusterCullParams) };
+			VkDescriptorSetLayout meshletSetLayouts[] = { setLayouts[0], setLayouts[1], _clusterSetLayout };
+
+			VkPipelineLayoutCreateInfo meshletCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+			meshletCreateInfo.setLayoutCount = uint32_t(std::size(meshletSetLayouts));
+			meshletCreateInfo.pSetLayouts = meshletSetLayouts;
+			meshletCreateInfo.pushConstantRangeCount = 1;
+			meshletCreateInfo.pPushConstantRanges = &meshletPushConstants;
+
+			vkCreatePipelineLayout(_device, &meshletCreateInfo, nullptr, &_meshletPipelineLayout);
+		}
 	}
 
 	void _createGraphicsPipeline()
+	{
+		_graphicsPipeline = _createGraphicsPipeline(0);
+
+		if (_config.scene == Scene::ManyPipelines)
+		{
+			_scenePipelines.resize(16);
+			for (size_t i = 0; i < _scenePipelines.size(); i++)
+			{
+				_scenePipelines[i] = _createGraphicsPipeline(int32_t(i));
+			}
+		}
+
+		if (_meshShading)
+		{
+			// no vertex input, the mesh shader fetches MeshFormat::Vertex itself
+			_meshPipeline = _createGraphicsPipeline({ { VK_SHADER_STAGE_TASK_BIT_EXT, _meshletShaderModuleTS }, { VK_SHADER_STAGE_MESH_BIT_EXT, _meshletShaderModuleMS },
+				{ VK_SHADER_STAGE_FRAGMENT_BIT, _meshShaderModulePS } }, 0, nullptr, VK_CULL_MODE_BACK_BIT, _meshletPipelineLayout);
+		}
+		else if (_config.scene == Scene::Mesh)
+		{
+			// MeshFormat::Vertex, fetched in its quantized form
+			VkVertexInputBindingDescription binding = { 0, sizeof(MeshFormat::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+			VkVertexInputAttributeDescription attributes[] =
+			{
+				{ 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(MeshFormat::Vertex, position) },
+				{ 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(MeshFormat::Vertex, normal) },
+				{ 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(MeshFormat::Vertex, uv) },
+			};
+
+			VkPipelineVertexInputStateCreateInfo vertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+			vertexInput.vertexBindingDescriptionCount = 1;
+			vertexInput.pVertexBindingDescriptions = &binding;
+			vertexInput.vertexAttributeDescriptionCount = uint32_t(std::size(attributes));
+			vertexInput.pVertexAttributeDescriptions = attributes;
+
+			_meshPipeline = _createGraphicsPipeline({ { VK_SHADER_STAGE_VERTEX_BIT, _meshShaderModuleVS }, { VK_SHADER_STAGE_FRAGMENT_BIT, _meshShaderModulePS } },
+				0, &vertexInput, VK_CULL_MODE_BACK_BIT, _pipelineLayout);
+		}
+	}
+
+	// colorIndex specializes the fragment shader's palette entry
+	VkPipeline _createGraphicsPipeline(int32_t colorIndex)
+	{
+		VkPipelineVertexInputStateCreateInfo vertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		return _createGraphicsPipeline({ { VK_SHADER_STAGE_VERTEX_BIT, _shaderModuleVS }, { VK_SHADER_STAGE_FRAGMENT_BIT, _shaderModulePS } },
+			colorIndex, &vertexInput, VK_CULL_MODE_NONE, _pipelineLayout);
+	}
+
+	// vertexInput is null for mesh shading pipelines, which have no vertex input or input assembly
+	VkPipeline _createGraphicsPipeline(std::initializer_list<std::pair<VkShaderStageFlagBits, VkShaderModule>> stages, int32_t colorIndex,
+		const VkPipelineVertexInputStateCreateInfo* vertexInput, VkCullModeFlags cullMode, VkPipelineLayout layout)
 	{
 		VkGraphicsPipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
 
-		VkPipelineShaderStageCreateInfo shaderStages[2] = {  };
-		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		shaderStages[0].module = _shaderModuleVS;
-		shaderStages[0].pName = "main";
+		VkSpecializationMapEntry colorEntry = { 0, 0, sizeof(int32_t) };
+		VkSpecializationInfo specialization = {};
+		specialization.mapEntryCount = 1;
+		specialization.pMapEntries = &colorEntry;
+		specialization.dataSize = sizeof(colorIndex);
+		specialization.pData = &colorIndex;
 
-		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		shaderStages[1].module = _shaderModulePS;
-		shaderStages[1].pName = "main";
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+		for (const auto& stage : stages)
+		{
+			VkPipelineShaderStageCreateInfo stageInfo = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+			stageInfo.stage = stage.first;
+			stageInfo.module = stage.second;
+			stageInfo.pName = "main";
+			if (stage.first == VK_SHADER_STAGE_FRAGMENT_BIT)
+			{
+				stageInfo.pSpecializationInfo = &specialization;
+			}
+			shaderStages.push_back(stageInfo);
+		}
 
-		createInfo.stageCount = sizeof(shaderStages) / sizeof(shaderStages[0]);
-		createInfo.pStages = shaderStages;
+		createInfo.stageCount = uint32_t(shaderStages.size());
+		createInfo.pStages = shaderStages.data();
 
-		VkPipelineVertexInputStateCreateInfo vertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
-		createInfo.pVertexInputState = &vertexInput;
+		createInfo.pVertexInputState = vertexInput;
 
 		VkPipelineInputAssemblyStateCreateInfo assemblyState = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
 		assemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		createInfo.pInputAssemblyState = &assemblyState;
+		createInfo.pInputAssemblyState = vertexInput ? &assemblyState : nullptr;
 
 		VkPipelineTessellationStateCreateInfo tessellationState = { VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO };
 		createInfo.pTessellationState = &tessellationState;
 
+		// a viewport per split-screen view unless they're multiview layers, see _beginScenePass
 		VkPipelineViewportStateCreateInfo viewport = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
-		viewport.viewportCount = 1;
-		viewport.scissorCount = 1;
+		viewport.viewportCount = _multiview ? 1 : _viewCount;
+		viewport.scissorCount = viewport.viewportCount;
 		createInfo.pViewportState = &viewport;
 
 		VkPipelineRasterizationStateCreateInfo rasterizationState = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
 		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizationState.cullMode = cullMode;
+		rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 		rasterizationState.lineWidth = 1.0f;
 		createInfo.pRasterizationState = &rasterizationState;
 
@@ -810,7 +1951,11 @@ private:
 		multiSampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 		createInfo.pMultisampleState = &multiSampleState;
 
+		// less-or-equal so the flat 2D scenes still draw in submission order
 		VkPipelineDepthStencilStateCreateInfo depthStencilState = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+		depthStencilState.depthTestEnable = VK_TRUE;
+		depthStencilState.depthWriteEnable = VK_TRUE;
+		depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
 		createInfo.pDepthStencilState = &depthStencilState;
 
 		VkPipelineColorBlendAttachmentState colorAttachmentState = {};
@@ -828,28 +1973,50 @@ private:
 		dynamicState.pDynamicStates = dynamicStates;
 		createInfo.pDynamicState = &dynamicState;
 
-		createInfo.layout = _pipelineLayout;
-		createInfo.renderPass = _renderPass;
+		createInfo.layout = layout;
+
+		VkPipelineRenderingCreateInfo renderingInfo = { VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachmentFormats = &_colorFormat;
+		renderingInfo.depthAttachmentFormat = _depthFormat;
+		renderingInfo.viewMask = _viewMask();
+		if (_dynamicRendering)
+		{
+			createInfo.pNext = &renderingInfo;
+		}
+		else
+		{
+			createInfo.renderPass = _renderPass;
+		}
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		vkCreateGraphicsPipelines(_device, nullptr, 1, &createInfo, nullptr, &pipeline);
+		assert(pipeline);
 
-		vkCreateGraphicsPipelines(_device, nullptr, 1, &createInfo, nullptr, &_graphicsPipeline);
-		assert(_graphicsPipeline);
+		return pipeline;
 	}
 
 	void _createFrameBuffers()
 	{
+		// dynamic rendering begins on the image views themselves
+		if (_dynamicRendering)
+			return;
+
 		_swapChainFrameBuffers.resize(_swapChainImageViews.size());
 
 		for (size_t i = 0; i < _swapChainImageViews.size(); ++i)
 		{
-			VkImageView attachments[] = { _swapChainImageViews[i] };
+			// offscreen, every pass draws into the same scene color, the upscale picks the swapchain image
+			VkImageView attachments[] = { _offscreenScene() ? _sceneColorView : _swapChainImageViews[i], _depthImageView };
+			VkExtent2D extent = _renderExtent();
 
 			VkFramebufferCreateInfo frameBufferInfo = {};
 			frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 			frameBufferInfo.renderPass = _renderPass;
-			frameBufferInfo.attachmentCount = 1;
+			frameBufferInfo.attachmentCount = uint32_t(std::size(attachments));
 			frameBufferInfo.pAttachments = attachments;
-			frameBufferInfo.width = _swapChainExtent.width;
-			frameBufferInfo.height = _swapChainExtent.height;
+			frameBufferInfo.width = extent.width;
+			frameBufferInfo.height = extent.height;
 			frameBufferInfo.layers = 1;
 
 			if (vkCreateFramebuffer(_device, &frameBufferInfo, nullptr, &_swapChainFrameBuffers[i]) != VK_SUCCESS)
@@ -861,7 +2028,7 @@ private:
 
 	void _createCommandPool()
 	{
-		QueueFamilyIndices queueFamilyIndice = _findQueueFamily(_physicalDevice);
+		const QueueFamilyIndices& queueFamilyIndice = _physicalDeviceInfo.queueFamilies;
 
 		VkCommandPoolCreateInfo poolInfo = {};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -878,7 +2045,7 @@ private:
 
 	void _createCommandBuffers()
 	{
-		_commandBuffers.resize(_swapChainFrameBuffers.size());
+		_commandBuffers.resize(_swapChainImages.size());
 
 		VkCommandBufferAllocateInfo allocInfo = {};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -890,13 +2057,74 @@ private:
 		{
 			throw std::runtime_error("Failed to create command buffers!");
 		}
+
+		if (_asyncCompute)
+		{
+			_earlyCommandBuffers.resize(_swapChainImages.size());
+			if (vkAllocateCommandBuffers(_device, &allocInfo, _earlyCommandBuffers.data()) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create command buffers!");
+			}
+		}
+	}
+
+	// the compute queue's pool, its per-slot command buffers and the semaphores between the queues
+	void _createAsyncCompute()
+	{
+		if (!_asyncCompute)
+			return;
+
+		VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+		poolInfo.queueFamilyIndex = _physicalDeviceInfo.queueFamilies.computeFamily.value();
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_computeCommandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create compute command pool");
+		}
+
+		_computeCommandBuffers.resize(MAX_FRAMES);
+		VkCommandBufferAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+		allocInfo.commandPool = _computeCommandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = uint32_t(_computeCommandBuffers.size());
+		if (vkAllocateCommandBuffers(_device, &allocInfo, _computeCommandBuffers.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create compute command buffers");
+		}
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		if (vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &_lightsBinnedSemaphore) != VK_SUCCESS ||
+			vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &_lightsReleasedSemaphore) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create async compute semaphores");
+		}
+	}
+
+	void _destroyAsyncCompute()
+	{
+		if (!_asyncCompute)
+			return;
+
+		_computeProfiler->Report(std::cout, "compute");
+		if (_overlapFrames > 0)
+		{
+			std::cout << "async compute: " << _computeMs / double(_overlapFrames) << " ms of compute per frame, "
+				<< (_computeMs > 0.0 ? 100.0 * _overlapMs / _computeMs : 0.0) << "% of it overlapping graphics work" << std::endl;
+		}
+		_computeProfiler.reset();
+
+		vkDestroySemaphore(_device, _lightsBinnedSemaphore, nullptr);
+		vkDestroySemaphore(_device, _lightsReleasedSemaphore, nullptr);
+		vkDestroyCommandPool(_device, _computeCommandPool, nullptr);
 	}
 
 	void _createSyncObjects()
 	{
-		_imageAvailableSemaphores.resize(MAX_FRAMES);
-		_renderFinishedSemaphores.resize(MAX_FRAMES);
-		_inFlightFences.resize(MAX_FRAMES);
+		_framesInFlight = _config.presentPolicy == PresentPolicy::LowLatency ? 1 : MAX_FRAMES;
+
+		_imageAvailableSemaphores.resize(_framesInFlight);
+		_renderFinishedSemaphores.resize(_framesInFlight);
+		_inFlightFences.resize(_framesInFlight);
 		_imagesInFlight.resize(_swapChainImages.size(), VK_NULL_HANDLE);
 
 		VkSemaphoreCreateInfo semaphoreCreateInfo = {};
@@ -906,7 +2134,7 @@ private:
 		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-		for (size_t i = 0; i < MAX_FRAMES; ++i)
+		for (size_t i = 0; i < _framesInFlight; ++i)
 		{
 			if (vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &_imageAvailableSemaphores[i]) != VK_SUCCESS ||
 				vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &_renderFinishedSemaphores[i]) != VK_SUCCESS ||
@@ -929,18 +2157,40 @@ private:
 
 		vkDeviceWaitIdle(_device);
 
+		// present ids belong to the old swapchain
+		_pendingPresents.clear();
+
 		_cleanupSwapChain();
 
 		_createSwapchain();
 		_createImageViews();
-		_createRenderPass();
-		_createPipelineLayout();
-		_createGraphicsPipeline();
-		_createFrameBuffers();
-		_createCommandBuffers();
-	}
+		_createDepthTargets();
+		_createLightClusters();
+		_updateShadowViews();
+
+		// render passes and framebuffers follow the swapchain, and the pipelines their render pass. with dynamic
+		// rendering the pipelines only know the formats, which a new swapchain of the same surface keeps
+		if (_dynamicRendering)
+		{
+			assert(_swapChainImageFormat == _colorFormat);
+		}
+		else
+		{
+			_createRenderPass(_swapChainImageFormat);
+			_createPipelineLayout();
+			_createGraphicsPipeline();
+			_createFrameBuffers();
+		}
+		_createCommandBuffers();
+		_createCaptureSlots();
+		if (_sceneBatches)
+		{
+			_sceneBatches->Invalidate();
+		}
+		_nameObjects();
+	}
 	
-	uint32_t _findeMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+	std::optional<uint32_t> _tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
 	{
 		VkPhysicalDeviceMemoryProperties memProperties;
 		vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memProperties);
@@ -953,10 +2203,23 @@ private:
 			}
 		}
 
-		throw std::runtime_error("Failed to find suitable memory type!");
+		return std::nullopt;
+	}
+
+	uint32_t _findeMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+	{
+		std::optional<uint32_t> memoryType = _tryFindMemoryType(typeFilter, properties);
+		if (!memoryType.has_value())
+		{
+			throw std::runtime_error("Failed to find suitable memory type!");
+		}
+
+		return memoryType.value();
 	}
 
-	void _createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+	// 'sharedWithCompute': also used on the async compute queue, concurrent instead of ownership transfers every frame
+	void _createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory,
+		MemoryCategory category, bool sharedWithCompute = false)
 	{
 		VkBufferCreateInfo vertexBufferInfo = {};
 		vertexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -965,6 +2228,14 @@ private:
 		vertexBufferInfo.usage = usage;
 		vertexBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+		uint32_t families[] = { _physicalDeviceInfo.queueFamilies.graphicsFamily.value_or(0), _physicalDeviceInfo.queueFamilies.computeFamily.value_or(0) };
+		if (sharedWithCompute && _asyncCompute)
+		{
+			vertexBufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			vertexBufferInfo.queueFamilyIndexCount = uint32_t(std::size(families));
+			vertexBufferInfo.pQueueFamilyIndices = families;
+		}
+
 		if (vkCreateBuffer(_device, &vertexBufferInfo, nullptr, &buffer) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create vertex buffer!");
@@ -978,7 +2249,7 @@ private:
 		allocInfo.allocationSize = memRequirements.size;
 		allocInfo.memoryTypeIndex = _findeMemoryType(memRequirements.memoryTypeBits, properties);
 
-		if (vkAllocateMemory(_device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+		if (_memoryTelemetry->Allocate(allocInfo, category, &bufferMemory) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to allocate vertex buffer memory!");
 		}
@@ -1024,238 +2295,4003 @@ private:
 		vkFreeCommandBuffers(_device, _commandPool, 1, &commandBuffer);
 	}
 
-	VkImageMemoryBarrier _imageBarrier(VkImage image, VkAccessFlags srcAccessMask, VkImageLayout oldLayout, VkAccessFlags dscAcessMask, VkImageLayout newLayout)
+	void _createCaptureSlots()
 	{
-		VkImageMemoryBarrier imageBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-		imageBarrier.srcAccessMask				 = srcAccessMask;
-		imageBarrier.dstAccessMask				 = dscAcessMask;
-		imageBarrier.oldLayout                   = oldLayout;
-		imageBarrier.newLayout                   = newLayout;
-		imageBarrier.srcQueueFamilyIndex		 = VK_QUEUE_FAMILY_IGNORED;
-		imageBarrier.dstQueueFamilyIndex		 = VK_QUEUE_FAMILY_IGNORED;
-		imageBarrier.image						 = image;
-		imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-		imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-
-		return imageBarrier;
-	}
+		if (!_captureEnabled)
+			return;
 
-	void pipelineImageBarrier(VkCommandBuffer commandbuffer, VkImage image, 
-		VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkImageLayout oldLayout, 
-		VkPipelineStageFlags dstStageMask, VkAccessFlags dscAcessMask, VkImageLayout newLayout)
-	{
+		// a device group member hands its readbacks to the group's encoder
+		if (!_frameEncoder && _config.captureFormat != CaptureFormat::None && _dispatcher == nullptr)
+		{
+			double frameRate = _config.EffectiveFrameRateLimit() > 0.0 ? _config.EffectiveFrameRateLimit() : 60.0;
+			_frameEncoder = std::make_unique<FrameEncoder>(_config.captureFormat, _config.capturePath, _config.captureQueueDepth, frameRate);
+		}
 
+		_captureSlots.resize(_framesInFlight);
+		for (CaptureSlot& slot : _captureSlots)
+		{
+			_createReadbackSlot(slot, nullptr, 0);
+		}
 	}
-	// init vulkan
-	void _initVulkan()
+
+	// a buffer a frame is read back into. 'hostPointer' imports those 'hostSize' bytes as its memory
+	// (VK_EXT_external_memory_host) instead of allocating, false when the device can't use them
+	bool _createReadbackSlot(CaptureSlot& slot, void* hostPointer, VkDeviceSize hostSize)
 	{
-		_createInstance();
-		_createSurface(); // The window surface needs to be created right after the instance creation
-		_setupMessenger();
-		_pickPhysicalDevice();
-		_createLogicDevice();
-		_createSwapchain();
+		slot = CaptureSlot();
+		slot.extent = _swapChainExtent;
+		slot.size = VkDeviceSize(_swapChainExtent.width) * _swapChainExtent.height * 4;
 
-		_shaderModuleVS = _createShaderModule("shaders/triangle.vert.spv");
-		_shaderModulePS = _createShaderModule("shaders/triangle.frag.spv");
+		VkExternalMemoryBufferCreateInfo externalInfo = { VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO };
+		externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
 
-		_createImageViews();
-		_createRenderPass();
-		_createPipelineLayout();
-		_createGraphicsPipeline();
-		_createFrameBuffers();
-		_createCommandPool();
-		_createCommandBuffers();
-		_createSyncObjects();
-	}
+		VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.pNext = hostPointer != nullptr ? &externalInfo : nullptr;
+		bufferInfo.size = slot.size;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	void _drawFrame()
-	{
-		vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
+		if (vkCreateBuffer(_device, &bufferInfo, nullptr, &slot.buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create capture buffer!");
+		}
 
-		// acquiring an image
-		uint32_t imageIndex;
-		VkResult result = vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(_device, slot.buffer, &memRequirements);
 
-		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		VkMemoryAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		VkImportMemoryHostPointerInfoEXT importInfo = { VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT };
+		std::optional<uint32_t> memoryType;
+		if (hostPointer != nullptr)
 		{
-			_recreateSwapChain();
-			return;
+			VkMemoryHostPointerPropertiesEXT pointerProperties = { VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT };
+			if (_vkGetMemoryHostPointerPropertiesEXT(_device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, hostPointer, &pointerProperties) == VK_SUCCESS)
+			{
+				memoryType = _tryFindMemoryType(memRequirements.memoryTypeBits & pointerProperties.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			}
+			if (!memoryType.has_value() || memRequirements.size > hostSize)
+			{
+				vkDestroyBuffer(_device, slot.buffer, nullptr);
+				slot = CaptureSlot();
+				return false;
+			}
+
+			importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+			importInfo.pHostPointer = hostPointer;
+			allocInfo.pNext = &importInfo;
+			allocInfo.allocationSize = hostSize;
 		}
-		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		else
 		{
-			throw std::runtime_error("Failed to acquire swap chain image!");
+			// cached memory makes the CPU read fast; coherent is the fallback every device has
+			memoryType = _tryFindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+			if (!memoryType.has_value())
+			{
+				memoryType = _findeMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			}
+			allocInfo.allocationSize = memRequirements.size;
 		}
 
-		if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memProperties);
+		slot.coherent = (memProperties.memoryTypes[memoryType.value()].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+		allocInfo.memoryTypeIndex = memoryType.value();
+
+		if (_memoryTelemetry->Allocate(allocInfo, MemoryCategory::Staging, &slot.memory) != VK_SUCCESS)
 		{
-			vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+			if (hostPointer != nullptr)
+			{
+				vkDestroyBuffer(_device, slot.buffer, nullptr);
+				slot = CaptureSlot();
+				return false;
+			}
+			throw std::runtime_error("Failed to allocate capture buffer memory!");
 		}
 
-		_imagesInFlight[imageIndex] = _inFlightFences[_currentFrame];
-
-		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-		vkBeginCommandBuffer(_commandBuffers[imageIndex], &beginInfo);
-
-		VkImageMemoryBarrier renderBeginBarrier = _imageBarrier(_swapChainImages[imageIndex], 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-		vkCmdPipelineBarrier(_commandBuffers[imageIndex], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderBeginBarrier);
-
-		// use renderpass to clear
-		VkClearColorValue cleanColor = { 48.0 / 255.f, 10.0 / 255.0f, 36.0 / 255.0f, 1.0f };
-		VkClearValue clearValue = { cleanColor };
-
-		VkRenderPassBeginInfo renderPassBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-		renderPassBeginInfo.renderPass = _renderPass;
-		renderPassBeginInfo.framebuffer = _swapChainFrameBuffers[imageIndex];
-		renderPassBeginInfo.clearValueCount = 1;
-		renderPassBeginInfo.pClearValues = &clearValue;
-		renderPassBeginInfo.renderArea.extent.width = windowWidth;
-		renderPassBeginInfo.renderArea.extent.height = windowHeight;
-
-		vkCmdBeginRenderPass(_commandBuffers[imageIndex], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		// draw calls go here
-		VkViewport viewport = { 0, float(windowHeight), float(windowWidth), -float(windowHeight), 0, 1 };
-		VkRect2D scissor = { {0, 0}, {windowWidth, windowHeight} };
+		vkBindBufferMemory(_device, slot.buffer, slot.memory, 0);
+		if (hostPointer != nullptr)
+		{
+			slot.imported = true;
+			slot.mapped = hostPointer;
+		}
+		else
+		{
+			vkMapMemory(_device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped);
+		}
+		return true;
+	}
 
-		vkCmdSetViewport(_commandBuffers[imageIndex], 0, 1, &viewport);
-		vkCmdSetScissor(_commandBuffers[imageIndex], 0, 1, &scissor);
+	void _destroyReadbackSlot(CaptureSlot& slot)
+	{
+		if (!slot.imported)
+		{
+			vkUnmapMemory(_device, slot.memory);
+		}
+		vkDestroyBuffer(_device, slot.buffer, nullptr);
+		_memoryTelemetry->Free(slot.memory);
+		slot = CaptureSlot();
+	}
 
-		vkCmdBindPipeline(_commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
-		vkCmdDraw(_commandBuffers[imageIndex], 3, 1, 0, 0);
+	// the ring --export hands frames to, and a readback slot per ring slot. headless, so it never follows a swapchain
+	void _createExportRing()
+	{
+		if (_config.exportName.empty())
+			return;
 
-		vkCmdEndRenderPass(_commandBuffers[imageIndex]);
+		_exportRing = std::make_unique<FrameExport::Producer>(_config.exportName, _config.exportSlots, _swapChainExtent.width, _swapChainExtent.height,
+			uint32_t(_swapChainImageFormat), _exportHostImport ? uint64_t(_exportImportAlignment) : 0);
+		_exportSlots.resize(_exportRing->SlotCount());
+		uint32_t imported = 0;
+		for (uint32_t i = 0; i < _exportRing->SlotCount(); i++)
+		{
+			if (_exportHostImport && _createReadbackSlot(_exportSlots[i], _exportRing->Slot(i), _exportRing->SlotStride()))
+			{
+				imported++;
+			}
+			else
+			{
+				_createReadbackSlot(_exportSlots[i], nullptr, 0);
+			}
+		}
+		_exportPending.assign(_framesInFlight, -1);
 
+		std::cout << "frame export: " << _config.exportName << ", " << _exportRing->SlotCount() << " slots, " << imported
+			<< " read back straight into shared memory, the rest copied in" << std::endl;
+	}
 
-		VkImageMemoryBarrier renderEndBarrier = _imageBarrier(_swapChainImages[imageIndex], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-		vkCmdPipelineBarrier(_commandBuffers[imageIndex], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderEndBarrier);
+	// hands the frame frame slot 'frame' exported to the consumer, once the slot's fence is through
+	void _collectExport(size_t frame)
+	{
+		int32_t ringSlot = _exportPending[frame];
+		if (ringSlot < 0)
+			return;
+		_exportPending[frame] = -1;
 
-		vkEndCommandBuffer(_commandBuffers[imageIndex]);
-		// submitting the command buffer
-		VkSubmitInfo submitInfo = {};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		CaptureSlot& slot = _exportSlots[ringSlot];
+		slot.pending = false;
+		if (!slot.coherent)
+		{
+			VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
+			range.memory = slot.memory;
+			range.offset = 0;
+			range.size = VK_WHOLE_SIZE;
+			vkInvalidateMappedMemoryRanges(_device, 1, &range);
+		}
+		if (!slot.imported)
+		{
+			memcpy(_exportRing->Slot(uint32_t(ringSlot)), slot.mapped, size_t(slot.size));
+		}
+		_exportRing->Publish(uint32_t(ringSlot), slot.frameIndex);
+	}
 
-		VkSemaphore watsSemaphores[] = { _imageAvailableSemaphores[_currentFrame] };
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = watsSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
+	void _destroyExportRing()
+	{
+		if (!_exportRing)
+			return;
 
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
+		// the frames still in flight, oldest first so the ring's order holds
+		for (size_t i = 0; i < _framesInFlight; i++)
+		{
+			_collectExport((_currentFrame + i) % _framesInFlight);
+		}
+		for (CaptureSlot& slot : _exportSlots)
+		{
+			_destroyReadbackSlot(slot);
+		}
+		_exportSlots.clear();
+		_exportRing->Report(std::cout);
+		_exportRing.reset();
+	}
 
-		VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[_currentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = signalSemaphores;
+	// caller guarantees the frame that filled the slot has completed
+	void _collectCapture(CaptureSlot& slot)
+	{
+		if (!slot.pending)
+			return;
+		slot.pending = false;
 
-		vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
-		if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]) != VK_SUCCESS)
+		if (!slot.coherent)
 		{
-			throw std::runtime_error("Failed to submit draw command buffer");
+			VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
+			range.memory = slot.memory;
+			range.offset = 0;
+			range.size = VK_WHOLE_SIZE;
+			vkInvalidateMappedMemoryRanges(_device, 1, &range);
 		}
 
-		VkPresentInfoKHR presentInfo = {};
-		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-
-		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = signalSemaphores;
+		CapturedFrame frame;
+		frame.index = slot.frameIndex;
+		frame.width = slot.extent.width;
+		frame.height = slot.extent.height;
+		frame.bgra = _swapChainImageFormat == VK_FORMAT_B8G8R8A8_UNORM || _swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB;
 
-		VkSwapchainKHR swapChains[] = { _swapChain };
-		presentInfo.swapchainCount = 1;
-		presentInfo.pSwapchains = swapChains;
-		presentInfo.pImageIndices = &imageIndex;
+		if (_config.captureToMemory)
+		{
+			_lastCapturedFrame = frame;
+			_lastCapturedFrame.pixels.assign((const uint8_t*)slot.mapped, (const uint8_t*)slot.mapped + slot.size);
+			if (_lastCapturedFrame.bgra)
+			{
+				ImageIO::SwapRedBlue(_lastCapturedFrame.pixels);
+				_lastCapturedFrame.bgra = false;
+			}
+		}
 
-		presentInfo.pResults = nullptr;
+		if (_frameEncoder)
+		{
+			frame.pixels = _frameEncoder->AcquireStorage(size_t(slot.size));
+			memcpy(frame.pixels.data(), slot.mapped, size_t(slot.size));
 
-		result = vkQueuePresentKHR(_presentQueue, &presentInfo);
-		if (result == VK_ERROR_OUT_OF_POOL_MEMORY_KHR || result == VK_SUBOPTIMAL_KHR || _framebufferResized)
+			_frameEncoder->Submit(std::move(frame), _config.captureDropWhenFull);
+		}
+		else if (_dispatcher != nullptr && _config.captureFormat != CaptureFormat::None)
 		{
-			glfwGetWindowSize(_window, &windowWidth, &windowHeight);
-			_framebufferResized = false;
-			_recreateSwapChain();
+			frame.pixels = _dispatcher->AcquireStorage(size_t(slot.size));
+			memcpy(frame.pixels.data(), slot.mapped, size_t(slot.size));
+
+			_dispatcher->Deliver(std::move(frame));
 		}
-		else if (result != VK_SUCCESS)
+	}
+
+	void _destroyCaptureSlots()
+	{
+		for (CaptureSlot& slot : _captureSlots)
 		{
-			throw std::runtime_error("Failed to present swap chain image!");
+			_collectCapture(slot);
+			_destroyReadbackSlot(slot);
 		}
+		_captureSlots.clear();
+	}
 
-		_currentFrame = (_currentFrame + 1) % MAX_FRAMES;
+	// how the frame's last write leaves the swapchain image: the upscale's copy in TRANSFER_DST, or the scene pass
+	// drawing into it directly. capture and present transition it from there once
+	void _renderedImageState(VkPipelineStageFlags2& stage, VkAccessFlags2& access, VkImageLayout& layout) const
+	{
+		bool upscaled = _offscreenScene();
+		stage = upscaled ? VK_PIPELINE_STAGE_2_TRANSFER_BIT : VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		access = upscaled ? VK_ACCESS_2_TRANSFER_WRITE_BIT : VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+		layout = upscaled ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	}
 
-	void _mainLoop()
+	// copies the rendered image into the slot and leaves it in _presentLayout()
+	void _recordCapture(VkCommandBuffer commandBuffer, VkImage image, CaptureSlot& slot)
 	{
-		while (!glfwWindowShouldClose(_window))
+		VkPipelineStageFlags2 renderedStage;
+		VkAccessFlags2 renderedAccess;
+		VkImageLayout renderedLayout;
+		_renderedImageState(renderedStage, renderedAccess, renderedLayout);
+		_barriers->Image(image, VK_IMAGE_ASPECT_COLOR_BIT, renderedStage, renderedAccess, renderedLayout,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		_barriers->Flush(commandBuffer);
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;		// tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { slot.extent.width, slot.extent.height, 1 };
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+		// make the copy visible to the host once the frame fence signals
+		_barriers->Buffer(slot.buffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+
+		// headless images stay in TRANSFER_SRC, there is nothing to present them to. the transition
+		// only has to wait for the copy's reads
+		if (!_config.headless)
 		{
-			glfwPollEvents();
-			_drawFrame();
+			_barriers->Image(image, VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 		}
+		_barriers->Flush(commandBuffer);
 
-		vkDeviceWaitIdle(_device);
+		slot.pending = true;
+		slot.frameIndex = _sceneFrame;
+		_capturedFrames++;
 	}
 
-	void _cleanupSwapChain()
+	void pipelineImageBarrier(VkCommandBuffer commandbuffer, VkImage image, 
+		VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkImageLayout oldLayout, 
+		VkPipelineStageFlags dstStageMask, VkAccessFlags dscAcessMask, VkImageLayout newLayout)
 	{
-		for (auto framebuffer : _swapChainFrameBuffers)
+
+	}
+	// init vulkan
+	//
+	// startup dependency graph:
+	//
+	//   shader file I/O ---------------------------------------+
+	//                                                          v
+	//   instance -> surface -> device pick -> logic device -> shader modules -> render pass -> pipeline --+
+	//                                                     \                                              v
+	//                                                      +-> swapchain -> image views ------------> framebuffers -> commands -> sync
+	//
+	// file I/O starts before the instance, and pipeline creation runs on a worker thread
+	// while the main thread builds the swapchain. the render pass only needs the surface format,
+	// which is known from the cached device info before the swapchain exists.
+	void _initVulkan()
+	{
+		auto loadShader = [this](const char* name, const char* path)
 		{
-			vkDestroyFramebuffer(_device, framebuffer, nullptr);
+			StartupTrace::Scope trace(_startupTrace, name);
+			return readFile(path);
+		};
+		std::future<std::vector<char>> vsCode = std::async(std::launch::async, loadShader, "load triangle.vert", "shaders/triangle.vert.spv");
+		std::future<std::vector<char>> psCode = std::async(std::launch::async, loadShader, "load triangle.frag", "shaders/triangle.frag.spv");
+		std::future<std::vector<char>> meshVsCode, meshPsCode;
+		if (_config.scene == Scene::Mesh)
+		{
+			// split-screen views pick their vertex shader once the device has decided how they're drawn
+			if (_config.viewCount == 1)
+			{
+				meshVsCode = std::async(std::launch::async, loadShader, "load mesh.vert", "shaders/mesh.vert.spv");
+			}
+			meshPsCode = std::async(std::launch::async, loadShader, "load mesh.frag", "shaders/mesh.frag.spv");
 		}
 
-		vkFreeCommandBuffers(_device, _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
+		{
+			StartupTrace::Scope trace(_startupTrace, "instance");
+			_createInstance();
+		}
+		{
+			StartupTrace::Scope trace(_startupTrace, "surface");
+			_createSurface(); // The window surface needs to be created right after the instance creation
+		}
+		{
+			StartupTrace::Scope trace(_startupTrace, "debug messenger");
+			_setupMessenger();
+		}
+		{
+			StartupTrace::Scope trace(_startupTrace, "pick physical device");
+			_pickPhysicalDevice();
+		}
+		{
+			StartupTrace::Scope trace(_startupTrace, "logic device");
+			_createLogicDevice();
+		}
+		{
+			// only kicks off decoding, the pipeline layout needs the descriptor set layout
+			StartupTrace::Scope trace(_startupTrace, "texture streamer");
+			_createTextureStreamer();
+		}
+		if (_clusterCulling != ClusterCulling::Off)
+		{
+			_createClusterSetLayout();
+		}
+		_createLightSetLayout();
 
-		vkDestroyPipeline(_device, _graphicsPipeline, nullptr);
+		VkFormat colorFormat = _config.headless ? VK_FORMAT_B8G8R8A8_UNORM : _chooseSwapSurfaceFormat(_physicalDeviceInfo.swapchainSupport.formats).format;
 
-		vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+		// the scene's render area is blitted up to the swapchain image with linear filtering. decided before the
+		// worker builds the render pass, which orders against the previous frame's blit
+		if (_config.targetFrameMs > 0.0)
+		{
+			VkFormatProperties properties = {};
+			vkGetPhysicalDeviceFormatProperties(_physicalDevice, colorFormat, &properties);
+			VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+			if ((properties.optimalTilingFeatures & needed) != needed)
+			{
+				throw std::runtime_error("Dynamic resolution needs linear blits of the swapchain format");
+			}
+			_dynamicResolution = std::make_unique<DynamicResolution>(_config.targetFrameMs, float(_config.minRenderScale), uint32_t(MAX_FRAMES));
+		}
+		std::future<void> pipeline = std::async(std::launch::async, [this, colorFormat, &vsCode, &psCode, &meshVsCode, &meshPsCode]()
+		{
+			{
+				StartupTrace::Scope trace(_startupTrace, "shader modules");
+				_shaderModuleVS = _createShaderModule(vsCode.get());
+				_shaderModulePS = _createShaderModule(psCode.get());
+				if (meshPsCode.valid())
+				{
+					_meshShaderModuleVS = _createShaderModule(meshVsCode.valid() ? meshVsCode.get() :
+						readFile(_multiview ? "shaders/mesh_multiview.vert.spv" : "shaders/mesh_viewports.vert.spv"));
+					_meshShaderModulePS = _createShaderModule(meshPsCode.get());
+				}
+				if (_meshShading)
+				{
+					_meshletShaderModuleTS = _createShaderModule(readFile("shaders/meshlet.task.spv"));
+					_meshletShaderModuleMS = _createShaderModule(readFile("shaders/meshlet.mesh.spv"));
+				}
+			}
+			{
+				StartupTrace::Scope trace(_startupTrace, "render pass");
+				_createRenderPass(colorFormat);
+			}
+			{
+				StartupTrace::Scope trace(_startupTrace, "graphics pipeline");
+				_createPipelineLayout();
+				_createGraphicsPipeline();
+			}
+		});
 
-		vkDestroyRenderPass(_device, _renderPass, nullptr);
+		{
+			StartupTrace::Scope trace(_startupTrace, "swapchain");
+			_createSwapchain();
+			_createImageViews();
+		}
+		{
+			StartupTrace::Scope trace(_startupTrace, "command pool");
+			_createCommandPool();
+			_createSyncObjects();
+			_createAsyncCompute();
+			_createSceneBatches();
+			_createCaptureSlots();
+			_createExportRing();
+		}
+		if (_config.scene == Scene::Mesh)
+		{
+			StartupTrace::Scope trace(_startupTrace, "mesh");
+			_createMeshBuffers();
+		}
+		{
+			StartupTrace::Scope trace(_startupTrace, "depth");
+			_createDepthTargets();
+		}
+		{
+			StartupTrace::Scope trace(_startupTrace, "lights");
+			_createLights();
+			_createLightClusters();
+		}
+		{
+			StartupTrace::Scope trace(_startupTrace, "shadows");
+			_createShadows();
+		}
+
+		// rethrows anything the worker threw
+		pipeline.get();
+		assert(_swapChainImageFormat == colorFormat);
 
-		for (auto imageView : _swapChainImageViews)
 		{
-			vkDestroyImageView(_device, imageView, nullptr);
+			StartupTrace::Scope trace(_startupTrace, "framebuffers");
+			_createFrameBuffers();
+			_createCommandBuffers();
 		}
+		_nameObjects();
+	}
 
-		vkDestroySwapchainKHR(_device, _swapChain, nullptr);
+	template <typename T>
+	void _name(T object, VkObjectType type, const std::string& name)
+	{
+		if (_debugUtils)
+		{
+			_debugUtils->Name(object, type, name);
+		}
 	}
 
-	void _cleanup()
+	void _name(const DeviceBuffer& buffer, const std::string& name)
 	{
-		vkDestroyShaderModule(_device, _shaderModuleVS, nullptr);
-		vkDestroyShaderModule(_device, _shaderModulePS, nullptr);
+		_name(buffer.buffer, VK_OBJECT_TYPE_BUFFER, name);
+		_name(buffer.memory, VK_OBJECT_TYPE_DEVICE_MEMORY, name);
+	}
 
-		_cleanupSwapChain();
+	// what the validation layer and capture tools call the renderer's objects. again after the swapchain is
+	// recreated, for what follows it; the rest is just named again
+	void _nameObjects()
+	{
+		if (!_debugUtils)
+			return;
 
-		for (size_t i = 0; i < MAX_FRAMES; i++)
+		_name(_device, VK_OBJECT_TYPE_DEVICE, "renderer");
+		_name(_graphicsQueue, VK_OBJECT_TYPE_QUEUE, "graphics queue");
+		if (_presentQueue != _graphicsQueue)
 		{
-			vkDestroySemaphore(_device, _imageAvailableSemaphores[i], nullptr);
-			vkDestroySemaphore(_device, _renderFinishedSemaphores[i], nullptr);
-			vkDestroyFence(_device, _inFlightFences[i], nullptr);
+			_name(_presentQueue, VK_OBJECT_TYPE_QUEUE, "present queue");
+		}
+		_name(_computeQueue, VK_OBJECT_TYPE_QUEUE, "async compute queue");
+		_name(_swapChain, VK_OBJECT_TYPE_SWAPCHAIN_KHR, "swapchain");
+		for (size_t i = 0; i < _swapChainImages.size(); i++)
+		{
+			std::string index = std::to_string(i);
+			_name(_swapChainImages[i], VK_OBJECT_TYPE_IMAGE, (_config.headless ? "offscreen image " : "swapchain image ") + index);
+			_name(_swapChainImageViews[i], VK_OBJECT_TYPE_IMAGE_VIEW, "swapchain view " + index);
+			if (i < _offscreenMemory.size())
+			{
+				_name(_offscreenMemory[i], VK_OBJECT_TYPE_DEVICE_MEMORY, "offscreen image " + index);
+			}
+			if (i < _swapChainFrameBuffers.size())
+			{
+				_name(_swapChainFrameBuffers[i], VK_OBJECT_TYPE_FRAMEBUFFER, "scene framebuffer " + index);
+			}
+			if (i < _commandBuffers.size())
+			{
+				_name(_commandBuffers[i], VK_OBJECT_TYPE_COMMAND_BUFFER, "frame commands " + index);
+			}
+			if (i < _earlyCommandBuffers.size())
+			{
+				_name(_earlyCommandBuffers[i], VK_OBJECT_TYPE_COMMAND_BUFFER, "early commands " + index);
+			}
+		}
+		for (size_t i = 0; i < _inFlightFences.size(); i++)
+		{
+			std::string index = std::to_string(i);
+			_name(_inFlightFences[i], VK_OBJECT_TYPE_FENCE, "frame slot " + index);
+			_name(_imageAvailableSemaphores[i], VK_OBJECT_TYPE_SEMAPHORE, "image available " + index);
+			_name(_renderFinishedSemaphores[i], VK_OBJECT_TYPE_SEMAPHORE, "render finished " + index);
+		}
+		for (size_t i = 0; i < _computeCommandBuffers.size(); i++)
+		{
+			_name(_computeCommandBuffers[i], VK_OBJECT_TYPE_COMMAND_BUFFER, "async compute commands " + std::to_string(i));
+		}
+		_name(_commandPool, VK_OBJECT_TYPE_COMMAND_POOL, "graphics commands");
+		_name(_computeCommandPool, VK_OBJECT_TYPE_COMMAND_POOL, "async compute commands");
+		_name(_lightsBinnedSemaphore, VK_OBJECT_TYPE_SEMAPHORE, "lights binned");
+		_name(_lightsReleasedSemaphore, VK_OBJECT_TYPE_SEMAPHORE, "lights released");
+		for (size_t i = 0; i < _captureSlots.size(); i++)
+		{
+			_name(_captureSlots[i].buffer, VK_OBJECT_TYPE_BUFFER, "capture readback " + std::to_string(i));
+			_name(_captureSlots[i].memory, VK_OBJECT_TYPE_DEVICE_MEMORY, "capture readback " + std::to_string(i));
+		}
+		for (size_t i = 0; i < _exportSlots.size(); i++)
+		{
+			_name(_exportSlots[i].buffer, VK_OBJECT_TYPE_BUFFER, "export slot " + std::to_string(i));
+			_name(_exportSlots[i].memory, VK_OBJECT_TYPE_DEVICE_MEMORY, "export slot " + std::to_string(i));
 		}
 
-		vkDestroyCommandPool(_device, _commandPool, nullptr);
-
-		vkDestroyDevice(_device, nullptr);
-
-		if (enableValidationLayer)
+		// passes and pipelines
+		_name(_renderPass, VK_OBJECT_TYPE_RENDER_PASS, "scene pass");
+		_name(_lateRenderPass, VK_OBJECT_TYPE_RENDER_PASS, "scene late pass");
+		_name(_shadowCacheRenderPass, VK_OBJECT_TYPE_RENDER_PASS, "shadow cache pass");
+		_name(_shadowAtlasRenderPass, VK_OBJECT_TYPE_RENDER_PASS, "shadow atlas pass");
+		_name(_pipelineLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT, "scene layout");
+		_name(_meshletPipelineLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT, "meshlet layout");
+		_name(_clusterCullLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT, "cluster culling layout");
+		_name(_depthReduceLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT, "depth reduce layout");
+		_name(_lightBinLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT, "light binning layout");
+		_name(_shadowPipelineLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT, "shadow layout");
+		_name(_graphicsPipeline, VK_OBJECT_TYPE_PIPELINE, "triangle");
+		for (size_t i = 0; i < _scenePipelines.size(); i++)
 		{
-			DestroyDebugUtilsMessengerEXT(_instance, debugMessenger, nullptr);
+			_name(_scenePipelines[i], VK_OBJECT_TYPE_PIPELINE, "scene pipeline " + std::to_string(i));
+		}
+		_name(_meshPipeline, VK_OBJECT_TYPE_PIPELINE, "mesh");
+		_name(_clusterCullPipeline, VK_OBJECT_TYPE_PIPELINE, "cluster culling");
+		_name(_lodSelectPipeline, VK_OBJECT_TYPE_PIPELINE, "LOD selection");
+		_name(_depthReducePipeline, VK_OBJECT_TYPE_PIPELINE, "depth reduce");
+		_name(_lightBinPipeline, VK_OBJECT_TYPE_PIPELINE, "light binning");
+		_name(_shadowPipeline, VK_OBJECT_TYPE_PIPELINE, "shadows");
+		_name(_shaderModuleVS, VK_OBJECT_TYPE_SHADER_MODULE, "triangle.vert");
+		_name(_shaderModulePS, VK_OBJECT_TYPE_SHADER_MODULE, "triangle.frag");
+		_name(_meshShaderModuleVS, VK_OBJECT_TYPE_SHADER_MODULE, "mesh.vert");
+		_name(_meshShaderModulePS, VK_OBJECT_TYPE_SHADER_MODULE, "mesh.frag");
+		_name(_meshletShaderModuleTS, VK_OBJECT_TYPE_SHADER_MODULE, "meshlet.task");
+		_name(_meshletShaderModuleMS, VK_OBJECT_TYPE_SHADER_MODULE, "meshlet.mesh");
+		_name(_shadowShaderModuleVS, VK_OBJECT_TYPE_SHADER_MODULE, "shadow.vert");
+
+		// descriptors
+		_name(_clusterSetLayout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, "cluster set");
+		_name(_clusterDescriptorPool, VK_OBJECT_TYPE_DESCRIPTOR_POOL, "cluster sets");
+		_name(_clusterSet, VK_OBJECT_TYPE_DESCRIPTOR_SET, "cluster set");
+		_name(_lightSetLayout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, "light set");
+		_name(_lightDescriptorPool, VK_OBJECT_TYPE_DESCRIPTOR_POOL, "light sets");
+		_name(_lightSet, VK_OBJECT_TYPE_DESCRIPTOR_SET, "light set");
+		_name(_depthReduceSetLayout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, "depth reduce set");
+		_name(_depthReducePool, VK_OBJECT_TYPE_DESCRIPTOR_POOL, "depth reduce sets");
+		for (size_t i = 0; i < _depthReduceSets.size(); i++)
+		{
+			_name(_depthReduceSets[i], VK_OBJECT_TYPE_DESCRIPTOR_SET, "depth reduce level " + std::to_string(i));
+		}
+
+		// buffers
+		_name(_meshVertices, "mesh vertices");
+		_name(_meshIndices, "mesh indices");
+		_name(_meshlets, "meshlets");
+		_name(_meshletVertices, "meshlet vertices");
+		_name(_meshletTriangles, "meshlet triangles");
+		_name(_clusterIndices, "cluster indices");
+		_name(_clusterDraw, "cluster draws");
+		_name(_clusterVisibility, "cluster visibility");
+		_name(_meshLodTable, "mesh LODs");
+		_name(_meshInstanceData, "mesh instances");
+		_name(_lightParams, "lighting params");
+		_name(_lightData, "lights");
+		_name(_lightClusters, "light clusters");
+		_name(_lightIndices, "light indices");
+		_name(_shadowViewData, "shadow views");
+
+		// images
+		_name(_depthImage, VK_OBJECT_TYPE_IMAGE, "depth");
+		_name(_depthImageView, VK_OBJECT_TYPE_IMAGE_VIEW, "depth");
+		_name(_sceneColorImage, VK_OBJECT_TYPE_IMAGE, "scene color");
+		_name(_sceneColorView, VK_OBJECT_TYPE_IMAGE_VIEW, "scene color");
+		_name(_depthPyramid, VK_OBJECT_TYPE_IMAGE, "depth pyramid");
+		_name(_depthPyramidView, VK_OBJECT_TYPE_IMAGE_VIEW, "depth pyramid");
+		for (size_t i = 0; i < _depthPyramidLevels.size(); i++)
+		{
+			_name(_depthPyramidLevels[i], VK_OBJECT_TYPE_IMAGE_VIEW, "depth pyramid level " + std::to_string(i));
+		}
+		_name(_depthPyramidSampler, VK_OBJECT_TYPE_SAMPLER, "depth pyramid");
+		const char* shadowNames[2] = { "shadow cache", "shadow atlas" };
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			_name(_shadowImages[i], VK_OBJECT_TYPE_IMAGE, shadowNames[i]);
+			_name(_shadowMemory[i], VK_OBJECT_TYPE_DEVICE_MEMORY, shadowNames[i]);
+			_name(_shadowImageViews[i], VK_OBJECT_TYPE_IMAGE_VIEW, shadowNames[i]);
+			_name(_shadowFramebuffers[i], VK_OBJECT_TYPE_FRAMEBUFFER, shadowNames[i]);
+		}
+		_name(_shadowSampler, VK_OBJECT_TYPE_SAMPLER, "shadows");
+	}
+
+	// device-local buffer filled through a staging buffer
+	void _uploadBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, DeviceBuffer& buffer, MemoryCategory category)
+	{
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingMemory;
+		_createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory,
+			MemoryCategory::Staging);
+
+		void* mapped = nullptr;
+		vkMapMemory(_device, stagingMemory, 0, size, 0, &mapped);
+		memcpy(mapped, data, size_t(size));
+		vkUnmapMemory(_device, stagingMemory);
+
+		_createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer.buffer, buffer.memory, category);
+		_copyBuffer(stagingBuffer, buffer.buffer, size);
+
+		vkDestroyBuffer(_device, stagingBuffer, nullptr);
+		_memoryTelemetry->Free(stagingMemory);
+	}
+
+	void _destroyBuffer(DeviceBuffer& buffer)
+	{
+		vkDestroyBuffer(_device, buffer.buffer, nullptr);
+		_memoryTelemetry->Free(buffer.memory);
+		buffer = {};
+	}
+
+	void _createMeshBuffers()
+	{
+		MeshFormat::Mesh mesh = MeshFormat::Read(_config.meshPath);
+		_meshHeader = mesh.header;
+		_shadowsEnabled = true;
+		_meshLods = mesh.lods;
+
+		// storage too, mesh shaders fetch vertices themselves
+		_uploadBuffer(mesh.vertices.data(), mesh.vertices.size() * sizeof(MeshFormat::Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _meshVertices, MemoryCategory::Mesh);
+		_uploadBuffer(mesh.indices.data(), mesh.indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, _meshIndices, MemoryCategory::Mesh);
+
+		// a grid filling the viewport, each row a bit smaller than the one below it so the LODs vary
+		const uint32_t columns = _config.meshInstances;
+		const float cell = 2.0f / columns;
+		for (uint32_t i = 0; i < columns * columns; i++)
+		{
+			uint32_t row = i / columns;
+			float shrink = 1.0f - 0.6f * float(row) / float(std::max(columns - 1, 1u));
+
+			MeshInstance instance = {};
+			instance.offset[0] = -1.0f + cell * (float(i % columns) + 0.5f);
+			instance.offset[1] = -1.0f + cell * (float(row) + 0.5f);
+			instance.scale = 0.4f * cell * shrink;
+			_meshInstances.push_back(instance);
+		}
+		_meshInstanceHomes = _meshInstances;
+		// vkCmdUpdateBuffer moves them, which is limited to 64 KB
+		_dynamicInstances = std::min({ _config.dynamicInstances, uint32_t(_meshInstances.size()), uint32_t(65536 / sizeof(MeshInstance)) });
+
+		if (_clusterCulling != ClusterCulling::Off)
+		{
+			_createClusterCulling(mesh);
+		}
+	}
+
+	// bindings: 0 meshlets, 1 meshlet vertices, 2 meshlet triangles, 3 compacted indices, 4 draw commands, 5 vertices,
+	// 6 LOD table, 7 instances, 8 the depth pyramid and 9 last frame's visibility (placeholders without occlusion culling).
+	// the LOD selection uses 4, 6 and 7, the compute culling everything but 5, the task/mesh shaders everything but 3
+	void _createClusterSetLayout()
+	{
+		VkShaderStageFlags stages = VK_SHADER_STAGE_COMPUTE_BIT;
+		if (_meshShading)
+		{
+			stages |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+		}
+
+		VkDescriptorSetLayoutBinding bindings[10] = {};
+		for (uint32_t i = 0; i < std::size(bindings); i++)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = i == 8 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = stages;
+		}
+
+		VkDescriptorSetLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		createInfo.bindingCount = uint32_t(std::size(bindings));
+		createInfo.pBindings = bindings;
+
+		if (vkCreateDescriptorSetLayout(_device, &createInfo, nullptr, &_clusterSetLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create cluster culling descriptor set layout");
+		}
+	}
+
+	VkPipeline _createComputePipeline(const std::string& path, VkPipelineLayout layout)
+	{
+		VkShaderModule shader = _createShaderModule(readFile(path));
+
+		VkComputePipelineCreateInfo pipelineInfo = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shader;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = layout;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkResult result = vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+		vkDestroyShaderModule(_device, shader, nullptr);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create compute pipeline from " + path);
+		}
+		return pipeline;
+	}
+
+	void _createClusterCulling(const MeshFormat::Mesh& mesh)
+	{
+		if (mesh.meshlets.empty())
+		{
+			throw std::runtime_error(_config.meshPath + " has no meshlets, re-run --optimize-mesh or use --cluster-culling=off");
+		}
+
+		_uploadBuffer(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(MeshFormat::Meshlet), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _meshlets, MemoryCategory::Mesh);
+		_uploadBuffer(mesh.meshletVertices.data(), mesh.meshletVertices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _meshletVertices, MemoryCategory::Mesh);
+		_uploadBuffer(mesh.meshletTriangles.data(), mesh.meshletTriangles.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _meshletTriangles, MemoryCategory::Mesh);
+		_uploadBuffer(mesh.lods.data(), mesh.lods.size() * sizeof(MeshFormat::Lod), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _meshLodTable, MemoryCategory::Mesh);
+		_uploadBuffer(_meshInstances.data(), _meshInstances.size() * sizeof(MeshInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _meshInstanceData, MemoryCategory::Mesh);
+
+		// host visible so the report can read the last frame's counts. zeroed once, every instance starts at LOD 0
+		VkDeviceSize drawSize = _clusterDrawCount() * sizeof(ClusterDrawCommand);
+		_createBuffer(drawSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _clusterDraw.buffer, _clusterDraw.memory, MemoryCategory::Mesh);
+		void* mapped = nullptr;
+		vkMapMemory(_device, _clusterDraw.memory, 0, drawSize, 0, &mapped);
+		memset(mapped, 0, size_t(drawSize));
+		vkUnmapMemory(_device, _clusterDraw.memory);
+
+		// nothing was visible before the first frame, it is all drawn by the late phase. the shaders
+		// reference it either way, without occlusion culling it's a placeholder
+		std::vector<uint32_t> visibility(_occlusionCulling ? _meshInstances.size() * _meshLods[0].meshletCount : 1, 0);
+		_uploadBuffer(visibility.data(), visibility.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _clusterVisibility, MemoryCategory::Mesh);
+
+		// worst case every instance at LOD 0 with every cluster surviving in every view, 32-bit indices since they
+		// come from the meshlet vertex tables
+		if (!_meshShading)
+		{
+			_createBuffer(VkDeviceSize(_meshInstances.size()) * _viewCount * _meshLods[0].indexCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _clusterIndices.buffer, _clusterIndices.memory, MemoryCategory::Mesh);
+		}
+
+		VkDescriptorPoolSize poolSizes[] = { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 9 }, { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } };
+		VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = uint32_t(std::size(poolSizes));
+		poolInfo.pPoolSizes = poolSizes;
+		if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_clusterDescriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create cluster culling descriptor pool");
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocInfo.descriptorPool = _clusterDescriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &_clusterSetLayout;
+		if (vkAllocateDescriptorSets(_device, &allocInfo, &_clusterSet) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate cluster culling descriptor set");
+		}
+
+		// the depth pyramid (8) is written by _createDepthTargets, it follows the swapchain size
+		VkDescriptorBufferInfo bufferInfos[10] =
+		{
+			{ _meshlets.buffer, 0, VK_WHOLE_SIZE },
+			{ _meshletVertices.buffer, 0, VK_WHOLE_SIZE },
+			{ _meshletTriangles.buffer, 0, VK_WHOLE_SIZE },
+			{ _clusterIndices.buffer, 0, VK_WHOLE_SIZE },
+			{ _clusterDraw.buffer, 0, VK_WHOLE_SIZE },
+			{ _meshVertices.buffer, 0, VK_WHOLE_SIZE },
+			{ _meshLodTable.buffer, 0, VK_WHOLE_SIZE },
+			{ _meshInstanceData.buffer, 0, VK_WHOLE_SIZE },
+			{},
+			{ _clusterVisibility.buffer, 0, VK_WHOLE_SIZE },
+		};
+		std::vector<VkWriteDescriptorSet> writes;
+		for (uint32_t i = 0; i < std::size(bufferInfos); i++)
+		{
+			if (bufferInfos[i].buffer == VK_NULL_HANDLE)
+				continue;	// the compacted stream on the mesh shading path
+
+			VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			write.dstSet = _clusterSet;
+			write.dstBinding = i;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &bufferInfos[i];
+			writes.push_back(write);
+		}
+		vkUpdateDescriptorSets(_device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+
+		VkPushConstantRange pushConstants = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullParams) };
+		VkPipelineLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &_clusterSetLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstants;
+		vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &_clusterCullLayout);
+
+		// LODs are picked by a compute pass on both paths, task shaders only take over the culling
+		_lodSelectPipeline = _createComputePipeline("shaders/lod_select.comp.spv", _clusterCullLayout);
+		if (!_meshShading)
+		{
+			_clusterCullPipeline = _createComputePipeline("shaders/cluster_cull.comp.spv", _clusterCullLayout);
+		}
+
+		_createDepthReduce();
+	}
+
+	// the mesh scene's view: instances are placed in clip space by _meshInstances, viewed down -z.
+	// split-screen views pan and zoom that, each view picks its own LODs at its zoom and the render scale
+	ClusterCullParams _meshCullParams()
+	{
+		VkExtent2D extent = _viewRect(0).extent;
+		ClusterCullParams params = {};
+		params.viewDirection[2] = -1.0f;
+		params.aspect = float(extent.height) / float(extent.width);
+		params.instanceCount = uint32_t(_meshInstances.size());
+		params.lodCount = uint32_t(_meshLods.size());
+		params.maxMeshlets = _meshLods[0].meshletCount;
+		params.viewportHeight = float(extent.height) * _renderScale;	// the pixels actually drawn, before a view's zoom
+		params.errorThreshold = float(_config.lodErrorPixels);
+		params.hysteresis = float(_config.lodHysteresis);
+		params.indexStride = _meshLods[0].indexCount;
+		params.phase = CullPhaseAll;
+		params.viewCount = _viewCount;
+		std::copy(_views, _views + _viewCount, params.views);
+		return params;
+	}
+
+	// ClusterDrawCommands per phase: one per view and instance, instance-major within a view. the late
+	// phase's follow the early ones
+	size_t _clusterDrawCount() const
+	{
+		return _meshInstances.size() * _viewCount * (_occlusionCulling ? 2 : 1);
+	}
+
+	// view 'view's tile of the swapchain image, two across. a single view is the whole image
+	VkRect2D _viewRect(uint32_t view) const
+	{
+		return _viewRect(view, _swapChainExtent);
+	}
+
+	// the same tiles of another extent, e.g. the scaled render area the viewports path draws to
+	VkRect2D _viewRect(uint32_t view, VkExtent2D extent) const
+	{
+		uint32_t columns = _viewCount > 1 ? 2 : 1;
+		uint32_t rows = (_viewCount + columns - 1) / columns;
+		VkExtent2D tile = { std::max(extent.width / columns, 1u), std::max(extent.height / rows, 1u) };
+		return { { int32_t(view % columns * tile.width), int32_t(view / columns * tile.height) }, tile };
+	}
+
+	// width over height of a view, how much wider view space is than tall
+	float _viewAspect() const
+	{
+		VkExtent2D extent = _viewRect(0).extent;
+		return float(extent.width) / float(extent.height);
+	}
+
+	// what the scene targets are sized for: a tile's size for multiview's layers, the swapchain's otherwise
+	VkExtent2D _renderExtent() const
+	{
+		return _multiview ? _viewRect(0).extent : _swapChainExtent;
+	}
+
+	// the part of the scene targets this frame draws to, all of them unless dynamic resolution scales it down
+	VkExtent2D _renderArea() const
+	{
+		VkExtent2D extent = _renderExtent();
+		return { std::max(uint32_t(float(extent.width) * _renderScale + 0.5f), 1u), std::max(uint32_t(float(extent.height) * _renderScale + 0.5f), 1u) };
+	}
+
+	// picks every instance's LOD in every view, resetting its draw command, and on the compute path culls
+	// the meshlets of that LOD against the view into the view's slice of the compacted index stream. outside the render pass,
+	// before the draws that consume it
+	void _recordClusterCulling(VkCommandBuffer commandBuffer)
+	{
+		if (_clusterCulling == ClusterCulling::Off)
+			return;
+
+		GpuProfiler::Scope profile(*_gpuProfiler, commandBuffer, "cluster culling");
+
+		// the previous frame's culling and draws are done with the commands and the index stream
+		VkPipelineStageFlags2 consumers = _meshShading ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT :
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+		VkPipelineStageFlags2 culling = _meshShading ? VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT : VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		_barriers->Memory(consumers, VK_ACCESS_2_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+		// last frame's pyramid is rebuilt between the phases, its contents can go. this also puts the
+		// placeholder pyramid in the layout the culling set expects when occlusion culling is off
+		_barriers->Image(_depthPyramid, VK_IMAGE_ASPECT_COLOR_BIT, consumers, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+		_barriers->Flush(commandBuffer);
+
+		ClusterCullParams params = _meshCullParams();
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterCullLayout, 0, 1, &_clusterSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, _clusterCullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+
+		// one invocation per instance, each handles every view
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _lodSelectPipeline);
+		vkCmdDispatch(commandBuffer, (params.instanceCount + 63) / 64, 1, 1);
+
+		_barriers->Memory(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, culling, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		_barriers->Flush(commandBuffer);
+
+		if (!_meshShading)
+		{
+			_recordClusterCullDispatch(commandBuffer, _occlusionCulling ? CullPhaseEarly : CullPhaseAll);
+		}
+	}
+
+	// compute path only, the task shaders cull as part of the draw
+	void _recordClusterCullDispatch(VkCommandBuffer commandBuffer, CullPhase phase)
+	{
+		ClusterCullParams params = _meshCullParams();
+		params.phase = phase;
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterCullLayout, 0, 1, &_clusterSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, _clusterCullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+
+		// one workgroup per LOD 0 meshlet slot of every instance, wrapped into y past the guaranteed 65535
+		// groups per dimension, and z is the view. slots past the selected LOD's meshlet count exit right away
+		const uint32_t maxGroups = 65535;
+		uint32_t groups = params.instanceCount * params.maxMeshlets;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterCullPipeline);
+		vkCmdDispatch(commandBuffer, std::min(groups, maxGroups), (groups + maxGroups - 1) / maxGroups, params.viewCount);
+
+		_barriers->Memory(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT);
+		_barriers->Flush(commandBuffer);
+	}
+
+	void _reportClusterCulling()
+	{
+		if (_clusterCulling == ClusterCulling::Off)
+			return;
+
+		// the early or only phase's commands, per view and instance
+		const size_t instanceCount = _meshInstances.size();
+		const size_t phaseCommands = instanceCount * _viewCount;
+		std::vector<ClusterDrawCommand> commands(_clusterDrawCount());
+		void* mapped = nullptr;
+		vkMapMemory(_device, _clusterDraw.memory, 0, commands.size() * sizeof(ClusterDrawCommand), 0, &mapped);
+		memcpy(commands.data(), mapped, commands.size() * sizeof(ClusterDrawCommand));
+		vkUnmapMemory(_device, _clusterDraw.memory);
+
+		uint64_t visibleMeshlets[2] = {};
+		uint64_t occludedMeshlets = 0;
+		uint64_t triangles = 0;
+		std::vector<uint32_t> lodHistogram(_meshLods.size());
+		for (size_t i = 0; i < commands.size(); i++)
+		{
+			const ClusterDrawCommand& command = commands[i];
+			visibleMeshlets[i / phaseCommands] += command.visibleMeshlets;
+			occludedMeshlets += command.occludedMeshlets;
+			triangles += command.draw.indexCount / 3;
+			if (i < phaseCommands)
+			{
+				lodHistogram[std::min<size_t>(command.lod, lodHistogram.size() - 1)]++;
+			}
+		}
+
+		std::cout << "cluster culling (" << (_meshShading ? "mesh shaders" : "compute") << "): " << visibleMeshlets[0] + visibleMeshlets[1] << " meshlets, "
+			<< triangles << " of " << uint64_t(_meshLods[0].indexCount / 3) * phaseCommands << " full-detail triangles drawn in the last frame"
+			<< (_viewCount > 1 ? ", over " + std::to_string(_viewCount) + " views" : std::string()) << std::endl;
+		if (_occlusionCulling)
+		{
+			std::cout << "occlusion culling: " << visibleMeshlets[0] << " meshlets drawn from last frame's visibility, " << visibleMeshlets[1]
+				<< " newly visible, " << occludedMeshlets << " hidden by the depth pyramid" << std::endl;
+		}
+		std::cout << "LOD selection (" << _config.lodErrorPixels << " px error):";
+		for (size_t l = 0; l < lodHistogram.size(); l++)
+		{
+			std::cout << " " << lodHistogram[l] << " at LOD " << l << (l + 1 < lodHistogram.size() ? "," : "");
+		}
+		std::cout << std::endl;
+	}
+
+	void _destroyClusterCulling()
+	{
+		_destroyBuffer(_meshlets);
+		_destroyBuffer(_meshletVertices);
+		_destroyBuffer(_meshletTriangles);
+		_destroyBuffer(_clusterIndices);
+		_destroyBuffer(_clusterDraw);
+		_destroyBuffer(_meshLodTable);
+		_destroyBuffer(_meshInstanceData);
+		_destroyBuffer(_clusterVisibility);
+		vkDestroyPipeline(_device, _depthReducePipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _depthReduceLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _depthReduceSetLayout, nullptr);
+		vkDestroySampler(_device, _depthPyramidSampler, nullptr);
+		vkDestroyPipeline(_device, _clusterCullPipeline, nullptr);
+		vkDestroyPipeline(_device, _lodSelectPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _clusterCullLayout, nullptr);
+		vkDestroyDescriptorPool(_device, _clusterDescriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _clusterSetLayout, nullptr);
+	}
+
+	// the pyramid reduction: nearest sampler for texelFetch, one set per level, source and target
+	void _createDepthReduce()
+	{
+		VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		if (vkCreateSampler(_device, &samplerInfo, nullptr, &_depthPyramidSampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth pyramid sampler");
+		}
+
+		VkDescriptorSetLayoutBinding bindings[2] =
+		{
+			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		};
+		VkDescriptorSetLayoutCreateInfo setLayoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		setLayoutInfo.bindingCount = uint32_t(std::size(bindings));
+		setLayoutInfo.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(_device, &setLayoutInfo, nullptr, &_depthReduceSetLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth reduction descriptor set layout");
+		}
+
+		// the size of the source's part to reduce, see depth_reduce.comp.glsl
+		VkPushConstantRange pushConstants = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int32_t) * 2 };
+		VkPipelineLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &_depthReduceSetLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstants;
+		vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &_depthReduceLayout);
+
+		_depthReducePipeline = _createComputePipeline("shaders/depth_reduce.comp.spv", _depthReduceLayout);
+	}
+
+	// more than one layer makes it an array view
+	VkImageView _createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t baseLevel, uint32_t levelCount, uint32_t layerCount = 1)
+	{
+		VkImageViewCreateInfo viewInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = image;
+		viewInfo.viewType = layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = format;
+		viewInfo.subresourceRange = { aspect, baseLevel, levelCount, 0, layerCount };
+
+		VkImageView view = VK_NULL_HANDLE;
+		if (vkCreateImageView(_device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create image view");
+		}
+		return view;
+	}
+
+	void _createImage(VkExtent2D extent, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory, MemoryCategory category)
+	{
+		VkImageCreateInfo imageInfo = _imageCreateInfo(extent, mipLevels, format, usage);
+		if (vkCreateImage(_device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create image");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(_device, image, &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = _findeMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (_memoryTelemetry->Allocate(allocInfo, category, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate image memory");
+		}
+
+		vkBindImageMemory(_device, image, memory, 0);
+	}
+
+	VkImageCreateInfo _imageCreateInfo(VkExtent2D extent, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, uint32_t layers = 1)
+	{
+		VkImageCreateInfo imageInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = format;
+		imageInfo.extent = { extent.width, extent.height, 1 };
+		imageInfo.mipLevels = mipLevels;
+		imageInfo.arrayLayers = layers;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		return imageInfo;
+	}
+
+	// the depth attachment and the pyramid the occlusion culling tests against, both follow the swapchain size.
+	// pyramid level 0 is half the depth size (rounded down like any mip), each texel the farthest depth it covers.
+	// the culling shaders bind the pyramid even with occlusion culling off, then it's a single unused texel.
+	//
+	// both are transient attachments. without occlusion culling the depth is never sampled or stored, so it
+	// can stay in tile memory. the placeholder pyramid is live all frame since the cluster set stays bound.
+	// multiview gives depth a layer per view, both at tile size. multiview and dynamic resolution add the
+	// scene color the passes draw to instead of the swapchain image, read by the upscale
+	void _createDepthTargets()
+	{
+		VkExtent2D extent = _renderExtent();
+		uint32_t layers = _multiview ? _viewCount : 1;
+		VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (_occlusionCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+		_depthImage = _transientAttachments->Add(_imageCreateInfo(extent, 1, _depthFormat, depthUsage, layers),
+			FramePassEarlyScene, _occlusionCulling ? FramePassLateScene : FramePassEarlyScene, !_occlusionCulling);
+		if (_offscreenScene())
+		{
+			_sceneColorImage = _transientAttachments->Add(_imageCreateInfo(extent, 1, _swapChainImageFormat,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, layers), FramePassEarlyScene, FramePassUpscale, false);
+		}
+
+		if (_clusterCulling == ClusterCulling::Off)
+		{
+			_transientAttachments->Allocate();
+			_createAttachmentViews(layers);
+			return;
+		}
+
+		VkExtent2D pyramidExtent = { 1, 1 };
+		if (_occlusionCulling)
+		{
+			pyramidExtent = { std::max(_swapChainExtent.width / 2, 1u), std::max(_swapChainExtent.height / 2, 1u) };
+		}
+		uint32_t levelCount = 1;
+		while ((std::max(pyramidExtent.width, pyramidExtent.height) >> levelCount) > 0)
+		{
+			levelCount++;
+		}
+
+		// the culling throws last frame's pyramid away, the reduction rebuilds it and the late culling is the last to read it
+		_depthPyramid = _transientAttachments->Add(_imageCreateInfo(pyramidExtent, levelCount, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT),
+			FramePassClusterCulling, _occlusionCulling ? FramePassLateCulling : FramePassLateScene, false);
+		_transientAttachments->Allocate();
+		_createAttachmentViews(layers);
+		_depthPyramidView = _createImageView(_depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount);
+
+		// the culling samples every level
+		VkDescriptorImageInfo pyramidInfo = { _depthPyramidSampler, _depthPyramidView, VK_IMAGE_LAYOUT_GENERAL };
+		VkWriteDescriptorSet pyramidWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		pyramidWrite.dstSet = _clusterSet;
+		pyramidWrite.dstBinding = 8;
+		pyramidWrite.descriptorCount = 1;
+		pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pyramidWrite.pImageInfo = &pyramidInfo;
+		vkUpdateDescriptorSets(_device, 1, &pyramidWrite, 0, nullptr);
+
+		if (!_occlusionCulling)
+			return;
+
+		for (uint32_t level = 0; level < levelCount; level++)
+		{
+			_depthPyramidLevels.push_back(_createImageView(_depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+		}
+
+		VkDescriptorPoolSize poolSizes[] = { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelCount }, { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelCount } };
+		VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		poolInfo.maxSets = levelCount;
+		poolInfo.poolSizeCount = uint32_t(std::size(poolSizes));
+		poolInfo.pPoolSizes = poolSizes;
+		if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_depthReducePool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth reduction descriptor pool");
+		}
+
+		std::vector<VkDescriptorSetLayout> setLayouts(levelCount, _depthReduceSetLayout);
+		VkDescriptorSetAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocInfo.descriptorPool = _depthReducePool;
+		allocInfo.descriptorSetCount = levelCount;
+		allocInfo.pSetLayouts = setLayouts.data();
+		_depthReduceSets.resize(levelCount);
+		if (vkAllocateDescriptorSets(_device, &allocInfo, _depthReduceSets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate depth reduction descriptor sets");
+		}
+
+		// level n reads level n - 1, level 0 the depth attachment
+		std::vector<VkDescriptorImageInfo> imageInfos(levelCount * 2);
+		std::vector<VkWriteDescriptorSet> writes;
+		for (uint32_t level = 0; level < levelCount; level++)
+		{
+			imageInfos[level * 2] = level == 0 ?
+				VkDescriptorImageInfo{ _depthPyramidSampler, _depthImageView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL } :
+				VkDescriptorImageInfo{ _depthPyramidSampler, _depthPyramidLevels[level - 1], VK_IMAGE_LAYOUT_GENERAL };
+			imageInfos[level * 2 + 1] = { VK_NULL_HANDLE, _depthPyramidLevels[level], VK_IMAGE_LAYOUT_GENERAL };
+
+			for (uint32_t binding = 0; binding < 2; binding++)
+			{
+				VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+				write.dstSet = _depthReduceSets[level];
+				write.dstBinding = binding;
+				write.descriptorCount = 1;
+				write.descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+				write.pImageInfo = &imageInfos[level * 2 + binding];
+				writes.push_back(write);
+			}
+		}
+		vkUpdateDescriptorSets(_device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	void _createAttachmentViews(uint32_t layers)
+	{
+		_depthImageView = _createImageView(_depthImage, _depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, layers);
+		if (_offscreenScene())
+		{
+			_sceneColorView = _createImageView(_sceneColorImage, _swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, layers);
+		}
+	}
+
+	void _destroyDepthTargets()
+	{
+		vkDestroyImageView(_device, _depthImageView, nullptr);
+		_depthImageView = VK_NULL_HANDLE;
+		_depthImage = VK_NULL_HANDLE;
+		vkDestroyImageView(_device, _sceneColorView, nullptr);
+		_sceneColorView = VK_NULL_HANDLE;
+		_sceneColorImage = VK_NULL_HANDLE;
+
+		vkDestroyDescriptorPool(_device, _depthReducePool, nullptr);
+		_depthReducePool = VK_NULL_HANDLE;
+		_depthReduceSets.clear();
+		for (VkImageView view : _depthPyramidLevels)
+		{
+			vkDestroyImageView(_device, view, nullptr);
+		}
+		_depthPyramidLevels.clear();
+		vkDestroyImageView(_device, _depthPyramidView, nullptr);
+		_depthPyramidView = VK_NULL_HANDLE;
+		_depthPyramid = VK_NULL_HANDLE;
+
+		_transientAttachments->Destroy();
+	}
+
+	// between the two phases: reduces the early draws' depth into the pyramid, then culls everything
+	// last frame's visibility didn't draw against it. the mesh shading path culls in the late draws' task shaders
+	void _recordOcclusionCulling(VkCommandBuffer commandBuffer)
+	{
+		VkPipelineStageFlags2 culling = _meshShading ? VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT : VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+
+		// the early culling's counts and visibility reads are ordered before the late culling through
+		// this chain of barriers
+		_barriers->Memory(culling, VK_ACCESS_2_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		_barriers->Flush(commandBuffer);
+
+		// level 0 reduces only the render area the scene drew, the pyramid covers the view at any render scale
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthReducePipeline);
+		VkExtent2D source = _renderArea();
+		for (uint32_t level = 0; level < _depthReduceSets.size(); level++)
+		{
+			uint32_t width = std::max(_swapChainExtent.width / 2 >> level, 1u);
+			uint32_t height = std::max(_swapChainExtent.height / 2 >> level, 1u);
+			int32_t sourceSize[2] = { int32_t(source.width), int32_t(source.height) };
+			vkCmdPushConstants(commandBuffer, _depthReduceLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sourceSize), sourceSize);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthReduceLayout, 0, 1, &_depthReduceSets[level], 0, nullptr);
+			vkCmdDispatch(commandBuffer, (width + 7) / 8, (height + 7) / 8, 1);
+			source = { width, height };
+
+			// the next level, or after the last one the culling, reads what this one wrote
+			bool last = level + 1 == _depthReduceSets.size();
+			_barriers->Memory(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, last ? culling : VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_READ_BIT | (last ? VK_ACCESS_2_SHADER_WRITE_BIT : VK_ACCESS_2_NONE));
+			_barriers->Flush(commandBuffer);
+		}
+
+		if (!_meshShading)
+		{
+			_recordClusterCullDispatch(commandBuffer, CullPhaseLate);
+		}
+	}
+
+	// 0 LightingParams, 1 the frame slot's lights (dynamic offset), 2 froxel runs, 3 light indices,
+	// 4 shadow views and 5 the shadow atlas, both only written (and read) by the mesh scene
+	void _createLightSetLayout()
+	{
+		VkShaderStageFlags stages = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		VkDescriptorSetLayoutBinding bindings[] =
+		{
+			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, stages, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, stages, nullptr },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, nullptr },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, nullptr },
+			{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+			{ 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+		};
+
+		VkDescriptorSetLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		createInfo.bindingCount = uint32_t(std::size(bindings));
+		createInfo.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(_device, &createInfo, nullptr, &_lightSetLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create light descriptor set layout");
+		}
+	}
+
+	// the lights are scattered over the view volume with a fixed seed, so every run (and every golden
+	// image, should a scene ever enable them) sees the same ones
+	void _createLights()
+	{
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		_shadowedLights = _shadowsEnabled ? std::min(_config.shadowedLights, _config.lightCount) : 0;
+		for (uint32_t i = 0; i < _config.lightCount; i++)
+		{
+			AnimatedLight light = {};
+			light.center[0] = unit(random) * 2.0f - 1.0f;
+			light.center[1] = unit(random) * 2.0f - 1.0f;
+			light.center[2] = -(LIGHT_NEAR - 0.25f + unit(random) * (LIGHT_FAR - LIGHT_NEAR));
+			light.orbit = 0.05f + 0.2f * unit(random);
+			light.speed = 0.5f + 1.5f * unit(random);
+			light.phase = 6.2831853f * unit(random);
+			light.light.radius = 0.15f + 0.25f * unit(random);
+
+			// saturated hues, dimmer when there are many so the sum stays in range
+			float hue = unit(random) * 6.0f;
+			float intensity = std::min(1.0f, 32.0f / float(_config.lightCount));
+			for (int c = 0; c < 3; c++)
+			{
+				float channel = std::clamp(std::abs(std::fmod(hue + 4.0f - 2.0f * c, 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f);
+				light.light.color[c] = std::max(channel, 0.2f) * intensity * 2.0f;
+			}
+
+			// shadowed lights hold still, a moving one would invalidate its cached map every frame
+			light.light.shadowView = -1;
+			if (i < _shadowedLights)
+			{
+				light.orbit = 0.0f;
+				light.light.shadowView = int32_t(SHADOW_CASCADES + i);
+			}
+			_lights.push_back(light);
+		}
+
+		// one slice of lights per frame slot, the host writes one while the device reads another
+		VkDeviceSize alignment = std::max<VkDeviceSize>(_physicalDeviceInfo.properties.limits.minStorageBufferOffsetAlignment, 1);
+		_lightSliceSize = (std::max<VkDeviceSize>(_lights.size(), 1) * sizeof(PointLight) + alignment - 1) / alignment * alignment;
+		_createBuffer(_lightSliceSize * MAX_FRAMES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			_lightData.buffer, _lightData.memory, MemoryCategory::Other, true);
+		vkMapMemory(_device, _lightData.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&_lightDataMapped));
+
+		_createBuffer(sizeof(LightingParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			_lightParams.buffer, _lightParams.memory, MemoryCategory::Other, true);
+
+		VkDescriptorPoolSize poolSizes[] =
+		{
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+		};
+		VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = uint32_t(std::size(poolSizes));
+		poolInfo.pPoolSizes = poolSizes;
+		if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_lightDescriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create light descriptor pool");
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocInfo.descriptorPool = _lightDescriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &_lightSetLayout;
+		if (vkAllocateDescriptorSets(_device, &allocInfo, &_lightSet) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate light descriptor set");
+		}
+
+		VkPipelineLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &_lightSetLayout;
+		vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &_lightBinLayout);
+
+		_lightBinPipeline = _createComputePipeline("shaders/light_bin.comp.spv", _lightBinLayout);
+	}
+
+	// the froxel grid follows the swapchain size
+	void _createLightClusters()
+	{
+		// split-screen views all shade at the scene's positions, binned at a view's size
+		VkExtent2D extent = _viewRect(0).extent;
+		_lightClusterCount[0] = (extent.width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+		_lightClusterCount[1] = (extent.height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+		_lightClusterCount[2] = LIGHT_SLICES;
+		VkDeviceSize clusterCount = VkDeviceSize(_lightClusterCount[0]) * _lightClusterCount[1] * _lightClusterCount[2];
+
+		// every froxel can list its maximum, so the index runs never overflow
+		_createBuffer(clusterCount * 2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			_lightClusters.buffer, _lightClusters.memory, MemoryCategory::Transient, true);
+		_createBuffer((1 + clusterCount * MAX_CLUSTER_LIGHTS) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _lightIndices.buffer, _lightIndices.memory, MemoryCategory::Transient, true);
+
+		LightingParams params = {};
+		std::copy(std::begin(_lightClusterCount), std::end(_lightClusterCount), params.clusterCount);
+		params.lightCount = uint32_t(_lights.size());
+		params.viewportSize[0] = float(extent.width);
+		params.viewportSize[1] = float(extent.height);
+		params.nearDistance = LIGHT_NEAR;
+		params.farDistance = LIGHT_FAR;
+		params.tileSize = LIGHT_TILE_SIZE;
+
+		void* mapped = nullptr;
+		vkMapMemory(_device, _lightParams.memory, 0, sizeof(params), 0, &mapped);
+		memcpy(mapped, &params, sizeof(params));
+		vkUnmapMemory(_device, _lightParams.memory);
+
+		VkDescriptorBufferInfo bufferInfos[] =
+		{
+			{ _lightParams.buffer, 0, VK_WHOLE_SIZE },
+			{ _lightData.buffer, 0, _lightSliceSize },
+			{ _lightClusters.buffer, 0, VK_WHOLE_SIZE },
+			{ _lightIndices.buffer, 0, VK_WHOLE_SIZE },
+		};
+		VkDescriptorType types[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+
+		VkWriteDescriptorSet writes[std::size(bufferInfos)] = {};
+		for (uint32_t i = 0; i < std::size(bufferInfos); i++)
+		{
+			writes[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			writes[i].dstSet = _lightSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = types[i];
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(_device, uint32_t(std::size(writes)), writes, 0, nullptr);
+	}
+
+	void _destroyLightClusters()
+	{
+		_destroyBuffer(_lightClusters);
+		_destroyBuffer(_lightIndices);
+	}
+
+	void _destroyLights()
+	{
+		vkDestroyPipeline(_device, _lightBinPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _lightBinLayout, nullptr);
+		vkDestroyDescriptorPool(_device, _lightDescriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _lightSetLayout, nullptr);
+		_destroyBuffer(_lightParams);
+		_destroyBuffer(_lightData);
+		_lightDataMapped = nullptr;
+	}
+
+	// places the lights into this frame slot's slice. time is counted in frames at 60 Hz so headless
+	// runs animate the same at any speed
+	void _updateLights()
+	{
+		if (_lights.empty())
+			return;
+
+		PointLight* slice = reinterpret_cast<PointLight*>(reinterpret_cast<uint8_t*>(_lightDataMapped) + _currentFrame * _lightSliceSize);
+		if (_replay != nullptr)
+		{
+			_replayUploads(UploadTargetLights, slice, _lights.size() * sizeof(PointLight));
+			return;
+		}
+
+		float time = float(_sceneFrame) / 60.0f;
+		float aspect = _viewAspect();
+		for (size_t i = 0; i < _lights.size(); i++)
+		{
+			const AnimatedLight& light = _lights[i];
+			float angle = light.phase + light.speed * time;
+			slice[i] = light.light;
+			slice[i].position[0] = (light.center[0] + light.orbit * std::cos(angle)) * aspect;
+			slice[i].position[1] = light.center[1] + light.orbit * std::sin(angle);
+			slice[i].position[2] = light.center[2];
+		}
+		_recordUpload(UploadTargetLights, slice, _lights.size() * sizeof(PointLight));
+	}
+
+	// bins the lights into the froxel grid, outside the render pass. one workgroup per froxel. on the compute
+	// queue the semaphores around the submit order it against the fragment shaders instead of the barriers
+	void _recordLightBinning(VkCommandBuffer commandBuffer, bool async)
+	{
+		if (_lights.empty())
+			return;
+
+		GpuProfiler::Scope profile(async ? *_computeProfiler : *_gpuProfiler, commandBuffer, "light binning");
+
+		// the previous frame's fragment shaders are done with the lists before they're rebuilt
+		if (!async)
+		{
+			_barriers->Memory(VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_NONE,
+				VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE);
+			_barriers->Flush(commandBuffer);
+		}
+		vkCmdFillBuffer(commandBuffer, _lightIndices.buffer, 0, sizeof(uint32_t), 0);
+
+		_barriers->Buffer(_lightIndices.buffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, 0, sizeof(uint32_t));
+		_barriers->Flush(commandBuffer);
+
+		uint32_t lightOffset = uint32_t(_currentFrame * _lightSliceSize);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _lightBinPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _lightBinLayout, 0, 1, &_lightSet, 1, &lightOffset);
+		vkCmdDispatch(commandBuffer, _lightClusterCount[0], _lightClusterCount[1], _lightClusterCount[2]);
+		if (async)
+			return;
+
+		_barriers->Memory(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+		_barriers->Flush(commandBuffer);
+	}
+
+	VkFormat _chooseShadowFormat()
+	{
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		for (VkFormat format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM })
+		{
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &properties);
+			if ((properties.optimalTilingFeatures & required) == required)
+				return format;
+		}
+
+		throw std::runtime_error("No supported shadow map format");
+	}
+
+	// depth only and loaded, the shadow passes only touch the texels they were asked to. the image sits in
+	// 'layout' between passes: the cache as a copy source, the atlas as a copy destination before and
+	// sampled after
+	VkRenderPass _createShadowRenderPass(VkImageLayout layout, VkImageLayout finalLayout)
+	{
+		VkAttachmentDescription depthAttachment = {};
+		depthAttachment.format = _shadowFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = layout;
+		depthAttachment.finalLayout = finalLayout;
+
+		VkAttachmentReference depthAttachmentRef = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+		// in: the copy that read the cache, or wrote the atlas. out: the copy into the atlas, or the receivers
+		bool atlas = layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		VkSubpassDependency dependencies[2] = {};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[0].srcAccessMask = atlas ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = atlas ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].dstAccessMask = atlas ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_TRANSFER_READ_BIT;
+
+		VkRenderPassCreateInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+		renderPassInfo.attachmentCount = 1;
+		renderPassInfo.pAttachments = &depthAttachment;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = uint32_t(std::size(dependencies));
+		renderPassInfo.pDependencies = dependencies;
+
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create shadow render pass");
+		}
+		return renderPass;
+	}
+
+	// the atlas layout is fixed: cascade i in quadrant i, point light tiles filling the last quadrant row by row
+	void _createShadows()
+	{
+		if (!_shadowsEnabled)
+			return;
+
+		_shadowFormat = _chooseShadowFormat();
+		VkExtent2D extent = { SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE };
+		for (int i = 0; i < 2; i++)
+		{
+			VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (i == 0 ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+			_createImage(extent, 1, _shadowFormat, usage, _shadowImages[i], _shadowMemory[i], MemoryCategory::Other);
+			_shadowImageViews[i] = _createImageView(_shadowImages[i], _shadowFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+		}
+		_shadowImagesInitialized = false;
+
+		VkRenderPass renderPasses[2] = {};
+		if (!_dynamicRendering)
+		{
+			_shadowCacheRenderPass = _createShadowRenderPass(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+			_shadowAtlasRenderPass = _createShadowRenderPass(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+			renderPasses[0] = _shadowCacheRenderPass;
+			renderPasses[1] = _shadowAtlasRenderPass;
+		}
+		for (int i = 0; i < 2 && !_dynamicRendering; i++)
+		{
+			VkFramebufferCreateInfo frameBufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+			frameBufferInfo.renderPass = renderPasses[i];
+			frameBufferInfo.attachmentCount = 1;
+			frameBufferInfo.pAttachments = &_shadowImageViews[i];
+			frameBufferInfo.width = SHADOW_ATLAS_SIZE;
+			frameBufferInfo.height = SHADOW_ATLAS_SIZE;
+			frameBufferInfo.layers = 1;
+			if (vkCreateFramebuffer(_device, &frameBufferInfo, nullptr, &_shadowFramebuffers[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create shadow framebuffer");
+			}
+		}
+
+		for (uint32_t i = 0; i < SHADOW_CASCADES; i++)
+		{
+			ShadowCache::Rect tile;
+			tile.x = int32_t((i % 2) * SHADOW_CASCADE_SIZE);
+			tile.y = int32_t((i / 2) * SHADOW_CASCADE_SIZE);
+			tile.width = tile.height = SHADOW_CASCADE_SIZE;
+			_shadowCache.AddView(tile);
+		}
+		const uint32_t tilesPerRow = (SHADOW_ATLAS_SIZE - SHADOW_CASCADE_SIZE) / SHADOW_TILE_SIZE;
+		for (uint32_t i = 0; i < _shadowedLights; i++)
+		{
+			ShadowCache::Rect tile;
+			tile.x = int32_t(SHADOW_CASCADE_SIZE + (i % tilesPerRow) * SHADOW_TILE_SIZE);
+			tile.y = int32_t(SHADOW_CASCADE_SIZE + (i / tilesPerRow) * SHADOW_TILE_SIZE);
+			tile.width = tile.height = SHADOW_TILE_SIZE;
+			_shadowCache.AddView(tile);
+		}
+
+		_createBuffer(_shadowCache.ViewCount() * sizeof(ShadowView), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			_shadowViewData.buffer, _shadowViewData.memory, MemoryCategory::Other);
+
+		// hardware 2x2 PCF where the format filters
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(_physicalDevice, _shadowFormat, &formatProperties);
+		bool linear = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+
+		VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = linear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+		samplerInfo.minFilter = samplerInfo.magFilter;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.compareEnable = VK_TRUE;
+		samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		if (vkCreateSampler(_device, &samplerInfo, nullptr, &_shadowSampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create shadow sampler");
+		}
+
+		VkDescriptorBufferInfo viewInfo = { _shadowViewData.buffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorImageInfo atlasInfo = { _shadowSampler, _shadowImageViews[1], VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+
+		VkWriteDescriptorSet writes[2] = { { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET }, { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET } };
+		writes[0].dstSet = _lightSet;
+		writes[0].dstBinding = 4;
+		writes[0].descriptorCount = 1;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[0].pBufferInfo = &viewInfo;
+		writes[1].dstSet = _lightSet;
+		writes[1].dstBinding = 5;
+		writes[1].descriptorCount = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[1].pImageInfo = &atlasInfo;
+		vkUpdateDescriptorSets(_device, uint32_t(std::size(writes)), writes, 0, nullptr);
+
+		_shadowShaderModuleVS = _createShaderModule(readFile("shaders/shadow.vert.spv"));
+		_createShadowPipeline();
+		_updateShadowViews();
+	}
+
+	// position only, no culling since the casters aren't closed towards every light, and sloped depth bias
+	// against acne on the receivers
+	void _createShadowPipeline()
+	{
+		VkPushConstantRange pushConstants = { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowDrawParams) };
+		VkPipelineLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstants;
+		vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &_shadowPipelineLayout);
+
+		VkPipelineShaderStageCreateInfo stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+		stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		stage.module = _shadowShaderModuleVS;
+		stage.pName = "main";
+
+		VkVertexInputBindingDescription binding = { 0, sizeof(MeshFormat::Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+		VkVertexInputAttributeDescription attribute = { 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(MeshFormat::Vertex, position) };
+		VkPipelineVertexInputStateCreateInfo vertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		vertexInput.vertexBindingDescriptionCount = 1;
+		vertexInput.pVertexBindingDescriptions = &binding;
+		vertexInput.vertexAttributeDescriptionCount = 1;
+		vertexInput.pVertexAttributeDescriptions = &attribute;
+
+		VkPipelineInputAssemblyStateCreateInfo assemblyState = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+		assemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkPipelineViewportStateCreateInfo viewport = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+		viewport.viewportCount = 1;
+		viewport.scissorCount = 1;
+
+		VkPipelineRasterizationStateCreateInfo rasterizationState = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizationState.cullMode = VK_CULL_MODE_NONE;
+		rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		rasterizationState.depthBiasEnable = VK_TRUE;
+		rasterizationState.depthBiasConstantFactor = 1.25f;
+		rasterizationState.depthBiasSlopeFactor = 1.75f;
+		rasterizationState.lineWidth = 1.0f;
+
+		VkPipelineMultisampleStateCreateInfo multiSampleState = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+		multiSampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+		depthStencilState.depthTestEnable = VK_TRUE;
+		depthStencilState.depthWriteEnable = VK_TRUE;
+		depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		VkPipelineColorBlendStateCreateInfo colorBlendState = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+
+		VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+		dynamicState.dynamicStateCount = uint32_t(std::size(dynamicStates));
+		dynamicState.pDynamicStates = dynamicStates;
+
+		// both shadow render passes are compatible, one pipeline draws into either
+		VkGraphicsPipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		createInfo.stageCount = 1;
+		createInfo.pStages = &stage;
+		createInfo.pVertexInputState = &vertexInput;
+		createInfo.pInputAssemblyState = &assemblyState;
+		createInfo.pViewportState = &viewport;
+		createInfo.pRasterizationState = &rasterizationState;
+		createInfo.pMultisampleState = &multiSampleState;
+		createInfo.pDepthStencilState = &depthStencilState;
+		createInfo.pColorBlendState = &colorBlendState;
+		createInfo.pDynamicState = &dynamicState;
+		createInfo.layout = _shadowPipelineLayout;
+
+		VkPipelineRenderingCreateInfo renderingInfo = { VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+		renderingInfo.depthAttachmentFormat = _shadowFormat;
+		if (_dynamicRendering)
+		{
+			createInfo.pNext = &renderingInfo;
+		}
+		else
+		{
+			createInfo.renderPass = _shadowCacheRenderPass;
+		}
+
+		if (vkCreateGraphicsPipelines(_device, nullptr, 1, &createInfo, nullptr, &_shadowPipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create shadow pipeline");
+		}
+	}
+
+	// the views follow the viewport's aspect. the cascades split the view depth half way between uniform and
+	// logarithmic; each covers its slab of the view volume and whatever lies towards the light from it.
+	// a view whose matrix didn't change keeps its cached texels
+	void _updateShadowViews()
+	{
+		if (!_shadowsEnabled)
+			return;
+
+		float aspect = _viewAspect();
+		std::vector<ShadowView> views(_shadowCache.ViewCount());
+
+		for (uint32_t i = 0; i < SHADOW_CASCADES; i++)
+		{
+			auto split = [](uint32_t index)
+			{
+				float t = float(index) / float(SHADOW_CASCADES);
+				return 0.5f * (LIGHT_NEAR * std::pow(LIGHT_FAR / LIGHT_NEAR, t)) + 0.5f * (LIGHT_NEAR + (LIGHT_FAR - LIGHT_NEAR) * t);
+			};
+			ShadowCache::Bounds slice = { { -aspect, -1.0f, -split(i + 1) }, { aspect, 1.0f, -split(i) } };
+			_shadowCache.SetViewMatrix(i, ShadowCache::DirectionalView(SUN_DIRECTION, slice, SHADOW_CASCADE_SIZE, LIGHT_FAR));
+			views[i].splitDistance = split(i + 1);
+		}
+
+		// a point light only shadows what's below it, down the view direction
+		for (uint32_t i = 0; i < _shadowedLights; i++)
+		{
+			const AnimatedLight& light = _lights[i];
+			float position[3] = { light.center[0] * aspect, light.center[1], light.center[2] };
+			_shadowCache.SetViewMatrix(SHADOW_CASCADES + i, ShadowCache::SpotView(position, 2.0f, light.light.radius));
+		}
+
+		for (uint32_t i = 0; i < views.size(); i++)
+		{
+			const ShadowCache::Rect& tile = _shadowCache.Tile(i);
+			std::copy(std::begin(_shadowCache.ViewMatrix(i).m), std::end(_shadowCache.ViewMatrix(i).m), views[i].shadowMatrix);
+			views[i].tile[0] = float(tile.x) / float(SHADOW_ATLAS_SIZE);
+			views[i].tile[1] = float(tile.y) / float(SHADOW_ATLAS_SIZE);
+			views[i].tile[2] = float(tile.width) / float(SHADOW_ATLAS_SIZE);
+			views[i].tile[3] = float(tile.height) / float(SHADOW_ATLAS_SIZE);
+		}
+
+		void* mapped = nullptr;
+		vkMapMemory(_device, _shadowViewData.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+		memcpy(mapped, views.data(), views.size() * sizeof(ShadowView));
+		vkUnmapMemory(_device, _shadowViewData.memory);
+	}
+
+	void _destroyShadows()
+	{
+		if (!_shadowsEnabled)
+			return;
+
+		_shadowCache.Report(std::cout);
+
+		vkDestroyPipeline(_device, _shadowPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _shadowPipelineLayout, nullptr);
+		vkDestroyShaderModule(_device, _shadowShaderModuleVS, nullptr);
+		vkDestroySampler(_device, _shadowSampler, nullptr);
+		vkDestroyRenderPass(_device, _shadowCacheRenderPass, nullptr);
+		vkDestroyRenderPass(_device, _shadowAtlasRenderPass, nullptr);
+		for (int i = 0; i < 2; i++)
+		{
+			vkDestroyFramebuffer(_device, _shadowFramebuffers[i], nullptr);
+			vkDestroyImageView(_device, _shadowImageViews[i], nullptr);
+			vkDestroyImage(_device, _shadowImages[i], nullptr);
+			_memoryTelemetry->Free(_shadowMemory[i]);
+		}
+		_destroyBuffer(_shadowViewData);
+	}
+
+	// view space box of an instance, the space the lights and shadow views live in. the mesh is [-1, 1]
+	// in object space, x and y scaled by the instance, z as is
+	ShadowCache::Bounds _instanceBounds(const MeshInstance& instance)
+	{
+		float aspect = _viewAspect();
+		float center[3] = { instance.offset[0] * aspect, instance.offset[1], -(LIGHT_NEAR + 1.0f) };
+		float extent[3] = { instance.scale, instance.scale, 1.0f };
+
+		ShadowCache::Bounds bounds;
+		for (int i = 0; i < 3; i++)
+		{
+			bounds.min[i] = center[i] - extent[i];
+			bounds.max[i] = center[i] + extent[i];
+		}
+		return bounds;
+	}
+
+	// the dynamic instances circle their grid cell, in frames at 60 Hz like the lights. the culling and
+	// mesh shaders read the instances from the device, the frame's new placement is written before them
+	void _moveDynamicInstances(VkCommandBuffer commandBuffer)
+	{
+		if (_dynamicInstances == 0)
+			return;
+
+		size_t first = _meshInstances.size() - _dynamicInstances;
+		if (_replay != nullptr)
+		{
+			_replayUploads(UploadTargetDynamicInstances, &_meshInstances[first], _dynamicInstances * sizeof(MeshInstance));
+		}
+		else
+		{
+			float time = float(_sceneFrame) / 60.0f;
+			for (size_t i = first; i < _meshInstances.size(); i++)
+			{
+				const MeshInstance& home = _meshInstanceHomes[i];
+				float angle = 1.5f * time + float(i);
+				_meshInstances[i].offset[0] = home.offset[0] + home.scale * 0.5f * std::cos(angle);
+				_meshInstances[i].offset[1] = home.offset[1] + home.scale * 0.5f * std::sin(angle);
+			}
+			_recordUpload(UploadTargetDynamicInstances, &_meshInstances[first], _dynamicInstances * sizeof(MeshInstance));
+		}
+
+		if (_meshInstanceData.buffer == VK_NULL_HANDLE)
+			return;
+
+		VkPipelineStageFlags2 readers = _meshShading ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT
+			: VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		VkDeviceSize updateOffset = first * sizeof(MeshInstance);
+		VkDeviceSize updateSize = _dynamicInstances * sizeof(MeshInstance);
+		_barriers->Buffer(_meshInstanceData.buffer, readers, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_NONE, updateOffset, updateSize);
+		_barriers->Flush(commandBuffer);
+		vkCmdUpdateBuffer(commandBuffer, _meshInstanceData.buffer, updateOffset, updateSize, &_meshInstances[first]);
+
+		_barriers->Buffer(_meshInstanceData.buffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, readers, VK_ACCESS_2_SHADER_READ_BIT,
+			updateOffset, updateSize);
+		_barriers->Flush(commandBuffer);
+	}
+
+	// casters [first, last) of _meshInstances whose shadow can reach 'area' of the view. shadows are drawn
+	// from LOD 1 where there is one, at shadow map resolution the full mesh is wasted
+	void _recordShadowCasters(VkCommandBuffer commandBuffer, uint32_t view, const ShadowCache::Rect& area, size_t first, size_t last)
+	{
+		const MeshFormat::Lod& lod = _meshLods[std::min<size_t>(1, _meshLods.size() - 1)];
+		float aspect = _viewAspect();
+
+		ShadowDrawParams params = {};
+		std::copy(std::begin(_shadowCache.ViewMatrix(view).m), std::end(_shadowCache.ViewMatrix(view).m), params.shadowMatrix);
+		params.depthOffset = -(LIGHT_NEAR + 1.0f);
+		for (size_t i = first; i < last; i++)
+		{
+			const MeshInstance& instance = _meshInstances[i];
+			if (!_shadowCache.Project(view, _instanceBounds(instance)).Intersects(area))
+				continue;
+
+			params.offset[0] = instance.offset[0] * aspect;
+			params.offset[1] = instance.offset[1];
+			params.scale = instance.scale;
+			vkCmdPushConstants(commandBuffer, _shadowPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(params), &params);
+			vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, lod.indexOffset, 0, 0);
+		}
+	}
+
+	// outside the render pass, before the receivers: the cache is re-rendered where ShadowCache says it's
+	// stale, copied into the atlas where last frame's dynamic casters (or the fresh static ones) are, and the
+	// dynamic casters drawn into the atlas on top
+	void _recordShadows(VkCommandBuffer commandBuffer)
+	{
+		if (!_shadowsEnabled)
+			return;
+
+		GpuProfiler::Scope profile(*_gpuProfiler, commandBuffer, "shadows");
+
+		size_t firstDynamic = _meshInstances.size() - _dynamicInstances;
+		for (size_t i = firstDynamic; i < _meshInstances.size(); i++)
+		{
+			_shadowCache.AddDynamicCaster(_instanceBounds(_meshInstances[i]));
+		}
+		const std::vector<ShadowCache::ViewPlan>& plans = _shadowCache.Plan(_config.shadowCache);
+
+		VkImageLayout atlasLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		if (!_shadowImagesInitialized)
+		{
+			// nothing to keep yet, the first plan re-renders every tile
+			_barriers->Image(_shadowImages[0], VK_IMAGE_ASPECT_DEPTH_BIT, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+			_barriers->Flush(commandBuffer);
+			atlasLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			_shadowImagesInitialized = true;
+		}
+
+		VkDeviceSize offset = 0;
+		auto beginShadowPass = [&](int image)
+		{
+			_beginShadowPass(commandBuffer, image);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowPipeline);
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &_meshVertices.buffer, &offset);
+			vkCmdBindIndexBuffer(commandBuffer, _meshIndices.buffer, 0, _meshHeader.indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+		};
+		auto setTile = [&](uint32_t view)
+		{
+			const ShadowCache::Rect& tile = _shadowCache.Tile(view);
+			VkViewport viewport = { float(tile.x), float(tile.y), float(tile.width), float(tile.height), 0, 1 };
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		};
+
+		bool redraw = std::any_of(plans.begin(), plans.end(), [](const ShadowCache::ViewPlan& plan) { return !plan.redraw.empty(); });
+		if (redraw)
+		{
+			beginShadowPass(0);
+			for (uint32_t view = 0; view < plans.size(); view++)
+			{
+				if (plans[view].redraw.empty())
+					continue;
+
+				setTile(view);
+				for (const ShadowCache::Rect& rect : plans[view].redraw)
+				{
+					VkRect2D scissor = { { rect.x, rect.y }, { rect.width, rect.height } };
+					vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+					VkClearAttachment clear = { VK_IMAGE_ASPECT_DEPTH_BIT, 0 };
+					clear.clearValue.depthStencil = { 1.0f, 0 };
+					VkClearRect clearRect = { scissor, 0, 1 };
+					vkCmdClearAttachments(commandBuffer, 1, &clear, 1, &clearRect);
+
+					_recordShadowCasters(commandBuffer, view, rect, 0, firstDynamic);
+				}
+			}
+			_endShadowPass(commandBuffer, 0);
+		}
+
+		// the previous frame's receivers are done with the atlas before it's restored
+		_barriers->Image(_shadowImages[1], VK_IMAGE_ASPECT_DEPTH_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_NONE, atlasLayout,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		_barriers->Flush(commandBuffer);
+
+		std::vector<VkImageCopy> copies;
+		for (const ShadowCache::ViewPlan& plan : plans)
+		{
+			for (const ShadowCache::Rect& rect : plan.restore)
+			{
+				VkImageCopy copy = {};
+				copy.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+				copy.srcOffset = { rect.x, rect.y, 0 };
+				copy.dstSubresource = copy.srcSubresource;
+				copy.dstOffset = copy.srcOffset;
+				copy.extent = { rect.width, rect.height, 1 };
+				copies.push_back(copy);
+			}
+		}
+		if (!copies.empty())
+		{
+			vkCmdCopyImage(commandBuffer, _shadowImages[0], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _shadowImages[1], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				uint32_t(copies.size()), copies.data());
+		}
+
+		// always begun, it also hands the atlas over to the receivers
+		beginShadowPass(1);
+		if (_dynamicInstances > 0)
+		{
+			for (uint32_t view = 0; view < plans.size(); view++)
+			{
+				const ShadowCache::Rect& tile = _shadowCache.Tile(view);
+				VkRect2D scissor = { { tile.x, tile.y }, { tile.width, tile.height } };
+				setTile(view);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				_recordShadowCasters(commandBuffer, view, tile, firstDynamic, _meshInstances.size());
+			}
+		}
+		_endShadowPass(commandBuffer, 1);
+	}
+
+	// image 0 is the cache, between passes a copy source, 1 the atlas, a copy destination before its pass and
+	// sampled after. dynamic rendering does the render passes' layout transitions and dependencies by barrier
+	void _beginShadowPass(VkCommandBuffer commandBuffer, int image)
+	{
+		VkRect2D renderArea = { { 0, 0 }, { SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE } };
+		if (!_dynamicRendering)
+		{
+			VkRenderPassBeginInfo renderPassBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+			renderPassBeginInfo.renderPass = image == 0 ? _shadowCacheRenderPass : _shadowAtlasRenderPass;
+			renderPassBeginInfo.framebuffer = _shadowFramebuffers[image];
+			renderPassBeginInfo.renderArea = renderArea;
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			return;
+		}
+
+		// the cache was last a copy source, the atlas a copy destination
+		_barriers->Image(_shadowImages[image], VK_IMAGE_ASPECT_DEPTH_BIT, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+			image == 0 ? VK_ACCESS_2_NONE : VK_ACCESS_2_TRANSFER_WRITE_BIT, image == 0 ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+		_barriers->Flush(commandBuffer);
+
+		VkRenderingAttachmentInfo depthAttachment = { VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+		depthAttachment.imageView = _shadowImageViews[image];
+		depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+		VkRenderingInfo renderingInfo = { VK_STRUCTURE_TYPE_RENDERING_INFO };
+		renderingInfo.renderArea = renderArea;
+		renderingInfo.layerCount = 1;
+		renderingInfo.pDepthAttachment = &depthAttachment;
+		_vkCmdBeginRendering(commandBuffer, &renderingInfo);
+	}
+
+	void _endShadowPass(VkCommandBuffer commandBuffer, int image)
+	{
+		if (!_dynamicRendering)
+		{
+			vkCmdEndRenderPass(commandBuffer);
+			return;
+		}
+
+		_vkCmdEndRendering(commandBuffer);
+
+		_barriers->Image(_shadowImages[image], VK_IMAGE_ASPECT_DEPTH_BIT,
+			VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			image == 0 ? VK_PIPELINE_STAGE_2_TRANSFER_BIT : VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			image == 0 ? VK_ACCESS_2_TRANSFER_READ_BIT : VK_ACCESS_2_SHADER_READ_BIT,
+			image == 0 ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+		_barriers->Flush(commandBuffer);
+	}
+
+	void _createTextureStreamer()
+	{
+		const VkDeviceSize mb = 1024 * 1024;
+		_textureStreamer = std::make_unique<TextureStreamer>(_physicalDevice, _device, *_memoryTelemetry, uint32_t(MAX_FRAMES), _config.textureStagingMB * mb,
+			_config.textureBudgetMB * mb, _physicalDeviceInfo.memoryBudgetSupported, _config.textureCompression);
+		// mips are what can go without breaking anything, so they're the first thing given back near the budget
+		_memoryTelemetry->AddEvictionCallback([this](uint32_t heap, VkDeviceSize bytes)
+		{
+			if (heap == _textureStreamer->HeapIndex())
+			{
+				_textureStreamer->Trim(bytes);
+			}
+		});
+
+		for (const std::string& path : _config.texturePaths)
+		{
+			_sceneTextures.push_back(_textureStreamer->Load(path));
+		}
+	}
+
+	void _drawFrame()
+	{
+		if (_dispatcher == nullptr)
+		{
+			_sceneFrame = _replay != nullptr ? _replay->frame : _frameIndex;
+		}
+		if (!_config.recordPath.empty() && _dispatcher == nullptr && _frameIndex == _config.recordFrame)
+		{
+			_beginRecording();
+		}
+
+		vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
+
+		// budget checks and eviction requests before the streamer plans this frame's residency
+		_memoryTelemetry->Update(_frameIndex);
+
+		// this slot's staging segment and anything retired a ring ago are free again
+		_textureStreamer->BeginFrame(_frameIndex, uint32_t(_currentFrame));
+
+		// whatever this frame slot captured last time around is complete now
+		if (_captureEnabled)
+		{
+			_collectCapture(_captureSlots[_currentFrame]);
+		}
+		if (_exportRing)
+		{
+			_collectExport(_currentFrame);
+		}
+
+		// acquiring an image, headless just cycles through the offscreen images
+		uint32_t imageIndex;
+		VkResult result = VK_SUCCESS;
+		if (_config.headless)
+		{
+			imageIndex = uint32_t(_frameIndex % _swapChainImages.size());
+		}
+		else
+		{
+			result = vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
+		}
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			_recreateSwapChain();
+			return;
+		}
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			throw std::runtime_error("Failed to acquire swap chain image!");
+		}
+
+		if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+		{
+			vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+		}
+
+		_imagesInFlight[imageIndex] = _inFlightFences[_currentFrame];
+
+		// with async compute the binning goes out first, and the graphics work before the scene in a submit of its
+		// own so the queues run them side by side. the scene's submit waits for the lists
+		bool asyncLights = _asyncCompute && !_lights.empty();
+		if (asyncLights)
+		{
+			_updateLights();
+			_submitLightBinning();
+		}
+		VkCommandBuffer early = asyncLights ? _earlyCommandBuffers[imageIndex] : _commandBuffers[imageIndex];
+
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		vkBeginCommandBuffer(early, &beginInfo);
+		_gpuProfiler->BeginFrame(early, uint32_t(_currentFrame));
+		_collectGpuFrameTime();
+		if (asyncLights)
+		{
+			_measureComputeOverlap();
+		}
+		_updateRenderScale();
+		uint32_t frameQuery = _gpuProfiler->Begin(early, "frame");
+
+		_textureStreamer->RecordUploads(early);
+		_moveDynamicInstances(early);
+		_recordClusterCulling(early);
+		if (!asyncLights)
+		{
+			_updateLights();
+			_recordLightBinning(early, false);
+		}
+		_recordShadows(early);
+
+		if (asyncLights)
+		{
+			vkEndCommandBuffer(early);
+			vkBeginCommandBuffer(_commandBuffers[imageIndex], &beginInfo);
+		}
+		uint32_t sceneQuery = _gpuProfiler->Begin(_commandBuffers[imageIndex], "scene");
+		_gpuProfiler->BeginLabel(_commandBuffers[imageIndex], "scene");
+
+		// a frame that goes to a recording writes its commands out as it records them
+		bool batched = _sceneBatches && _replay == nullptr && !_recording;
+		_beginScenePass(_commandBuffers[imageIndex], imageIndex, false, batched);
+		if (batched)
+		{
+			_executeSceneBatches(_commandBuffers[imageIndex]);
+		}
+		else
+		{
+			_recordScene(_commandBuffers[imageIndex]);
+		}
+		_endScenePass(_commandBuffers[imageIndex], false);
+
+		// second phase: cull against the early draws' depth, then add what they didn't hide
+		if (_occlusionCulling)
+		{
+			_recordOcclusionCulling(_commandBuffers[imageIndex]);
+
+			_beginScenePass(_commandBuffers[imageIndex], imageIndex, true);
+			if (_replay != nullptr)
+			{
+				_replayScene(_commandBuffers[imageIndex], 1);
+			}
+			else
+			{
+				_recordMeshDraws(_commandBuffers[imageIndex], CullPhaseLate);
+			}
+			_endScenePass(_commandBuffers[imageIndex], true);
+		}
+		_gpuProfiler->EndLabel(_commandBuffers[imageIndex]);
+		_gpuProfiler->End(_commandBuffers[imageIndex], sceneQuery);
+		if (_offscreenScene())
+		{
+			_recordUpscale(_commandBuffers[imageIndex], imageIndex);
+		}
+		_drawQueue.EndFrame();
+
+		// the culling counters are read on the host at exit. goes out with the frame's last transition
+		if (_clusterCulling != ClusterCulling::Off)
+		{
+			_barriers->Memory(_meshShading ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT : VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+		}
+
+		bool capture = _dispatcher != nullptr ? _captureEnabled && _dispatcher->Captured(_sceneFrame) : _captureEnabled && _frameIndex >= _config.captureStartFrame &&
+			(_config.captureFrames == 0 || _capturedFrames < _config.captureFrames);
+		int32_t exportSlot = _exportRing ? _exportRing->TryAcquire() : -1;
+		if (capture)
+		{
+			_recordCapture(_commandBuffers[imageIndex], _swapChainImages[imageIndex], _captureSlots[_currentFrame]);
+		}
+		else if (exportSlot >= 0)
+		{
+			_recordCapture(_commandBuffers[imageIndex], _swapChainImages[imageIndex], _exportSlots[exportSlot]);
+			_exportPending[_currentFrame] = exportSlot;
+		}
+		else
+		{
+			// nothing later in the frame touches the image, the submit's signal covers the present
+			VkPipelineStageFlags2 renderedStage;
+			VkAccessFlags2 renderedAccess;
+			VkImageLayout renderedLayout;
+			_renderedImageState(renderedStage, renderedAccess, renderedLayout);
+			_barriers->Image(_swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, renderedStage, renderedAccess, renderedLayout,
+				VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, _presentLayout());
+			_barriers->Flush(_commandBuffers[imageIndex]);
+		}
+
+		_gpuProfiler->End(_commandBuffers[imageIndex], frameQuery);
+		vkEndCommandBuffer(_commandBuffers[imageIndex]);
+		// submitting the command buffer
+		VkSubmitInfo submitInfos[2] = { { VK_STRUCTURE_TYPE_SUBMIT_INFO }, { VK_STRUCTURE_TYPE_SUBMIT_INFO } };
+		VkSubmitInfo& earlySubmit = submitInfos[0];
+		VkSubmitInfo& submitInfo = submitInfos[asyncLights ? 1 : 0];
+
+		earlySubmit.commandBufferCount = 1;
+		earlySubmit.pCommandBuffers = &early;
+
+		// headless has no acquire or present to synchronize with, the fence covers the readback
+		VkSemaphore watsSemaphores[2];
+		VkPipelineStageFlags waitStages[2];
+		VkSemaphore signalSemaphores[2];
+		uint32_t waitCount = 0;
+		uint32_t signalCount = 0;
+		if (!_config.headless)
+		{
+			watsSemaphores[waitCount] = _imageAvailableSemaphores[_currentFrame];
+			waitStages[waitCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			signalSemaphores[signalCount++] = _renderFinishedSemaphores[_currentFrame];
+		}
+		// the fragment shaders read the lists, and the next binning rebuilds them once the frame is done
+		if (asyncLights)
+		{
+			watsSemaphores[waitCount] = _lightsBinnedSemaphore;
+			waitStages[waitCount++] = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			signalSemaphores[signalCount++] = _lightsReleasedSemaphore;
+		}
+		submitInfo.waitSemaphoreCount = waitCount;
+		submitInfo.pWaitSemaphores = watsSemaphores;
+		submitInfo.pWaitDstStageMask = waitStages;
+
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
+
+		submitInfo.signalSemaphoreCount = signalCount;
+		submitInfo.pSignalSemaphores = signalSemaphores;
+
+		vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
+		if (vkQueueSubmit(_graphicsQueue, asyncLights ? 2 : 1, submitInfos, _inFlightFences[_currentFrame]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit draw command buffer");
+		}
+		_lightsReleasedPending = asyncLights;
+		if (_recording)
+		{
+			_finishRecording();
+		}
+
+		if (_config.headless)
+		{
+			_frameIndex++;
+			_currentFrame = (_currentFrame + 1) % _framesInFlight;
+			return;
+		}
+
+		VkPresentInfoKHR presentInfo = {};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = signalSemaphores;
+
+		VkSwapchainKHR swapChains[] = { _swapChain };
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = swapChains;
+		presentInfo.pImageIndices = &imageIndex;
+
+		presentInfo.pResults = nullptr;
+
+		// tag the present so _collectPresentLatency can wait for it to reach the display
+		VkPresentIdKHR presentId = { VK_STRUCTURE_TYPE_PRESENT_ID_KHR };
+		uint64_t presentIdValue = ++_presentId;
+		if (_presentWaitEnabled)
+		{
+			presentId.swapchainCount = 1;
+			presentId.pPresentIds = &presentIdValue;
+			presentInfo.pNext = &presentId;
+		}
+
+		result = vkQueuePresentKHR(_presentQueue, &presentInfo);
+
+		if (_presentWaitEnabled)
+		{
+			_pendingPresents.push_back({ presentIdValue, _inputTimestamp });
+		}
+		else
+		{
+			// no present wait, the best we can see is input-to-queue-present
+			_latencyStats.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _inputTimestamp).count());
+		}
+		if (result == VK_ERROR_OUT_OF_POOL_MEMORY_KHR || result == VK_SUBOPTIMAL_KHR || _framebufferResized)
+		{
+			glfwGetWindowSize(_window, &windowWidth, &windowHeight);
+			_framebufferResized = false;
+			_recreateSwapChain();
+		}
+		else if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to present swap chain image!");
+		}
+
+		_frameIndex++;
+		_currentFrame = (_currentFrame + 1) % _framesInFlight;
+	}
+
+	// records and submits this frame's binning on the compute queue, after the last frame that read the lists
+	void _submitLightBinning()
+	{
+		VkCommandBuffer commandBuffer = _computeCommandBuffers[_currentFrame];
+		vkResetCommandBuffer(commandBuffer, 0);
+
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		_computeProfiler->BeginFrame(commandBuffer, uint32_t(_currentFrame));
+		_recordLightBinning(commandBuffer, true);
+		vkEndCommandBuffer(commandBuffer);
+
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.waitSemaphoreCount = _lightsReleasedPending ? 1 : 0;
+		submitInfo.pWaitSemaphores = &_lightsReleasedSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &_lightsBinnedSemaphore;
+		if (vkQueueSubmit(_computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit light binning");
+		}
+		_lightsReleasedPending = false;
+	}
+
+	// files the "frame" scope the profiler just collected under the frame that recorded it
+	void _collectGpuFrameTime()
+	{
+		for (const GpuProfiler::Interval& interval : _gpuProfiler->LastFrame())
+		{
+			if (strcmp(interval.name, "frame") != 0)
+				continue;
+
+			uint64_t frame = _profiledFrames[_currentFrame];
+			if (_gpuFrameTimesMs.size() <= frame)
+			{
+				_gpuFrameTimesMs.resize(size_t(frame) + 1, -1.0);
+			}
+			_gpuFrameTimesMs[frame] = interval.endMs - interval.beginMs;
+		}
+		_profiledFrames[_currentFrame] = _frameIndex;
+	}
+
+	// this frame's render scale, from the frame the profiler just collected. "scene" spans the passes drawn at
+	// the scale, the rest of "frame" doesn't change with it
+	void _updateRenderScale()
+	{
+		if (!_dynamicResolution)
+			return;
+		if (_replay != nullptr)
+		{
+			_renderScale = _replay->renderScale;
+			return;
+		}
+
+		double frameMs = -1.0, sceneMs = -1.0;
+		for (const GpuProfiler::Interval& interval : _gpuProfiler->LastFrame())
+		{
+			if (strcmp(interval.name, "frame") == 0)
+				frameMs = interval.endMs - interval.beginMs;
+			else if (strcmp(interval.name, "scene") == 0)
+				sceneMs = interval.endMs - interval.beginMs;
+		}
+		if (frameMs >= 0.0 && sceneMs >= 0.0)
+		{
+			_renderScale = _dynamicResolution->Update(frameMs, sceneMs);
+		}
+	}
+
+	// how much of the binning ran while the graphics queue was busy, from the frame both profilers just
+	// collected. timestamps of both queues are on the device's clock. "frame" spans everything, so only the
+	// scopes inside it count as busy
+	void _measureComputeOverlap()
+	{
+		const std::vector<GpuProfiler::Interval>& graphics = _gpuProfiler->LastFrame();
+		const std::vector<GpuProfiler::Interval>& compute = _computeProfiler->LastFrame();
+		if (graphics.empty() || compute.empty())
+			return;
+
+		for (const GpuProfiler::Interval& interval : compute)
+		{
+			double length = interval.endMs - interval.beginMs;
+			double overlap = 0.0;
+			for (const GpuProfiler::Interval& scope : graphics)
+			{
+				if (strcmp(scope.name, "frame") != 0)
+				{
+					overlap += std::max(0.0, std::min(interval.endMs, scope.endMs) - std::max(interval.beginMs, scope.beginMs));
+				}
+			}
+			_computeMs += length;
+			_overlapMs += std::min(overlap, length);
+		}
+		_overlapFrames++;
+	}
+
+	VkRect2D _sceneRenderArea() const
+	{
+		return { { 0, 0 }, _offscreenScene() ? _renderArea() : VkExtent2D{ uint32_t(windowWidth), uint32_t(windowHeight) } };
+	}
+
+	// the pass drawing into the swapchain image, cleared unless it's occlusion culling's late pass ('resume').
+	// dynamic rendering has no subpass dependencies or layout transitions of its own, the barriers here do
+	// what _createRenderPass' dependencies and initial layouts do on the render pass path.
+	// multiview draws into the views' layers instead, _recordUpscale takes them to the swapchain image.
+	// 'secondary': the pass' commands come from the scene batches, which set their own viewports
+	void _beginScenePass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool resume, bool secondary = false)
+	{
+		VkClearValue clearValues[2] = { { CLEAR_COLOR } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRect2D renderArea = _sceneRenderArea();
+		VkImage colorImage = _offscreenScene() ? _sceneColorImage : _swapChainImages[imageIndex];
+		if (_dynamicRendering)
+		{
+			// the early pass clears the image the acquire semaphore released at color output and the depth the previous
+			// frame's tests and pyramid reduction are done with. the late pass waits for the pyramid reduction to be done
+			// reading its depth, and for the early pass' color writes
+			const VkPipelineStageFlags2 depthTests = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+			const VkAccessFlags2 depthAccess = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			if (resume)
+			{
+				_barriers->Image(_depthImage, VK_IMAGE_ASPECT_DEPTH_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+					depthTests, depthAccess, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+				_barriers->Image(colorImage, VK_IMAGE_ASPECT_COLOR_BIT,
+					VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+					VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+			}
+			else
+			{
+				_barriers->Image(_depthImage, VK_IMAGE_ASPECT_DEPTH_BIT,
+					_occlusionCulling ? depthTests | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT : depthTests, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+					depthTests, depthAccess, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+				// the scene's own color was last read by the previous frame's upscale
+				_barriers->Image(colorImage, VK_IMAGE_ASPECT_COLOR_BIT,
+					_offscreenScene() ? VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT : VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+					VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+			}
+			_barriers->Flush(commandBuffer);
+
+			VkRenderingAttachmentInfo colorAttachment = { VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+			colorAttachment.imageView = _offscreenScene() ? _sceneColorView : _swapChainImageViews[imageIndex];
+			colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			colorAttachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+			colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			colorAttachment.clearValue = clearValues[0];
+
+			VkRenderingAttachmentInfo depthAttachment = { VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+			depthAttachment.imageView = _depthImageView;
+			depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			depthAttachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+			depthAttachment.storeOp = _occlusionCulling && !resume ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			depthAttachment.clearValue = clearValues[1];
+
+			VkRenderingInfo renderingInfo = { VK_STRUCTURE_TYPE_RENDERING_INFO };
+			renderingInfo.flags = secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+			renderingInfo.renderArea = renderArea;
+			renderingInfo.layerCount = 1;
+			renderingInfo.viewMask = _viewMask();
+			renderingInfo.colorAttachmentCount = 1;
+			renderingInfo.pColorAttachments = &colorAttachment;
+			renderingInfo.pDepthAttachment = &depthAttachment;
+			_vkCmdBeginRendering(commandBuffer, &renderingInfo);
+		}
+		else
+		{
+			VkRenderPassBeginInfo renderPassBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+			renderPassBeginInfo.renderPass = resume ? _lateRenderPass : _renderPass;
+			renderPassBeginInfo.framebuffer = _swapChainFrameBuffers[imageIndex];
+			renderPassBeginInfo.clearValueCount = uint32_t(std::size(clearValues));
+			renderPassBeginInfo.pClearValues = clearValues;
+			renderPassBeginInfo.renderArea = renderArea;
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+		}
+
+		if (!secondary)
+		{
+			_setSceneViewports(commandBuffer, renderArea);
+		}
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::BeginPass, CommandStream::Payload() << uint32_t(resume ? 1 : 0));
+		}
+	}
+
+	// y flipped, a viewport per split-screen view unless they're multiview layers
+	void _setSceneViewports(VkCommandBuffer commandBuffer, VkRect2D renderArea)
+	{
+		uint32_t viewportCount = _multiview ? 1 : _viewCount;
+		VkViewport viewports[MAX_VIEWS];
+		VkRect2D scissors[MAX_VIEWS];
+		for (uint32_t i = 0; i < viewportCount; i++)
+		{
+			scissors[i] = viewportCount > 1 ? _viewRect(i, renderArea.extent) : renderArea;
+			viewports[i] = { float(scissors[i].offset.x), float(scissors[i].offset.y + int32_t(scissors[i].extent.height)),
+				float(scissors[i].extent.width), -float(scissors[i].extent.height), 0, 1 };
+		}
+		vkCmdSetViewport(commandBuffer, 0, viewportCount, viewports);
+		vkCmdSetScissor(commandBuffer, 0, viewportCount, scissors);
+	}
+
+	void _endScenePass(VkCommandBuffer commandBuffer, bool resume)
+	{
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::EndPass);
+		}
+
+		if (!_dynamicRendering)
+		{
+			vkCmdEndRenderPass(commandBuffer);
+			return;
+		}
+
+		_vkCmdEndRendering(commandBuffer);
+
+		// the pyramid reduction reads the early pass' depth
+		if (_occlusionCulling && !resume)
+		{
+			_barriers->Image(_depthImage, VK_IMAGE_ASPECT_DEPTH_BIT,
+				VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+			_barriers->Flush(commandBuffer);
+		}
+	}
+
+	// the scene's color into the swapchain image: every multiview layer into its tile, the render area dynamic
+	// resolution drew scaled up to the size it stands for with a linear blit, a plain copy at full scale. the
+	// image is left in TRANSFER_DST for capture or present to take it from, see _renderedImageState
+	void _recordUpscale(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	{
+		GpuProfiler::Scope profile(*_gpuProfiler, commandBuffer, "upscale");
+		VkImage image = _swapChainImages[imageIndex];
+		VkExtent2D area = _renderArea();
+		VkExtent2D extent = _renderExtent();
+		uint32_t layers = _multiview ? _viewCount : 1;
+
+		_barriers->Image(_sceneColorImage, VK_IMAGE_ASPECT_COLOR_BIT,
+			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		_barriers->Image(image, VK_IMAGE_ASPECT_COLOR_BIT,
+			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		_barriers->Flush(commandBuffer);
+
+		// multiview's tiles don't cover an odd pixel row or column, nor the empty fourth tile of three views
+		if (_multiview)
+		{
+			VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &CLEAR_COLOR, 1, &range);
+			_barriers->Memory(VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+			_barriers->Flush(commandBuffer);
+		}
+
+		if (area.width == extent.width && area.height == extent.height)
+		{
+			VkImageCopy regions[MAX_VIEWS] = {};
+			for (uint32_t i = 0; i < layers; i++)
+			{
+				VkRect2D tile = _multiview ? _viewRect(i) : VkRect2D{ { 0, 0 }, extent };
+				regions[i].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, i, 1 };
+				regions[i].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				regions[i].dstOffset = { tile.offset.x, tile.offset.y, 0 };
+				regions[i].extent = { tile.extent.width, tile.extent.height, 1 };
+			}
+			vkCmdCopyImage(commandBuffer, _sceneColorImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layers, regions);
+		}
+		else
+		{
+			VkImageBlit regions[MAX_VIEWS] = {};
+			for (uint32_t i = 0; i < layers; i++)
+			{
+				VkRect2D tile = _multiview ? _viewRect(i) : VkRect2D{ { 0, 0 }, extent };
+				regions[i].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, i, 1 };
+				regions[i].srcOffsets[1] = { int32_t(area.width), int32_t(area.height), 1 };
+				regions[i].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				regions[i].dstOffsets[0] = { tile.offset.x, tile.offset.y, 0 };
+				regions[i].dstOffsets[1] = { tile.offset.x + int32_t(tile.extent.width), tile.offset.y + int32_t(tile.extent.height), 1 };
+			}
+			vkCmdBlitImage(commandBuffer, _sceneColorImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layers, regions,
+				VK_FILTER_LINEAR);
+		}
+	}
+
+	void _pushDrawParams(VkCommandBuffer commandBuffer, float offsetX, float offsetY, float scale, uint32_t columns)
+	{
+		DrawParams params = { { offsetX, offsetY }, { scale, scale }, columns };
+		_pushConstants(commandBuffer, _pipelineLayout, 0, sizeof(params), &params);
+	}
+
+	// the scene's commands. each goes to the recording too while there is one, see CommandStream::Op
+	void _bindScenePipeline(VkCommandBuffer commandBuffer, uint32_t pipeline)
+	{
+		VkPipeline handle = pipeline == ScenePipelineGraphics ? _graphicsPipeline : pipeline == ScenePipelineMesh ? _meshPipeline : _scenePipelines[pipeline - ScenePipelineMany];
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, handle);
+
+		// the task and mesh shaders' sets, the vertex pipelines' are bound per pass
+		if (pipeline == ScenePipelineMesh && _meshShading)
+		{
+			_bindLights(commandBuffer, _meshletPipelineLayout);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _meshletPipelineLayout, 2, 1, &_clusterSet, 0, nullptr);
+		}
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::BindPipeline, CommandStream::Payload() << pipeline);
+		}
+	}
+
+	// the mesh's vertices, and its indices or the culling's compacted stream
+	void _bindMesh(VkCommandBuffer commandBuffer)
+	{
+		bool compacted = _clusterCulling == ClusterCulling::Compute;
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &_meshVertices.buffer, &offset);
+		if (compacted)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, _clusterIndices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		}
+		else
+		{
+			vkCmdBindIndexBuffer(commandBuffer, _meshIndices.buffer, 0, _meshHeader.indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+		}
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::BindMesh, CommandStream::Payload() << uint32_t(compacted ? 1 : 0));
+		}
+	}
+
+	// the stages follow from the layout, the meshlet layout's constants are the task and mesh shaders'
+	void _pushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t offset, uint32_t size, const void* data)
+	{
+		VkShaderStageFlags stages = layout == _meshletPipelineLayout ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : VK_SHADER_STAGE_VERTEX_BIT;
+		vkCmdPushConstants(commandBuffer, layout, stages, offset, size, data);
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::Push, (CommandStream::Payload() << offset).Append(data, size));
+		}
+	}
+
+	void _draw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount)
+	{
+		vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, 0);
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::Draw, CommandStream::Payload() << vertexCount << instanceCount);
+		}
+	}
+
+	void _drawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex)
+	{
+		vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, 0, 0);
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::DrawIndexed, CommandStream::Payload() << indexCount << instanceCount << firstIndex);
+		}
+	}
+
+	// 'command' indexes the culling's ClusterDrawCommands
+	void _drawIndirect(VkCommandBuffer commandBuffer, uint32_t command)
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, _clusterDraw.buffer, command * sizeof(ClusterDrawCommand), 1, sizeof(ClusterDrawCommand));
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::DrawIndirect, CommandStream::Payload() << command);
+		}
+	}
+
+	void _drawMeshTasks(VkCommandBuffer commandBuffer, uint32_t groupCount)
+	{
+		_vkCmdDrawMeshTasksEXT(commandBuffer, groupCount, 1, 1);
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::DrawMeshTasks, CommandStream::Payload() << groupCount);
+		}
+	}
+
+	// binds the draw's texture and tells the streamer how many pixels it's drawn at, at the render scale.
+	// the triangle's bounds are one NDC unit at scale 1, i.e. half the viewport
+	void _bindTexture(VkCommandBuffer commandBuffer, size_t drawIndex, float scale)
+	{
+		_bindTexture(commandBuffer, drawIndex, scale, _pipelineLayout);
+	}
+
+	void _bindTexture(VkCommandBuffer commandBuffer, size_t drawIndex, float scale, VkPipelineLayout layout)
+	{
+		uint32_t texture = _sceneTexture(drawIndex);
+		float screenWidth = scale * 0.5f * float(_swapChainExtent.width) * _renderScale;
+		float screenHeight = scale * 0.5f * float(_swapChainExtent.height) * _renderScale;
+		VkDescriptorSet set = _textureStreamer->Request(texture, screenWidth, screenHeight);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &set, 0, nullptr);
+
+		// recorded as the place in the --texture list, what the replay's own texture handles follow
+		if (_recording)
+		{
+			uint32_t recorded = _sceneTextures.empty() ? UINT32_MAX : uint32_t(drawIndex % _sceneTextures.size());
+			_recording->Write(CommandStream::Op::BindTexture, CommandStream::Payload() << recorded << scale);
+		}
+	}
+
+	uint32_t _sceneTexture(size_t drawIndex) const
+	{
+		return _sceneTextures.empty() ? TextureStreamer::DefaultTexture : _sceneTextures[drawIndex % _sceneTextures.size()];
+	}
+
+	// the light set is set 1 of every graphics layout, the lights of this frame slot
+	void _bindLights(VkCommandBuffer commandBuffer, VkPipelineLayout layout)
+	{
+		uint32_t lightOffset = uint32_t(_currentFrame * _lightSliceSize);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &_lightSet, 1, &lightOffset);
+	}
+
+	void _recordScene(VkCommandBuffer commandBuffer)
+	{
+		if (_replay != nullptr)
+		{
+			_bindLights(commandBuffer, _pipelineLayout);
+			_replayScene(commandBuffer, 0);
+			return;
+		}
+
+		_queueSceneDraws();
+		uint32_t batchCount = _sceneBatchCount();
+		for (uint32_t batch = 0; batch < batchCount; batch++)
+		{
+			_recordSceneBatch(commandBuffer, batch);
+		}
+		_drawQueue.Clear();
+	}
+
+	// the many pipelines' draws, one per cell, sorted once for the whole pass. the batches are runs of the sorted
+	// packets, the queue is emptied once they're recorded
+	void _queueSceneDraws()
+	{
+		if (_config.scene != Scene::ManyPipelines)
+			return;
+
+		for (uint32_t i = 0; i < uint32_t(_scenePipelines.size()); i++)
+		{
+			_drawQueue.Push(DrawQueue::Key(0, i, _sceneTexture(i), 0.0f), i);
+		}
+		_drawQueue.Sort();
+	}
+
+	// batch 'batch's run [first, last) of the sorted packets
+	void _sceneBatchDraws(uint32_t batch, size_t& first, size_t& last) const
+	{
+		size_t count = _drawQueue.Packets().size();
+		first = std::min<size_t>(size_t(batch) * MANY_PIPELINES_COLUMNS, count);
+		last = std::min<size_t>(first + MANY_PIPELINES_COLUMNS, count);
+	}
+
+	// the static scenes' draws in runs a secondary each: the triangle and the instanced grid are one, the many
+	// pipelines a run per row of the grid. the mesh scene's draws follow the culling and LODs, it has one batch
+	// that is always recorded inline
+	uint32_t _sceneBatchCount() const
+	{
+		return _config.scene == Scene::ManyPipelines ? MANY_PIPELINES_COLUMNS : 1;
+	}
+
+	void _createSceneBatches()
+	{
+		if (!_config.sceneBatches || _config.scene == Scene::Mesh)
+			return;
+
+		_sceneBatches = std::make_unique<SceneBatches>(_device, _physicalDeviceInfo.queueFamilies.graphicsFamily.value(), uint32_t(MAX_FRAMES), _sceneBatchCount());
+	}
+
+	// everything a batch's commands are recorded from that changes without the swapchain: the render area its
+	// viewport covers and the texture sets the streamer hands out for its draws, which also keeps their demand
+	// coming while the batch is reused
+	uint64_t _sceneBatchKey(uint32_t batch)
+	{
+		VkRect2D renderArea = _sceneRenderArea();
+		SceneBatches::Key key;
+		key << renderArea.extent.width << renderArea.extent.height;
+
+		std::vector<uint32_t> cells = { 0 };
+		float scale = 1.0f;
+		if (_config.scene == Scene::Instancing)
+		{
+			scale = 1.6f / 8;
+		}
+		else if (_config.scene == Scene::ManyPipelines)
+		{
+			size_t first, last;
+			_sceneBatchDraws(batch, first, last);
+			cells.clear();
+			for (size_t packet = first; packet < last; packet++)
+			{
+				cells.push_back(_drawQueue.Packets()[packet].draw);
+			}
+			scale = 0.8f * 2.0f / MANY_PIPELINES_COLUMNS;
+		}
+		for (uint32_t i : cells)
+		{
+			float screenWidth = scale * 0.5f * float(_swapChainExtent.width) * _renderScale;
+			float screenHeight = scale * 0.5f * float(_swapChainExtent.height) * _renderScale;
+			key << i << _textureStreamer->Request(_sceneTexture(i), screenWidth, screenHeight);
+		}
+		return key.Value();
+	}
+
+	// the scene pass' commands as the batches' secondaries, re-recording those whose key changed
+	void _executeSceneBatches(VkCommandBuffer commandBuffer)
+	{
+		VkCommandBufferInheritanceRenderingInfo renderingInheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
+		renderingInheritance.viewMask = _viewMask();
+		renderingInheritance.colorAttachmentCount = 1;
+		renderingInheritance.pColorAttachmentFormats = &_colorFormat;
+		renderingInheritance.depthAttachmentFormat = _depthFormat;
+		renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkCommandBufferInheritanceInfo inheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		if (_dynamicRendering)
+		{
+			inheritance.pNext = &renderingInheritance;
+		}
+		else
+		{
+			inheritance.renderPass = _renderPass;
+			inheritance.subpass = 0;
+		}
+
+		// simultaneous use: a reused secondary stays recorded into the primary of the swapchain image that last
+		// executed it while another image's primary executes it
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		beginInfo.pInheritanceInfo = &inheritance;
+
+		_queueSceneDraws();
+		std::vector<VkCommandBuffer> secondaries(_sceneBatches->BatchCount());
+		for (uint32_t batch = 0; batch < _sceneBatches->BatchCount(); batch++)
+		{
+			bool record = false;
+			secondaries[batch] = _sceneBatches->Acquire(uint32_t(_currentFrame), batch, _sceneBatchKey(batch), record);
+			if (record)
+			{
+				vkBeginCommandBuffer(secondaries[batch], &beginInfo);
+				_setSceneViewports(secondaries[batch], _sceneRenderArea());
+				_recordSceneBatch(secondaries[batch], batch);
+				vkEndCommandBuffer(secondaries[batch]);
+			}
+		}
+		_drawQueue.Clear();
+		vkCmdExecuteCommands(commandBuffer, uint32_t(secondaries.size()), secondaries.data());
+		_sceneBatches->EndFrame();
+	}
+
+	void _recordSceneBatch(VkCommandBuffer commandBuffer, uint32_t batch)
+	{
+		_bindLights(commandBuffer, _pipelineLayout);
+		switch (_config.scene)
+		{
+		case Scene::Triangle:
+			_bindScenePipeline(commandBuffer, ScenePipelineGraphics);
+			_bindTexture(commandBuffer, 0, 1.0f);
+			_pushDrawParams(commandBuffer, 0.0f, 0.0f, 1.0f, 0);
+			_draw(commandBuffer, 3, 1);
+			break;
+
+		case Scene::Instancing:
+		{
+			// 8x8 grid, each triangle a bit smaller than its cell
+			const uint32_t columns = 8;
+			_bindScenePipeline(commandBuffer, ScenePipelineGraphics);
+			_bindTexture(commandBuffer, 0, 1.6f / columns);
+			_pushDrawParams(commandBuffer, 0.0f, 0.0f, 1.6f / columns, columns);
+			_draw(commandBuffer, 3, columns * columns);
+			break;
+		}
+
+		case Scene::ManyPipelines:
+		{
+			// one draw per cell of a 4x4 grid, each with its own pipeline, the batch's run of the pass' sorted draws,
+			// see _queueSceneDraws. the queue binds a texture the previous cell already bound only once
+			const uint32_t columns = MANY_PIPELINES_COLUMNS;
+			const float cell = 2.0f / columns;
+			size_t first, last;
+			_sceneBatchDraws(batch, first, last);
+			_drawQueue.Record(first, last - first, [&](const DrawPacket& packet, bool bindPipeline, bool bindMaterial)
+			{
+				uint32_t i = packet.draw;
+				float x = -1.0f + cell * (float(i % columns) + 0.5f);
+				float y = -1.0f + cell * (float(i / columns) + 0.5f);
+
+				if (bindPipeline)
+				{
+					_bindScenePipeline(commandBuffer, ScenePipelineMany + DrawQueue::Pipeline(packet.key));
+				}
+				if (bindMaterial)
+				{
+					_bindTexture(commandBuffer, i, 0.8f * cell);
+				}
+				_pushDrawParams(commandBuffer, x, y, 0.8f * cell, 0);
+				_draw(commandBuffer, 3, 1);
+			});
+			break;
+		}
+
+		case Scene::Mesh:
+			_recordMeshDraws(commandBuffer, _occlusionCulling ? CullPhaseEarly : CullPhaseAll);
+			break;
+		}
+	}
+
+	// one draw per view and instance, of what the culling kept for this phase
+	void _recordMeshDraws(VkCommandBuffer commandBuffer, CullPhase phase)
+	{
+		// the mesh is normalized to [-1, 1], keep it square on screen. the bottom row is the largest
+		ClusterCullParams cull = _meshCullParams();
+		cull.phase = phase;
+
+		if (_meshShading)
+		{
+			_bindScenePipeline(commandBuffer, ScenePipelineMesh);
+			_bindTexture(commandBuffer, 0, 2.0f * _meshInstances[0].scale, _meshletPipelineLayout);
+
+			// the task shaders read the instance's LOD, 32 meshlet slots per workgroup, see meshlet.task.glsl
+			for (cull.instance = 0; cull.instance < cull.instanceCount; cull.instance++)
+			{
+				_pushConstants(commandBuffer, _meshletPipelineLayout, 0, sizeof(cull), &cull);
+				_drawMeshTasks(commandBuffer, (cull.maxMeshlets + 31) / 32);
+			}
+			return;
+		}
+
+		// the views stay pushed behind every draw's DrawParams, which names the one it draws, see mesh_multiview.vert.glsl
+		if (_viewCount > 1)
+		{
+			_pushConstants(commandBuffer, _pipelineLayout, ViewParamsOffset, sizeof(ViewParams) * MAX_VIEWS, _views);
+		}
+
+		// front to back, the larger instances are the closer ones. a packet's draw is its ClusterDrawCommand
+		// within the phase, view-major
+		const uint32_t instanceCount = uint32_t(_meshInstances.size());
+		for (uint32_t view = 0; view < _viewCount; view++)
+		{
+			for (uint32_t i = 0; i < instanceCount; i++)
+			{
+				float depth = 1.0f - std::min(_meshInstances[i].scale / _meshInstances[0].scale, 1.0f);
+				_drawQueue.Push(DrawQueue::Key(uint32_t(phase), 0, _sceneTexture(0), depth), view * instanceCount + i);
+			}
+		}
+
+		_drawQueue.Flush([&](const DrawPacket& packet, bool bindPipeline, bool bindMaterial)
+		{
+			if (bindPipeline)
+			{
+				_bindScenePipeline(commandBuffer, ScenePipelineMesh);
+				_bindMesh(commandBuffer);
+			}
+			if (bindMaterial)
+			{
+				_bindTexture(commandBuffer, 0, 2.0f * _meshInstances[0].scale);
+			}
+
+			uint32_t command = uint32_t(packet.draw);
+			const MeshInstance& instance = _meshInstances[command % instanceCount];
+			DrawParams params = { { instance.offset[0], instance.offset[1] }, { instance.scale * cull.aspect, instance.scale }, 0, command / instanceCount };
+			_pushConstants(commandBuffer, _pipelineLayout, 0, sizeof(params), &params);
+
+			// without the pre-pass nothing picks a LOD, everything is drawn at full detail
+			if (_clusterCulling == ClusterCulling::Compute)
+			{
+				_drawIndirect(commandBuffer, phase == CullPhaseLate ? instanceCount * _viewCount + command : command);
+			}
+			else
+			{
+				_drawIndexed(commandBuffer, _meshLods[0].indexCount, 1, _meshLods[0].indexOffset);
+			}
+		});
+	}
+
+	// the recording's scene pass 'pass' (0 the scene, 1 the late pass) instead of the live scene's draws. the
+	// light binning, culling and shadows around it are the renderer's own, from the recorded options and uploads
+	void _replayScene(VkCommandBuffer commandBuffer, uint32_t pass)
+	{
+		using CommandStream::Op;
+
+		VkPipelineLayout layout = _pipelineLayout;
+		bool inPass = false;
+		size_t offset = 0;
+		CommandStream::Command command;
+		while (_replay->Next(offset, command))
+		{
+			CommandStream::Arguments args = command.Args();
+			if (command.op == Op::BeginPass)
+			{
+				inPass = args.Get<uint32_t>() == pass;
+				continue;
+			}
+			if (!inPass)
+				continue;
+
+			switch (command.op)
+			{
+			case Op::EndPass:
+				return;
+
+			case Op::BindPipeline:
+			{
+				uint32_t pipeline = args.Get<uint32_t>();
+				bool valid = pipeline == ScenePipelineGraphics || (pipeline == ScenePipelineMesh && _meshPipeline != VK_NULL_HANDLE) ||
+					(pipeline >= ScenePipelineMany && pipeline - ScenePipelineMany < _scenePipelines.size());
+				if (!valid)
+					throw std::runtime_error("command stream: pipeline " + std::to_string(pipeline) + " isn't one of this scene's");
+				_bindScenePipeline(commandBuffer, pipeline);
+				layout = pipeline == ScenePipelineMesh && _meshShading ? _meshletPipelineLayout : _pipelineLayout;
+				break;
+			}
+
+			case Op::BindTexture:
+			{
+				uint32_t texture = args.Get<uint32_t>();
+				float scale = args.Get<float>();
+				_bindTexture(commandBuffer, texture == UINT32_MAX ? 0 : texture, scale, layout);
+				break;
+			}
+
+			case Op::BindMesh:
+				if ((args.Get<uint32_t>() != 0) != (_clusterCulling == ClusterCulling::Compute))
+					throw std::runtime_error("command stream: the recording's index stream doesn't match this renderer's cluster culling");
+				_bindMesh(commandBuffer);
+				break;
+
+			case Op::Push:
+			{
+				uint32_t pushOffset = args.Get<uint32_t>();
+				uint32_t size = args.Remaining();
+				if (pushOffset + size > sizeof(ClusterCullParams))
+					throw std::runtime_error("command stream: push constants past the 128 bytes every layout has");
+				_pushConstants(commandBuffer, layout, pushOffset, size, args.Bytes(size));
+				break;
+			}
+
+			case Op::Draw:
+			{
+				uint32_t vertexCount = args.Get<uint32_t>();
+				uint32_t instanceCount = args.Get<uint32_t>();
+				_draw(commandBuffer, vertexCount, instanceCount);
+				break;
+			}
+
+			case Op::DrawIndexed:
+			{
+				uint32_t indexCount = args.Get<uint32_t>();
+				uint32_t instanceCount = args.Get<uint32_t>();
+				uint32_t firstIndex = args.Get<uint32_t>();
+				_drawIndexed(commandBuffer, indexCount, instanceCount, firstIndex);
+				break;
+			}
+
+			case Op::DrawIndirect:
+			{
+				uint32_t drawCommand = args.Get<uint32_t>();
+				if (_clusterCulling != ClusterCulling::Compute || drawCommand >= _clusterDrawCount())
+					throw std::runtime_error("command stream: indirect draw " + std::to_string(drawCommand) + " without a culling command for it");
+				_drawIndirect(commandBuffer, drawCommand);
+				break;
+			}
+
+			case Op::DrawMeshTasks:
+				_drawMeshTasks(commandBuffer, args.Get<uint32_t>());
+				break;
+
+			default:
+				break;	// uploads are applied where the live renderer writes them, barriers are this renderer's own
+			}
+		}
+	}
+
+	// the recording's uploads to 'target' into 'destination', which holds 'size' bytes
+	void _replayUploads(uint32_t target, void* destination, size_t size)
+	{
+		size_t offset = 0;
+		CommandStream::Command command;
+		while (_replay->Next(offset, command))
+		{
+			if (command.op != CommandStream::Op::Upload)
+				continue;
+
+			CommandStream::Arguments args = command.Args();
+			uint32_t uploadTarget = args.Get<uint32_t>();
+			uint32_t uploadOffset = args.Get<uint32_t>();
+			uint64_t blob = args.Get<uint64_t>();
+			if (uploadTarget != target)
+				continue;
+
+			const std::vector<uint8_t>& data = _replay->GetBlob(blob);
+			if (uploadOffset > size || data.size() > size - uploadOffset)
+				throw std::runtime_error("command stream: upload past the end of its target");
+			memcpy(static_cast<uint8_t*>(destination) + uploadOffset, data.data(), data.size());
+		}
+	}
+
+	void _recordUpload(uint32_t target, const void* data, size_t size)
+	{
+		if (_recording)
+		{
+			_recording->Write(CommandStream::Op::Upload, CommandStream::Payload() << target << uint32_t(0) << _recording->Blob(data, size));
+		}
+	}
+
+	// --record's frame is about to be drawn. its barriers go to the recording along with the scene's commands
+	void _beginRecording()
+	{
+		_recording = std::make_unique<CommandStream::Recording>();
+		_recording->frame = _sceneFrame;
+		_recording->meshShading = _meshShading;
+		_recording->device = DeviceName();
+		_recording->options = _recordOptions();
+		_barriers->SetRecorder(_recording.get());
+	}
+
+	void _finishRecording()
+	{
+		_barriers->SetRecorder(nullptr);
+		_recording->renderScale = _renderScale;
+		CommandStream::Save(_config.recordPath, *_recording);
+
+		std::vector<uint64_t> counts = _recording->CountOps();
+		std::cout << "record: frame " << _recording->frame << " to " << _config.recordPath << ", " << _recording->commands.size() << " bytes of commands (";
+		const char* separator = "";
+		for (size_t op = 0; op < size_t(CommandStream::Op::Count); op++)
+		{
+			if (counts[op] > 0)
+			{
+				std::cout << separator << counts[op] << " " << CommandStream::OpName(CommandStream::Op(op));
+				separator = ", ";
+			}
+		}
+		std::cout << "), " << _recording->blobs.size() << " blobs, " << _recording->BlobBytes() / 1024.0 << " KB" << std::endl;
+		_recording.reset();
+	}
+
+	// the options the recorded frame was drawn with, as this device resolved them, so a replay elsewhere draws the
+	// same passes. the files they name go in as blobs
+	std::vector<std::string> _recordOptions()
+	{
+		auto onOff = [](bool on) { return std::string(on ? "on" : "off"); };
+		auto file = [this](const std::string& path)
+		{
+			std::vector<uint8_t> bytes = ImageIO::ReadFile(path);
+			return "@" + CommandStream::HashName(_recording->Blob(bytes.data(), bytes.size()));
+		};
+
+		std::vector<std::string> options = {
+			"--size=" + std::to_string(_swapChainExtent.width) + "x" + std::to_string(_swapChainExtent.height),
+			std::string("--scene=") + SceneName(_config.scene),
+			std::string("--rendering=") + (_dynamicRendering ? "dynamic" : "render-pass"),
+			"--draw-sort=" + onOff(_config.drawSort),
+			"--lights=" + std::to_string(_config.lightCount),
+			"--async-compute=" + onOff(_asyncCompute),
+			"--texture-compression=" + onOff(_config.textureCompression),
+		};
+		for (const std::string& path : _config.texturePaths)
+		{
+			options.push_back("--texture=" + file(path));
+		}
+		if (_dynamicResolution)
+		{
+			options.push_back("--target-frame-ms=" + std::to_string(_config.targetFrameMs));
+			options.push_back("--min-render-scale=" + std::to_string(_config.minRenderScale));
+		}
+		if (_config.scene == Scene::Mesh)
+		{
+			options.push_back("--mesh=" + file(_config.meshPath));
+			options.push_back(std::string("--cluster-culling=") + (_meshShading ? "auto" : _clusterCulling == ClusterCulling::Compute ? "compute" : "off"));
+			options.push_back("--occlusion-culling=" + onOff(_occlusionCulling));
+			options.push_back("--mesh-instances=" + std::to_string(_config.meshInstances));
+			options.push_back("--lod-error=" + std::to_string(_config.lodErrorPixels));
+			options.push_back("--lod-hysteresis=" + std::to_string(_config.lodHysteresis));
+			options.push_back("--views=" + std::to_string(_viewCount));
+			options.push_back(std::string("--view-mode=") + (_multiview ? "multiview" : "viewports"));
+			options.push_back("--shadowed-lights=" + std::to_string(_config.shadowedLights));
+			options.push_back("--dynamic-instances=" + std::to_string(_config.dynamicInstances));
+			options.push_back("--shadow-cache=" + onOff(_config.shadowCache));
+		}
+		return options;
+	}
+
+	// the replayed frames next to the recorded one: GPU time here, and the barriers this build derives for the
+	// frame against the ones recorded. only the scene draws and uploads are the recording's, the culling, light
+	// binning and shadows are this build's, from the recorded options
+	void _reportReplay()
+	{
+		const GpuProfiler::ScopeStats* frame = _gpuProfiler->Find("frame");
+		const BarrierBatch::Stats& stats = _barriers->GetStats();
+		double barriers = _frameIndex > 0 ? double(stats.imageBarriers + stats.bufferBarriers + stats.memoryBarriers) / double(_frameIndex) : 0.0;
+
+		std::cout << "replay: scene draws and uploads of scene frame " << _replay->frame << " recorded on " << _replay->device
+			<< " (culling, light binning and shadows rebuilt from its options), GPU frame avg ";
+		if (frame != nullptr)
+			std::cout << frame->AverageMs() << " ms";
+		else
+			std::cout << "unavailable";
+		std::cout << ", barriers per frame " << _replay->CountOps()[size_t(CommandStream::Op::Barrier)] << " recorded, " << barriers << " replayed" << std::endl;
+	}
+
+	// records input-to-present latency for presents that reached the display. with 'bound' set,
+	// blocks until at most maxQueuedPresents are outstanding so the next input sample is as late as possible
+	void _collectPresentLatency(bool bound)
+	{
+		if (!_presentWaitEnabled)
+			return;
+
+		const uint64_t boundTimeout = 100 * 1000 * 1000; // never hang on a surface that stopped presenting
+
+		while (!_pendingPresents.empty())
+		{
+			bool mustWait = bound && _pendingPresents.size() > _config.maxQueuedPresents;
+			const PendingPresent& pending = _pendingPresents.front();
+
+			VkResult result = _vkWaitForPresentKHR(_device, _swapChain, pending.id, mustWait ? boundTimeout : 0);
+			if (result == VK_TIMEOUT && !mustWait)
+				break;
+
+			if (result == VK_SUCCESS)
+			{
+				_latencyStats.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pending.inputTime).count());
+			}
+			else if (result != VK_TIMEOUT)
+			{
+				// out of date / surface lost, the swapchain is about to be recreated
+				_pendingPresents.clear();
+				break;
+			}
+			_pendingPresents.pop_front();
+		}
+	}
+
+	void _mainLoop()
+	{
+		_frameLimiter.SetRate(_config.EffectiveFrameRateLimit());
+
+		if (_dispatcher != nullptr)
+		{
+			std::cout << "device group: " << SceneName(_config.scene) << " " << _swapChainExtent.width << "x" << _swapChainExtent.height
+				<< " on " << DeviceName() << std::endl;
+		}
+		else if (_config.headless)
+		{
+			std::cout << "headless: " << SceneName(_config.scene) << " " << _swapChainExtent.width << "x" << _swapChainExtent.height
+				<< " on " << DeviceName() << ", " << _config.frameCount << " frames" << std::endl;
+		}
+		else
+		{
+			std::cout << "present policy: " << PresentPolicyName(_config.presentPolicy)
+				<< ", " << _swapChainImages.size() << " swapchain images, "
+				<< _framesInFlight << " frame(s) in flight, present wait "
+				<< (_presentWaitEnabled ? "on" : "unavailable") << std::endl;
+		}
+		std::cout << "rendering: " << (_dynamicRendering ? "dynamic rendering" : "render passes") << std::endl;
+		if (_config.lightCount > 0)
+		{
+			std::cout << "light binning: " << (_asyncCompute ? "async compute queue" : "graphics queue") << std::endl;
+		}
+
+		_frameTimesMs.reserve(size_t(_config.frameCount));
+		auto frameBegin = std::chrono::steady_clock::now();
+
+		while (!_shouldStop())
+		{
+			_frameLimiter.Wait();
+			_collectPresentLatency(_config.presentPolicy == PresentPolicy::LowLatency);
+
+			if (!_config.headless)
+			{
+				glfwPollEvents();
+			}
+			_inputTimestamp = std::chrono::steady_clock::now();
+
+			if (_dispatcher != nullptr && !_takeBatchFrame())
+				break;
+
+			_drawFrame();
+
+			// loop-to-loop wall time; with frames in flight this settles at the GPU's frame time
+			auto frameEnd = std::chrono::steady_clock::now();
+			_frameTimesMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameBegin).count());
+			frameBegin = frameEnd;
+
+			if (!_firstFrameReported)
+			{
+				_startupTrace.MarkFirstFrame();
+				_startupTrace.Report(std::cout);
+				_firstFrameReported = true;
+			}
+		}
+
+		vkDeviceWaitIdle(_device);
+
+		if (!_config.headless)
+		{
+			_latencyStats.Report(std::cout, _presentWaitEnabled ? "present wait" : "queue present");
+		}
+	}
+
+	// the next of the group's frames. a full reorder window waits for an earlier frame, which may be one of ours
+	// still in flight, so those are read back and delivered before blocking
+	bool _takeBatchFrame()
+	{
+		BatchDispatcher::Result result = _dispatcher->TryTake(_sceneFrame);
+		if (result == BatchDispatcher::Result::Wait)
+		{
+			vkDeviceWaitIdle(_device);
+			for (CaptureSlot& slot : _captureSlots)
+			{
+				_collectCapture(slot);
+			}
+			return _dispatcher->Take(_sceneFrame);
+		}
+		return result == BatchDispatcher::Result::Frame;
+	}
+
+	bool _shouldStop()
+	{
+		if (_dispatcher != nullptr)
+			return false;	// the dispatcher runs out of frames instead
+		if (_exportRing && _exportRing->ConsumerGone())
+			return true;
+		if (_config.frameCount > 0 && _frameIndex >= _config.frameCount)
+			return true;
+		return !_config.headless && glfwWindowShouldClose(_window);
+	}
+
+	void _cleanupSwapChain()
+	{
+		_destroyCaptureSlots();
+
+		for (auto framebuffer : _swapChainFrameBuffers)
+		{
+			vkDestroyFramebuffer(_device, framebuffer, nullptr);
+		}
+
+		vkFreeCommandBuffers(_device, _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
+		if (!_earlyCommandBuffers.empty())
+		{
+			vkFreeCommandBuffers(_device, _commandPool, static_cast<uint32_t>(_earlyCommandBuffers.size()), _earlyCommandBuffers.data());
+			_earlyCommandBuffers.clear();
+		}
+
+		if (!_dynamicRendering)
+		{
+			_destroyPipelines();
+		}
+
+		_destroyDepthTargets();
+		_destroyLightClusters();
+
+		for (auto imageView : _swapChainImageViews)
+		{
+			vkDestroyImageView(_device, imageView, nullptr);
+		}
+
+		if (_config.headless)
+		{
+			for (size_t i = 0; i < _swapChainImages.size(); i++)
+			{
+				vkDestroyImage(_device, _swapChainImages[i], nullptr);
+				_memoryTelemetry->Free(_offscreenMemory[i]);
+			}
+			_swapChainImages.clear();
+			_offscreenMemory.clear();
+		}
+		else
+		{
+			vkDestroySwapchainKHR(_device, _swapChain, nullptr);
+		}
+	}
+
+	void _destroyPipelines()
+	{
+		vkDestroyPipeline(_device, _graphicsPipeline, nullptr);
+		for (VkPipeline pipeline : _scenePipelines)
+		{
+			vkDestroyPipeline(_device, pipeline, nullptr);
+		}
+		_scenePipelines.clear();
+		vkDestroyPipeline(_device, _meshPipeline, nullptr);
+		_meshPipeline = VK_NULL_HANDLE;
+		vkDestroyPipelineLayout(_device, _meshletPipelineLayout, nullptr);
+		_meshletPipelineLayout = VK_NULL_HANDLE;
+
+		vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+
+		vkDestroyRenderPass(_device, _renderPass, nullptr);
+		vkDestroyRenderPass(_device, _lateRenderPass, nullptr);
+		_lateRenderPass = VK_NULL_HANDLE;
+	}
+
+	void _cleanup()
+	{
+		vkDestroyShaderModule(_device, _shaderModuleVS, nullptr);
+		vkDestroyShaderModule(_device, _shaderModulePS, nullptr);
+		vkDestroyShaderModule(_device, _meshShaderModuleVS, nullptr);
+		vkDestroyShaderModule(_device, _meshShaderModulePS, nullptr);
+		vkDestroyShaderModule(_device, _meshletShaderModuleTS, nullptr);
+		vkDestroyShaderModule(_device, _meshletShaderModuleMS, nullptr);
+
+		_destroyExportRing();
+		_cleanupSwapChain();
+		if (_dynamicRendering)
+		{
+			_destroyPipelines();	// kept across swapchain rebuilds
+		}
+
+		_reportClusterCulling();
+		if (_dynamicResolution)
+		{
+			if (!_gpuProfiler->Enabled())
+			{
+				std::cout << "dynamic resolution: no timestamps on the graphics queue, drawn at full scale" << std::endl;
+			}
+			_dynamicResolution->Report(std::cout);
+			_dynamicResolution.reset();
+		}
+		if (_viewCount > 1)
+		{
+			VkExtent2D extent = _viewRect(0).extent;
+			std::cout << "split-screen views: " << _viewCount << " in one pass, " << (_multiview ? "multiview layers copied to " : "viewports on ") << extent.width
+				<< "x" << extent.height << " tiles, each culled against its own frustum and drawn from its own commands" << std::endl;
+		}
+		_destroyClusterCulling();
+		_destroyShadows();
+		_destroyLights();
+
+		if (_replay != nullptr)
+		{
+			_reportReplay();
+		}
+		else if (!_config.recordPath.empty() && _frameIndex <= _config.recordFrame)
+		{
+			std::cout << "record: the run ended before frame " << _config.recordFrame << ", nothing recorded" << std::endl;
+		}
+		_gpuProfiler->Report(std::cout);
+		_gpuProfiler.reset();
+		_destroyAsyncCompute();
+		_barriers->Report(std::cout);
+		_barriers.reset();
+		_drawQueue.Report(std::cout);
+		if (_sceneBatches)
+		{
+			_sceneBatches->Report(std::cout);
+			_sceneBatches.reset();
+		}
+		_destroyBuffer(_meshVertices);
+		_destroyBuffer(_meshIndices);
+
+		_textureStreamer->Report(std::cout);
+		_textureStreamer.reset();
+
+		if (_frameEncoder)
+		{
+			_frameEncoder->Close();
+
+			FrameEncoder::Stats stats = _frameEncoder->GetStats();
+			std::cout << "capture: " << stats.encoded << " frames encoded, " << stats.dropped << " dropped, max queue depth "
+				<< stats.maxQueueDepth << ", render loop blocked " << stats.blockedMs << " ms" << std::endl;
+			_frameEncoder.reset();
+		}
+
+		for (size_t i = 0; i < _framesInFlight; i++)
+		{
+			vkDestroySemaphore(_device, _imageAvailableSemaphores[i], nullptr);
+			vkDestroySemaphore(_device, _renderFinishedSemaphores[i], nullptr);
+			vkDestroyFence(_device, _inFlightFences[i], nullptr);
+		}
+
+		vkDestroyCommandPool(_device, _commandPool, nullptr);
+
+		// everything the renderer allocated is freed by now, live allocations in the report leaked
+		_transientAttachments->Report(std::cout);
+		_transientAttachments.reset();
+		_memoryTelemetry->Report(std::cout);
+		if (!_config.memoryDumpPath.empty())
+		{
+			_memoryTelemetry->DumpJson(_config.memoryDumpPath);
+		}
+		_memoryTelemetry.reset();
+
+		vkDestroyDevice(_device, nullptr);
+
+		if (debugMessenger != VK_NULL_HANDLE)
+		{
+			DestroyDebugUtilsMessengerEXT(_instance, debugMessenger, nullptr);
 		}
 
 		vkDestroySurfaceKHR(_instance, _surface, nullptr);
 
 		vkDestroyInstance(_instance, nullptr);
 
-		glfwDestroyWindow(_window);
+		if (_debugUtils)
+		{
+			_debugUtils->Report(std::cout);
+			if (!_config.debugDumpPath.empty())
+			{
+				_debugUtils->DumpJson(_config.debugDumpPath);
+			}
+		}
+
+		if (!_config.headless)
+		{
+			glfwDestroyWindow(_window);
 
-		glfwTerminate();
+			glfwTerminate();
+		}
 	}
 };
 
-int main()
+// renders every canonical scene headless and compares the last frame against <dir>/<scene>.png and the
+// median GPU frame time against <dir>/<scene>.frametime. a scene without a golden image fails, failures
+// leave the actual and diff images in <dir>/out.
+// a box without a GPU runs this on lavapipe or SwiftShader, e.g. VK_ICD_FILENAMES=.../lvp_icd.x86_64.json. the
+// Linux build runs it as ctest's golden test against goldens/, see CMakeLists.txt
+static int runGoldenTests(const RendererConfig& baseConfig)
+{
+	const Scene scenes[] = { Scene::Triangle, Scene::Instancing, Scene::ManyPipelines };
+	const std::string directory = baseConfig.goldenDirectory;
+	const std::string outDirectory = directory + "/out";
+
+	int failures = 0;
+	for (Scene scene : scenes)
+	{
+		RendererConfig config = baseConfig;
+		config.headless = true;
+		config.scene = scene;
+		config.preferSoftwareDevice = true;
+		config.frameRateLimit = 0.0;
+		config.captureFormat = CaptureFormat::None;
+		config.captureToMemory = true;
+
+		// warm-up, measured frames, then one extra frame that is read back so readback doesn't skew the timing
+		uint64_t measuredEnd = uint64_t(config.goldenWarmupFrames) + config.goldenMeasuredFrames;
+		config.frameCount = measuredEnd + 1;
+		config.captureStartFrame = measuredEnd;
+		config.captureFrames = 1;
+
+		VKRenderer renderer(config);
+		renderer.Run();
+
+		// GPU time of the measured frames the profiler collected, the loop's wall time without timestamps
+		std::vector<double> measured;
+		const std::vector<double>& gpuFrameTimes = renderer.GpuFrameTimesMs();
+		for (size_t i = config.goldenWarmupFrames; i < std::min<size_t>(size_t(measuredEnd), gpuFrameTimes.size()); i++)
+		{
+			if (gpuFrameTimes[i] >= 0.0)
+			{
+				measured.push_back(gpuFrameTimes[i]);
+			}
+		}
+		bool gpuTime = !measured.empty();
+		if (!gpuTime)
+		{
+			const std::vector<double>& frameTimes = renderer.FrameTimesMs();
+			measured.assign(frameTimes.begin() + config.goldenWarmupFrames, frameTimes.begin() + measuredEnd);
+		}
+		double frameMs = GoldenImage::Median(measured);
+		const char* timeSource = gpuTime ? " ms/frame GPU" : " ms/frame CPU";
+		const CapturedFrame& frame = renderer.LastCapturedFrame();
+
+		std::string name = SceneName(scene);
+		std::string goldenPath = directory + "/" + name + ".png";
+		std::string baselinePath = directory + "/" + name + ".frametime";
+
+		if (config.goldenUpdate)
+		{
+			std::filesystem::create_directories(directory);
+			std::vector<uint8_t> png = ImageIO::EncodePng(frame.pixels.data(), frame.width, frame.height);
+			ImageIO::WriteFile(goldenPath, png.data(), png.size());
+			GoldenImage::WriteBaseline(baselinePath, frameMs);
+			std::cout << "golden " << name << ": updated, " << frameMs << timeSource << " on " << renderer.DeviceName() << std::endl;
+			continue;
+		}
+
+		// a scene without a golden checks nothing, that fails until --golden-update writes one
+		std::string failure;
+		if (!std::filesystem::exists(goldenPath))
+		{
+			failure = "no golden image at " + goldenPath + ", --golden-update writes it";
+		}
+		else
+		{
+			uint32_t goldenWidth = 0, goldenHeight = 0;
+			std::vector<uint8_t> golden = ImageIO::DecodePng(ImageIO::ReadFile(goldenPath), goldenWidth, goldenHeight);
+			if (goldenWidth != frame.width || goldenHeight != frame.height)
+			{
+				failure = "size " + std::to_string(frame.width) + "x" + std::to_string(frame.height) +
+					" differs from golden " + std::to_string(goldenWidth) + "x" + std::to_string(goldenHeight);
+			}
+			else
+			{
+				GoldenImage::CompareResult result = GoldenImage::Compare(golden, frame.pixels, frame.width, frame.height, config.goldenPixelThreshold);
+				if (result.MismatchFraction() > config.goldenMaxMismatch)
+				{
+					failure = std::to_string(result.mismatchedPixels) + " pixels differ (max delta " + std::to_string(result.maxDelta) + ")";
+
+					std::filesystem::create_directories(outDirectory);
+					std::vector<uint8_t> actualPng = ImageIO::EncodePng(frame.pixels.data(), frame.width, frame.height);
+					std::vector<uint8_t> diffPng = ImageIO::EncodePng(result.diff.data(), frame.width, frame.height);
+					ImageIO::WriteFile(outDirectory + "/" + name + ".actual.png", actualPng.data(), actualPng.size());
+					ImageIO::WriteFile(outDirectory + "/" + name + ".diff.png", diffPng.data(), diffPng.size());
+				}
+			}
+		}
+
+		double baselineMs = 0.0;
+		bool haveBaseline = GoldenImage::ReadBaseline(baselinePath, baselineMs);
+		if (failure.empty() && haveBaseline && frameMs > baselineMs * (1.0 + config.goldenTimeTolerance))
+		{
+			failure = "frame time " + std::to_string(frameMs) + " ms over baseline " + std::to_string(baselineMs) + " ms";
+		}
+
+		std::cout << "golden " << name << ": " << (failure.empty() ? "PASS" : "FAIL " + failure) << ", " << frameMs << timeSource;
+		if (haveBaseline)
+		{
+			std::cout << " (baseline " << baselineMs << " ms)";
+		}
+		std::cout << " on " << renderer.DeviceName() << std::endl;
+
+		if (!failure.empty())
+		{
+			failures++;
+		}
+	}
+
+	if (failures > 0)
+	{
+		std::cout << "golden: " << failures << " of " << std::size(scenes) << " scenes failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+// names of the devices the loader reports, in vkEnumeratePhysicalDevices order
+static std::vector<std::string> enumerateDevices()
+{
+	VkApplicationInfo appInfo = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
+	appInfo.apiVersion = VK_API_VERSION_1_0;
+
+	VkInstanceCreateInfo createInfo = { VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+	createInfo.pApplicationInfo = &appInfo;
+
+	VkInstance instance = VK_NULL_HANDLE;
+	if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create instance!");
+	}
+
+	uint32_t deviceCount = 0;
+	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+	std::vector<VkPhysicalDevice> devices(deviceCount);
+	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+	std::vector<std::string> names;
+	for (VkPhysicalDevice device : devices)
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+		names.push_back(properties.deviceName);
+	}
+
+	vkDestroyInstance(instance, nullptr);
+	return names;
+}
+
+// one headless job on a group of devices: a renderer with its own instance and logical device per physical
+// device, each on its own thread, taking frames from a shared dispatcher. software ICDs take part like any GPU
+static int runDeviceGroup(const RendererConfig& baseConfig)
+{
+	std::vector<std::string> names = enumerateDevices();
+	std::vector<uint32_t> devices = baseConfig.deviceGroupDevices;
+	if (devices.empty())
+	{
+		for (uint32_t i = 0; i < names.size(); i++)
+		{
+			devices.push_back(i);
+		}
+	}
+	if (devices.empty())
+	{
+		throw std::runtime_error("Failed to find GPUs with Vulkan support!");
+	}
+	for (uint32_t device : devices)
+	{
+		if (device >= names.size())
+		{
+			throw std::runtime_error("--device-group names device " + std::to_string(device) + " but there are " + std::to_string(names.size()) + " devices");
+		}
+	}
+
+	std::unique_ptr<FrameEncoder> encoder;
+	if (baseConfig.captureFormat != CaptureFormat::None)
+	{
+		double frameRate = baseConfig.EffectiveFrameRateLimit() > 0.0 ? baseConfig.EffectiveFrameRateLimit() : 60.0;
+		encoder = std::make_unique<FrameEncoder>(baseConfig.captureFormat, baseConfig.capturePath, baseConfig.captureQueueDepth, frameRate);
+	}
+
+	// an encoder queue's worth of frames per device may wait for a late one before the devices stall
+	BatchDispatcher dispatcher(baseConfig.frameCount, baseConfig.captureStartFrame, baseConfig.captureFrames, encoder.get(),
+		baseConfig.captureDropWhenFull, size_t(baseConfig.captureQueueDepth) * devices.size());
+
+	std::mutex errorMutex;
+	std::string error;
+	std::vector<std::thread> threads;
+	for (uint32_t device : devices)
+	{
+		threads.emplace_back([&, device]()
+		{
+			RendererConfig config = baseConfig;
+			config.deviceIndex = int32_t(device);
+			try
+			{
+				VKRenderer renderer(config);
+				renderer.SetDispatcher(&dispatcher);
+				renderer.Run();
+
+				const std::vector<double>& frameTimes = renderer.FrameTimesMs();
+				dispatcher.AddDevice({ renderer.DeviceName(), renderer.FramesRendered(), std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) });
+			}
+			catch (const std::exception& e)
+			{
+				dispatcher.Abort();
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (error.empty())
+				{
+					error = names[device] + ": " + e.what();
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	if (encoder)
+	{
+		encoder->Close();
+
+		FrameEncoder::Stats stats = encoder->GetStats();
+		std::cout << "capture: " << stats.encoded << " frames encoded, " << stats.dropped << " dropped, max queue depth "
+			<< stats.maxQueueDepth << ", render loops blocked " << stats.blockedMs << " ms" << std::endl;
+	}
+	if (!error.empty())
+	{
+		throw std::runtime_error(error);
+	}
+
+	dispatcher.Report(std::cout);
+	return EXIT_SUCCESS;
+}
+
+// a --record'ed frame, headless: the recording's options with the files they name extracted next to it, and the
+// scene's commands from the stream, drawn 'replayLoops' times. the replayer is this executable rather than a tool
+// of its own so it draws with exactly the passes a live run does
+static int runReplay(const RendererConfig& baseConfig)
+{
+	CommandStream::Recording recording = CommandStream::Load(baseConfig.replayPath);
+
+	std::string blobDirectory = baseConfig.replayPath + ".blobs";
+	std::filesystem::create_directories(blobDirectory);
+	std::vector<std::string> arguments = { "VKRenderer" };
+	for (const std::string& option : recording.options)
+	{
+		size_t at = option.find("=@");
+		if (at == std::string::npos)
+		{
+			arguments.push_back(option);
+			continue;
+		}
+
+		uint64_t hash = std::stoull(option.substr(at + 2), nullptr, 16);
+		std::string path = blobDirectory + "/" + CommandStream::HashName(hash);
+		if (!std::filesystem::exists(path))
+		{
+			const std::vector<uint8_t>& blob = recording.GetBlob(hash);
+			ImageIO::WriteFile(path, blob.data(), blob.size());
+		}
+		arguments.push_back(option.substr(0, at + 1) + path);
+	}
+
+	std::vector<char*> argv;
+	for (std::string& argument : arguments)
+	{
+		argv.push_back(&argument[0]);
+	}
+	RendererConfig config = RendererConfig::FromCommandLine(int(argv.size()), argv.data());
+	config.headless = true;
+	config.frameCount = baseConfig.replayLoops;
+	config.frameRateLimit = 0.0;
+	config.deviceIndex = baseConfig.deviceIndex;
+	config.preferSoftwareDevice = baseConfig.preferSoftwareDevice;
+
+	std::cout << "replay: " << baseConfig.replayPath << ", " << recording.commands.size() << " bytes of commands, " << recording.blobs.size()
+		<< " blobs, " << baseConfig.replayLoops << " loops" << std::endl;
+
+	VKRenderer renderer(config);
+	renderer.SetReplay(&recording);
+	renderer.Run();
+
+	const std::vector<double>& frameTimes = renderer.FrameTimesMs();
+	std::cout << "replay: CPU frame median " << GoldenImage::Median(frameTimes) << " ms, min " << *std::min_element(frameTimes.begin(), frameTimes.end())
+		<< " ms, max " << *std::max_element(frameTimes.begin(), frameTimes.end()) << " ms over " << frameTimes.size() << " frames on " << renderer.DeviceName() << std::endl;
+	return EXIT_SUCCESS;
+}
+
+// the compositor's side of --export, to test the renderer's: reads frames from the ring until the renderer closes
+// it or --frames were read, checks they come in order and reports the latency from hand-over to read
+static int runExportConsumer(const RendererConfig& config)
+{
+	FrameExport::Consumer consumer(config.exportConsumeName, 10000);
+	size_t frameBytes = size_t(consumer.Width()) * consumer.Height() * 4;
+	std::cout << "export consumer: " << config.exportConsumeName << ", " << consumer.Width() << "x" << consumer.Height() << ", "
+		<< consumer.SlotCount() << " slots" << std::endl;
+
+	uint64_t frames = 0, skipped = 0, outOfOrder = 0, lastIndex = 0, checksum = 0;
+	double latencySum = 0.0, latencyMax = 0.0;
+	FrameExport::Consumer::Frame frame;
+	while ((config.frameCount == 0 || frames < config.frameCount) && consumer.Acquire(frame, 5000))
+	{
+		if (frames > 0 && frame.index <= lastIndex)
+			outOfOrder++;
+		else if (frames > 0)
+			skipped += frame.index - lastIndex - 1;	// the renderer found no free slot for those
+		lastIndex = frame.index;
+
+		checksum ^= CommandStream::Hash(frame.pixels, frameBytes);
+		latencySum += frame.latencyMs;
+		latencyMax = std::max(latencyMax, frame.latencyMs);
+		frames++;
+		consumer.Release(frame);
+	}
+
+	if (frames == 0)
+	{
+		std::cerr << "export consumer: no frames arrived" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "export consumer: " << frames << " frames, " << skipped << " skipped by the renderer, " << outOfOrder << " out of order, latency avg "
+		<< latencySum / double(frames) << " ms, max " << latencyMax << " ms, checksum " << CommandStream::HashName(checksum) << std::endl;
+	return outOfOrder == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// OBJ -> .vkmesh: vertex cache, overdraw and vertex fetch ordering, quantization, LODs and meshlets. see MeshOptimizer.h
+static int runMeshOptimizer(const RendererConfig& config)
 {
-	VKRenderer app;
+	std::string outPath = config.meshOutPath;
+	if (outPath.empty())
+	{
+		outPath = std::filesystem::path(config.optimizeMeshPath).replace_extension(".vkmesh").string();
+	}
+
+	MeshOptimizer::SourceMesh source = MeshOptimizer::LoadObj(config.optimizeMeshPath);
+	MeshOptimizer::Report report;
+	MeshFormat::Mesh mesh = MeshOptimizer::Optimize(source, report);
+	MeshFormat::Write(outPath, mesh);
+
+	std::cout << "mesh: " << config.optimizeMeshPath << " -> " << outPath << ", " << report.vertexCount << " vertices, "
+		<< report.triangleCount << " triangles, " << mesh.header.indexSize * 8 << "-bit indices" << std::endl;
+	std::cout << "  ACMR (FIFO " << MeshOptimizer::AnalyzeCacheSize << "): " << report.before.acmr << " -> " << report.afterCache.acmr
+		<< " after vertex cache, " << report.afterOverdraw.acmr << " after overdraw ordering" << std::endl;
+	std::cout << "  ATVR: " << report.before.atvr << " -> " << report.afterOverdraw.atvr << std::endl;
+	std::cout << "  meshlets: " << report.meshletCount << ", " << report.trianglesPerMeshlet << " triangles and " << report.verticesPerMeshlet
+		<< " vertices on average, " << report.degenerateCones << " without a usable normal cone" << std::endl;
+	for (size_t l = 0; l < report.lodTriangles.size(); l++)
+	{
+		std::cout << "  LOD " << l << ": " << report.lodTriangles[l] << " triangles, error " << report.lodErrors[l] << std::endl;
+	}
+	std::cout << "  size: " << report.bytesBefore << " -> " << report.bytesAfter << " bytes ("
+		<< 100.0 * (1.0 - double(report.bytesAfter) / double(report.bytesBefore)) << "% saved), position step "
+		<< report.positionPrecision << std::endl;
+	return EXIT_SUCCESS;
+}
 
+int main(int argc, char** argv)
+{
 	try
 	{
+		RendererConfig config = RendererConfig::FromCommandLine(argc, argv);
+		if (!config.optimizeMeshPath.empty())
+		{
+			return runMeshOptimizer(config);
+		}
+		if (!config.goldenDirectory.empty())
+		{
+			return runGoldenTests(config);
+		}
+		if (config.deviceGroup)
+		{
+			return runDeviceGroup(config);
+		}
+		if (!config.replayPath.empty())
+		{
+			return runReplay(config);
+		}
+		if (!config.exportConsumeName.empty())
+		{
+			return runExportConsumer(config);
+		}
+
+		VKRenderer app(config);
 		app.Run();
 	}
 	catch (const std::exception & e)
@@ -0,0 +1,196 @@
+#version 450
+
+// one workgroup per meshlet slot of each instance's selected LOD and view (z): the first invocation tests the
+// bounds (and with occlusion culling, last frame's visibility or the depth pyramid), the whole group copies the surviving triangles into the instance's slice of the compacted
+// index stream for that view, which the vertex pipeline draws indirectly. the order clusters land in is whatever
+// order the atomics resolve in
+layout(local_size_x = 64) in;
+
+struct Meshlet
+{
+	uint vertexOffset;
+	uint triangleOffset;
+	uint vertexCount;
+	uint triangleCount;
+	vec4 sphere;	// center, radius
+	vec4 cone;		// axis, cutoff
+};
+
+struct Lod
+{
+	uint indexOffset;
+	uint indexCount;
+	uint meshletOffset;
+	uint meshletCount;
+	float error;
+	uint padding[3];
+};
+
+struct Instance
+{
+	vec2 offset;
+	float scale;
+	float padding;
+};
+
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+	uint visibleMeshlets;
+	uint lod;			// picked by lod_select.comp.glsl
+	uint occludedMeshlets;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(std430, set = 0, binding = 1) readonly buffer MeshletVertices { uint meshletVertices[]; };
+layout(std430, set = 0, binding = 2) readonly buffer MeshletTriangles { uint meshletTriangles[]; };
+layout(std430, set = 0, binding = 3) writeonly buffer Indices { uint indices[]; };
+layout(std430, set = 0, binding = 4) buffer DrawCommands { DrawCommand draws[]; };
+layout(std430, set = 0, binding = 6) readonly buffer Lods { Lod lods[]; };
+layout(std430, set = 0, binding = 7) readonly buffer Instances { Instance instances[]; };
+layout(set = 0, binding = 8) uniform sampler2D depthPyramid;
+layout(std430, set = 0, binding = 9) buffer Visibility { uint visibility[]; };	// per meshlet slot, last frame's result
+
+layout(push_constant) uniform CullParams
+{
+	vec3 viewDirection;
+	float aspect;
+	uint instanceCount;
+	uint lodCount;
+	uint maxMeshlets;
+	uint instance;
+	float viewportHeight;
+	float errorThreshold;
+	float hysteresis;
+	uint indexStride;
+	uint phase;			// CullPhase
+	uint viewCount;		// commands and index stream slices are per view, view-major
+	uint padding[2];
+	vec4 views[4];		// center xy, zoom z
+} cull;
+
+// CullPhase: the early phase draws what was visible last frame, the late phase what the depth
+// pyramid of those draws doesn't hide and wasn't drawn yet. without occlusion culling one phase does all
+const uint CullPhaseEarly = 0;
+const uint CullPhaseLate = 1;
+const uint CullPhaseAll = 2;
+
+shared bool visible;
+shared uint firstOutput;
+
+// orthographic, same transform as mesh.vert.glsl: clip space is offset + position * scale, depth 0.5 - z * 0.5.
+// split-screen views pan and zoom that, each against its own frustum. there is one depth pyramid and no
+// per-view visibility bits, which is why views turn occlusion culling off
+bool outsideFrustum(Meshlet meshlet, Instance instance, vec4 view)
+{
+	if (abs(meshlet.sphere.z) - meshlet.sphere.w > 1.0)
+		return true;
+
+	vec2 scale = instance.scale * vec2(cull.aspect, 1.0);
+	vec2 center = meshlet.sphere.xy * scale + instance.offset;
+	vec2 radius = meshlet.sphere.w * abs(scale);
+	return any(greaterThan((abs(center - view.xy) - radius) * view.z, vec2(1.0)));
+}
+
+// every triangle faces away once the view direction is inside the cone's complement
+bool backfacing(Meshlet meshlet)
+{
+	return dot(cull.viewDirection, meshlet.cone.xyz) >= meshlet.cone.w;
+}
+
+// the sphere's screen rectangle against the depth pyramid, at the first level where it spans at most
+// 2x2 texels. those texels hold the farthest depth under the rectangle, anything nearer than the
+// sphere's nearest point means every pixel it could cover is already in front of it
+bool occluded(Meshlet meshlet, Instance instance)
+{
+	vec2 scale = instance.scale * vec2(cull.aspect, 1.0);
+	vec2 center = meshlet.sphere.xy * scale + instance.offset;
+	vec2 radius = meshlet.sphere.w * abs(scale);
+
+	// the viewport is flipped, clip space y = 1 is the top row
+	vec2 uvMin = clamp(vec2(center.x - radius.x, -(center.y + radius.y)) * 0.5 + 0.5, 0.0, 1.0);
+	vec2 uvMax = clamp(vec2(center.x + radius.x, -(center.y - radius.y)) * 0.5 + 0.5, 0.0, 1.0);
+	float nearest = 0.5 - (meshlet.sphere.z + meshlet.sphere.w) * 0.5;
+
+	int levelCount = textureQueryLevels(depthPyramid);
+	int level = 0;
+	ivec2 size, first, last;
+	for (;;)
+	{
+		size = textureSize(depthPyramid, level);
+		first = min(ivec2(uvMin * vec2(size)), size - 1);
+		last = min(ivec2(uvMax * vec2(size)), size - 1);
+		if (all(lessThanEqual(last - first, ivec2(1))) || level == levelCount - 1)
+			break;
+		level++;
+	}
+
+	float farthest = texelFetch(depthPyramid, first, level).r;
+	farthest = max(farthest, texelFetch(depthPyramid, ivec2(last.x, first.y), level).r);
+	farthest = max(farthest, texelFetch(depthPyramid, ivec2(first.x, last.y), level).r);
+	farthest = max(farthest, texelFetch(depthPyramid, last, level).r);
+	return nearest > farthest;
+}
+
+void main()
+{
+	uint slot = gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+	uint instanceIndex = slot / cull.maxMeshlets;
+	if (instanceIndex >= cull.instanceCount)
+		return;
+
+	// the view's command for the instance, and its slice of the index stream
+	uint view = gl_WorkGroupID.z;
+	uint drawIndex = view * cull.instanceCount + instanceIndex;
+	Lod lod = lods[draws[drawIndex].lod];
+	uint meshletIndex = slot % cull.maxMeshlets;
+	if (meshletIndex >= lod.meshletCount)
+		return;
+
+	Meshlet meshlet = meshlets[lod.meshletOffset + meshletIndex];
+	if (gl_LocalInvocationIndex == 0)
+	{
+		bool passes = !outsideFrustum(meshlet, instances[instanceIndex], cull.views[view]) && !backfacing(meshlet);
+		uint command = drawIndex;
+		visible = passes;
+		if (cull.phase == CullPhaseEarly)
+		{
+			visible = passes && visibility[slot] != 0;
+		}
+		else if (cull.phase == CullPhaseLate)
+		{
+			// the late draws go after the early ones in the instance's slice of the index stream
+			command = cull.viewCount * cull.instanceCount + drawIndex;
+			draws[command].firstIndex = draws[drawIndex].firstIndex + draws[drawIndex].indexCount;
+
+			bool hidden = passes && occluded(meshlet, instances[instanceIndex]);
+			if (hidden)
+				atomicAdd(draws[command].occludedMeshlets, 1);
+			visible = passes && !hidden && visibility[slot] == 0;
+			visibility[slot] = passes && !hidden ? 1 : 0;
+		}
+
+		if (visible)
+		{
+			firstOutput = draws[command].firstIndex + atomicAdd(draws[command].indexCount, meshlet.triangleCount * 3);
+			atomicAdd(draws[command].visibleMeshlets, 1);
+		}
+	}
+	barrier();
+
+	if (!visible)
+		return;
+
+	for (uint triangle = gl_LocalInvocationIndex; triangle < meshlet.triangleCount; triangle += gl_WorkGroupSize.x)
+	{
+		uint packed = meshletTriangles[meshlet.triangleOffset + triangle];
+		uint target = firstOutput + triangle * 3;
+		indices[target + 0] = meshletVertices[meshlet.vertexOffset + (packed & 0xff)];
+		indices[target + 1] = meshletVertices[meshlet.vertexOffset + ((packed >> 8) & 0xff)];
+		indices[target + 2] = meshletVertices[meshlet.vertexOffset + ((packed >> 16) & 0xff)];
+	}
+}
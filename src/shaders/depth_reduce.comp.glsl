@@ -0,0 +1,38 @@
+#version 450
+
+// one level of the depth pyramid: each texel is the farthest depth of the source texels it covers.
+// sizes round down like any mip chain, so a texel can cover a third row or column of its source,
+// the footprint below takes every source texel the target texel overlaps
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D target;
+
+// the part of the source reduced, from its origin: the previous level, or for level 0 the render
+// area dynamic resolution drew, stretched over the whole pyramid
+layout(push_constant) uniform ReduceParams
+{
+	ivec2 sourceSize;
+} reduce;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 targetSize = imageSize(target);
+	if (any(greaterThanEqual(texel, targetSize)))
+		return;
+
+	ivec2 sourceSize = reduce.sourceSize;
+	ivec2 first = texel * sourceSize / targetSize;
+	ivec2 last = min(((texel + 1) * sourceSize + targetSize - 1) / targetSize, sourceSize) - 1;
+
+	float farthest = 0.0;
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+		{
+			farthest = max(farthest, texelFetch(source, ivec2(x, y), 0).r);
+		}
+	}
+	imageStore(target, texel, vec4(farthest));
+}
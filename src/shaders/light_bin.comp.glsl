@@ -0,0 +1,99 @@
+#version 450
+
+// clustered forward lighting, binning: one workgroup per froxel of the view volume, a screen tile by a
+// depth slice. the slices are spaced logarithmically between the near and far view distance, so they
+// stay roughly as deep as they are wide. every invocation tests a strided share of the lights against the
+// froxel's bounds, the survivors are gathered in shared memory and copied into one compact run of the
+// light index list, which the fragment shaders walk for the froxel they land in
+layout(local_size_x = 64) in;
+
+const uint MaxLightsPerCluster = 128;
+
+struct PointLight
+{
+	vec3 position;		// view space
+	float radius;
+	vec3 color;
+	int shadowView;		// into the shadow views, -1 when the light casts none
+};
+
+layout(std140, set = 0, binding = 0) uniform LightingParams
+{
+	uvec3 clusterCount;		// tiles x, tiles y, depth slices
+	uint lightCount;
+	vec2 viewportSize;
+	float nearDistance;		// view distance at depth 0
+	float farDistance;		// and at depth 1
+	uint tileSize;			// pixels
+} lighting;
+
+layout(std430, set = 0, binding = 1) readonly buffer Lights { PointLight lights[]; };
+layout(std430, set = 0, binding = 2) writeonly buffer Clusters { uvec2 clusters[]; };	// first index, count
+layout(std430, set = 0, binding = 3) buffer LightIndices
+{
+	uint lightIndexCount;	// reset to 0 before the pass
+	uint lightIndices[];
+};
+
+shared uint clusterLightCount;
+shared uint clusterLights[MaxLightsPerCluster];
+shared uint firstIndex;
+
+// view space is y-up with the viewer looking down -z, x scaled so a unit is as wide as it is tall.
+// pixel rows count down from clip space y = 1, the viewport is flipped
+vec2 viewPosition(vec2 pixel)
+{
+	vec2 ndc = vec2(pixel.x / lighting.viewportSize.x * 2.0 - 1.0, 1.0 - pixel.y / lighting.viewportSize.y * 2.0);
+	return vec2(ndc.x * lighting.viewportSize.x / lighting.viewportSize.y, ndc.y);
+}
+
+float sliceDistance(uint slice)
+{
+	return lighting.nearDistance * pow(lighting.farDistance / lighting.nearDistance, float(slice) / float(lighting.clusterCount.z));
+}
+
+void main()
+{
+	uvec3 cluster = gl_WorkGroupID;
+	uint clusterIndex = (cluster.z * lighting.clusterCount.y + cluster.y) * lighting.clusterCount.x + cluster.x;
+
+	// the froxel is a box in an orthographic view
+	vec2 pixelMin = vec2(cluster.xy * lighting.tileSize);
+	vec2 pixelMax = min(vec2((cluster.xy + 1) * lighting.tileSize), lighting.viewportSize);
+	vec2 corner0 = viewPosition(pixelMin);
+	vec2 corner1 = viewPosition(pixelMax);
+	vec3 boundsMin = vec3(min(corner0, corner1), -sliceDistance(cluster.z + 1));
+	vec3 boundsMax = vec3(max(corner0, corner1), -sliceDistance(cluster.z));
+
+	if (gl_LocalInvocationIndex == 0)
+		clusterLightCount = 0;
+	barrier();
+
+	for (uint i = gl_LocalInvocationIndex; i < lighting.lightCount; i += gl_WorkGroupSize.x)
+	{
+		PointLight light = lights[i];
+		vec3 closest = clamp(light.position, boundsMin, boundsMax);
+		vec3 offset = closest - light.position;
+		if (dot(offset, offset) <= light.radius * light.radius)
+		{
+			uint slot = atomicAdd(clusterLightCount, 1);
+			if (slot < MaxLightsPerCluster)
+				clusterLights[slot] = i;
+		}
+	}
+	barrier();
+
+	// a froxel past the limit drops the lights that came last, which ones that is depends on scheduling
+	uint count = min(clusterLightCount, MaxLightsPerCluster);
+	if (gl_LocalInvocationIndex == 0)
+	{
+		firstIndex = count > 0 ? atomicAdd(lightIndexCount, count) : 0;
+		clusters[clusterIndex] = uvec2(firstIndex, count);
+	}
+	barrier();
+
+	for (uint i = gl_LocalInvocationIndex; i < count; i += gl_WorkGroupSize.x)
+	{
+		lightIndices[firstIndex + i] = clusterLights[i];
+	}
+}
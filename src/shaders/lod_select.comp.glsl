@@ -0,0 +1,104 @@
+#version 450
+
+// one invocation per mesh instance: for each split-screen view, picks the coarsest LOD whose simplification
+// error stays under the pixel threshold at the instance's projected size in that view, and resets the
+// view's draw commands for the instance for the culling that follows. a band around the threshold keeps the previous pick, so an instance
+// sitting right at a switch distance doesn't flip LODs every frame
+layout(local_size_x = 64) in;
+
+// MeshFormat::Lod
+struct Lod
+{
+	uint indexOffset;
+	uint indexCount;
+	uint meshletOffset;
+	uint meshletCount;
+	float error;		// normalized object units
+	uint padding[3];
+};
+
+struct Instance
+{
+	vec2 offset;
+	float scale;		// object units to clip space
+	float padding;
+};
+
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+	uint visibleMeshlets;
+	uint lod;
+	uint occludedMeshlets;
+};
+
+layout(std430, set = 0, binding = 4) buffer DrawCommands { DrawCommand draws[]; };
+layout(std430, set = 0, binding = 6) readonly buffer Lods { Lod lods[]; };
+layout(std430, set = 0, binding = 7) readonly buffer Instances { Instance instances[]; };
+
+layout(push_constant) uniform CullParams
+{
+	vec3 viewDirection;
+	float aspect;
+	uint instanceCount;
+	uint lodCount;
+	uint maxMeshlets;
+	uint instance;
+	float viewportHeight;
+	float errorThreshold;
+	float hysteresis;
+	uint indexStride;
+	uint phase;			// CullPhase
+	uint viewCount;		// commands and index stream slices are per view, view-major
+	uint padding[2];
+	vec4 views[4];		// center xy, zoom z
+} cull;
+
+void main()
+{
+	uint instanceIndex = gl_GlobalInvocationID.x;
+	if (instanceIndex >= cull.instanceCount)
+		return;
+
+	for (uint view = 0; view < cull.viewCount; view++)
+	{
+		// clip space spans half the viewport per unit, times the view's zoom
+		float pixelsPerUnit = instances[instanceIndex].scale * cull.viewportHeight * 0.5 * cull.views[view].z;
+
+		// errors grow with the level, so both searches end at the last level under their bound
+		uint coarse = 0;
+		uint fine = 0;
+		for (uint lod = 1; lod < cull.lodCount; lod++)
+		{
+			float pixels = lods[lod].error * pixelsPerUnit;
+			if (pixels <= cull.errorThreshold * (1.0 - cull.hysteresis))
+				coarse = lod;
+			if (pixels <= cull.errorThreshold * (1.0 + cull.hysteresis))
+				fine = lod;
+		}
+
+		// a view's commands follow the previous view's, each with its own slice of the index stream
+		uint drawIndex = view * cull.instanceCount + instanceIndex;
+		DrawCommand draw;
+		draw.indexCount = 0;
+		draw.instanceCount = 1;
+		draw.firstIndex = drawIndex * cull.indexStride;
+		draw.vertexOffset = 0;
+		draw.firstInstance = 0;
+		draw.visibleMeshlets = 0;
+		draw.lod = clamp(draws[drawIndex].lod, coarse, fine);
+		draw.occludedMeshlets = 0;
+		draws[drawIndex] = draw;
+
+		// with occlusion culling the late phase draws from a second set of commands after every view's first
+		uint late = cull.viewCount * cull.instanceCount + drawIndex;
+		if (late < draws.length())
+		{
+			draws[late] = draw;
+		}
+	}
+}
@@ -0,0 +1,125 @@
+#version 450
+
+layout(location = 0)
+in vec2 uv;
+layout(location = 1)
+in vec3 normal;
+layout(location = 2)
+in vec3 scenePosition;	// clip space before any split-screen view's pan and zoom
+
+layout(location = 0)
+out vec4 outputColor;
+
+// streamed texture, 1x1 white when the draw has none
+layout(set = 0, binding = 0)
+uniform sampler2D albedo;
+
+// clustered lights, binned per froxel by light_bin.comp.glsl
+struct PointLight
+{
+	vec3 position;		// view space
+	float radius;
+	vec3 color;
+	int shadowView;		// into the shadow views, -1 when the light casts none
+};
+
+layout(std140, set = 1, binding = 0) uniform LightingParams
+{
+	uvec3 clusterCount;
+	uint lightCount;		// 0 turns the clustered lights off, the froxels aren't binned then
+	vec2 viewportSize;
+	float nearDistance;
+	float farDistance;
+	uint tileSize;
+} lighting;
+
+layout(std430, set = 1, binding = 1) readonly buffer Lights { PointLight lights[]; };
+layout(std430, set = 1, binding = 2) readonly buffer Clusters { uvec2 clusters[]; };
+layout(std430, set = 1, binding = 3) readonly buffer LightIndices
+{
+	uint lightIndexCount;
+	uint lightIndices[];
+};
+
+// shadow views: the directional light's cascades first, then the shadowed point lights' tiles
+const uint CascadeCount = 3;
+
+struct ShadowView
+{
+	mat4 shadowMatrix;		// view space to the view's clip space
+	vec4 tile;				// atlas uv offset and size
+	float splitDistance;	// cascades: the farthest view distance they cover
+};
+
+layout(std430, set = 1, binding = 4) readonly buffer ShadowViews { ShadowView shadowViews[]; };
+layout(set = 1, binding = 5) uniform sampler2DShadow shadowAtlas;
+
+// 1 lit, 0 in shadow. outside the view's frustum nothing casts
+float shadowFactor(uint view, vec3 position)
+{
+	vec4 clip = shadowViews[view].shadowMatrix * vec4(position, 1.0);
+	vec3 ndc = clip.xyz / clip.w;
+	if (clip.w <= 0.0 || any(greaterThan(abs(ndc.xy), vec2(1.0))) || ndc.z > 1.0)
+		return 1.0;
+
+	// clamped half a texel inside the tile, the filter mustn't reach a neighbour's texels
+	vec4 tile = shadowViews[view].tile;
+	vec2 halfTexel = 0.5 / vec2(textureSize(shadowAtlas, 0));
+	vec2 uv = clamp(tile.xy + (ndc.xy * 0.5 + 0.5) * tile.zw, tile.xy + halfTexel, tile.xy + tile.zw - halfTexel);
+	return texture(shadowAtlas, vec3(uv, ndc.z));
+}
+
+// the fragment's view space position, see light_bin.comp.glsl. taken from the scene position rather than
+// gl_FragCoord, so a zoomed view shades what it shows the way the full view would
+vec3 viewPosition()
+{
+	vec2 ndc = scenePosition.xy;
+	float viewDistance = mix(lighting.nearDistance, lighting.farDistance, scenePosition.z);
+	return vec3(ndc.x * lighting.viewportSize.x / lighting.viewportSize.y, ndc.y, -viewDistance);
+}
+
+// what the lights of the fragment's froxel add, for a view space normal
+vec3 clusteredLighting(vec3 position, vec3 normal)
+{
+	float viewDistance = -position.z;
+	vec2 pixel = vec2(scenePosition.x * 0.5 + 0.5, 0.5 - scenePosition.y * 0.5) * lighting.viewportSize;
+	uvec2 tile = min(uvec2(pixel) / lighting.tileSize, lighting.clusterCount.xy - 1);
+	float sliceScale = float(lighting.clusterCount.z) / log(lighting.farDistance / lighting.nearDistance);
+	uint slice = min(uint(log(viewDistance / lighting.nearDistance) * sliceScale), lighting.clusterCount.z - 1);
+	uvec2 cluster = clusters[(slice * lighting.clusterCount.y + tile.y) * lighting.clusterCount.x + tile.x];
+
+	vec3 result = vec3(0.0);
+	for (uint i = 0; i < cluster.y; i++)
+	{
+		PointLight light = lights[lightIndices[cluster.x + i]];
+		vec3 toLight = light.position - position;
+		float lightDistance = length(toLight);
+		float falloff = clamp(1.0 - (lightDistance * lightDistance) / (light.radius * light.radius), 0.0, 1.0);
+		float lit = falloff * falloff * max(dot(normal, toLight / max(lightDistance, 1e-4)), 0.0);
+		if (light.shadowView >= 0 && lit > 0.0)
+			lit *= shadowFactor(uint(light.shadowView), position);
+		result += light.color * lit;
+	}
+	return result;
+}
+
+const vec3 lightDirection = normalize(vec3(0.4, 0.6, 0.7));
+
+void main()
+{
+	vec3 n = normalize(normal);
+	vec3 position = viewPosition();
+
+	// the first cascade that reaches the fragment's distance
+	uint cascade = 0;
+	while (cascade < CascadeCount - 1 && -position.z > shadowViews[cascade].splitDistance)
+		cascade++;
+	float diffuse = max(dot(n, lightDirection), 0.0);
+	if (diffuse > 0.0)
+		diffuse *= shadowFactor(cascade, position);
+
+	vec3 light = vec3(0.15 + 0.85 * diffuse);
+	if (lighting.lightCount > 0)
+		light += clusteredLighting(position, n);
+	outputColor = vec4(light, 1.0) * texture(albedo, uv);
+}
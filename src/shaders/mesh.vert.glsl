@@ -0,0 +1,42 @@
+#version 450
+#extension GL_KHR_vulkan_glsl: enable
+
+// quantized .vkmesh vertex, see MeshFormat.h. the fetch formats do the unpacking:
+// position R16G16B16A16_SNORM, normal R16G16_SNORM (octahedral), uv R16G16_SFLOAT
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(push_constant) uniform DrawParams
+{
+	vec2 offset;
+	vec2 scale;
+	uint columns;
+} draw;
+
+layout(location = 0)
+out vec2 uv;
+layout(location = 1)
+out vec3 normal;
+layout(location = 2)
+out vec3 scenePosition;	// what mesh.frag.glsl shades at
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	uv = inUV;
+	normal = decodeOctahedral(inNormal);
+
+	// object space is y-up like the flipped viewport and [-1, 1] after dequantization, the viewer looks down -z
+	vec2 position = inPosition.xy * draw.scale + draw.offset;
+	gl_Position = vec4(position, 0.5 - inPosition.z * 0.5, 1.0);
+	scenePosition = gl_Position.xyz;
+}
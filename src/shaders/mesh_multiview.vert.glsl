@@ -0,0 +1,46 @@
+#version 450
+#extension GL_KHR_vulkan_glsl: enable
+#extension GL_EXT_multiview: require
+
+// mesh.vert.glsl drawn into every layer of a multiview pass, a layer per split-screen view. each draw is
+// culled for one view, the other layers clip it away
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(push_constant) uniform DrawParams
+{
+	vec2 offset;
+	vec2 scale;
+	uint columns;
+	uint view;		// the view this draw was culled for
+	vec4 views[4];	// center xy, zoom z. pushed once per pass
+} draw;
+
+layout(location = 0)
+out vec2 uv;
+layout(location = 1)
+out vec3 normal;
+layout(location = 2)
+out vec3 scenePosition;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	uv = inUV;
+	normal = decodeOctahedral(inNormal);
+
+	vec2 position = inPosition.xy * draw.scale + draw.offset;
+	scenePosition = vec3(position, 0.5 - inPosition.z * 0.5);
+
+	vec4 view = draw.views[gl_ViewIndex];
+	gl_Position = uint(gl_ViewIndex) == draw.view ? vec4((position - view.xy) * view.z, scenePosition.z, 1.0) : vec4(2.0, 2.0, 2.0, 1.0);
+}
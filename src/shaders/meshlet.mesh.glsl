@@ -0,0 +1,100 @@
+#version 450
+#extension GL_EXT_mesh_shader : require
+
+// one workgroup per visible meshlet, fetches the quantized vertices itself (no vertex input with
+// mesh shaders) and emits the meshlet's triangles. outputs match mesh.frag.glsl
+layout(local_size_x = 64) in;
+layout(triangles, max_vertices = 64, max_primitives = 124) out;
+
+struct Meshlet
+{
+	uint vertexOffset;
+	uint triangleOffset;
+	uint vertexCount;
+	uint triangleCount;
+	vec4 sphere;
+	vec4 cone;
+};
+
+struct Instance
+{
+	vec2 offset;
+	float scale;
+	float padding;
+};
+
+// MeshFormat::Vertex as raw words
+struct Vertex
+{
+	uint positionXY;
+	uint positionZW;
+	uint normal;
+	uint uv;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(std430, set = 2, binding = 1) readonly buffer MeshletVertices { uint meshletVertices[]; };
+layout(std430, set = 2, binding = 2) readonly buffer MeshletTriangles { uint meshletTriangles[]; };
+layout(std430, set = 2, binding = 5) readonly buffer Vertices { Vertex vertices[]; };
+layout(std430, set = 2, binding = 7) readonly buffer Instances { Instance instances[]; };
+
+layout(push_constant) uniform CullParams
+{
+	vec3 viewDirection;
+	float aspect;
+	uint instanceCount;
+	uint lodCount;
+	uint maxMeshlets;
+	uint instance;
+	float viewportHeight;
+	float errorThreshold;
+	float hysteresis;
+	uint indexStride;
+} cull;
+
+struct Payload
+{
+	uint instance;
+	uint meshletIndices[32];
+};
+taskPayloadSharedEXT Payload payload;
+
+layout(location = 0) out vec2 uv[];
+layout(location = 1) out vec3 normal[];
+layout(location = 2) out vec3 scenePosition[];
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	Meshlet meshlet = meshlets[payload.meshletIndices[gl_WorkGroupID.x]];
+	Instance instance = instances[payload.instance];
+	vec2 scale = instance.scale * vec2(cull.aspect, 1.0);
+	SetMeshOutputsEXT(meshlet.vertexCount, meshlet.triangleCount);
+
+	for (uint i = gl_LocalInvocationIndex; i < meshlet.vertexCount; i += gl_WorkGroupSize.x)
+	{
+		Vertex vertex = vertices[meshletVertices[meshlet.vertexOffset + i]];
+		vec2 xy = unpackSnorm2x16(vertex.positionXY);
+		float z = unpackSnorm2x16(vertex.positionZW).x;
+
+		// same transform as mesh.vert.glsl
+		gl_MeshVerticesEXT[i].gl_Position = vec4(xy * scale + instance.offset, 0.5 - z * 0.5, 1.0);
+		scenePosition[i] = gl_MeshVerticesEXT[i].gl_Position.xyz;
+		uv[i] = unpackHalf2x16(vertex.uv);
+		normal[i] = decodeOctahedral(unpackSnorm2x16(vertex.normal));
+	}
+
+	for (uint i = gl_LocalInvocationIndex; i < meshlet.triangleCount; i += gl_WorkGroupSize.x)
+	{
+		uint packed = meshletTriangles[meshlet.triangleOffset + i];
+		gl_PrimitiveTriangleIndicesEXT[i] = uvec3(packed & 0xff, (packed >> 8) & 0xff, (packed >> 16) & 0xff);
+	}
+}
@@ -0,0 +1,179 @@
+#version 450
+#extension GL_EXT_mesh_shader : require
+
+// mesh shading path of the cluster culling, one draw per instance: each invocation tests one
+// meshlet of the LOD lod_select.comp.glsl picked, the survivors are compacted into the payload and
+// launched as mesh workgroups
+layout(local_size_x = 32) in;
+
+struct Meshlet
+{
+	uint vertexOffset;
+	uint triangleOffset;
+	uint vertexCount;
+	uint triangleCount;
+	vec4 sphere;	// center, radius
+	vec4 cone;		// axis, cutoff
+};
+
+struct Lod
+{
+	uint indexOffset;
+	uint indexCount;
+	uint meshletOffset;
+	uint meshletCount;
+	float error;
+	uint padding[3];
+};
+
+struct Instance
+{
+	vec2 offset;
+	float scale;
+	float padding;
+};
+
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+	uint visibleMeshlets;
+	uint lod;
+	uint occludedMeshlets;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(std430, set = 2, binding = 4) buffer DrawCommands { DrawCommand draws[]; };
+layout(std430, set = 2, binding = 6) readonly buffer Lods { Lod lods[]; };
+layout(std430, set = 2, binding = 7) readonly buffer Instances { Instance instances[]; };
+layout(set = 2, binding = 8) uniform sampler2D depthPyramid;
+layout(std430, set = 2, binding = 9) buffer Visibility { uint visibility[]; };	// per meshlet slot, last frame's result
+
+layout(push_constant) uniform CullParams
+{
+	vec3 viewDirection;
+	float aspect;
+	uint instanceCount;
+	uint lodCount;
+	uint maxMeshlets;
+	uint instance;
+	float viewportHeight;
+	float errorThreshold;
+	float hysteresis;
+	uint indexStride;
+	uint phase;			// CullPhase
+} cull;
+
+// CullPhase: the early phase draws what was visible last frame, the late phase what the depth
+// pyramid of those draws doesn't hide and wasn't drawn yet. without occlusion culling one phase does all
+const uint CullPhaseEarly = 0;
+const uint CullPhaseLate = 1;
+const uint CullPhaseAll = 2;
+
+struct Payload
+{
+	uint instance;
+	uint meshletIndices[32];
+};
+taskPayloadSharedEXT Payload payload;
+
+shared uint visibleCount;
+
+// same tests as cluster_cull.comp.glsl
+bool outsideFrustum(Meshlet meshlet, Instance instance)
+{
+	vec2 scale = instance.scale * vec2(cull.aspect, 1.0);
+	vec2 center = meshlet.sphere.xy * scale + instance.offset;
+	vec2 radius = meshlet.sphere.w * abs(scale);
+	if (any(greaterThan(abs(center) - radius, vec2(1.0))))
+		return true;
+	return abs(meshlet.sphere.z) - meshlet.sphere.w > 1.0;
+}
+
+bool backfacing(Meshlet meshlet)
+{
+	return dot(cull.viewDirection, meshlet.cone.xyz) >= meshlet.cone.w;
+}
+
+// the sphere's screen rectangle against the depth pyramid, at the first level where it spans at most
+// 2x2 texels. those texels hold the farthest depth under the rectangle, anything nearer than the
+// sphere's nearest point means every pixel it could cover is already in front of it
+bool occluded(Meshlet meshlet, Instance instance)
+{
+	vec2 scale = instance.scale * vec2(cull.aspect, 1.0);
+	vec2 center = meshlet.sphere.xy * scale + instance.offset;
+	vec2 radius = meshlet.sphere.w * abs(scale);
+
+	// the viewport is flipped, clip space y = 1 is the top row
+	vec2 uvMin = clamp(vec2(center.x - radius.x, -(center.y + radius.y)) * 0.5 + 0.5, 0.0, 1.0);
+	vec2 uvMax = clamp(vec2(center.x + radius.x, -(center.y - radius.y)) * 0.5 + 0.5, 0.0, 1.0);
+	float nearest = 0.5 - (meshlet.sphere.z + meshlet.sphere.w) * 0.5;
+
+	int levelCount = textureQueryLevels(depthPyramid);
+	int level = 0;
+	ivec2 size, first, last;
+	for (;;)
+	{
+		size = textureSize(depthPyramid, level);
+		first = min(ivec2(uvMin * vec2(size)), size - 1);
+		last = min(ivec2(uvMax * vec2(size)), size - 1);
+		if (all(lessThanEqual(last - first, ivec2(1))) || level == levelCount - 1)
+			break;
+		level++;
+	}
+
+	float farthest = texelFetch(depthPyramid, first, level).r;
+	farthest = max(farthest, texelFetch(depthPyramid, ivec2(last.x, first.y), level).r);
+	farthest = max(farthest, texelFetch(depthPyramid, ivec2(first.x, last.y), level).r);
+	farthest = max(farthest, texelFetch(depthPyramid, last, level).r);
+	return nearest > farthest;
+}
+
+void main()
+{
+	if (gl_LocalInvocationIndex == 0)
+		visibleCount = 0;
+	barrier();
+
+	Lod lod = lods[draws[cull.instance].lod];
+	uint command = cull.phase == CullPhaseLate ? cull.instanceCount + cull.instance : cull.instance;
+	uint meshletIndex = gl_GlobalInvocationID.x;
+	if (meshletIndex < lod.meshletCount)
+	{
+		Meshlet meshlet = meshlets[lod.meshletOffset + meshletIndex];
+		uint visibilitySlot = cull.instance * cull.maxMeshlets + meshletIndex;
+		bool passes = !outsideFrustum(meshlet, instances[cull.instance]) && !backfacing(meshlet);
+		bool visible = passes;
+		if (cull.phase == CullPhaseEarly)
+		{
+			visible = passes && visibility[visibilitySlot] != 0;
+		}
+		else if (cull.phase == CullPhaseLate)
+		{
+			bool hidden = passes && occluded(meshlet, instances[cull.instance]);
+			if (hidden)
+				atomicAdd(draws[command].occludedMeshlets, 1);
+			visible = passes && !hidden && visibility[visibilitySlot] == 0;
+			visibility[visibilitySlot] = passes && !hidden ? 1 : 0;
+		}
+
+		if (visible)
+		{
+			uint slot = atomicAdd(visibleCount, 1);
+			payload.meshletIndices[slot] = lod.meshletOffset + meshletIndex;
+			atomicAdd(draws[command].indexCount, meshlet.triangleCount * 3);	// for the report only
+		}
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0)
+	{
+		payload.instance = cull.instance;
+		if (visibleCount > 0)
+			atomicAdd(draws[command].visibleMeshlets, visibleCount);
+	}
+	EmitMeshTasksEXT(visibleCount, 1, 1);
+}
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_KHR_vulkan_glsl: enable
+
+// depth-only caster pass of the shadow maps. the mesh's position is placed in view space the way
+// mesh.vert.glsl places it on screen, then projected by the shadow view
+layout(location = 0) in vec4 inPosition;
+
+layout(push_constant) uniform ShadowDrawParams
+{
+	mat4 shadowMatrix;
+	vec2 offset;		// view space, x already stretched to the viewport's aspect
+	float scale;
+	float depthOffset;	// view z of object z = 0
+} draw;
+
+void main()
+{
+	vec3 position = vec3(inPosition.xy * draw.scale + draw.offset, inPosition.z + draw.depthOffset);
+	gl_Position = draw.shadowMatrix * vec4(position, 1.0);
+}
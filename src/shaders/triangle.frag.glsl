@@ -1,10 +1,100 @@
 #version 450
 
+layout(location = 0)
+in vec2 uv;
+layout(location = 1)
+in vec3 scenePosition;	// clip space
+
 layout(location = 0)
 out vec4 outputColor;
 
+// streamed texture, 1x1 white when the draw has none
+layout(set = 0, binding = 0)
+uniform sampler2D albedo;
+
+// clustered lights, binned per froxel by light_bin.comp.glsl
+struct PointLight
+{
+	vec3 position;		// view space
+	float radius;
+	vec3 color;
+	int shadowView;		// into the shadow views, -1 when the light casts none
+};
+
+layout(std140, set = 1, binding = 0) uniform LightingParams
+{
+	uvec3 clusterCount;
+	uint lightCount;		// 0 turns the clustered lights off, the froxels aren't binned then
+	vec2 viewportSize;
+	float nearDistance;
+	float farDistance;
+	uint tileSize;
+} lighting;
+
+layout(std430, set = 1, binding = 1) readonly buffer Lights { PointLight lights[]; };
+layout(std430, set = 1, binding = 2) readonly buffer Clusters { uvec2 clusters[]; };
+layout(std430, set = 1, binding = 3) readonly buffer LightIndices
+{
+	uint lightIndexCount;
+	uint lightIndices[];
+};
+
+// what the lights of the fragment's froxel add, for a view space normal. placed by the scene position rather
+// than gl_FragCoord, whose pixels are the render area's when dynamic resolution scales it down
+vec3 clusteredLighting(vec3 normal)
+{
+	vec2 ndc = scenePosition.xy;
+	float viewDistance = mix(lighting.nearDistance, lighting.farDistance, scenePosition.z);
+	vec3 position = vec3(ndc.x * lighting.viewportSize.x / lighting.viewportSize.y, ndc.y, -viewDistance);
+
+	vec2 pixel = vec2(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5) * lighting.viewportSize;
+	uvec2 tile = min(uvec2(pixel) / lighting.tileSize, lighting.clusterCount.xy - 1);
+	float sliceScale = float(lighting.clusterCount.z) / log(lighting.farDistance / lighting.nearDistance);
+	uint slice = min(uint(log(viewDistance / lighting.nearDistance) * sliceScale), lighting.clusterCount.z - 1);
+	uvec2 cluster = clusters[(slice * lighting.clusterCount.y + tile.y) * lighting.clusterCount.x + tile.x];
+
+	vec3 result = vec3(0.0);
+	for (uint i = 0; i < cluster.y; i++)
+	{
+		PointLight light = lights[lightIndices[cluster.x + i]];
+		vec3 toLight = light.position - position;
+		float lightDistance = length(toLight);
+		float falloff = clamp(1.0 - (lightDistance * lightDistance) / (light.radius * light.radius), 0.0, 1.0);
+		result += light.color * falloff * falloff * max(dot(normal, toLight / max(lightDistance, 1e-4)), 0.0);
+	}
+	return result;
+}
+
+// one pipeline per color in the many-pipelines scene
+layout(constant_id = 0) const int colorIndex = 0;
+
+const vec4 palette[] =
+{
+	vec4(1, 0, 1, 1),
+	vec4(1, 0, 0, 1),
+	vec4(0, 1, 0, 1),
+	vec4(0, 0, 1, 1),
+	vec4(1, 1, 0, 1),
+	vec4(0, 1, 1, 1),
+	vec4(1, 1, 1, 1),
+	vec4(1, 0.5, 0, 1),
+	vec4(0.5, 0, 1, 1),
+	vec4(0, 0.5, 0.25, 1),
+	vec4(0.5, 0.5, 0.5, 1),
+	vec4(1, 0.5, 0.5, 1),
+	vec4(0.5, 1, 0.5, 1),
+	vec4(0.5, 0.5, 1, 1),
+	vec4(0.25, 0.25, 0, 1),
+	vec4(0, 0.25, 0.5, 1)
+};
+
+const float ambient = 0.1;
 
 void main()
 {
-	outputColor = vec4(1,0,1,1);
-}
\ No newline at end of file
+	outputColor = palette[colorIndex % 16] * texture(albedo, uv);
+
+	// the triangles lie flat in the view plane, facing the viewer
+	if (lighting.lightCount > 0)
+		outputColor.rgb *= ambient + clusteredLighting(vec3(0.0, 0.0, 1.0));
+}
@@ -7,7 +7,31 @@ const vec3 vertices[] =
 	vec3(-0.5, -0.5,0)
 };
 
+// columns > 0 lays instances out on a columns x columns grid over the viewport
+layout(push_constant) uniform DrawParams
+{
+	vec2 offset;
+	vec2 scale;
+	uint columns;
+} draw;
+
+layout(location = 0)
+out vec2 uv;
+layout(location = 1)
+out vec3 scenePosition;	// what the lighting places the fragment by, see triangle.frag.glsl
+
 void main()
 {
-	gl_Position = vec4(vertices[gl_VertexIndex], 1.0);
-}
\ No newline at end of file
+	uv = vertices[gl_VertexIndex].xy + 0.5;
+
+	vec2 position = vertices[gl_VertexIndex].xy * draw.scale + draw.offset;
+	if (draw.columns > 0)
+	{
+		float cell = 2.0 / float(draw.columns);
+		uint column = uint(gl_InstanceIndex) % draw.columns;
+		uint row = uint(gl_InstanceIndex) / draw.columns;
+		position += vec2(-1.0 + cell * (float(column) + 0.5), -1.0 + cell * (float(row) + 0.5));
+	}
+	gl_Position = vec4(position, 0.0, 1.0);
+	scenePosition = gl_Position.xyz;
+}
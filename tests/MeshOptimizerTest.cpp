@@ -0,0 +1,103 @@
+// the overdraw pass reorders triangles, it never adds or drops one: whatever its input starts with, every
+// triangle comes out exactly once
+#include "MeshOptimizer.h"
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what)
+{
+	if (!condition)
+	{
+		std::cout << "FAIL " << what << std::endl;
+		failures++;
+	}
+}
+
+static std::multiset<std::array<uint32_t, 3>> triangles(const std::vector<uint32_t>& indices)
+{
+	std::multiset<std::array<uint32_t, 3>> set;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		set.insert({ indices[t], indices[t + 1], indices[t + 2] });
+	}
+	return set;
+}
+
+// n x n quads in the z = 0 plane, two triangles each
+static MeshOptimizer::SourceMesh grid(uint32_t n)
+{
+	MeshOptimizer::SourceMesh mesh;
+	for (uint32_t y = 0; y <= n; y++)
+	{
+		for (uint32_t x = 0; x <= n; x++)
+		{
+			mesh.positions.insert(mesh.positions.end(), { float(x), float(y), 0.0f });
+		}
+	}
+	for (uint32_t y = 0; y < n; y++)
+	{
+		for (uint32_t x = 0; x < n; x++)
+		{
+			uint32_t v = y * (n + 1) + x;
+			mesh.indices.insert(mesh.indices.end(), { v, v + 1, v + n + 1, v + 1, v + n + 2, v + n + 1 });
+		}
+	}
+	return mesh;
+}
+
+static void overdrawKeepsTriangles(const std::vector<uint32_t>& indices, const std::vector<float>& positions, const std::string& what)
+{
+	std::vector<uint32_t> sorted = MeshOptimizer::OptimizeOverdraw(indices, positions);
+	check(sorted.size() == indices.size(), what + ": " + std::to_string(indices.size() / 3) + " triangles in, " + std::to_string(sorted.size() / 3) + " out");
+	check(triangles(sorted) == triangles(indices), what + ": different triangles out");
+}
+
+int main()
+{
+	// a first triangle that misses only twice used to drop everything up to the next three-miss triangle
+	{
+		std::vector<float> positions = { 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 0, 2, 0, 0, 2, 1, 0 };
+		std::vector<uint32_t> indices = { 0, 0, 1, 1, 3, 2, 1, 4, 3, 4, 5, 3 };
+		overdrawKeepsTriangles(indices, positions, "degenerate first triangle");
+	}
+
+	{
+		MeshOptimizer::SourceMesh mesh = grid(32);
+		std::vector<uint32_t> optimized = MeshOptimizer::OptimizeVertexCache(mesh.indices, mesh.VertexCount());
+		check(optimized.size() == mesh.indices.size(), "vertex cache pass changed the triangle count");
+		overdrawKeepsTriangles(optimized, mesh.positions, "cache-optimized grid");
+		overdrawKeepsTriangles(mesh.indices, mesh.positions, "unoptimized grid");
+	}
+
+	{
+		std::vector<float> positions = { 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+		std::vector<uint32_t> indices = { 0, 0, 1, 0, 1, 2, 2, 2, 2 };
+		std::vector<uint32_t> optimized = MeshOptimizer::OptimizeVertexCache(indices, 3);
+		check(optimized.size() == 3, "vertex cache pass kept degenerate triangles");
+	}
+
+	// f 1 1 2 is kept by the format, but has no area
+	{
+		std::string path = "mesh_optimizer_test.obj";
+		std::ofstream obj(path);
+		obj << "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nv 2 0 0\nv 2 1 0\n"
+			<< "f 1 1 2\nf 2 4 3\nf 2 5 4\nf 5 6 4\nf 1 2 3\n";
+		obj.close();
+		MeshOptimizer::SourceMesh mesh = MeshOptimizer::LoadObj(path);
+		std::remove(path.c_str());
+		check(mesh.indices.size() == 4 * 3, "LoadObj kept " + std::to_string(mesh.indices.size() / 3) + " of 4 triangles with area");
+
+		std::vector<uint32_t> optimized = MeshOptimizer::OptimizeVertexCache(mesh.indices, mesh.VertexCount());
+		overdrawKeepsTriangles(optimized, mesh.positions, "OBJ with a degenerate first face");
+	}
+
+	if (failures == 0)
+		std::cout << "mesh optimizer: all passed" << std::endl;
+	return failures == 0 ? 0 : 1;
+}